@@ -4,7 +4,7 @@
 
 #define SHADOW_MAP_CASCADE_COUNT 8
 
-layout (set = 0, binding = 1) uniform sampler2DArray shadowMap;
+layout (set = 0, binding = 1) uniform sampler2D shadowMap;
 layout (set = 1, binding = 0) uniform sampler2D colorMap;
 
 layout (location = 0) in vec3 inNormal;
@@ -28,6 +28,9 @@ layout (set = 0, binding = 2) uniform UBO {
     highp vec3 cameraPos;
     lowp float _padcameraPos;
     int colorCascades;
+    int cascadeCount;
+    // 每个cascade在shadow atlas中的区域，xy为偏移，zw为大小
+    vec4 cascadeAtlasRects[SHADOW_MAP_CASCADE_COUNT];
 } ubo;
 
 const mat4 biasMat = mat4(
@@ -43,7 +46,11 @@ float textureProj(vec4 shadowCoord, vec2 offset, uint cascadeIndex)
     float bias = 0.005;
 
     if (shadowCoord.z > -1.0 && shadowCoord.z < 1.0) {
-        float dist = texture(shadowMap, vec3(shadowCoord.st + offset, cascadeIndex)).r;
+        // 限制在cascade自己的区域内，PCF和双线性过滤不会采到相邻的cascade
+        vec4 rect = ubo.cascadeAtlasRects[cascadeIndex];
+        vec2 halfTexel = 0.5 / vec2(textureSize(shadowMap, 0));
+        vec2 uv = clamp(rect.xy + (shadowCoord.st + offset) * rect.zw, rect.xy + halfTexel, rect.xy + rect.zw - halfTexel);
+        float dist = texture(shadowMap, uv).r;
         if (shadowCoord.w > 0 && dist < shadowCoord.z - bias) {
             shadow = ambient;
         }
@@ -54,7 +61,8 @@ float textureProj(vec4 shadowCoord, vec2 offset, uint cascadeIndex)
 
 float filterPCF(vec4 sc, uint cascadeIndex)
 {
-    ivec2 texDim = textureSize(shadowMap, 0).xy;
+    // 每个cascade的分辨率不同，偏移按cascade自己的texel计算
+    vec2 texDim = vec2(textureSize(shadowMap, 0)) * ubo.cascadeAtlasRects[cascadeIndex].zw;
     vec2 offset = 1.0 / texDim;
     //	float dx = 1.0 / float(texDim.x);
     //	float dy = 1.0 / float(texDim.y);
@@ -81,7 +89,7 @@ void main()
 
     // Get cascade index for the current fragment's view position
     uint cascadeIndex = 0;
-    for (int i = SHADOW_MAP_CASCADE_COUNT - 1; i >= 0; --i) {
+    for (int i = ubo.cascadeCount - 2; i >= 0; --i) {
         if (inViewPos.z < ubo.cascadeSplits[i/4][i%4]) {
             cascadeIndex = i + 1;
             break;
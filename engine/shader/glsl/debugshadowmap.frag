@@ -2,7 +2,20 @@
 
 #extension GL_GOOGLE_include_directive : enable
 #include "debug.glsl"
-layout (binding = 1) uniform sampler2DArray shadowMap;
+#define SHADOW_MAP_CASCADE_COUNT 8
+layout (binding = 1) uniform sampler2D shadowMap;
+layout (binding = 2) uniform UBO {
+	vec4 cascadeSplits[SHADOW_MAP_CASCADE_COUNT/4];
+	mat4 cascadeViewProjMat[SHADOW_MAP_CASCADE_COUNT];
+	mat4 projViewMatrix;
+	vec3 lightDir;
+	float _padlightDir;
+	vec3 cameraPos;
+	float _padcameraPos;
+	int colorCascades;
+	int cascadeCount;
+	vec4 cascadeAtlasRects[SHADOW_MAP_CASCADE_COUNT];
+} ubo;
 
 layout (location = 0) in vec2 inUV;
 layout (location = 1) flat in uint inCascadeIndex;
@@ -11,7 +24,8 @@ layout (location = 0) out vec4 outFragColor;
 
 void main() 
 {
-	float depth = texture(shadowMap, vec3(inUV, float(inCascadeIndex))).r;
+	vec4 rect = ubo.cascadeAtlasRects[inCascadeIndex];
+	float depth = texture(shadowMap, rect.xy + inUV * rect.zw).r;
 
 	outFragColor = vec4(vec3((depth)), 1.0);
 }
\ No newline at end of file
@@ -3,7 +3,7 @@
 #include "debugFrag.glsl"
 #include "mesh_lighting.glsl"
 #define SHADOW_MAP_CASCADE_COUNT 8
-layout (set = 0, binding = 1) uniform sampler2DArray shadowMap;
+layout (set = 0, binding = 1) uniform sampler2D shadowMap;
 layout (set = 0, binding = 2) uniform UBO {
     vec4 cascadeSplits[SHADOW_MAP_CASCADE_COUNT/4];
     mat4 cascadeViewProjMat[SHADOW_MAP_CASCADE_COUNT];
@@ -13,8 +13,16 @@ layout (set = 0, binding = 2) uniform UBO {
     highp vec3 cameraPos;
     lowp float _padcameraPos;
     int colorCascades;
+    int cascadeCount;
+    // 每个cascade在shadow atlas中的区域，xy为偏移，zw为大小
+    vec4 cascadeAtlasRects[SHADOW_MAP_CASCADE_COUNT];
+    int shadowFilter;
+    float filterRadius;
+    float lightSize;
 } ubo;
 layout (set = 0, binding = 3) uniform samplerCube skyboxSampler;
+// 和shadowMap是同一个atlas，sampler开启了深度比较
+layout (set = 0, binding = 4) uniform sampler2DShadow shadowMapCompare;
 layout (input_attachment_index = 0, set = 1, binding = 0) uniform subpassInput inputMetarial;
 layout (input_attachment_index = 1, set = 1, binding = 1) uniform subpassInput inputNormal;
 layout (input_attachment_index = 2, set = 1, binding = 2) uniform subpassInput inputAlbedo;
@@ -34,25 +42,70 @@ const mat4 biasMat = mat4(
 0.5, 0.5, 0.0, 1.0
 );
 
+#define SHADOW_FILTER_PCF 0
+#define SHADOW_FILTER_HARDWARE_PCF 1
+#define SHADOW_FILTER_POISSON 2
+#define SHADOW_FILTER_PCSS 3
+
+#define SHADOW_BIAS 0.005
+#define POISSON_TAPS 16
+#define POISSON_EARLY_TAPS 4
+#define PCSS_MAX_RADIUS 32.0
+
+// 前4个点分布在四个象限的外圈，用来提前判断是否在半影中
+const vec2 poissonDisk[POISSON_TAPS] = vec2[](
+vec2(-0.94201624, -0.39906216),
+vec2(0.94558609, -0.76890725),
+vec2(0.97484398, 0.75648379),
+vec2(-0.81409955, 0.91437590),
+vec2(-0.094184101, -0.92938870),
+vec2(0.34495938, 0.29387760),
+vec2(-0.91588581, 0.45771432),
+vec2(-0.81544232, -0.87912464),
+vec2(-0.38277543, 0.27676845),
+vec2(0.44323325, -0.97511554),
+vec2(0.53742981, -0.47373420),
+vec2(-0.26496911, -0.41893023),
+vec2(0.79197514, 0.19090188),
+vec2(-0.24188840, 0.99706507),
+vec2(0.19984126, 0.78641367),
+vec2(0.14383161, -0.14100790)
+);
+
+// cascade内的坐标转换到atlas，限制在cascade自己的区域内，PCF和双线性过滤不会采到相邻的cascade
+vec2 atlasUV(vec2 st, uint cascadeIndex)
+{
+    vec4 rect = ubo.cascadeAtlasRects[cascadeIndex];
+    vec2 halfTexel = 0.5 / vec2(textureSize(shadowMap, 0));
+    return clamp(rect.xy + st * rect.zw, rect.xy + halfTexel, rect.xy + rect.zw - halfTexel);
+}
+
+// cascade内一个texel对应的坐标大小，每个cascade的分辨率不同
+vec2 cascadeTexelSize(uint cascadeIndex)
+{
+    return 1.0 / (vec2(textureSize(shadowMap, 0)) * ubo.cascadeAtlasRects[cascadeIndex].zw);
+}
+
 float textureProj(vec4 shadowCoord, vec2 offset, uint cascadeIndex)
 {
     float shadow = 1.0;
-    float bias = 0.005;
 
-    if (shadowCoord.z > -1.0 && shadowCoord.z < 1.0) {
-        float dist = texture(shadowMap, vec3(shadowCoord.st + offset, cascadeIndex)).r;
-        if (shadowCoord.w > 0 && dist < shadowCoord.z - bias) {
-            shadow = ambient;
-        }
+    float dist = texture(shadowMap, atlasUV(shadowCoord.st + offset, cascadeIndex)).r;
+    if (shadowCoord.w > 0 && dist < shadowCoord.z - SHADOW_BIAS) {
+        shadow = 0.0;
     }
     return shadow;
+}
 
+// 硬件比较后的双线性结果，返回没有被遮挡的比例
+float textureCompare(vec4 shadowCoord, vec2 offset, uint cascadeIndex)
+{
+    return texture(shadowMapCompare, vec3(atlasUV(shadowCoord.st + offset, cascadeIndex), shadowCoord.z - SHADOW_BIAS));
 }
 
 float filterPCF(vec4 sc, uint cascadeIndex)
 {
-    ivec2 texDim = textureSize(shadowMap, 0).xy;
-    vec2 offset = 1.0 / texDim;
+    vec2 offset = cascadeTexelSize(cascadeIndex);
     //	float dx = 1.0 / float(texDim.x);
     //	float dy = 1.0 / float(texDim.y);
 
@@ -69,6 +122,86 @@ float filterPCF(vec4 sc, uint cascadeIndex)
     return shadowFactor / count;
 }
 
+// 4次双线性比较覆盖3x3 texel，和手动3x3 PCF的范围相同
+float filterHardwarePCF(vec4 sc, uint cascadeIndex)
+{
+    vec2 offset = 0.5 * cascadeTexelSize(cascadeIndex);
+    return 0.25 * (textureCompare(sc, vec2(-offset.x, -offset.y), cascadeIndex) +
+                   textureCompare(sc, vec2(offset.x, -offset.y), cascadeIndex) +
+                   textureCompare(sc, vec2(-offset.x, offset.y), cascadeIndex) +
+                   textureCompare(sc, vec2(offset.x, offset.y), cascadeIndex));
+}
+
+// 每个像素旋转Poisson disk，把固定图案的条纹换成噪声
+mat2 poissonRotation()
+{
+    float angle = 6.28318530 * fract(52.9829189 * fract(dot(gl_FragCoord.xy, vec2(0.06711056, 0.00583715))));
+    float s = sin(angle);
+    float c = cos(angle);
+    return mat2(c, s, -s, c);
+}
+
+float filterPoisson(vec4 sc, uint cascadeIndex, vec2 radius, mat2 rotation)
+{
+    float lit = 0.0;
+    for (int i = 0; i < POISSON_EARLY_TAPS; i++) {
+        lit += textureCompare(sc, rotation * poissonDisk[i] * radius, cascadeIndex);
+    }
+    // 外圈的tap全部被遮挡或全部没有遮挡时不在半影中
+    if (lit == 0.0 || lit == float(POISSON_EARLY_TAPS)) {
+        return lit / float(POISSON_EARLY_TAPS);
+    }
+    for (int i = POISSON_EARLY_TAPS; i < POISSON_TAPS; i++) {
+        lit += textureCompare(sc, rotation * poissonDisk[i] * radius, cascadeIndex);
+    }
+    return lit / float(POISSON_TAPS);
+}
+
+// 正交投影下深度和cascade内的坐标按相同的尺度(2倍半径)归一化，半影宽度直接是深度差乘光源大小
+float filterPCSS(vec4 sc, uint cascadeIndex)
+{
+    vec2 texelSize = cascadeTexelSize(cascadeIndex);
+    mat2 rotation = poissonRotation();
+    float receiver = sc.z - SHADOW_BIAS;
+
+    // 搜索范围内可能产生半影的blocker
+    vec2 searchRadius = clamp(vec2(receiver * ubo.lightSize), texelSize, texelSize * PCSS_MAX_RADIUS);
+    float blockerDepth = 0.0;
+    int blockers = 0;
+    for (int i = 0; i < POISSON_TAPS; i++) {
+        float depth = texture(shadowMap, atlasUV(sc.st + rotation * poissonDisk[i] * searchRadius, cascadeIndex)).r;
+        if (depth < receiver) {
+            blockerDepth += depth;
+            blockers++;
+        }
+    }
+    if (blockers == 0) {
+        return 1.0;
+    }
+    blockerDepth /= float(blockers);
+
+    vec2 radius = clamp(vec2((receiver - blockerDepth) * ubo.lightSize), texelSize, texelSize * PCSS_MAX_RADIUS);
+    return filterPoisson(sc, cascadeIndex, radius, rotation);
+}
+
+// 返回没有被遮挡的比例
+float shadowFactor(vec4 sc, uint cascadeIndex)
+{
+    if (sc.z <= -1.0 || sc.z >= 1.0 || sc.w <= 0.0) {
+        return 1.0;
+    }
+    switch (ubo.shadowFilter) {
+        case SHADOW_FILTER_HARDWARE_PCF:
+        return filterHardwarePCF(sc, cascadeIndex);
+        case SHADOW_FILTER_POISSON:
+        return filterPoisson(sc, cascadeIndex, ubo.filterRadius * cascadeTexelSize(cascadeIndex), poissonRotation());
+        case SHADOW_FILTER_PCSS:
+        return filterPCSS(sc, cascadeIndex);
+        default :
+        return filterPCF(sc, cascadeIndex);
+    }
+}
+
 void main()
 {
     highp vec3 inPos;
@@ -94,7 +227,7 @@ void main()
 
         // Get cascade index for the current fragment's view position
         uint cascadeIndex = 0;
-        for (int i = SHADOW_MAP_CASCADE_COUNT - 1; i >= 0; --i) {
+        for (int i = ubo.cascadeCount - 2; i >= 0; --i) {
             if (inViewPos.z < ubo.cascadeSplits[i/4][i%4]) {
                 cascadeIndex = i + 1;
                 break;
@@ -104,12 +237,7 @@ void main()
         // Depth compare for shadowing
         vec4 shadowCoord = (biasMat * ubo.cascadeViewProjMat[cascadeIndex]) * vec4(inPos, 1.0);
 
-        float shadow = 0;
-        //	if (enablePCF == 1) {
-        shadow = filterPCF(shadowCoord / shadowCoord.w, cascadeIndex);
-        //	} else {
-        //		shadow = textureProj(shadowCoord / shadowCoord.w, vec2(0.0), cascadeIndex);
-        //	}
+        float shadow = mix(ambient, 1.0, shadowFactor(shadowCoord / shadowCoord.w, cascadeIndex));
 
         // Directional light
         vec3 N = normalize(inNormal);
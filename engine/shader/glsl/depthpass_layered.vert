@@ -0,0 +1,28 @@
+#version 450
+#extension GL_GOOGLE_include_directive : enable
+#extension GL_ARB_shader_viewport_layer_array : require
+#include "debug.glsl"
+#define MAX_LAYERS 8
+layout (location = 0) in vec3 inPos;
+layout (location = 1) in vec2 inUV;
+
+// layers按实例序号每4位打包一个输出的layer，每个layer是atlas中的一个viewport
+layout(push_constant) uniform PushConsts {
+    vec3 position;
+    uint layers;
+} pushConsts;
+
+layout (binding = 0) uniform UBO {
+    mat4 cascadeProjViewMat[MAX_LAYERS];
+} ubo;
+
+layout (location = 0) out vec2 outUV;
+
+void main()
+{
+    uint layer = (pushConsts.layers >> (4 * gl_InstanceIndex)) & 0xF;
+    outUV = inUV;
+    vec3 pos = inPos + pushConsts.position;
+    gl_ViewportIndex = int(layer);
+    gl_Position = ubo.cascadeProjViewMat[layer] * vec4(pos, 1.0);
+}
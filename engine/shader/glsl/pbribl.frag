@@ -3,6 +3,9 @@
 #include "constants.glsl"
 #include "debugFrag.glsl"
 #include "mesh_lighting.glsl"
+#include "sh.glsl"
+// 为1时漫反射用SH系数计算，不采样samplerIrradiance
+layout (constant_id = 0) const uint USE_SH_IRRADIANCE = 1u;
 layout (binding = 0) uniform UBOParams {
     mat4 projViewMatrix;
     vec4 lights[maxLightsCount];
@@ -11,6 +14,9 @@ layout (binding = 0) uniform UBOParams {
 layout (binding = 1) uniform samplerCube samplerIrradiance;
 layout (binding = 2) uniform sampler2D samplerBRDFLUT;
 layout (binding = 3) uniform samplerCube prefilteredMap;
+layout (binding = 4) uniform SHIrradiance {
+    vec4 coefficients[SH_COEFFICIENT_COUNT];
+} shUbo;
 layout (input_attachment_index = 0, set = 1, binding = 0) uniform subpassInput inputMaterial;
 layout (input_attachment_index = 1, set = 1, binding = 1) uniform subpassInput inputNormal;
 layout (input_attachment_index = 2, set = 1, binding = 2) uniform subpassInput inputAlbedo;
@@ -74,7 +80,8 @@ void main()
 
         vec2 brdf = texture(samplerBRDFLUT, vec2(max(dot(N, V), 0.0), roughness)).rg;
         vec3 reflection = prefilteredReflection(R, roughness).rgb;
-        vec3 irradiance = texture(samplerIrradiance, N).rgb;
+        vec3 irradiance = USE_SH_IRRADIANCE == 1u ? shIrradiance(shUbo.coefficients, N)
+                                                   : texture(samplerIrradiance, N).rgb;
 
         // Diffuse based on irradiance
         vec3 diffuse = irradiance * ALBEDO;
@@ -20,7 +20,9 @@ void main()
 	vec3 T = normalize(inTangent.xyz);
 	vec3 B = cross(inNormal, inTangent.xyz) * inTangent.w;
 	mat3 TBN = mat3(T, B, N);
-	N = TBN * normalize(texture(samplerNormalMap, inUV).xyz * 2.0 - vec3(1.0));
+	// 只使用xy并重建z，BC5压缩的法线贴图没有z通道
+	vec2 normalXY = texture(samplerNormalMap, inUV).xy * 2.0 - vec2(1.0);
+	N = TBN * normalize(vec3(normalXY, sqrt(max(1.0 - dot(normalXY, normalXY), 0.0))));
 
 	const float ambient = 0.1;
 	vec3 L = normalize(inLightVec);
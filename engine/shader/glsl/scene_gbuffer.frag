@@ -4,6 +4,13 @@
 #include "debug.glsl"
 layout (set = 1, binding = 0) uniform sampler2D samplerColor;
 layout (set = 1, binding = 1) uniform sampler2D samplerNormalMap;
+#define VT_SET 2
+#include "virtual_texture.glsl"
+
+// 材质的基础色在虚拟贴图中的序号，不使用虚拟贴图时为VT_INVALID_INDEX
+layout (push_constant) uniform MaterialConsts {
+    layout (offset = 16) uint virtualTexture;
+} materialConsts;
 
 layout (location = 0) in vec3 inNormal;
 layout (location = 1) in vec2 inUV;
@@ -35,10 +42,16 @@ void main()
     vec3 T = normalize(inTangent);
     vec3 B = cross(N, T);
     mat3 TBN = mat3(T, B, N);
-    vec3 tnorm = TBN * normalize(texture(samplerNormalMap, inUV).xyz * 2.0 - vec3(1.0));
+    // 只使用xy并重建z，BC5压缩的法线贴图没有z通道
+    vec2 normalXY = texture(samplerNormalMap, inUV).xy * 2.0 - vec2(1.0);
+    vec3 tnorm = TBN * normalize(vec3(normalXY, sqrt(max(1.0 - dot(normalXY, normalXY), 0.0))));
     //    outNormal = vec4(tnorm, 1.0);
     outNormal = vec4(N, 1.0);
     //    outNormal = vec4(normalize(inNormal) * 0.5 + 0.5, 1.0);
-    outAlbedo = texture(samplerColor, inUV);
+    if (materialConsts.virtualTexture != VT_INVALID_INDEX) {
+        outAlbedo = sampleVirtualTexture(materialConsts.virtualTexture, inUV);
+    } else {
+        outAlbedo = texture(samplerColor, inUV);
+    }
     if (outAlbedo.a<0.5)discard;
 }
\ No newline at end of file
@@ -0,0 +1,111 @@
+#version 450
+#extension GL_GOOGLE_include_directive : enable
+#include "debug.glsl"
+#include "ssao_temporal.glsl"
+
+layout (constant_id = 0) const int SSAO_KERNEL_SIZE = 64;
+layout (constant_id = 1) const float SSAO_RADIUS = 0.5;
+// 每帧使用的样本数
+layout (constant_id = 2) const int SSAO_SAMPLE_COUNT = 8;
+layout (binding = 2) uniform sampler2D ssaoNoise;
+
+layout (binding = 3) uniform UBOSSAOKernel
+{
+    vec4 samples[SSAO_KERNEL_SIZE];
+} uboSSAOKernel;
+
+// 上一帧的累积结果
+layout (binding = 5) uniform sampler2D historyAO;
+layout (binding = 6, rgba16f) uniform writeonly image2D outputAO;
+
+// history的深度和重投影的深度相差超过这个比例时认为是新露出来的区域
+const float DISOCCLUSION_THRESHOLD = 0.05;
+const float GOLDEN_ANGLE = 2.39996323;
+
+float computeOcclusion(vec3 pos, vec3 normal, ivec2 lowPixel)
+{
+    // 4x4的噪声每帧旋转一次，累积后各个方向都会被采样到
+    ivec2 noiseDim = textureSize(ssaoNoise, 0);
+    vec2 noise = texelFetch(ssaoNoise, lowPixel % noiseDim, 0).xy;
+    float angle = float(uboTemporal.frameIndex) * GOLDEN_ANGLE;
+    float c = cos(angle);
+    float s = sin(angle);
+    vec3 randomVec = vec3(mat2(c, s, -s, c) * noise, 0.0);
+
+    vec3 tangent = normalize(randomVec - normal * dot(randomVec, normal));
+    vec3 bitangent = cross(tangent, normal);
+    mat3 TBN = mat3(tangent, bitangent, normal);
+
+    // kernel中的样本由近到远排列，每帧间隔地取一组，近处和远处的样本都有
+    int stride = max(SSAO_KERNEL_SIZE / SSAO_SAMPLE_COUNT, 1);
+    int phase = int(uboTemporal.frameIndex % uint(stride));
+    float occlusion = 0.f;
+    const float bias = 0.025f;
+    int validCnt = 0;
+    for (int i = 0; i < SSAO_SAMPLE_COUNT; ++i) {
+        int index = min(i * stride + phase, SSAO_KERNEL_SIZE - 1);
+        vec3 samplePos = TBN * uboSSAOKernel.samples[index].xyz;
+        samplePos = pos + samplePos * SSAO_RADIUS;
+        vec4 offset = uboTemporal.projection * vec4(samplePos, 1.0f);
+
+        offset.xyz = offset.xyz / offset.w * 0.5f + 0.5f;
+        if (any(lessThan(offset.xy, vec2(0.0))) || any(greaterThan(offset.xy, vec2(1.0)))) continue;
+        ++validCnt;
+        float sampleDepth = -texture(inputViewPosition, offset.xy).w;
+
+        float rangeCheck = smoothstep(0.f, 1.f, SSAO_RADIUS / abs(pos.z - sampleDepth));
+        occlusion += (sampleDepth >= samplePos.z + bias ? 1.0f : 0.0f) * rangeCheck;
+    }
+    return validCnt > 0 ? 1.0 - occlusion / float(validCnt) : 1.0;
+}
+
+void main()
+{
+    ivec2 lowPixel = ivec2(gl_FragCoord.xy);
+    ivec2 fullSize = textureSize(inputViewPosition, 0);
+    ivec2 lowSize = (fullSize + int(uboTemporal.scale) - 1) / int(uboTemporal.scale);
+    ivec2 pixel = lowResToFullRes(lowPixel, fullSize);
+    vec3 pos = texelFetch(inputViewPosition, pixel, 0).xyz;
+    vec3 normal = texelFetch(inputNormal, pixel, 0).xyz;
+    if (normal.x == 0 && normal.y == 0 && normal.z == 0) {
+        imageStore(outputAO, lowPixel, vec4(1.0, 0.0, 0.0, 1.0));
+        return;
+    }
+    normal = normalize(normal);
+    float depth = -pos.z;
+    float ao = computeOcclusion(pos, normal, lowPixel);
+
+    // 重投影到上一帧，双线性的4个tap分别按深度判断是否有效
+    float history = 0.0;
+    float historyWeight = 0.0;
+    if (uboTemporal.historyValid != 0) {
+        vec4 prevViewPos = uboTemporal.currentToPrevView * vec4(pos, 1.0);
+        vec4 prevClip = uboTemporal.prevProjection * prevViewPos;
+        vec2 prevUV = prevClip.xy / prevClip.w * 0.5 + 0.5;
+        float prevDepth = -prevViewPos.z;
+        if (prevClip.w > 0.0 && all(greaterThanEqual(prevUV, vec2(0.0))) && all(lessThanEqual(prevUV, vec2(1.0)))) {
+            vec2 historyPos = prevUV * vec2(lowSize) - 0.5;
+            ivec2 base = ivec2(floor(historyPos));
+            vec2 f = historyPos - vec2(base);
+            for (int y = 0; y < 2; y++) {
+                for (int x = 0; x < 2; x++) {
+                    ivec2 tap = clamp(base + ivec2(x, y), ivec2(0), lowSize - 1);
+                    vec4 h = texelFetch(historyAO, tap, 0);
+                    float w = (x == 0 ? 1.0 - f.x : f.x) * (y == 0 ? 1.0 - f.y : f.y);
+                    if (abs(h.y - prevDepth) < DISOCCLUSION_THRESHOLD * prevDepth) {
+                        history += h.x * w;
+                        historyWeight += w;
+                    }
+                }
+            }
+        }
+    }
+
+    float result = ao;
+    if (historyWeight > 0.01) {
+        // 只有部分tap有效时更相信这一帧的结果
+        float blend = mix(1.0, uboTemporal.temporalBlend, historyWeight);
+        result = mix(history / historyWeight, ao, blend);
+    }
+    imageStore(outputAO, lowPixel, vec4(result, depth, octEncode(normal)));
+}
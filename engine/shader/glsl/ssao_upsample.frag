@@ -0,0 +1,58 @@
+#version 450
+#extension GL_GOOGLE_include_directive : enable
+#include "debug.glsl"
+#include "ssao_temporal.glsl"
+
+layout (binding = 7) uniform sampler2D lowResAO;
+
+layout (location = 0) in vec2 inUV;
+layout (location = 0) out float outFragColor;
+
+// 相对深度差和法线夹角的权重衰减速度
+const float DEPTH_SHARPNESS = 40.0;
+const float NORMAL_SHARPNESS = 8.0;
+
+void main()
+{
+    ivec2 pixel = ivec2(gl_FragCoord.xy);
+    vec3 pos = texelFetch(inputViewPosition, pixel, 0).xyz;
+    vec3 normal = texelFetch(inputNormal, pixel, 0).xyz;
+    if (normal.x == 0 && normal.y == 0 && normal.z == 0) {
+        outFragColor = 1;
+        return;
+    }
+    normal = normalize(normal);
+    float depth = -pos.z;
+
+    ivec2 fullSize = textureSize(inputViewPosition, 0);
+    int scale = int(uboTemporal.scale);
+    ivec2 lowSize = (fullSize + scale - 1) / scale;
+    // 低分辨率像素的中心在全分辨率的lowPixel * scale + scale / 2
+    vec2 lowPos = (vec2(pixel) - float(scale / 2)) / float(scale);
+    ivec2 base = ivec2(floor(lowPos));
+    vec2 f = lowPos - vec2(base);
+
+    float ao = 0.0;
+    float weightSum = 0.0;
+    float nearestAO = 1.0;
+    float nearestDiff = 1e30;
+    for (int y = 0; y < 2; y++) {
+        for (int x = 0; x < 2; x++) {
+            ivec2 tap = clamp(base + ivec2(x, y), ivec2(0), lowSize - 1);
+            vec4 s = texelFetch(lowResAO, tap, 0);
+            float depthDiff = abs(s.y - depth) / depth;
+            float bilinear = (x == 0 ? 1.0 - f.x : f.x) * (y == 0 ? 1.0 - f.y : f.y);
+            float depthWeight = exp(-depthDiff * DEPTH_SHARPNESS);
+            float normalWeight = pow(max(dot(octDecode(s.zw), normal), 0.0), NORMAL_SHARPNESS);
+            float w = max(bilinear, 1e-3) * depthWeight * normalWeight;
+            ao += s.x * w;
+            weightSum += w;
+            if (depthDiff < nearestDiff) {
+                nearestDiff = depthDiff;
+                nearestAO = s.x;
+            }
+        }
+    }
+    // 周围的低分辨率像素都在别的表面上时取深度最接近的
+    outFragColor = weightSum > 1e-4 ? ao / weightSum : nearestAO;
+}
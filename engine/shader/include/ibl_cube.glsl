@@ -0,0 +1,14 @@
+// irradiance_cube.comp和prefilter_env_map.comp共用，和cube.vert渲染立方体贴图时的投影一致
+layout (local_size_x = 8, local_size_y = 8) in;
+
+layout (binding = 0) uniform samplerCube samplerEnv;
+// 每个mip一个包含6个面的view
+layout (constant_id = 0) const uint MIP_COUNT = 1u;
+layout (binding = 1, rgba16f) uniform writeonly image2DArray outputCube[MIP_COUNT];
+
+// 90度透视投影下像素中心对应的方向，faceRotation为CubePass中对应面旋转的逆，Vulkan的NDC中y向下
+vec3 cubeTexelDirection(mat4 faceRotation, uvec2 texel, uint dim)
+{
+    vec2 ndc = (vec2(texel) + 0.5) / float(dim) * 2.0 - 1.0;
+    return normalize(mat3(faceRotation) * vec3(ndc, -1.0));
+}
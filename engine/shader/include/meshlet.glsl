@@ -0,0 +1,30 @@
+// 和render_model.h中的Meshlet、MeshVertex一致
+#define MAX_VERTICES 64
+#define MAX_PRIMITIVES 126
+#define MAX_INDICES MAX_PRIMITIVES * 3
+struct Meshlet
+{
+    uint vertices[MAX_VERTICES];
+    uint indices[MAX_INDICES];
+    uint indexCount;
+    uint vertexCount;
+    vec4 bounds; // 包围球，w为半径
+    vec4 cone;   // 三角形法线的锥，w为cutoff
+};
+
+struct Vertex
+{
+    vec3   inPos;
+    float  _padPos;
+    vec2   inUV;
+    vec2   _padUV;
+    vec3   inColor;
+    float  _padColor;
+    vec3   inNormal;
+    float  _padNormal;
+    vec3   inTangent;
+    float  _padTangent;
+    float  inMetallic;
+    float  inRoughness;
+    vec2   _padding;
+};
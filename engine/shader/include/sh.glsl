@@ -0,0 +1,27 @@
+// 二阶(L2)球谐，9个实数基函数
+#define SH_COEFFICIENT_COUNT 9
+
+void shBasis(vec3 n, out float Y[SH_COEFFICIENT_COUNT])
+{
+    Y[0] = 0.282095;
+    Y[1] = 0.488603 * n.y;
+    Y[2] = 0.488603 * n.z;
+    Y[3] = 0.488603 * n.x;
+    Y[4] = 1.092548 * n.x * n.y;
+    Y[5] = 1.092548 * n.y * n.z;
+    Y[6] = 0.315392 * (3.0 * n.z * n.z - 1.0);
+    Y[7] = 1.092548 * n.x * n.z;
+    Y[8] = 0.546274 * (n.x * n.x - n.y * n.y);
+}
+
+// 系数已经和余弦lobe卷积并除以PI，结果和irradiance_cube.frag的输出一致
+vec3 shIrradiance(vec4 coefficients[SH_COEFFICIENT_COUNT], vec3 n)
+{
+    float Y[SH_COEFFICIENT_COUNT];
+    shBasis(n, Y);
+    vec3 irradiance = vec3(0.0);
+    for (int i = 0; i < SH_COEFFICIENT_COUNT; i++) {
+        irradiance += coefficients[i].rgb * Y[i];
+    }
+    return max(irradiance, vec3(0.0));
+}
@@ -0,0 +1,41 @@
+// ssao_temporal.frag和ssao_upsample.frag共用的descriptor，和SSAOPass::createTemporalDescriptorSets一致
+layout (binding = 0) uniform sampler2D inputViewPosition;
+layout (binding = 1) uniform sampler2D inputNormal;
+
+layout (binding = 4) uniform UBOTemporal
+{
+    mat4 projection;
+    mat4 currentToPrevView;
+    mat4 prevProjection;
+    uint frameIndex;
+    uint scale;
+    float temporalBlend;
+    uint historyValid;
+} uboTemporal;
+
+// 低分辨率结果：x为ao，y为view空间的线性深度(天空为0)，zw为八面体编码的view空间法线
+vec2 octEncode(vec3 n)
+{
+    n /= abs(n.x) + abs(n.y) + abs(n.z);
+    vec2 e = n.xy;
+    if (n.z < 0.0) {
+        e = (1.0 - abs(n.yx)) * vec2(n.x >= 0.0 ? 1.0 : -1.0, n.y >= 0.0 ? 1.0 : -1.0);
+    }
+    return e;
+}
+
+vec3 octDecode(vec2 e)
+{
+    vec3 n = vec3(e, 1.0 - abs(e.x) - abs(e.y));
+    if (n.z < 0.0) {
+        n.xy = (1.0 - abs(n.yx)) * vec2(n.x >= 0.0 ? 1.0 : -1.0, n.y >= 0.0 ? 1.0 : -1.0);
+    }
+    return normalize(n);
+}
+
+// 低分辨率像素lowPixel对应的全分辨率像素
+ivec2 lowResToFullRes(ivec2 lowPixel, ivec2 fullSize)
+{
+    int scale = int(uboTemporal.scale);
+    return min(lowPixel * scale + scale / 2, fullSize - 1);
+}
@@ -0,0 +1,71 @@
+// 和VirtualTexture中的常量一致
+#define VT_PAGE_SIZE 128u
+#define VT_PAGE_BORDER 4u
+#define VT_PAGE_PAYLOAD 120u
+#define VT_MAX_LEVELS 16
+#define VT_FEEDBACK_SCALE 8u
+#define VT_INVALID_INDEX 0xffffffffu
+
+struct VirtualTextureInfo {
+    uvec4 header; // 宽、高、level数、页表偏移
+    uint levelOffsets[VT_MAX_LEVELS];
+};
+
+layout (set = VT_SET, binding = 0) uniform sampler2D virtualTextureAtlas;
+layout (std430, set = VT_SET, binding = 1) readonly buffer VirtualTextureInfos {
+    VirtualTextureInfo virtualTextureInfos[];
+};
+layout (std430, set = VT_SET, binding = 2) readonly buffer VirtualTexturePageTable {
+    uint virtualTexturePageTable[];
+};
+layout (std430, set = VT_SET, binding = 3) buffer VirtualTextureFeedback {
+    uvec4 virtualTextureFeedbackHeader; // 宽、高、本帧写反馈的像素位置
+    uvec2 virtualTextureFeedback[];
+};
+
+// 和采样器的MIRRORED_REPEAT一致
+vec2 virtualTextureMirror(vec2 uv) {
+    vec2 t = mod(uv, 2.0);
+    return mix(t, 2.0 - t, greaterThan(t, vec2(1.0)));
+}
+
+uvec2 virtualTexturePages(uvec2 levelSize) {
+    return (levelSize + VT_PAGE_PAYLOAD - 1u) / VT_PAGE_PAYLOAD;
+}
+
+vec4 sampleVirtualTexture(uint index, vec2 uv) {
+    VirtualTextureInfo info = virtualTextureInfos[index];
+    uvec2 size = info.header.xy;
+    uint levelCount = info.header.z;
+
+    // 和硬件mip选择一样按屏幕导数选level，atlas中没有mip，只做双线性过滤
+    vec2 texel = uv * vec2(size);
+    vec2 dx = dFdx(texel);
+    vec2 dy = dFdy(texel);
+    float lod = 0.5 * log2(max(max(dot(dx, dx), dot(dy, dy)), 1e-8));
+    uint level = uint(clamp(floor(lod + 0.5), 0.0, float(levelCount - 1u)));
+
+    vec2 wrapped = clamp(virtualTextureMirror(uv), 0.0, 0.99999);
+    uvec2 levelSize = max(size >> level, uvec2(1u));
+    uvec2 pages = virtualTexturePages(levelSize);
+    uvec2 page = min(uvec2(wrapped * vec2(levelSize)) / VT_PAGE_PAYLOAD, pages - 1u);
+
+    uvec2 pixel = uvec2(gl_FragCoord.xy);
+    uvec2 feedbackPixel = pixel / VT_FEEDBACK_SCALE;
+    if (pixel % VT_FEEDBACK_SCALE == virtualTextureFeedbackHeader.zw &&
+        all(lessThan(feedbackPixel, virtualTextureFeedbackHeader.xy))) {
+        virtualTextureFeedback[feedbackPixel.y * virtualTextureFeedbackHeader.x + feedbackPixel.x] =
+                uvec2(index << 4 | level, page.x | page.y << 16);
+    }
+
+    // 缺页时条目指向最近的常驻祖先页
+    uint entry = virtualTexturePageTable[info.header.w + info.levelOffsets[level] + page.y * pages.x + page.x];
+    uvec2 physical = uvec2(entry & 0xffu, (entry >> 8) & 0xffu);
+    uint mappedLevel = (entry >> 16) & 0xffu;
+    uvec2 mappedPage = page >> (mappedLevel - level);
+    vec2 mappedTexel = wrapped * vec2(max(size >> mappedLevel, uvec2(1u)));
+    vec2 local = clamp(mappedTexel - vec2(mappedPage * VT_PAGE_PAYLOAD), vec2(-0.5),
+                       vec2(float(VT_PAGE_PAYLOAD) + 0.5));
+    vec2 atlasUV = (vec2(physical * VT_PAGE_SIZE + VT_PAGE_BORDER) + local) / vec2(textureSize(virtualTextureAtlas, 0));
+    return textureLod(virtualTextureAtlas, atlasUV, 0.0);
+}
@@ -0,0 +1,122 @@
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <thread>
+#include <vector>
+
+#include "runtime/function/render/render_guid_allocator.h"
+
+namespace {
+    void printUsage() {
+        std::cout << "Usage: MWBench [--iterations count] [--shared percent]" << std::endl;
+    }
+
+    struct BenchResult {
+        double seconds{0.0};
+        uint64_t operations{0};
+        uint64_t failures{0};
+    };
+
+    // 每个线程循环分配、查询、释放，shared比例的分配使用所有线程共用的元素，测试去重时的竞争
+    BenchResult runGuidAllocator(uint32_t threadCount, uint32_t iterations, uint32_t sharedPercent) {
+        MW::GuidAllocator<uint64_t> allocator;
+        std::atomic<uint32_t> ready{0};
+        std::atomic<bool> start{false};
+        std::atomic<uint64_t> failures{0};
+        std::vector<std::thread> threads;
+        threads.reserve(threadCount);
+        for (uint32_t t = 0; t < threadCount; ++t) {
+            threads.emplace_back([&, t] {
+                uint64_t random = 0x9e3779b97f4a7c15ull * (t + 1);
+                std::vector<size_t> guids;
+                guids.reserve(64);
+                uint64_t failed = 0;
+                ++ready;
+                while (!start.load(std::memory_order_acquire)) {
+                    std::this_thread::yield();
+                }
+                for (uint32_t i = 0; i < iterations; ++i) {
+                    random ^= random << 13;
+                    random ^= random >> 7;
+                    random ^= random << 17;
+                    const bool shared = random % 100 < sharedPercent;
+                    const uint64_t element = shared ? random % 256 : (static_cast<uint64_t>(t + 1) << 32) | i;
+                    const size_t guid = allocator.allocGuid(element);
+                    uint64_t value;
+                    if (!allocator.getGuidRelatedElement(guid, value) || value != element) {
+                        // 共用元素可能已被其他线程释放
+                        failed += shared ? 0 : 1;
+                    }
+                    if (!shared) {
+                        guids.push_back(guid);
+                    }
+                    if (guids.size() == 64) {
+                        for (size_t g: guids) {
+                            allocator.freeGuid(g);
+                        }
+                        guids.clear();
+                    } else if (shared && (random >> 32) % 8 == 0) {
+                        allocator.freeElement(element);
+                    }
+                }
+                for (size_t g: guids) {
+                    allocator.freeGuid(g);
+                }
+                failures += failed;
+            });
+        }
+        while (ready.load() < threadCount) {
+            std::this_thread::yield();
+        }
+        const auto begin = std::chrono::steady_clock::now();
+        start.store(true, std::memory_order_release);
+        for (std::thread &thread: threads) {
+            thread.join();
+        }
+        const auto end = std::chrono::steady_clock::now();
+
+        BenchResult result;
+        result.seconds = std::chrono::duration<double>(end - begin).count();
+        result.operations = static_cast<uint64_t>(threadCount) * iterations;
+        result.failures = failures.load();
+        return result;
+    }
+}
+
+int main(int argc, char **argv) {
+    uint32_t iterations = 200000;
+    uint32_t sharedPercent = 10;
+    for (int i = 1; i < argc; ++i) {
+        if (strcmp(argv[i], "--iterations") == 0 && i + 1 < argc) {
+            iterations = static_cast<uint32_t>(std::strtoul(argv[++i], nullptr, 10));
+        } else if (strcmp(argv[i], "--shared") == 0 && i + 1 < argc) {
+            sharedPercent = static_cast<uint32_t>(std::strtoul(argv[++i], nullptr, 10));
+        } else {
+            printUsage();
+            return 1;
+        }
+    }
+    if (iterations == 0 || sharedPercent > 100) {
+        printUsage();
+        return 1;
+    }
+
+    std::cout << "GuidAllocator contention, " << iterations << " alloc/lookup/free per thread, " << sharedPercent
+              << "% shared elements" << std::endl;
+    std::cout << "threads\tseconds\tMops/s" << std::endl;
+    int status = 0;
+    for (uint32_t threadCount: {1u, 2u, 4u, 8u, 16u, 32u}) {
+        const BenchResult result = runGuidAllocator(threadCount, iterations, sharedPercent);
+        std::cout << threadCount << "\t" << result.seconds << "\t"
+                  << result.operations / result.seconds / 1000000.0 << std::endl;
+        if (result.failures > 0) {
+            std::cerr << result.failures << " lookups returned the wrong element with " << threadCount << " threads"
+                      << std::endl;
+            status = 1;
+        }
+    }
+    return status;
+}
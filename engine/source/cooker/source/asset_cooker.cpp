@@ -0,0 +1,314 @@
+#include "asset_cooker.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <future>
+#include <iostream>
+#include <memory>
+#include <sstream>
+
+#include "runtime/core/base/hash.h"
+#include "runtime/core/base/thread_pool.h"
+#include "runtime/core/file/mapped_file.h"
+#include "runtime/function/render/ibl_baker.h"
+#include "runtime/function/render/scene_manager.h"
+
+namespace MW {
+    namespace {
+        const char *const kManifestName = ".mwcook_manifest";
+        const char *const kManifestHeader = "MWCOOK 1";
+
+        bool endsWith(const std::string &value, const std::string &suffix) {
+            return value.size() >= suffix.size() &&
+                   value.compare(value.size() - suffix.size(), suffix.size(), suffix) == 0;
+        }
+
+        std::string toLower(std::string value) {
+            std::transform(value.begin(), value.end(), value.begin(),
+                           [](unsigned char c) { return static_cast<char>(std::tolower(c)); });
+            return value;
+        }
+
+        // 烘焙结果也是RGBA16F的立方体贴图，不能再作为输入
+        bool isBakedOutput(const std::string &file) {
+            return endsWith(file, ".irradiance.ktx") || endsWith(file, ".prefiltered.ktx") ||
+                   endsWith(file, ".lut.ktx");
+        }
+
+        uint64_t getJobSeed(CookJobType type) {
+            uint64_t seed = static_cast<uint64_t>(type) << 32;
+            if (type == CookJobType::Model) {
+#if USE_MESH_SHADER
+                seed |= SceneManager::modelLoadingFlags | 0x80000000u;
+#else
+                seed |= SceneManager::modelLoadingFlags;
+#endif
+            }
+            return seed;
+        }
+
+        const char *getJobName(CookJobType type) {
+            switch (type) {
+                case CookJobType::Model:
+                    return "model";
+                case CookJobType::Environment:
+                    return "environment";
+                default:
+                    return "brdf lut";
+            }
+        }
+    }
+
+    bool AssetCooker::cook(const std::string &directory) {
+        this->directory = directory;
+        while (this->directory.size() > 1 && this->directory.back() == '/') {
+            this->directory.pop_back();
+        }
+        std::error_code error;
+        if (!std::filesystem::is_directory(this->directory, error)) {
+            std::cerr << "Could not read directory \"" << directory << "\"" << std::endl;
+            return false;
+        }
+        if (!force) {
+            loadManifest();
+        }
+
+        const std::vector<CookJob> jobs = collectJobs();
+        std::vector<ManifestEntry> entries(jobs.size());
+        std::vector<char> results(jobs.size(), 0);
+        std::vector<char> skipped(jobs.size(), 0);
+        // 任务在单独的线程池上执行，任务内部的解码、压缩和烘焙继续使用全局线程池
+        {
+            ThreadPool pool(threadCount);
+            std::vector<std::future<void>> futures;
+            futures.reserve(jobs.size());
+            for (size_t i = 0; i < jobs.size(); i++) {
+                futures.push_back(pool.submit([&, i]() {
+                    const auto start = std::chrono::steady_clock::now();
+                    const CookJob &job = jobs[i];
+                    auto found = manifest.find(job.input);
+                    if (found != manifest.end()) {
+                        const uint64_t hash = hashInputs(job.input, found->second.dependencies,
+                                                         getJobSeed(job.type));
+                        if (isUpToDate(found->second, hash)) {
+                            entries[i] = found->second;
+                            results[i] = 1;
+                            skipped[i] = 1;
+                            return;
+                        }
+                    }
+                    results[i] = runJob(job, entries[i]);
+                    const auto time = std::chrono::duration<double>(std::chrono::steady_clock::now() - start);
+                    std::cout << (results[i] ? "Cooked " : "Failed to cook ") << getJobName(job.type) << " \""
+                              << job.input << "\" in " << time.count() << " s" << std::endl;
+                }));
+            }
+            for (auto &future: futures) {
+                future.get();
+            }
+        }
+
+        bool success = true;
+        uint32_t skippedCount = 0;
+        std::unordered_map<std::string, ManifestEntry> cooked;
+        for (size_t i = 0; i < jobs.size(); i++) {
+            skippedCount += skipped[i];
+            if (!results[i]) {
+                success = false;
+                continue;
+            }
+            // 输入变化后旧的输出不再被引用，直接删除
+            auto previous = manifest.find(jobs[i].input);
+            if (previous != manifest.end()) {
+                for (const std::string &output: previous->second.outputs) {
+                    if (std::find(entries[i].outputs.begin(), entries[i].outputs.end(), output) ==
+                        entries[i].outputs.end()) {
+                        std::remove((this->directory + "/" + output).c_str());
+                    }
+                }
+            }
+            cooked[jobs[i].input] = std::move(entries[i]);
+        }
+        // 失败的任务保留上一次的记录，下次重试
+        for (auto &entry: manifest) {
+            if (cooked.find(entry.first) == cooked.end() &&
+                std::find_if(jobs.begin(), jobs.end(), [&](const CookJob &job) { return job.input == entry.first; }) !=
+                jobs.end()) {
+                cooked[entry.first] = entry.second;
+            }
+        }
+        manifest = std::move(cooked);
+        if (!saveManifest()) {
+            std::cerr << "Could not write cook manifest in \"" << this->directory << "\"" << std::endl;
+            success = false;
+        }
+        std::cout << "Cooked " << jobs.size() - skippedCount << " of " << jobs.size() << " assets, " << skippedCount
+                  << " up to date" << std::endl;
+        return success;
+    }
+
+    std::vector<CookJob> AssetCooker::collectJobs() const {
+        std::vector<CookJob> jobs;
+        std::error_code error;
+        for (auto it = std::filesystem::recursive_directory_iterator(directory, error);
+             it != std::filesystem::recursive_directory_iterator(); it.increment(error)) {
+            if (error) {
+                break;
+            }
+            if (!it->is_regular_file(error)) {
+                continue;
+            }
+            const std::string file = it->path().generic_string();
+            const std::string extension = toLower(it->path().extension().string());
+            if (extension == ".gltf" || extension == ".glb") {
+                jobs.push_back({CookJobType::Model, toRelative(file)});
+            } else if (extension == ".ktx" && !isBakedOutput(file) && isBakeableEnvironmentMap(file)) {
+                jobs.push_back({CookJobType::Environment, toRelative(file)});
+            }
+        }
+        jobs.push_back({CookJobType::BrdfLut, toRelative(getBakedBrdfLutPath(directory + "/"))});
+        // 耗时长的环境贴图先开始
+        std::stable_sort(jobs.begin(), jobs.end(), [](const CookJob &a, const CookJob &b) {
+            return a.type > b.type;
+        });
+        return jobs;
+    }
+
+    bool AssetCooker::runJob(const CookJob &job, ManifestEntry &entry) const {
+        const std::string input = directory + "/" + job.input;
+        entry = {};
+        switch (job.type) {
+            case CookJobType::Model: {
+#if USE_MESH_SHADER
+                Model model(true);
+#else
+                Model model;
+#endif
+                std::vector<std::string> outputs;
+                if (!model.cook(input, SceneManager::modelLoadingFlags, 1.0f, entry.dependencies, outputs)) {
+                    return false;
+                }
+                for (const std::string &output: outputs) {
+                    entry.outputs.push_back(toRelative(output));
+                }
+                break;
+            }
+            case CookJobType::Environment: {
+                BakedIblPaths paths;
+                if (!getBakedIblPaths(input, paths) || !bakeEnvironmentMaps(input, paths)) {
+                    return false;
+                }
+                entry.outputs = {toRelative(paths.irradiance), toRelative(paths.prefiltered)};
+                break;
+            }
+            case CookJobType::BrdfLut: {
+                // 文件名已经包含烘焙参数的hash
+                if (!bakeBrdfLut(input)) {
+                    return false;
+                }
+                entry.outputs = {job.input};
+                break;
+            }
+        }
+        entry.hash = hashInputs(job.input, entry.dependencies, getJobSeed(job.type));
+        return true;
+    }
+
+    uint64_t AssetCooker::hashInputs(const std::string &input, const std::vector<std::string> &dependencies,
+                                     uint64_t seed) const {
+        if (seed >> 32 == static_cast<uint64_t>(CookJobType::BrdfLut)) {
+            return seed | 1;
+        }
+        const std::string file = directory + "/" + input;
+        MappedFile mapped;
+        if (!mapped.open(file)) {
+            return 0;
+        }
+        uint64_t hash = hash_bytes(mapped.data(), mapped.size(), seed);
+        // 依赖的路径相对输入文件所在目录
+        const size_t pos = file.find_last_of('/');
+        const std::string base = file.substr(0, pos);
+        for (const std::string &dependency: dependencies) {
+            hash = hash_bytes(dependency.data(), dependency.size(), hash);
+            MappedFile dependencyFile;
+            if (dependencyFile.open(base + "/" + dependency)) {
+                hash = hash_bytes(dependencyFile.data(), dependencyFile.size(), hash);
+            }
+        }
+        return hash;
+    }
+
+    bool AssetCooker::isUpToDate(const ManifestEntry &entry, uint64_t hash) const {
+        if (hash == 0 || hash != entry.hash) {
+            return false;
+        }
+        std::error_code error;
+        for (const std::string &output: entry.outputs) {
+            if (!std::filesystem::exists(directory + "/" + output, error)) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    std::string AssetCooker::toRelative(const std::string &file) const {
+        const std::string prefix = directory + "/";
+        return file.compare(0, prefix.size(), prefix) == 0 ? file.substr(prefix.size()) : file;
+    }
+
+    bool AssetCooker::loadManifest() {
+        std::ifstream file(directory + "/" + kManifestName);
+        std::string line;
+        if (!file || !std::getline(file, line) || line != kManifestHeader) {
+            return false;
+        }
+        // 每个输入一行"<hash> <path>"，后面是它的"D <依赖>"和"O <输出>"
+        ManifestEntry *entry = nullptr;
+        while (std::getline(file, line)) {
+            if (line.size() > 2 && (line[0] == 'D' || line[0] == 'O') && line[1] == ' ') {
+                if (entry) {
+                    (line[0] == 'D' ? entry->dependencies : entry->outputs).push_back(line.substr(2));
+                }
+            } else if (line.size() > 17 && line[16] == ' ') {
+                entry = &manifest[line.substr(17)];
+                entry->hash = std::strtoull(line.substr(0, 16).c_str(), nullptr, 16);
+            } else {
+                entry = nullptr;
+            }
+        }
+        return true;
+    }
+
+    bool AssetCooker::saveManifest() const {
+        // 先写临时文件再替换，中途失败不会留下不完整的manifest
+        const std::string filename = directory + "/" + kManifestName;
+        const std::string tempFilename = filename + ".tmp";
+        {
+            std::ofstream file(tempFilename, std::ios::trunc);
+            if (!file) {
+                return false;
+            }
+            file << kManifestHeader << "\n";
+            for (const auto &item: manifest) {
+                char hash[17];
+                snprintf(hash, sizeof(hash), "%016llx", static_cast<unsigned long long>(item.second.hash));
+                file << hash << " " << item.first << "\n";
+                for (const std::string &dependency: item.second.dependencies) {
+                    file << "D " << dependency << "\n";
+                }
+                for (const std::string &output: item.second.outputs) {
+                    file << "O " << output << "\n";
+                }
+            }
+            if (!file) {
+                return false;
+            }
+        }
+        std::error_code error;
+        std::filesystem::rename(tempFilename, filename, error);
+        return !error;
+    }
+}
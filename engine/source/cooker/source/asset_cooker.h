@@ -0,0 +1,62 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace MW {
+    enum class CookJobType : uint32_t {
+        Model,       // glTF -> 模型缓存(优化后的网格、LOD、meshlet) + KTX2压缩贴图
+        Environment, // 立方体环境贴图 -> irradiance/prefiltered贴图
+        BrdfLut
+    };
+
+    struct CookJob {
+        CookJobType type;
+        // 相对资源目录的路径
+        std::string input;
+    };
+
+    /*
+        Offline conversion of an asset directory into the files the runtime loads directly.
+        Inputs whose content hash (including referenced buffers and images) matches the manifest
+        and whose outputs still exist are skipped
+    */
+    class AssetCooker {
+    public:
+        // 忽略manifest，全部重新生成
+        bool force{false};
+        // 同时处理的任务数，0时使用硬件线程数-1
+        uint32_t threadCount{0};
+
+        // 返回所有任务是否都成功
+        bool cook(const std::string &directory);
+
+    private:
+        struct ManifestEntry {
+            uint64_t hash{0};
+            std::vector<std::string> dependencies;
+            std::vector<std::string> outputs;
+        };
+
+        std::vector<CookJob> collectJobs() const;
+
+        bool runJob(const CookJob &job, ManifestEntry &entry) const;
+
+        // 输入文件和它依赖的文件的内容hash，文件不存在时返回0
+        uint64_t hashInputs(const std::string &input, const std::vector<std::string> &dependencies,
+                            uint64_t seed) const;
+
+        bool isUpToDate(const ManifestEntry &entry, uint64_t hash) const;
+
+        std::string toRelative(const std::string &file) const;
+
+        bool loadManifest();
+
+        bool saveManifest() const;
+
+        std::string directory;
+        std::unordered_map<std::string, ManifestEntry> manifest;
+    };
+}
@@ -0,0 +1,31 @@
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <string>
+
+#include "asset_cooker.h"
+
+namespace {
+    void printUsage() {
+        std::cout << "Usage: MWCooker <asset directory> [--force] [--jobs count]" << std::endl;
+    }
+}
+
+int main(int argc, char **argv) {
+    if (argc < 2) {
+        printUsage();
+        return 1;
+    }
+    MW::AssetCooker cooker;
+    for (int i = 2; i < argc; ++i) {
+        if (strcmp(argv[i], "--force") == 0) {
+            cooker.force = true;
+        } else if (strcmp(argv[i], "--jobs") == 0 && i + 1 < argc) {
+            cooker.threadCount = static_cast<uint32_t>(std::strtoul(argv[++i], nullptr, 10));
+        } else {
+            printUsage();
+            return 1;
+        }
+    }
+    return cooker.cook(argv[1]) ? 0 : 1;
+}
@@ -0,0 +1,60 @@
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <iostream>
+#include <string>
+
+#include "runtime/core/file/asset_archive.h"
+
+namespace {
+    void printUsage() {
+        std::cout << "Usage: MWPacker <input directory> <output file> [--none|--lz4|--zstd] [--chunk-size bytes]"
+                  << std::endl;
+    }
+}
+
+int main(int argc, char **argv) {
+    if (argc < 3) {
+        printUsage();
+        return 1;
+    }
+    const std::string inputDirectory = argv[1];
+    const std::string outputFile = argv[2];
+    MW::ArchiveCompression compression = MW::ArchiveCompression::LZ4;
+    MW::AssetArchiveWriter writer;
+    for (int i = 3; i < argc; ++i) {
+        if (strcmp(argv[i], "--none") == 0) {
+            compression = MW::ArchiveCompression::None;
+        } else if (strcmp(argv[i], "--lz4") == 0) {
+            compression = MW::ArchiveCompression::LZ4;
+        } else if (strcmp(argv[i], "--zstd") == 0) {
+            compression = MW::ArchiveCompression::Zstd;
+        } else if (strcmp(argv[i], "--chunk-size") == 0 && i + 1 < argc) {
+            writer.chunkSize = static_cast<uint32_t>(std::strtoul(argv[++i], nullptr, 10));
+        } else {
+            printUsage();
+            return 1;
+        }
+    }
+    if (writer.chunkSize == 0) {
+        std::cerr << "Invalid chunk size" << std::endl;
+        return 1;
+    }
+    if (!writer.addDirectory(inputDirectory)) {
+        std::cerr << "Could not read directory \"" << inputDirectory << "\"" << std::endl;
+        return 1;
+    }
+    // 输出文件在输入目录中时，不把上一次的归档打进去
+    std::error_code error;
+    const std::filesystem::path outputPath = std::filesystem::weakly_canonical(outputFile, error);
+    const std::filesystem::path inputPath = std::filesystem::weakly_canonical(inputDirectory, error);
+    const std::filesystem::path relative = outputPath.lexically_relative(inputPath);
+    if (!relative.empty() && *relative.begin() != "..") {
+        writer.removeFile(relative.generic_string());
+    }
+    if (!writer.write(outputFile, compression)) {
+        std::cerr << "Could not write archive \"" << outputFile << "\"" << std::endl;
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,32 @@
+#pragma once
+
+// 默认编译选项只开到SSE2，更高的指令集按函数开启，运行时检测CPU后再调用
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define MW_SIMD_X86 1
+#if defined(_MSC_VER) && !defined(__clang__)
+#include <intrin.h>
+#define MW_TARGET_SSSE3
+#else
+#define MW_TARGET_SSSE3 __attribute__((target("ssse3")))
+#endif
+#endif
+
+namespace MW {
+    inline bool cpuSupportsSSSE3() {
+#if defined(__SSSE3__)
+        return true;
+#elif defined(MW_SIMD_X86) && defined(_MSC_VER) && !defined(__clang__)
+        static const bool supported = [] {
+            int info[4];
+            __cpuid(info, 1);
+            return (info[2] & (1 << 9)) != 0;
+        }();
+        return supported;
+#elif defined(MW_SIMD_X86)
+        static const bool supported = __builtin_cpu_supports("ssse3");
+        return supported;
+#else
+        return false;
+#endif
+    }
+}
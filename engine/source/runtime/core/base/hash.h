@@ -1,6 +1,8 @@
 #pragma once
 
 #include <cstddef>
+#include <cstdint>
+#include <cstring>
 #include <functional>
 
 template<typename T>
@@ -13,8 +15,48 @@ template<typename T, typename... Ts>
 inline void hash_combine(std::size_t& seed, const T& v, Ts... rest)
 {
     hash_combine(seed, v);
-    if constexpr (sizeof...(Ts) > 1)
+    if constexpr (sizeof...(Ts) > 0)
     {
         hash_combine(seed, rest...);
     }
 }
+
+// MurmurHash64A，用于文件内容等大块数据
+inline uint64_t hash_bytes(const void* data, std::size_t size, uint64_t seed = 0)
+{
+    const uint64_t m = 0xc6a4a7935bd1e995ull;
+    const int      r = 47;
+
+    uint64_t h = seed ^ (size * m);
+
+    const unsigned char* bytes = static_cast<const unsigned char*>(data);
+    const std::size_t    blocks = size / 8;
+    for (std::size_t i = 0; i < blocks; ++i)
+    {
+        uint64_t k;
+        std::memcpy(&k, bytes + i * 8, sizeof(k));
+        k *= m;
+        k ^= k >> r;
+        k *= m;
+        h ^= k;
+        h *= m;
+    }
+
+    const unsigned char* tail = bytes + blocks * 8;
+    switch (size & 7)
+    {
+        case 7: h ^= uint64_t(tail[6]) << 48; [[fallthrough]];
+        case 6: h ^= uint64_t(tail[5]) << 40; [[fallthrough]];
+        case 5: h ^= uint64_t(tail[4]) << 32; [[fallthrough]];
+        case 4: h ^= uint64_t(tail[3]) << 24; [[fallthrough]];
+        case 3: h ^= uint64_t(tail[2]) << 16; [[fallthrough]];
+        case 2: h ^= uint64_t(tail[1]) << 8; [[fallthrough]];
+        case 1: h ^= uint64_t(tail[0]);
+                h *= m;
+    }
+
+    h ^= h >> r;
+    h *= m;
+    h ^= h >> r;
+    return h;
+}
@@ -0,0 +1,101 @@
+#include "thread_pool.h"
+
+#include <algorithm>
+#include <atomic>
+
+namespace MW {
+    ThreadPool::ThreadPool(uint32_t threadCount) {
+        if (threadCount == 0) {
+            const uint32_t hardwareThreads = std::thread::hardware_concurrency();
+            threadCount = std::max(1u, hardwareThreads > 1 ? hardwareThreads - 1 : 1u);
+        }
+        workers.reserve(threadCount);
+        for (uint32_t i = 0; i < threadCount; ++i) {
+            workers.emplace_back([this]() { workerLoop(); });
+        }
+    }
+
+    ThreadPool::~ThreadPool() {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+        condition.notify_all();
+        for (std::thread &worker: workers) {
+            worker.join();
+        }
+    }
+
+    ThreadPool &ThreadPool::global() {
+        static ThreadPool pool;
+        return pool;
+    }
+
+    void ThreadPool::enqueue(std::function<void()> task) {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            tasks.push_back(std::move(task));
+        }
+        condition.notify_one();
+    }
+
+    void ThreadPool::workerLoop() {
+        for (;;) {
+            std::function<void()> task;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                condition.wait(lock, [this]() { return stopping || !tasks.empty(); });
+                if (stopping && tasks.empty()) {
+                    return;
+                }
+                task = std::move(tasks.front());
+                tasks.pop_front();
+            }
+            task();
+        }
+    }
+
+    void ThreadPool::parallelFor(uint32_t count, const std::function<void(uint32_t)> &function) {
+        if (count == 0) {
+            return;
+        }
+        if (count == 1) {
+            function(0);
+            return;
+        }
+
+        // 共享状态由shared_ptr持有，没来得及执行的辅助任务在返回后运行也是安全的
+        struct State {
+            std::atomic<uint32_t> next{0};
+            std::atomic<uint32_t> done{0};
+            uint32_t count{0};
+            const std::function<void(uint32_t)> *function{nullptr};
+            std::mutex mutex;
+            std::condition_variable finished;
+        };
+        auto state = std::make_shared<State>();
+        state->count = count;
+        state->function = &function;
+
+        auto run = [state]() {
+            uint32_t completed = 0;
+            for (uint32_t i = state->next.fetch_add(1); i < state->count; i = state->next.fetch_add(1)) {
+                (*state->function)(i);
+                ++completed;
+            }
+            if (completed && state->done.fetch_add(completed) + completed == state->count) {
+                std::lock_guard<std::mutex> lock(state->mutex);
+                state->finished.notify_all();
+            }
+        };
+
+        const uint32_t helpers = std::min(getThreadCount(), count - 1);
+        for (uint32_t i = 0; i < helpers; ++i) {
+            enqueue(run);
+        }
+        run();
+
+        std::unique_lock<std::mutex> lock(state->mutex);
+        state->finished.wait(lock, [&state]() { return state->done.load() == state->count; });
+    }
+}
@@ -0,0 +1,56 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+namespace MW {
+    /*
+        Fixed size worker pool
+    */
+    class ThreadPool {
+    public:
+        // threadCount为0时使用硬件线程数-1（至少1个）
+        explicit ThreadPool(uint32_t threadCount = 0);
+
+        ~ThreadPool();
+
+        ThreadPool(const ThreadPool &) = delete;
+
+        ThreadPool &operator=(const ThreadPool &) = delete;
+
+        template<typename Function>
+        auto submit(Function &&function) -> std::future<std::invoke_result_t<std::decay_t<Function>>> {
+            using Result = std::invoke_result_t<std::decay_t<Function>>;
+            auto task = std::make_shared<std::packaged_task<Result()>>(std::forward<Function>(function));
+            std::future<Result> future = task->get_future();
+            enqueue([task]() { (*task)(); });
+            return future;
+        }
+
+        // 调用线程也参与执行，返回时所有index都已处理完
+        void parallelFor(uint32_t count, const std::function<void(uint32_t)> &function);
+
+        uint32_t getThreadCount() const { return static_cast<uint32_t>(workers.size()); }
+
+        static ThreadPool &global();
+
+    private:
+        void enqueue(std::function<void()> task);
+
+        void workerLoop();
+
+        std::vector<std::thread> workers;
+        std::deque<std::function<void()>> tasks;
+        std::mutex mutex;
+        std::condition_variable condition;
+        bool stopping{false};
+    };
+}
@@ -0,0 +1,367 @@
+#include "asset_archive.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+
+#include "core/base/hash.h"
+#include "core/file/lz4.h"
+
+#if MW_HAS_ZSTD
+#include <zstd.h>
+#endif
+
+namespace MW {
+    std::string normalizeArchivePath(const std::string &path) {
+        std::vector<std::string> parts;
+        size_t start = 0;
+        while (start <= path.size()) {
+            size_t end = path.find_first_of("/\\", start);
+            if (end == std::string::npos) {
+                end = path.size();
+            }
+            std::string part = path.substr(start, end - start);
+            if (part == "..") {
+                if (!parts.empty()) {
+                    parts.pop_back();
+                }
+            } else if (!part.empty() && part != ".") {
+                parts.push_back(std::move(part));
+            }
+            start = end + 1;
+        }
+        std::string normalized;
+        for (const std::string &part: parts) {
+            if (!normalized.empty()) {
+                normalized += '/';
+            }
+            normalized += part;
+        }
+        return normalized;
+    }
+
+    uint64_t hashArchivePath(const std::string &normalizedPath) {
+        return hash_bytes(normalizedPath.data(), normalizedPath.size());
+    }
+
+    bool AssetArchive::open(const std::string &filename) {
+        close();
+        if (!file.open(filename) || file.size() < sizeof(ArchiveHeader)) {
+            file.close();
+            return false;
+        }
+        const uint64_t size = file.size();
+        const auto *archiveHeader = reinterpret_cast<const ArchiveHeader *>(file.data());
+        const bool valid = archiveHeader->magic == ArchiveHeader::magicValue &&
+                           archiveHeader->version == ArchiveHeader::currentVersion &&
+                           archiveHeader->chunkSize > 0 &&
+                           archiveHeader->entriesOffset % alignof(ArchiveEntry) == 0 &&
+                           archiveHeader->chunksOffset % alignof(ArchiveChunk) == 0 &&
+                           archiveHeader->entriesOffset + archiveHeader->entryCount * sizeof(ArchiveEntry) <= size &&
+                           archiveHeader->chunksOffset + archiveHeader->chunkCount * sizeof(ArchiveChunk) <= size &&
+                           archiveHeader->stringsOffset + archiveHeader->stringsSize <= size;
+        if (!valid) {
+            std::cerr << "Invalid asset archive \"" << filename << "\"" << std::endl;
+            file.close();
+            return false;
+        }
+        header = archiveHeader;
+        entries = reinterpret_cast<const ArchiveEntry *>(file.data() + header->entriesOffset);
+        chunks = reinterpret_cast<const ArchiveChunk *>(file.data() + header->chunksOffset);
+        strings = reinterpret_cast<const char *>(file.data() + header->stringsOffset);
+        return true;
+    }
+
+    void AssetArchive::close() {
+        file.close();
+        header = nullptr;
+        entries = nullptr;
+        chunks = nullptr;
+        strings = nullptr;
+    }
+
+    const ArchiveEntry *AssetArchive::find(const std::string &path) const {
+        if (!header) {
+            return nullptr;
+        }
+        const std::string normalized = normalizeArchivePath(path);
+        const uint64_t hash = hashArchivePath(normalized);
+        const ArchiveEntry *end = entries + header->entryCount;
+        const ArchiveEntry *it = std::lower_bound(entries, end, hash, [](const ArchiveEntry &entry, uint64_t value) {
+            return entry.pathHash < value;
+        });
+        for (; it != end && it->pathHash == hash; ++it) {
+            if (it->pathLength == normalized.size() &&
+                static_cast<uint64_t>(it->pathOffset) + it->pathLength <= header->stringsSize &&
+                memcmp(strings + it->pathOffset, normalized.data(), normalized.size()) == 0) {
+                return it;
+            }
+        }
+        return nullptr;
+    }
+
+    const uint8_t *AssetArchive::getMappedData(const ArchiveEntry &entry) const {
+        if (entry.compression != static_cast<uint32_t>(ArchiveCompression::None) ||
+            entry.dataOffset + entry.size > file.size()) {
+            return nullptr;
+        }
+        return file.data() + entry.dataOffset;
+    }
+
+    std::string AssetArchive::getPath(const ArchiveEntry &entry) const {
+        return std::string(strings + entry.pathOffset, entry.pathLength);
+    }
+
+    bool AssetArchive::decompressChunk(const ArchiveEntry &entry, const ArchiveChunk &chunk, uint8_t *dst) const {
+        if (chunk.offset + chunk.storedSize > file.size()) {
+            return false;
+        }
+        const uint8_t *src = file.data() + chunk.offset;
+        if (chunk.storedSize == chunk.rawSize) {
+            memcpy(dst, src, chunk.rawSize);
+            return true;
+        }
+        switch (static_cast<ArchiveCompression>(entry.compression)) {
+            case ArchiveCompression::LZ4:
+                return lz4Decompress(src, chunk.storedSize, dst, chunk.rawSize);
+#if MW_HAS_ZSTD
+            case ArchiveCompression::Zstd: {
+                const size_t result = ZSTD_decompress(dst, chunk.rawSize, src, chunk.storedSize);
+                return !ZSTD_isError(result) && result == chunk.rawSize;
+            }
+#endif
+            default:
+                return false;
+        }
+    }
+
+    bool AssetArchive::read(const ArchiveEntry &entry, uint8_t *dst, ThreadPool &threadPool) const {
+        if (entry.compression == static_cast<uint32_t>(ArchiveCompression::None)) {
+            const uint8_t *data = getMappedData(entry);
+            if (data && entry.size > 0) {
+                memcpy(dst, data, entry.size);
+            }
+            return data != nullptr;
+        }
+        if (static_cast<uint64_t>(entry.firstChunk) + entry.chunkCount > header->chunkCount) {
+            return false;
+        }
+        // 除最后一块外每块都是chunkSize
+        uint64_t rawSize = 0;
+        for (uint32_t i = 0; i < entry.chunkCount; ++i) {
+            const ArchiveChunk &chunk = chunks[entry.firstChunk + i];
+            if ((i + 1 < entry.chunkCount && chunk.rawSize != header->chunkSize) || chunk.rawSize > header->chunkSize) {
+                return false;
+            }
+            rawSize += chunk.rawSize;
+        }
+        if (rawSize != entry.size) {
+            return false;
+        }
+        std::atomic<bool> success{true};
+        threadPool.parallelFor(entry.chunkCount, [&](uint32_t i) {
+            const ArchiveChunk &chunk = chunks[entry.firstChunk + i];
+            if (!decompressChunk(entry, chunk, dst + static_cast<uint64_t>(i) * header->chunkSize)) {
+                success = false;
+            }
+        });
+        return success;
+    }
+
+    void AssetArchiveWriter::addFile(const std::string &path, const std::string &sourceFile) {
+        files.push_back({normalizeArchivePath(path), sourceFile});
+    }
+
+    bool AssetArchiveWriter::addDirectory(const std::string &directory) {
+        namespace fs = std::filesystem;
+        std::error_code error;
+        const fs::path root(directory);
+        std::vector<PendingFile> found;
+        for (fs::recursive_directory_iterator it(root, error), end; !error && it != end; it.increment(error)) {
+            if (!it->is_regular_file(error)) {
+                continue;
+            }
+            const fs::path relative = fs::relative(it->path(), root, error);
+            found.push_back({normalizeArchivePath(relative.generic_string()), it->path().string()});
+        }
+        if (error) {
+            std::cerr << "Could not list \"" << directory << "\": " << error.message() << std::endl;
+            return false;
+        }
+        // 目录遍历顺序不固定，排序后归档内容可复现
+        std::sort(found.begin(), found.end(), [](const PendingFile &a, const PendingFile &b) {
+            return a.path < b.path;
+        });
+        files.insert(files.end(), found.begin(), found.end());
+        return true;
+    }
+
+    void AssetArchiveWriter::removeFile(const std::string &path) {
+        const std::string normalized = normalizeArchivePath(path);
+        files.erase(std::remove_if(files.begin(), files.end(), [&](const PendingFile &file) {
+            return file.path == normalized;
+        }), files.end());
+    }
+
+    bool AssetArchiveWriter::write(const std::string &filename, ArchiveCompression compression,
+                                   ThreadPool &threadPool) {
+#if !MW_HAS_ZSTD
+        if (compression == ArchiveCompression::Zstd) {
+            std::cerr << "zstd is not available, falling back to LZ4" << std::endl;
+            compression = ArchiveCompression::LZ4;
+        }
+#endif
+        std::ofstream out(filename, std::ios::binary | std::ios::trunc);
+        if (!out) {
+            std::cerr << "Could not create archive \"" << filename << "\"" << std::endl;
+            return false;
+        }
+
+        ArchiveHeader header{};
+        header.chunkSize = chunkSize;
+        header.alignment = alignment;
+        out.write(reinterpret_cast<const char *>(&header), sizeof(header));
+        uint64_t offset = sizeof(header);
+        auto pad = [&](uint64_t align) {
+            const uint64_t aligned = (offset + align - 1) / align * align;
+            static const char zeros[4096] = {};
+            while (offset < aligned) {
+                const uint64_t count = std::min<uint64_t>(aligned - offset, sizeof(zeros));
+                out.write(zeros, static_cast<std::streamsize>(count));
+                offset += count;
+            }
+        };
+
+        std::vector<ArchiveEntry> entries;
+        std::vector<ArchiveChunk> chunks;
+        std::string strings;
+        uint64_t rawBytes = 0;
+        for (const PendingFile &pending: files) {
+            MappedFile source;
+            if (!source.open(pending.sourceFile)) {
+                std::cerr << "Could not read \"" << pending.sourceFile << "\"" << std::endl;
+                return false;
+            }
+            ArchiveEntry entry{};
+            entry.pathHash = hashArchivePath(pending.path);
+            entry.pathOffset = static_cast<uint32_t>(strings.size());
+            entry.pathLength = static_cast<uint32_t>(pending.path.size());
+            entry.size = source.size();
+            strings += pending.path;
+            rawBytes += entry.size;
+
+            bool compressed = false;
+            if (compression != ArchiveCompression::None && entry.size > 0) {
+                const uint32_t chunkCount = static_cast<uint32_t>((entry.size + chunkSize - 1) / chunkSize);
+                // 为空表示这一块压缩后没有变小，原样存放
+                std::vector<std::vector<uint8_t>> blocks(chunkCount);
+                threadPool.parallelFor(chunkCount, [&](uint32_t i) {
+                    const uint8_t *src = source.data() + static_cast<uint64_t>(i) * chunkSize;
+                    const size_t rawSize = static_cast<size_t>(
+                            std::min<uint64_t>(chunkSize, entry.size - static_cast<uint64_t>(i) * chunkSize));
+                    std::vector<uint8_t> &block = blocks[i];
+                    size_t storedSize = 0;
+                    if (compression == ArchiveCompression::LZ4) {
+                        block.resize(lz4CompressBound(rawSize));
+                        storedSize = lz4Compress(src, rawSize, block.data(), block.size());
+                    }
+#if MW_HAS_ZSTD
+                    else if (compression == ArchiveCompression::Zstd) {
+                        block.resize(ZSTD_compressBound(rawSize));
+                        const size_t result = ZSTD_compress(block.data(), block.size(), src, rawSize, zstdLevel);
+                        storedSize = ZSTD_isError(result) ? 0 : result;
+                    }
+#endif
+                    if (storedSize == 0 || storedSize >= rawSize) {
+                        block.clear();
+                    } else {
+                        block.resize(storedSize);
+                    }
+                });
+                uint64_t storedBytes = 0;
+                for (uint32_t i = 0; i < chunkCount; ++i) {
+                    storedBytes += blocks[i].empty() ? std::min<uint64_t>(chunkSize, entry.size - uint64_t(i) * chunkSize)
+                                                     : blocks[i].size();
+                }
+                if (static_cast<double>(storedBytes) <= static_cast<double>(entry.size) * maxCompressedRatio) {
+                    pad(16);
+                    entry.compression = static_cast<uint32_t>(compression);
+                    entry.dataOffset = offset;
+                    entry.firstChunk = static_cast<uint32_t>(chunks.size());
+                    entry.chunkCount = chunkCount;
+                    for (uint32_t i = 0; i < chunkCount; ++i) {
+                        const uint64_t rawOffset = static_cast<uint64_t>(i) * chunkSize;
+                        const uint32_t rawSize = static_cast<uint32_t>(std::min<uint64_t>(chunkSize,
+                                                                                          entry.size - rawOffset));
+                        ArchiveChunk chunk{offset, rawSize, rawSize};
+                        if (blocks[i].empty()) {
+                            out.write(reinterpret_cast<const char *>(source.data() + rawOffset), rawSize);
+                        } else {
+                            chunk.storedSize = static_cast<uint32_t>(blocks[i].size());
+                            out.write(reinterpret_cast<const char *>(blocks[i].data()), chunk.storedSize);
+                        }
+                        offset += chunk.storedSize;
+                        chunks.push_back(chunk);
+                    }
+                    compressed = true;
+                }
+            }
+            if (!compressed) {
+                pad(alignment);
+                entry.compression = static_cast<uint32_t>(ArchiveCompression::None);
+                entry.dataOffset = offset;
+                if (entry.size > 0) {
+                    out.write(reinterpret_cast<const char *>(source.data()), static_cast<std::streamsize>(entry.size));
+                }
+                offset += entry.size;
+            }
+            entries.push_back(entry);
+        }
+
+        std::sort(entries.begin(), entries.end(), [&strings](const ArchiveEntry &a, const ArchiveEntry &b) {
+            if (a.pathHash != b.pathHash) {
+                return a.pathHash < b.pathHash;
+            }
+            return strings.compare(a.pathOffset, a.pathLength, strings, b.pathOffset, b.pathLength) < 0;
+        });
+        for (size_t i = 1; i < entries.size(); ++i) {
+            const ArchiveEntry &a = entries[i - 1], &b = entries[i];
+            if (a.pathHash == b.pathHash &&
+                strings.compare(a.pathOffset, a.pathLength, strings, b.pathOffset, b.pathLength) == 0) {
+                std::cerr << "Duplicate archive path \"" << strings.substr(a.pathOffset, a.pathLength) << "\""
+                          << std::endl;
+                return false;
+            }
+        }
+
+        pad(alignof(ArchiveEntry));
+        header.entryCount = static_cast<uint32_t>(entries.size());
+        header.entriesOffset = offset;
+        out.write(reinterpret_cast<const char *>(entries.data()),
+                  static_cast<std::streamsize>(entries.size() * sizeof(ArchiveEntry)));
+        offset += entries.size() * sizeof(ArchiveEntry);
+        header.chunkCount = static_cast<uint32_t>(chunks.size());
+        header.chunksOffset = offset;
+        out.write(reinterpret_cast<const char *>(chunks.data()),
+                  static_cast<std::streamsize>(chunks.size() * sizeof(ArchiveChunk)));
+        offset += chunks.size() * sizeof(ArchiveChunk);
+        header.stringsOffset = offset;
+        header.stringsSize = strings.size();
+        out.write(strings.data(), static_cast<std::streamsize>(strings.size()));
+        offset += strings.size();
+
+        out.seekp(0);
+        out.write(reinterpret_cast<const char *>(&header), sizeof(header));
+        out.close();
+        if (!out) {
+            std::cerr << "Could not write archive \"" << filename << "\"" << std::endl;
+            return false;
+        }
+        std::cout << "Packed " << entries.size() << " files, " << rawBytes << " -> " << offset << " bytes into \""
+                  << filename << "\"" << std::endl;
+        return true;
+    }
+}
@@ -0,0 +1,127 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "core/base/thread_pool.h"
+#include "core/file/mapped_file.h"
+
+namespace MW {
+    enum class ArchiveCompression : uint32_t {
+        None = 0,
+        LZ4,   // 解压快，运行时默认
+        Zstd,  // 体积小，需要编译时找到zstd(MW_HAS_ZSTD)
+    };
+
+    // 文件布局：ArchiveHeader | 数据 | ArchiveEntry[entryCount] | ArchiveChunk[chunkCount] | 路径字符串
+    struct ArchiveHeader {
+        static constexpr uint32_t magicValue = 0x4b50574d; // "MWPK"
+        static constexpr uint32_t currentVersion = 1;
+
+        uint32_t magic{magicValue};
+        uint32_t version{currentVersion};
+        uint32_t entryCount{0};
+        uint32_t chunkCount{0};
+        uint64_t entriesOffset{0};
+        uint64_t chunksOffset{0};
+        uint64_t stringsOffset{0};
+        uint64_t stringsSize{0};
+        uint32_t chunkSize{0};
+        uint32_t alignment{0};
+    };
+
+    // 按pathHash排序，查找时二分
+    struct ArchiveEntry {
+        uint64_t pathHash{0};
+        uint32_t pathOffset{0};
+        uint32_t pathLength{0};
+        uint64_t dataOffset{0};
+        uint64_t size{0};
+        uint32_t compression{0};
+        uint32_t firstChunk{0};
+        uint32_t chunkCount{0};
+        uint32_t reserved{0};
+    };
+
+    // 压缩条目按chunkSize分块独立压缩，可以并行解压，storedSize等于rawSize的块没有压缩
+    struct ArchiveChunk {
+        uint64_t offset{0};
+        uint32_t storedSize{0};
+        uint32_t rawSize{0};
+    };
+
+    // 去掉"."、".."和重复的分隔符，统一使用'/'
+    std::string normalizeArchivePath(const std::string &path);
+
+    uint64_t hashArchivePath(const std::string &normalizedPath);
+
+    /*
+        Read-only packed asset archive.
+        The archive is memory mapped, uncompressed entries are aligned so they can be used in place,
+        compressed entries are decompressed chunk by chunk on the thread pool
+    */
+    class AssetArchive {
+    public:
+        bool open(const std::string &filename);
+
+        void close();
+
+        // path为归档内的相对路径
+        const ArchiveEntry *find(const std::string &path) const;
+
+        // 没有压缩的条目直接返回映射的数据，否则返回nullptr
+        const uint8_t *getMappedData(const ArchiveEntry &entry) const;
+
+        // dst至少为entry.size
+        bool read(const ArchiveEntry &entry, uint8_t *dst, ThreadPool &threadPool = ThreadPool::global()) const;
+
+        std::string getPath(const ArchiveEntry &entry) const;
+
+        uint32_t getEntryCount() const { return header ? header->entryCount : 0; }
+
+        const ArchiveEntry &getEntry(uint32_t index) const { return entries[index]; }
+
+    private:
+        bool decompressChunk(const ArchiveEntry &entry, const ArchiveChunk &chunk, uint8_t *dst) const;
+
+        MappedFile file;
+        const ArchiveHeader *header{nullptr};
+        const ArchiveEntry *entries{nullptr};
+        const ArchiveChunk *chunks{nullptr};
+        const char *strings{nullptr};
+    };
+
+    /*
+        Builds an AssetArchive, files are read and compressed one at a time with the chunks of each file
+        compressed in parallel
+    */
+    class AssetArchiveWriter {
+    public:
+        // 归档内的路径和磁盘上的源文件
+        void addFile(const std::string &path, const std::string &sourceFile);
+
+        // 递归加入目录下的所有文件，路径相对于directory
+        bool addDirectory(const std::string &directory);
+
+        void removeFile(const std::string &path);
+
+        bool write(const std::string &filename, ArchiveCompression compression,
+                   ThreadPool &threadPool = ThreadPool::global());
+
+        uint32_t chunkSize{256 * 1024};
+        // 不压缩的条目按页对齐，可以直接映射使用
+        uint32_t alignment{4096};
+        int zstdLevel{19};
+        // 压缩后大于原大小的这个比例时不压缩，例如jpg和已经块压缩的贴图
+        float maxCompressedRatio{0.9f};
+
+    private:
+        struct PendingFile {
+            std::string path;
+            std::string sourceFile;
+        };
+
+        std::vector<PendingFile> files;
+    };
+}
@@ -0,0 +1,475 @@
+#include "async_file_reader.h"
+
+#include <algorithm>
+#include <fstream>
+
+#if defined(__linux__)
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <linux/io_uring.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+namespace MW {
+#if defined(__linux__)
+    struct AsyncFileReader::Ring {
+        int fd{-1};
+        int wakeupFd{-1};
+        uint64_t wakeupValue{0};
+        uint32_t entries{0};
+        uint32_t pendingSubmit{0};
+        void *sqRing{MAP_FAILED};
+        void *cqRing{MAP_FAILED};
+        size_t sqRingSize{0};
+        size_t cqRingSize{0};
+        io_uring_sqe *sqes{static_cast<io_uring_sqe *>(MAP_FAILED)};
+        size_t sqesSize{0};
+        unsigned *sqTail{nullptr};
+        unsigned *sqMask{nullptr};
+        unsigned *sqArray{nullptr};
+        unsigned *cqHead{nullptr};
+        unsigned *cqTail{nullptr};
+        unsigned *cqMask{nullptr};
+        io_uring_cqe *cqes{nullptr};
+    };
+#else
+    struct AsyncFileReader::Ring {
+    };
+#endif
+
+    namespace {
+        // 同步读取时每块的大小，块之间检查取消
+        constexpr uint64_t blockingChunkSize = 4ull * 1024 * 1024;
+        constexpr uint32_t maxFallbackThreads = 8;
+#if defined(__linux__)
+        constexpr uint32_t ringEntries = 256;
+        // 单次read的长度是32位
+        constexpr uint64_t maxRingReadSize = 1ull << 30;
+        constexpr uint64_t wakeupUserData = 0;
+#endif
+    }
+
+    AsyncFileReader::AsyncFileReader(uint32_t maxInFlight, bool useIoUring)
+            : maxInFlight(std::max(1u, maxInFlight)) {
+#if defined(__linux__)
+        if (useIoUring && createRing()) {
+            this->maxInFlight = std::min(this->maxInFlight, ring->entries - 1);
+            threads.emplace_back([this]() { ringLoop(); });
+            return;
+        }
+#endif
+        const uint32_t threadCount = std::min(this->maxInFlight, maxFallbackThreads);
+        for (uint32_t i = 0; i < threadCount; ++i) {
+            threads.emplace_back([this]() { workerLoop(); });
+        }
+    }
+
+    AsyncFileReader::~AsyncFileReader() {
+        // 排队中的请求以Cancelled回调，正在读的做完
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+        condition.notify_all();
+#if defined(__linux__)
+        if (ring) {
+            wakeup();
+        }
+#endif
+        for (std::thread &thread: threads) {
+            thread.join();
+        }
+#if defined(__linux__)
+        destroyRing();
+#endif
+    }
+
+    AsyncFileReader &AsyncFileReader::global() {
+        static AsyncFileReader reader;
+        return reader;
+    }
+
+    AsyncFileReader::RequestId
+    AsyncFileReader::read(const std::string &filename, Priority priority, Callback callback, uint64_t offset,
+                          uint64_t size) {
+        auto request = std::make_shared<Request>();
+        request->filename = filename;
+        request->offset = offset;
+        request->size = size;
+        request->priority = priority;
+        request->callback = std::move(callback);
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            request->id = nextId++;
+            requests[request->id] = request;
+            queues[static_cast<size_t>(priority)].push_back(request);
+        }
+#if defined(__linux__)
+        if (ring) {
+            wakeup();
+            return request->id;
+        }
+#endif
+        condition.notify_one();
+        return request->id;
+    }
+
+    std::future<AsyncFileReader::Result> AsyncFileReader::readFile(const std::string &filename, Priority priority) {
+        auto promise = std::make_shared<std::promise<Result>>();
+        std::future<Result> future = promise->get_future();
+        read(filename, priority, [promise](Result &result) { promise->set_value(std::move(result)); });
+        return future;
+    }
+
+    bool AsyncFileReader::cancel(RequestId id) {
+        std::lock_guard<std::mutex> lock(mutex);
+        auto it = requests.find(id);
+        if (it == requests.end()) {
+            return false;
+        }
+        // 排队中的请求出队时直接完成，正在读的请求读完当前块后丢弃数据
+        it->second->cancelled = true;
+        return true;
+    }
+
+    void AsyncFileReader::setMaxInFlight(uint32_t count) {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            maxInFlight = std::max(1u, count);
+#if defined(__linux__)
+            if (ring) {
+                maxInFlight = std::min(maxInFlight, ring->entries - 1);
+            }
+#endif
+        }
+        condition.notify_all();
+#if defined(__linux__)
+        if (ring) {
+            wakeup();
+        }
+#endif
+    }
+
+    std::shared_ptr<AsyncFileReader::Request> AsyncFileReader::popRequest() {
+        for (auto &queue: queues) {
+            if (!queue.empty()) {
+                std::shared_ptr<Request> request = std::move(queue.front());
+                queue.pop_front();
+                return request;
+            }
+        }
+        return nullptr;
+    }
+
+    void AsyncFileReader::finish(const std::shared_ptr<Request> &request) {
+#if defined(__linux__)
+        if (request->fd >= 0) {
+            ::close(request->fd);
+            request->fd = -1;
+        }
+#endif
+        if (request->cancelled) {
+            request->result.status = Status::Cancelled;
+        }
+        if (request->result.status != Status::Success) {
+            request->result.data.clear();
+        }
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            requests.erase(request->id);
+        }
+        request->callback(request->result);
+    }
+
+    void AsyncFileReader::workerLoop() {
+        for (;;) {
+            std::shared_ptr<Request> request;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                condition.wait(lock, [this]() {
+                    if (stopping) {
+                        return true;
+                    }
+                    return inFlight < maxInFlight &&
+                           std::any_of(queues.begin(), queues.end(), [](const auto &queue) { return !queue.empty(); });
+                });
+                request = popRequest();
+                if (!request) {
+                    return;
+                }
+                if (stopping) {
+                    request->cancelled = true;
+                }
+                ++inFlight;
+            }
+            if (!request->cancelled) {
+                readBlocking(*request);
+            }
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                --inFlight;
+            }
+            condition.notify_one();
+            finish(request);
+        }
+    }
+
+    void AsyncFileReader::readBlocking(Request &request) {
+        request.result.status = Status::Failed;
+        std::ifstream file(request.filename, std::ios::binary | std::ios::ate);
+        if (!file) {
+            return;
+        }
+        const uint64_t fileSize = static_cast<uint64_t>(file.tellg());
+        if (request.offset > fileSize) {
+            return;
+        }
+        const uint64_t available = fileSize - request.offset;
+        const uint64_t size = request.size == 0 ? available : std::min(request.size, available);
+        request.result.data.resize(size);
+        file.seekg(static_cast<std::streamoff>(request.offset));
+        while (request.completed < size) {
+            if (request.cancelled) {
+                return;
+            }
+            const uint64_t chunk = std::min(blockingChunkSize, size - request.completed);
+            file.read(reinterpret_cast<char *>(request.result.data.data() + request.completed),
+                      static_cast<std::streamsize>(chunk));
+            if (!file) {
+                return;
+            }
+            request.completed += chunk;
+        }
+        request.result.status = Status::Success;
+    }
+
+#if defined(__linux__)
+    bool AsyncFileReader::createRing() {
+        io_uring_params params{};
+        const int fd = static_cast<int>(syscall(__NR_io_uring_setup, ringEntries, &params));
+        if (fd < 0) {
+            return false;
+        }
+        ring = std::make_unique<Ring>();
+        ring->fd = fd;
+        ring->entries = params.sq_entries;
+        // IORING_OP_READ在5.6加入，用同一版本加入的feature判断
+        if (!(params.features & IORING_FEAT_RW_CUR_POS)) {
+            destroyRing();
+            return false;
+        }
+
+        ring->sqRingSize = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+        ring->cqRingSize = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+        const bool singleMap = (params.features & IORING_FEAT_SINGLE_MMAP) != 0;
+        if (singleMap) {
+            ring->sqRingSize = ring->cqRingSize = std::max(ring->sqRingSize, ring->cqRingSize);
+        }
+        ring->sqRing = mmap(nullptr, ring->sqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd,
+                            IORING_OFF_SQ_RING);
+        if (ring->sqRing == MAP_FAILED) {
+            destroyRing();
+            return false;
+        }
+        if (!singleMap) {
+            ring->cqRing = mmap(nullptr, ring->cqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd,
+                                IORING_OFF_CQ_RING);
+            if (ring->cqRing == MAP_FAILED) {
+                destroyRing();
+                return false;
+            }
+        }
+        ring->sqesSize = params.sq_entries * sizeof(io_uring_sqe);
+        ring->sqes = static_cast<io_uring_sqe *>(mmap(nullptr, ring->sqesSize, PROT_READ | PROT_WRITE,
+                                                      MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES));
+        ring->wakeupFd = eventfd(0, EFD_CLOEXEC);
+        if (ring->sqes == MAP_FAILED || ring->wakeupFd < 0) {
+            destroyRing();
+            return false;
+        }
+
+        auto *sq = static_cast<unsigned char *>(ring->sqRing);
+        auto *cq = static_cast<unsigned char *>(singleMap ? ring->sqRing : ring->cqRing);
+        ring->sqTail = reinterpret_cast<unsigned *>(sq + params.sq_off.tail);
+        ring->sqMask = reinterpret_cast<unsigned *>(sq + params.sq_off.ring_mask);
+        ring->sqArray = reinterpret_cast<unsigned *>(sq + params.sq_off.array);
+        ring->cqHead = reinterpret_cast<unsigned *>(cq + params.cq_off.head);
+        ring->cqTail = reinterpret_cast<unsigned *>(cq + params.cq_off.tail);
+        ring->cqMask = reinterpret_cast<unsigned *>(cq + params.cq_off.ring_mask);
+        ring->cqes = reinterpret_cast<io_uring_cqe *>(cq + params.cq_off.cqes);
+        return true;
+    }
+
+    void AsyncFileReader::destroyRing() {
+        if (!ring) {
+            return;
+        }
+        if (ring->sqes != MAP_FAILED) {
+            munmap(ring->sqes, ring->sqesSize);
+        }
+        if (ring->cqRing != MAP_FAILED) {
+            munmap(ring->cqRing, ring->cqRingSize);
+        }
+        if (ring->sqRing != MAP_FAILED) {
+            munmap(ring->sqRing, ring->sqRingSize);
+        }
+        if (ring->wakeupFd >= 0) {
+            ::close(ring->wakeupFd);
+        }
+        ::close(ring->fd);
+        ring.reset();
+    }
+
+    void AsyncFileReader::wakeup() {
+        const uint64_t value = 1;
+        ssize_t written = ::write(ring->wakeupFd, &value, sizeof(value));
+        (void) written;
+    }
+
+    void AsyncFileReader::armWakeup() {
+        // 在eventfd上挂一个读，新请求、取消和退出时写eventfd唤醒等待中的I/O线程
+        const unsigned tail = *ring->sqTail;
+        const unsigned index = tail & *ring->sqMask;
+        io_uring_sqe &sqe = ring->sqes[index];
+        memset(&sqe, 0, sizeof(sqe));
+        sqe.opcode = IORING_OP_READ;
+        sqe.fd = ring->wakeupFd;
+        sqe.addr = reinterpret_cast<uint64_t>(&ring->wakeupValue);
+        sqe.len = sizeof(ring->wakeupValue);
+        sqe.user_data = wakeupUserData;
+        ring->sqArray[index] = index;
+        __atomic_store_n(ring->sqTail, tail + 1, __ATOMIC_RELEASE);
+        ++ring->pendingSubmit;
+    }
+
+    void AsyncFileReader::submitRingRead(Request &request) {
+        const unsigned tail = *ring->sqTail;
+        const unsigned index = tail & *ring->sqMask;
+        io_uring_sqe &sqe = ring->sqes[index];
+        memset(&sqe, 0, sizeof(sqe));
+        sqe.opcode = IORING_OP_READ;
+        sqe.fd = request.fd;
+        sqe.off = request.offset + request.completed;
+        sqe.addr = reinterpret_cast<uint64_t>(request.result.data.data() + request.completed);
+        sqe.len = static_cast<uint32_t>(std::min(maxRingReadSize, request.size - request.completed));
+        sqe.user_data = reinterpret_cast<uint64_t>(&request);
+        ring->sqArray[index] = index;
+        __atomic_store_n(ring->sqTail, tail + 1, __ATOMIC_RELEASE);
+        ++ring->pendingSubmit;
+    }
+
+    bool AsyncFileReader::startRingRequest(const std::shared_ptr<Request> &request) {
+        request->result.status = Status::Failed;
+        if (request->cancelled) {
+            return false;
+        }
+        request->fd = ::open(request->filename.c_str(), O_RDONLY | O_CLOEXEC);
+        if (request->fd < 0) {
+            return false;
+        }
+        struct stat fileStat{};
+        if (fstat(request->fd, &fileStat) != 0 || request->offset > static_cast<uint64_t>(fileStat.st_size)) {
+            return false;
+        }
+        const uint64_t available = static_cast<uint64_t>(fileStat.st_size) - request->offset;
+        request->size = request->size == 0 ? available : std::min(request->size, available);
+        if (request->size == 0) {
+            request->result.status = Status::Success;
+            return false;
+        }
+        request->result.data.resize(request->size);
+        submitRingRead(*request);
+        return true;
+    }
+
+    void AsyncFileReader::ringLoop() {
+        armWakeup();
+        for (;;) {
+            std::vector<std::shared_ptr<Request>> started;
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                if (stopping && inFlight == 0 &&
+                    std::all_of(queues.begin(), queues.end(), [](const auto &queue) { return queue.empty(); })) {
+                    break;
+                }
+                while (inFlight < maxInFlight) {
+                    std::shared_ptr<Request> request = popRequest();
+                    if (!request) {
+                        break;
+                    }
+                    if (stopping) {
+                        request->cancelled = true;
+                    }
+                    ++inFlight;
+                    started.push_back(std::move(request));
+                }
+            }
+
+            // 打开失败、空文件或已取消的请求不进ring，直接完成
+            std::vector<std::shared_ptr<Request>> finished;
+            for (const std::shared_ptr<Request> &request: started) {
+                if (!startRingRequest(request)) {
+                    finished.push_back(request);
+                }
+            }
+
+            // 有直接完成的请求时不等待，处理完回调后马上补充新请求
+            const unsigned minComplete = finished.empty() ? 1 : 0;
+            const int result = static_cast<int>(syscall(__NR_io_uring_enter, ring->fd, ring->pendingSubmit,
+                                                        minComplete, IORING_ENTER_GETEVENTS, nullptr, 0));
+            if (result >= 0) {
+                ring->pendingSubmit -= static_cast<uint32_t>(std::min<int>(result, ring->pendingSubmit));
+            }
+
+            unsigned head = *ring->cqHead;
+            const unsigned tail = __atomic_load_n(ring->cqTail, __ATOMIC_ACQUIRE);
+            for (; head != tail; ++head) {
+                const io_uring_cqe &cqe = ring->cqes[head & *ring->cqMask];
+                if (cqe.user_data == wakeupUserData) {
+                    armWakeup();
+                    continue;
+                }
+                Request &request = *reinterpret_cast<Request *>(cqe.user_data);
+                bool done = true;
+                if (cqe.res == -EINTR || cqe.res == -EAGAIN) {
+                    submitRingRead(request);
+                    done = false;
+                } else if (cqe.res < 0) {
+                    request.result.status = Status::Failed;
+                } else if (cqe.res == 0) {
+                    // 文件在读的过程中被截短
+                    request.result.status = Status::Failed;
+                } else {
+                    request.completed += static_cast<uint64_t>(cqe.res);
+                    if (request.completed < request.size && !request.cancelled) {
+                        submitRingRead(request);
+                        done = false;
+                    } else {
+                        request.result.status = Status::Success;
+                    }
+                }
+                if (done) {
+                    std::lock_guard<std::mutex> lock(mutex);
+                    finished.push_back(requests[request.id]);
+                }
+            }
+            __atomic_store_n(ring->cqHead, head, __ATOMIC_RELEASE);
+
+            if (!finished.empty()) {
+                {
+                    std::lock_guard<std::mutex> lock(mutex);
+                    inFlight -= static_cast<uint32_t>(finished.size());
+                }
+                for (const std::shared_ptr<Request> &request: finished) {
+                    finish(request);
+                }
+            }
+        }
+    }
+#endif
+}
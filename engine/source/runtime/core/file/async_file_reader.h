@@ -0,0 +1,126 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+namespace MW {
+    /*
+        Asynchronous file reader.
+        On Linux reads are submitted through io_uring from a single I/O thread, when io_uring is not available
+        (older kernels, other platforms, or disabled) a few threads issue blocking reads instead.
+        Pending requests are served highest priority first and at most maxInFlight reads run at the same time
+    */
+    class AsyncFileReader {
+    public:
+        enum class Priority : uint32_t {
+            High = 0,   // 阻塞中的加载
+            Normal,     // 贴图流送
+            Low,        // 预取
+            Count
+        };
+
+        enum class Status {
+            Success,
+            Failed,
+            Cancelled
+        };
+
+        struct Result {
+            Status status{Status::Failed};
+            std::vector<unsigned char> data;
+        };
+
+        using RequestId = uint64_t;
+        // 回调在I/O线程上执行，解码等耗时的工作应该再提交到线程池
+        using Callback = std::function<void(Result &result)>;
+
+        // maxInFlight为同时提交的读请求上限
+        explicit AsyncFileReader(uint32_t maxInFlight = 32, bool useIoUring = true);
+
+        ~AsyncFileReader();
+
+        AsyncFileReader(const AsyncFileReader &) = delete;
+
+        AsyncFileReader &operator=(const AsyncFileReader &) = delete;
+
+        // 读取[offset, offset + size)，size为0时读到文件末尾，可以在任意线程调用
+        RequestId read(const std::string &filename, Priority priority, Callback callback, uint64_t offset = 0,
+                       uint64_t size = 0);
+
+        std::future<Result> readFile(const std::string &filename, Priority priority = Priority::Normal);
+
+        // 还没完成的请求以Cancelled回调，已经完成或不存在时返回false
+        bool cancel(RequestId id);
+
+        void setMaxInFlight(uint32_t count);
+
+        bool isUsingIoUring() const { return ring != nullptr; }
+
+        static AsyncFileReader &global();
+
+    private:
+        struct Request {
+            RequestId id{0};
+            std::string filename;
+            uint64_t offset{0};
+            uint64_t size{0};
+            Priority priority{Priority::Normal};
+            Callback callback;
+            int fd{-1};
+            uint64_t completed{0};
+            std::atomic<bool> cancelled{false};
+            Result result;
+        };
+
+        struct Ring;
+
+        // 取出优先级最高的请求，调用时需要持有mutex
+        std::shared_ptr<Request> popRequest();
+
+        void finish(const std::shared_ptr<Request> &request);
+
+        void workerLoop();
+
+        // 同步读取，thread pool后端使用
+        void readBlocking(Request &request);
+
+#if defined(__linux__)
+        bool createRing();
+
+        void destroyRing();
+
+        void ringLoop();
+
+        // 打开文件并提交第一次读，失败时返回false
+        bool startRingRequest(const std::shared_ptr<Request> &request);
+
+        void submitRingRead(Request &request);
+
+        void armWakeup();
+
+        void wakeup();
+#endif
+
+        uint32_t maxInFlight;
+        uint32_t inFlight{0};
+        RequestId nextId{1};
+        bool stopping{false};
+        std::array<std::deque<std::shared_ptr<Request>>, static_cast<size_t>(Priority::Count)> queues;
+        std::unordered_map<RequestId, std::shared_ptr<Request>> requests;
+        std::mutex mutex;
+        std::condition_variable condition;
+        std::vector<std::thread> threads;
+        std::unique_ptr<Ring> ring;
+    };
+}
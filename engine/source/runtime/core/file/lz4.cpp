@@ -0,0 +1,175 @@
+#include "lz4.h"
+
+#include <cstring>
+#include <memory>
+
+namespace MW {
+    namespace {
+        constexpr size_t minMatch = 4;
+        // 最后一个match必须在块结束前12字节开始，最后5字节必须是literal
+        constexpr size_t matchStartLimit = 12;
+        constexpr size_t lastLiterals = 5;
+        constexpr size_t maxOffset = 65535;
+        constexpr uint32_t hashLog = 16;
+
+        uint32_t read32(const uint8_t *p) {
+            uint32_t value;
+            memcpy(&value, p, sizeof(value));
+            return value;
+        }
+
+        uint32_t hashSequence(uint32_t sequence) {
+            return (sequence * 2654435761u) >> (32 - hashLog);
+        }
+
+        // 长度的nibble为15时后面跟255的倍数
+        uint8_t *writeLength(uint8_t *op, size_t length) {
+            while (length >= 255) {
+                *op++ = 255;
+                length -= 255;
+            }
+            *op++ = static_cast<uint8_t>(length);
+            return op;
+        }
+
+        bool readLength(const uint8_t *src, size_t srcSize, size_t &ip, size_t &length) {
+            uint8_t value;
+            do {
+                if (ip >= srcSize) {
+                    return false;
+                }
+                value = src[ip++];
+                length += value;
+            } while (value == 255);
+            return true;
+        }
+    }
+
+    size_t lz4CompressBound(size_t size) {
+        return size + size / 255 + 16;
+    }
+
+    size_t lz4Compress(const uint8_t *src, size_t srcSize, uint8_t *dst, size_t dstCapacity) {
+        uint8_t *op = dst;
+        uint8_t *const opEnd = dst + dstCapacity;
+
+        auto emit = [&](size_t literalStart, size_t literalLength, size_t offset, size_t matchLength) -> bool {
+            const size_t required = 1 + literalLength / 255 + 1 + literalLength + 2 + matchLength / 255 + 1;
+            if (static_cast<size_t>(opEnd - op) < required) {
+                return false;
+            }
+            uint8_t *token = op++;
+            *token = static_cast<uint8_t>((literalLength < 15 ? literalLength : 15) << 4);
+            if (literalLength >= 15) {
+                op = writeLength(op, literalLength - 15);
+            }
+            if (literalLength > 0) {
+                memcpy(op, src + literalStart, literalLength);
+                op += literalLength;
+            }
+            if (matchLength == 0) {
+                return true;
+            }
+            *op++ = static_cast<uint8_t>(offset);
+            *op++ = static_cast<uint8_t>(offset >> 8);
+            const size_t matchCode = matchLength - minMatch;
+            *token |= static_cast<uint8_t>(matchCode < 15 ? matchCode : 15);
+            if (matchCode >= 15) {
+                op = writeLength(op, matchCode - 15);
+            }
+            return true;
+        };
+
+        size_t anchor = 0;
+        if (srcSize > matchStartLimit) {
+            // 表中存位置+1，0表示空
+            std::unique_ptr<uint32_t[]> table(new uint32_t[1u << hashLog]());
+            const size_t ipLimit = srcSize - matchStartLimit;
+            const size_t matchLimit = srcSize - lastLiterals;
+            size_t ip = 0;
+            while (ip < ipLimit) {
+                const uint32_t sequence = read32(src + ip);
+                const uint32_t hash = hashSequence(sequence);
+                const size_t candidate = table[hash];
+                table[hash] = static_cast<uint32_t>(ip + 1);
+                if (candidate == 0 || ip - (candidate - 1) > maxOffset || read32(src + candidate - 1) != sequence) {
+                    ++ip;
+                    continue;
+                }
+                size_t ref = candidate - 1;
+                // 向前扩展到上一个序列的结尾
+                while (ip > anchor && ref > 0 && src[ip - 1] == src[ref - 1]) {
+                    --ip;
+                    --ref;
+                }
+                size_t matchLength = minMatch;
+                while (ip + matchLength < matchLimit && src[ip + matchLength] == src[ref + matchLength]) {
+                    ++matchLength;
+                }
+                if (!emit(anchor, ip - anchor, ip - ref, matchLength)) {
+                    return 0;
+                }
+                ip += matchLength;
+                anchor = ip;
+                // match中间的位置也放进表里，提高后续命中率
+                if (ip < ipLimit) {
+                    table[hashSequence(read32(src + ip - 2))] = static_cast<uint32_t>(ip - 2 + 1);
+                }
+            }
+        }
+        if (!emit(anchor, srcSize - anchor, 0, 0)) {
+            return 0;
+        }
+        return static_cast<size_t>(op - dst);
+    }
+
+    bool lz4Decompress(const uint8_t *src, size_t srcSize, uint8_t *dst, size_t dstSize) {
+        size_t ip = 0, op = 0;
+        while (ip < srcSize) {
+            const uint8_t token = src[ip++];
+            size_t literalLength = token >> 4;
+            if (literalLength == 15 && !readLength(src, srcSize, ip, literalLength)) {
+                return false;
+            }
+            if (literalLength > srcSize - ip || literalLength > dstSize - op) {
+                return false;
+            }
+            if (literalLength > 0) {
+                memcpy(dst + op, src + ip, literalLength);
+            }
+            ip += literalLength;
+            op += literalLength;
+            // 最后一个序列只有literal
+            if (ip == srcSize) {
+                break;
+            }
+            if (srcSize - ip < 2) {
+                return false;
+            }
+            const size_t offset = static_cast<size_t>(src[ip]) | static_cast<size_t>(src[ip + 1]) << 8;
+            ip += 2;
+            if (offset == 0 || offset > op) {
+                return false;
+            }
+            size_t matchLength = token & 15;
+            if (matchLength == 15 && !readLength(src, srcSize, ip, matchLength)) {
+                return false;
+            }
+            matchLength += minMatch;
+            if (matchLength > dstSize - op) {
+                return false;
+            }
+            const uint8_t *match = dst + op - offset;
+            if (offset >= matchLength) {
+                memcpy(dst + op, match, matchLength);
+            } else {
+                // 重叠的match需要逐字节复制
+                for (size_t i = 0; i < matchLength; ++i) {
+                    dst[op + i] = match[i];
+                }
+            }
+            op += matchLength;
+        }
+        return op == dstSize;
+    }
+}
@@ -0,0 +1,17 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+namespace MW {
+    // LZ4 block格式，和官方lz4的LZ4_compress_default/LZ4_decompress_safe互相兼容
+
+    // 最坏情况下压缩结果的大小
+    size_t lz4CompressBound(size_t size);
+
+    // 返回压缩后的大小，dstCapacity不够时返回0
+    size_t lz4Compress(const uint8_t *src, size_t srcSize, uint8_t *dst, size_t dstCapacity);
+
+    // 解压结果必须正好是dstSize，数据损坏时返回false而不会越界读写
+    bool lz4Decompress(const uint8_t *src, size_t srcSize, uint8_t *dst, size_t dstSize);
+}
@@ -0,0 +1,123 @@
+#include "mapped_file.h"
+
+#include <utility>
+
+#if defined(_WIN32)
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace MW {
+    MappedFile::~MappedFile() {
+        close();
+    }
+
+    MappedFile::MappedFile(MappedFile &&other) noexcept {
+        *this = std::move(other);
+    }
+
+    MappedFile &MappedFile::operator=(MappedFile &&other) noexcept {
+        if (this != &other) {
+            close();
+            std::swap(mappedData, other.mappedData);
+            std::swap(fileSize, other.fileSize);
+            std::swap(opened, other.opened);
+#if defined(_WIN32)
+            std::swap(fileHandle, other.fileHandle);
+            std::swap(mappingHandle, other.mappingHandle);
+#endif
+        }
+        return *this;
+    }
+
+    bool MappedFile::open(const std::string &filename) {
+        close();
+#if defined(_WIN32)
+        HANDLE file = CreateFileA(filename.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING,
+                                  FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+        if (file == INVALID_HANDLE_VALUE) {
+            return false;
+        }
+        LARGE_INTEGER size;
+        if (!GetFileSizeEx(file, &size)) {
+            CloseHandle(file);
+            return false;
+        }
+        fileHandle = file;
+        fileSize = static_cast<size_t>(size.QuadPart);
+        opened = true;
+        if (fileSize == 0) {
+            // 空文件无法建立映射
+            return true;
+        }
+        HANDLE mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+        if (mapping == nullptr) {
+            close();
+            return false;
+        }
+        mappingHandle = mapping;
+        mappedData = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+        if (mappedData == nullptr) {
+            close();
+            return false;
+        }
+#else
+        int fd = ::open(filename.c_str(), O_RDONLY);
+        if (fd < 0) {
+            return false;
+        }
+        struct stat st{};
+        if (fstat(fd, &st) != 0) {
+            ::close(fd);
+            return false;
+        }
+        fileSize = static_cast<size_t>(st.st_size);
+        opened = true;
+        if (fileSize == 0) {
+            ::close(fd);
+            return true;
+        }
+        void *data = mmap(nullptr, fileSize, PROT_READ, MAP_PRIVATE, fd, 0);
+        // 映射建立后文件描述符可以直接关闭
+        ::close(fd);
+        if (data == MAP_FAILED) {
+            fileSize = 0;
+            opened = false;
+            return false;
+        }
+        madvise(data, fileSize, MADV_SEQUENTIAL);
+        mappedData = data;
+#endif
+        return true;
+    }
+
+    void MappedFile::close() {
+#if defined(_WIN32)
+        if (mappedData) {
+            UnmapViewOfFile(mappedData);
+        }
+        if (mappingHandle) {
+            CloseHandle(static_cast<HANDLE>(mappingHandle));
+        }
+        if (fileHandle) {
+            CloseHandle(static_cast<HANDLE>(fileHandle));
+        }
+        mappingHandle = nullptr;
+        fileHandle = nullptr;
+#else
+        if (mappedData) {
+            munmap(mappedData, fileSize);
+        }
+#endif
+        mappedData = nullptr;
+        fileSize = 0;
+        opened = false;
+    }
+}
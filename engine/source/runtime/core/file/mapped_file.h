@@ -0,0 +1,44 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+namespace MW {
+    /*
+        Read-only memory mapped file
+    */
+    class MappedFile {
+    public:
+        MappedFile() = default;
+
+        ~MappedFile();
+
+        MappedFile(const MappedFile &) = delete;
+
+        MappedFile &operator=(const MappedFile &) = delete;
+
+        MappedFile(MappedFile &&other) noexcept;
+
+        MappedFile &operator=(MappedFile &&other) noexcept;
+
+        bool open(const std::string &filename);
+
+        void close();
+
+        bool isOpen() const { return mappedData != nullptr || (fileSize == 0 && opened); }
+
+        const uint8_t *data() const { return static_cast<const uint8_t *>(mappedData); }
+
+        size_t size() const { return fileSize; }
+
+    private:
+        void *mappedData{nullptr};
+        size_t fileSize{0};
+        bool opened{false};
+#if defined(_WIN32)
+        void *fileHandle{nullptr};
+        void *mappingHandle{nullptr};
+#endif
+    };
+}
@@ -0,0 +1,118 @@
+#include "virtual_file_system.h"
+
+#include <fstream>
+#include <iostream>
+#include <mutex>
+
+namespace MW {
+    void VirtualFile::close() {
+        mapped.close();
+        buffer.clear();
+        buffer.shrink_to_fit();
+        archive.reset();
+        view = nullptr;
+        viewSize = 0;
+        opened = false;
+    }
+
+    VirtualFileSystem &VirtualFileSystem::global() {
+        static VirtualFileSystem fileSystem;
+        return fileSystem;
+    }
+
+    bool VirtualFileSystem::mountArchive(const std::string &archiveFile, const std::string &mountPoint) {
+        auto archive = std::make_shared<AssetArchive>();
+        if (!archive->open(archiveFile)) {
+            return false;
+        }
+        std::unique_lock<std::shared_mutex> lock(mutex);
+        mounts.insert(mounts.begin(), {normalizeArchivePath(mountPoint), std::move(archive)});
+        return true;
+    }
+
+    void VirtualFileSystem::unmountAll() {
+        std::unique_lock<std::shared_mutex> lock(mutex);
+        mounts.clear();
+    }
+
+    const ArchiveEntry *VirtualFileSystem::findEntry(const std::string &path,
+                                                     std::shared_ptr<const AssetArchive> &archive) const {
+        std::shared_lock<std::shared_mutex> lock(mutex);
+        if (mounts.empty()) {
+            return nullptr;
+        }
+        const std::string normalized = normalizeArchivePath(path);
+        for (const Mount &mount: mounts) {
+            const std::string &prefix = mount.mountPoint;
+            if (!prefix.empty() && (normalized.compare(0, prefix.size(), prefix) != 0 ||
+                                    normalized.size() <= prefix.size() || normalized[prefix.size()] != '/')) {
+                continue;
+            }
+            const ArchiveEntry *entry = mount.archive->find(
+                    prefix.empty() ? normalized : normalized.substr(prefix.size() + 1));
+            if (entry) {
+                archive = mount.archive;
+                return entry;
+            }
+        }
+        return nullptr;
+    }
+
+    bool VirtualFileSystem::open(const std::string &path, VirtualFile &file) const {
+        file.close();
+        std::shared_ptr<const AssetArchive> archive;
+        if (const ArchiveEntry *entry = findEntry(path, archive)) {
+            if (const uint8_t *data = archive->getMappedData(*entry)) {
+                file.archive = std::move(archive);
+                file.view = data;
+            } else {
+                file.buffer.resize(entry->size);
+                if (!archive->read(*entry, file.buffer.data())) {
+                    std::cerr << "Could not decompress \"" << path << "\" from archive" << std::endl;
+                    file.close();
+                    return false;
+                }
+                file.view = file.buffer.data();
+            }
+            file.viewSize = entry->size;
+            file.opened = true;
+            return true;
+        }
+        if (!file.mapped.open(path)) {
+            return false;
+        }
+        file.view = file.mapped.data();
+        file.viewSize = file.mapped.size();
+        file.opened = true;
+        return true;
+    }
+
+    bool VirtualFileSystem::readFile(const std::string &path, std::vector<uint8_t> &data) const {
+        std::shared_ptr<const AssetArchive> archive;
+        if (const ArchiveEntry *entry = findEntry(path, archive)) {
+            data.resize(entry->size);
+            return archive->read(*entry, data.data());
+        }
+        std::ifstream file(path, std::ios::binary | std::ios::ate);
+        if (!file) {
+            return false;
+        }
+        data.resize(static_cast<size_t>(file.tellg()));
+        file.seekg(0);
+        file.read(reinterpret_cast<char *>(data.data()), static_cast<std::streamsize>(data.size()));
+        return static_cast<bool>(file);
+    }
+
+    bool VirtualFileSystem::exists(const std::string &path) const {
+        if (isArchived(path)) {
+            return true;
+        }
+        std::ifstream file(path);
+        return !file.fail();
+    }
+
+    bool VirtualFileSystem::isArchived(const std::string &path) const {
+        std::shared_ptr<const AssetArchive> archive;
+        return findEntry(path, archive) != nullptr;
+    }
+}
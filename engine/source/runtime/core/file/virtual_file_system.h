@@ -0,0 +1,72 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <shared_mutex>
+#include <string>
+#include <vector>
+
+#include "core/file/asset_archive.h"
+#include "core/file/mapped_file.h"
+
+namespace MW {
+    /*
+        Contents of a file opened through VirtualFileSystem, either a mapped loose file,
+        an uncompressed archive entry used in place, or a decompressed archive entry
+    */
+    class VirtualFile {
+    public:
+        const uint8_t *data() const { return view; }
+
+        size_t size() const { return viewSize; }
+
+        bool isOpen() const { return opened; }
+
+        void close();
+
+    private:
+        friend class VirtualFileSystem;
+
+        MappedFile mapped;
+        std::vector<uint8_t> buffer;
+        // 直接使用归档映射的数据时保持归档打开
+        std::shared_ptr<const AssetArchive> archive;
+        const uint8_t *view{nullptr};
+        size_t viewSize{0};
+        bool opened{false};
+    };
+
+    /*
+        Resolves asset paths against mounted archives before falling back to loose files.
+        An archive mounted at mountPoint serves every path below it, archives mounted later take precedence
+    */
+    class VirtualFileSystem {
+    public:
+        bool mountArchive(const std::string &archiveFile, const std::string &mountPoint);
+
+        void unmountAll();
+
+        bool open(const std::string &path, VirtualFile &file) const;
+
+        bool readFile(const std::string &path, std::vector<uint8_t> &data) const;
+
+        bool exists(const std::string &path) const;
+
+        // 在已挂载的归档中，读取不涉及磁盘上的散文件
+        bool isArchived(const std::string &path) const;
+
+        static VirtualFileSystem &global();
+
+    private:
+        struct Mount {
+            std::string mountPoint;
+            std::shared_ptr<AssetArchive> archive;
+        };
+
+        // 返回归档和其中的条目，找不到时archive为空
+        const ArchiveEntry *findEntry(const std::string &path, std::shared_ptr<const AssetArchive> &archive) const;
+
+        std::vector<Mount> mounts;
+        mutable std::shared_mutex mutex;
+    };
+}
@@ -4,11 +4,18 @@
 #include "function/render/render_system.h"
 #include "function/render/scene_manager.h"
 #include "function/input/input_system.h"
+#include "function/render/rhi/vulkan_util.h"
+#include "core/file/virtual_file_system.h"
 
 namespace MW {
     EngineGlobalContext engineGlobalContext;
 
     void EngineGlobalContext::initialize() {
+        // 资源目录下有打包好的归档时优先从归档读取
+        const std::string archiveFile = getAssetPath() + "assets.mwpak";
+        if (fileExists(archiveFile)) {
+            VirtualFileSystem::global().mountArchive(archiveFile, getAssetPath());
+        }
         windowSystem = std::make_shared<WindowSystem>();
         WindowCreateInfo windowInfo;
         windowSystem->initialize(windowInfo);
@@ -26,6 +33,7 @@ namespace MW {
         renderSystem->clean();
         renderSystem.reset();
         windowSystem.reset();
+        VirtualFileSystem::global().unmountAll();
     }
 
     std::shared_ptr<SceneManager> EngineGlobalContext::getScene() {
@@ -0,0 +1,173 @@
+#include "gltf_accessor.h"
+
+#include <algorithm>
+#include <iostream>
+#include <vector>
+
+#include "function/render/meshopt_decoder.h"
+#include "core/base/thread_pool.h"
+
+namespace MW {
+    GltfAccessor::GltfAccessor(const tinygltf::Model &model, int accessorIndex) {
+        if (accessorIndex < 0 || accessorIndex >= static_cast<int>(model.accessors.size())) {
+            return;
+        }
+        const tinygltf::Accessor &accessor = model.accessors[accessorIndex];
+        const int components = tinygltf::GetNumComponentsInType(static_cast<uint32_t>(accessor.type));
+        const int size = tinygltf::GetComponentSizeInBytes(static_cast<uint32_t>(accessor.componentType));
+        if (components <= 0 || size <= 0 || accessor.count == 0) {
+            return;
+        }
+        componentCount = static_cast<uint32_t>(components);
+        componentSize = static_cast<uint32_t>(size);
+        componentType = accessor.componentType;
+        normalized = accessor.normalized;
+        if (accessor.bufferView < 0) {
+            count = accessor.count;
+            return;
+        }
+        const tinygltf::BufferView &view = model.bufferViews[accessor.bufferView];
+        const int byteStride = accessor.ByteStride(view);
+        if (byteStride <= 0 || view.buffer < 0 || view.buffer >= static_cast<int>(model.buffers.size())) {
+            std::cerr << "Invalid accessor " << accessorIndex << std::endl;
+            return;
+        }
+        // 最后一个元素也必须在bufferView和buffer之内
+        const tinygltf::Buffer &buffer = model.buffers[view.buffer];
+        const size_t elementSize = componentSize * componentCount;
+        const size_t end = accessor.byteOffset + static_cast<size_t>(byteStride) * (accessor.count - 1) + elementSize;
+        if (end > view.byteLength || view.byteOffset + view.byteLength > buffer.data.size()) {
+            std::cerr << "Accessor " << accessorIndex << " is out of range of its buffer" << std::endl;
+            return;
+        }
+        data = buffer.data.data() + view.byteOffset + accessor.byteOffset;
+        stride = static_cast<size_t>(byteStride);
+        count = accessor.count;
+    }
+
+    float GltfAccessor::readComponent(const uint8_t *component) const {
+        switch (componentType) {
+            case TINYGLTF_COMPONENT_TYPE_BYTE: {
+                const float value = static_cast<float>(static_cast<int8_t>(*component));
+                return normalized ? std::max(value / 127.0f, -1.0f) : value;
+            }
+            case TINYGLTF_COMPONENT_TYPE_UNSIGNED_BYTE: {
+                const float value = static_cast<float>(*component);
+                return normalized ? value / 255.0f : value;
+            }
+            case TINYGLTF_COMPONENT_TYPE_SHORT: {
+                int16_t raw;
+                memcpy(&raw, component, sizeof(raw));
+                const float value = static_cast<float>(raw);
+                return normalized ? std::max(value / 32767.0f, -1.0f) : value;
+            }
+            case TINYGLTF_COMPONENT_TYPE_UNSIGNED_SHORT: {
+                uint16_t raw;
+                memcpy(&raw, component, sizeof(raw));
+                const float value = static_cast<float>(raw);
+                return normalized ? value / 65535.0f : value;
+            }
+            case TINYGLTF_COMPONENT_TYPE_UNSIGNED_INT: {
+                uint32_t raw;
+                memcpy(&raw, component, sizeof(raw));
+                return static_cast<float>(raw);
+            }
+            case TINYGLTF_COMPONENT_TYPE_FLOAT: {
+                float value;
+                memcpy(&value, component, sizeof(value));
+                return value;
+            }
+            default:
+                return 0.0f;
+        }
+    }
+
+    bool decodeMeshoptBufferViews(tinygltf::Model &model, std::string &error) {
+        struct CompressedView {
+            int view;
+            const uint8_t *data;
+            size_t size;
+            size_t count;
+            size_t stride;
+            std::string mode;
+            MeshoptFilter filter;
+            size_t offset;
+        };
+        std::vector<CompressedView> views;
+        size_t decodedSize = 0;
+        for (size_t i = 0; i < model.bufferViews.size(); i++) {
+            const tinygltf::BufferView &view = model.bufferViews[i];
+            auto extension = view.extensions.find("EXT_meshopt_compression");
+            if (extension == view.extensions.end()) {
+                continue;
+            }
+            const tinygltf::Value &value = extension->second;
+            auto getNumber = [&value](const char *name) -> size_t {
+                return value.Has(name) && value.Get(name).IsNumber()
+                       ? static_cast<size_t>(value.Get(name).GetNumberAsInt()) : 0;
+            };
+            const int bufferIndex = value.Has("buffer") ? value.Get("buffer").GetNumberAsInt() : -1;
+            CompressedView compressed{};
+            compressed.view = static_cast<int>(i);
+            compressed.size = getNumber("byteLength");
+            compressed.count = getNumber("count");
+            compressed.stride = getNumber("byteStride");
+            compressed.mode = value.Has("mode") ? value.Get("mode").Get<std::string>() : std::string();
+            const std::string filter = value.Has("filter") ? value.Get("filter").Get<std::string>() : "NONE";
+            compressed.filter = filter == "OCTAHEDRAL" ? MeshoptFilter::Octahedral
+                                : filter == "QUATERNION" ? MeshoptFilter::Quaternion
+                                : filter == "EXPONENTIAL" ? MeshoptFilter::Exponential : MeshoptFilter::None;
+            const size_t byteOffset = getNumber("byteOffset");
+            if (bufferIndex < 0 || bufferIndex >= static_cast<int>(model.buffers.size()) ||
+                byteOffset + compressed.size > model.buffers[bufferIndex].data.size() || compressed.stride == 0) {
+                error = "Invalid EXT_meshopt_compression buffer view " + std::to_string(i);
+                return false;
+            }
+            compressed.data = model.buffers[bufferIndex].data.data() + byteOffset;
+            // 解码结果按4字节对齐放进同一个buffer
+            compressed.offset = decodedSize;
+            decodedSize += (compressed.count * compressed.stride + 3) & ~size_t(3);
+            views.push_back(compressed);
+        }
+        if (views.empty()) {
+            return true;
+        }
+
+        tinygltf::Buffer decoded;
+        decoded.data.resize(decodedSize);
+        std::vector<char> results(views.size(), 0);
+        ThreadPool::global().parallelFor(static_cast<uint32_t>(views.size()), [&](uint32_t i) {
+            const CompressedView &view = views[i];
+            uint8_t *destination = decoded.data.data() + view.offset;
+            if (view.mode == "ATTRIBUTES") {
+                results[i] = decodeMeshoptVertexBuffer(destination, view.count, view.stride, view.data, view.size) &&
+                             applyMeshoptFilter(view.filter, destination, view.count, view.stride);
+            } else if (view.mode == "TRIANGLES") {
+                results[i] = decodeMeshoptIndexBuffer(destination, view.count, view.stride, view.data, view.size);
+            } else if (view.mode == "INDICES") {
+                results[i] = decodeMeshoptIndexSequence(destination, view.count, view.stride, view.data, view.size);
+            }
+        });
+        for (size_t i = 0; i < views.size(); i++) {
+            if (!results[i]) {
+                error = "Could not decode EXT_meshopt_compression buffer view " + std::to_string(views[i].view);
+                return false;
+            }
+        }
+
+        // 和fallback buffer一样标记为不对应任何文件，模型缓存据此跳过
+        tinygltf::Value::Object marker;
+        marker["fallback"] = tinygltf::Value(true);
+        decoded.extensions["EXT_meshopt_compression"] = tinygltf::Value(std::move(marker));
+        const int decodedBuffer = static_cast<int>(model.buffers.size());
+        model.buffers.push_back(std::move(decoded));
+        for (const CompressedView &compressed: views) {
+            tinygltf::BufferView &view = model.bufferViews[compressed.view];
+            view.buffer = decodedBuffer;
+            view.byteOffset = compressed.offset;
+            view.byteLength = compressed.count * compressed.stride;
+            view.extensions.erase("EXT_meshopt_compression");
+        }
+        return true;
+    }
+}
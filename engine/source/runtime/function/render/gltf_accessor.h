@@ -0,0 +1,91 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <string>
+
+// tiny_gltf.h的实现部分没有include guard，统一通过render_model.h包含
+#include "function/render/render_model.h"
+
+namespace MW {
+    /*
+        Reads a glTF accessor of any component type, including the normalized and integer
+        attributes allowed by KHR_mesh_quantization, honoring the buffer view stride.
+        Values are always expanded to float: there is no compact vertex format yet and
+        every pipeline, the meshlet builder and the model cache consume gltfVertex
+    */
+    class GltfAccessor {
+    public:
+        GltfAccessor() = default;
+
+        // accessorIndex为-1或数据越界时isValid()为false
+        GltfAccessor(const tinygltf::Model &model, int accessorIndex);
+
+        bool isValid() const { return count > 0; }
+
+        size_t getCount() const { return count; }
+
+        uint32_t getComponentCount() const { return componentCount; }
+
+        int getComponentType() const { return componentType; }
+
+        // normalized的整数映射到[0,1]或[-1,1]，其他整数按数值转换，accessor没有的分量取fallback
+        glm::vec4 read(size_t index, const glm::vec4 &fallback = glm::vec4(0.0f)) const {
+            glm::vec4 result = fallback;
+            if (!data) {
+                // 没有bufferView的accessor内容全为0
+                for (uint32_t c = 0; c < componentCount && c < 4; ++c) {
+                    result[c] = 0.0f;
+                }
+                return result;
+            }
+            const uint8_t *element = data + index * stride;
+            if (componentType == TINYGLTF_COMPONENT_TYPE_FLOAT) {
+                memcpy(&result, element, sizeof(float) * (componentCount < 4 ? componentCount : 4));
+                return result;
+            }
+            for (uint32_t c = 0; c < componentCount && c < 4; ++c) {
+                result[c] = readComponent(element + c * componentSize);
+            }
+            return result;
+        }
+
+        // 按无符号整数读取第一个分量，用于索引
+        uint32_t readIndex(size_t index) const {
+            if (!data) {
+                return 0;
+            }
+            const uint8_t *element = data + index * stride;
+            switch (componentType) {
+                case TINYGLTF_COMPONENT_TYPE_UNSIGNED_BYTE:
+                    return *element;
+                case TINYGLTF_COMPONENT_TYPE_UNSIGNED_SHORT: {
+                    uint16_t value;
+                    memcpy(&value, element, sizeof(value));
+                    return value;
+                }
+                case TINYGLTF_COMPONENT_TYPE_UNSIGNED_INT: {
+                    uint32_t value;
+                    memcpy(&value, element, sizeof(value));
+                    return value;
+                }
+                default:
+                    return 0;
+            }
+        }
+
+    private:
+        float readComponent(const uint8_t *component) const;
+
+        const uint8_t *data{nullptr};
+        size_t stride{0};
+        size_t count{0};
+        uint32_t componentCount{0};
+        uint32_t componentSize{0};
+        int componentType{0};
+        bool normalized{false};
+    };
+
+    // 把EXT_meshopt_compression压缩的bufferView解码到新的buffer中并去掉扩展，之后按普通bufferView读取
+    bool decodeMeshoptBufferViews(tinygltf::Model &model, std::string &error);
+}
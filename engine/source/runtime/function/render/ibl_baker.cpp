@@ -0,0 +1,428 @@
+#include "ibl_baker.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <vector>
+
+#define GLM_FORCE_RADIANS
+#define GLM_FORCE_DEPTH_ZERO_TO_ONE
+
+#include "glm/glm.hpp"
+#include "glm/gtc/matrix_transform.hpp"
+#include "glm/gtc/packing.hpp"
+
+#include "ktx.h"
+#include "core/base/hash.h"
+#include "core/base/thread_pool.h"
+#include "core/file/virtual_file_system.h"
+
+namespace MW {
+    namespace {
+        // 生成算法(shader和这里的CPU实现)修改时增加kBakeVersion
+        constexpr uint32_t kBakeVersion = 2;
+        constexpr uint32_t kCubeDim = IBL_CUBE_DIM;
+        constexpr uint32_t kPrefilterSamples = IBL_PREFILTER_SAMPLES;
+        constexpr uint32_t kLutDim = IBL_LUT_DIM;
+        constexpr uint32_t kLutSamples = IBL_LUT_SAMPLES;
+        constexpr float kPi = 3.1415926536f;
+        constexpr float kIrradianceDeltaPhi = 2.0f * kPi / 180.0f;
+        constexpr float kIrradianceDeltaTheta = 0.5f * kPi / 64.0f;
+
+        constexpr uint32_t kGlHalfFloat = 0x140B;
+        constexpr uint32_t kGlRg = 0x8227;
+        constexpr uint32_t kGlRgba = 0x1908;
+        constexpr uint32_t kGlRg16f = 0x822F;
+        constexpr uint32_t kGlRgba16f = 0x881A;
+        constexpr uint32_t kGlRgba32f = 0x8814;
+
+        struct CubeImage {
+            uint32_t dim{0};
+            uint32_t levelCount{0};
+            // 下标为level * 6 + face
+            std::vector<std::vector<glm::vec4>> faces;
+
+            const std::vector<glm::vec4> &face(uint32_t level, uint32_t face) const {
+                return faces[level * 6 + face];
+            }
+        };
+
+        bool readEnvironmentMap(const std::string &filename, CubeImage &cube) {
+            VirtualFile file;
+            if (!VirtualFileSystem::global().open(filename, file)) {
+                std::cerr << "Could not open environment map \"" << filename << "\"" << std::endl;
+                return false;
+            }
+            ktxTexture *texture = nullptr;
+            if (ktxTexture_CreateFromMemory(file.data(), file.size(), KTX_TEXTURE_CREATE_LOAD_IMAGE_DATA_BIT,
+                                            &texture) != KTX_SUCCESS) {
+                return false;
+            }
+            const bool half = texture->glInternalformat == kGlRgba16f;
+            if (texture->numFaces != 6 || texture->baseWidth != texture->baseHeight ||
+                (!half && texture->glInternalformat != kGlRgba32f)) {
+                ktxTexture_Destroy(texture);
+                return false;
+            }
+            cube.dim = texture->baseWidth;
+            cube.levelCount = texture->numLevels;
+            cube.faces.resize(cube.levelCount * 6);
+            for (uint32_t level = 0; level < cube.levelCount; level++) {
+                const uint32_t dim = std::max(1u, cube.dim >> level);
+                for (uint32_t face = 0; face < 6; face++) {
+                    ktx_size_t offset = 0;
+                    ktxTexture_GetImageOffset(texture, level, 0, face, &offset);
+                    const uint8_t *src = ktxTexture_GetData(texture) + offset;
+                    std::vector<glm::vec4> &pixels = cube.faces[level * 6 + face];
+                    pixels.resize(dim * dim);
+                    for (uint32_t i = 0; i < dim * dim; i++) {
+                        if (half) {
+                            uint16_t value[4];
+                            memcpy(value, src + i * sizeof(value), sizeof(value));
+                            pixels[i] = glm::vec4(glm::unpackHalf1x16(value[0]), glm::unpackHalf1x16(value[1]),
+                                                  glm::unpackHalf1x16(value[2]), glm::unpackHalf1x16(value[3]));
+                        } else {
+                            memcpy(&pixels[i], src + i * sizeof(glm::vec4), sizeof(glm::vec4));
+                        }
+                    }
+                }
+            }
+            ktxTexture_Destroy(texture);
+            return true;
+        }
+
+        // Vulkan规范中立方体贴图的面选择
+        void directionToFace(const glm::vec3 &r, uint32_t &face, float &u, float &v) {
+            const glm::vec3 a = glm::abs(r);
+            float sc, tc, ma;
+            if (a.x >= a.y && a.x >= a.z) {
+                face = r.x >= 0.0f ? 0 : 1;
+                sc = r.x >= 0.0f ? -r.z : r.z;
+                tc = -r.y;
+                ma = a.x;
+            } else if (a.y >= a.z) {
+                face = r.y >= 0.0f ? 2 : 3;
+                sc = r.x;
+                tc = r.y >= 0.0f ? r.z : -r.z;
+                ma = a.y;
+            } else {
+                face = r.z >= 0.0f ? 4 : 5;
+                sc = r.z >= 0.0f ? r.x : -r.x;
+                tc = -r.y;
+                ma = a.z;
+            }
+            u = 0.5f * (sc / ma + 1.0f);
+            v = 0.5f * (tc / ma + 1.0f);
+        }
+
+        // 面内双线性过滤，边缘clamp
+        glm::vec3 sampleFace(const CubeImage &cube, uint32_t level, uint32_t face, float u, float v) {
+            const int dim = static_cast<int>(std::max(1u, cube.dim >> level));
+            const std::vector<glm::vec4> &pixels = cube.face(level, face);
+            const float x = u * dim - 0.5f, y = v * dim - 0.5f;
+            const int x0 = static_cast<int>(std::floor(x)), y0 = static_cast<int>(std::floor(y));
+            const float fx = x - x0, fy = y - y0;
+            auto texel = [&](int tx, int ty) -> glm::vec3 {
+                tx = std::min(std::max(tx, 0), dim - 1);
+                ty = std::min(std::max(ty, 0), dim - 1);
+                return glm::vec3(pixels[ty * dim + tx]);
+            };
+            return glm::mix(glm::mix(texel(x0, y0), texel(x0 + 1, y0), fx),
+                            glm::mix(texel(x0, y0 + 1), texel(x0 + 1, y0 + 1), fx), fy);
+        }
+
+        // 相当于textureLod，mip之间线性插值
+        glm::vec3 sampleCube(const CubeImage &cube, const glm::vec3 &direction, float lod) {
+            uint32_t face;
+            float u, v;
+            directionToFace(direction, face, u, v);
+            lod = std::min(std::max(lod, 0.0f), static_cast<float>(cube.levelCount - 1));
+            const uint32_t level0 = static_cast<uint32_t>(lod);
+            const uint32_t level1 = std::min(level0 + 1, cube.levelCount - 1);
+            const glm::vec3 color0 = sampleFace(cube, level0, face, u, v);
+            if (level1 == level0) {
+                return color0;
+            }
+            return glm::mix(color0, sampleFace(cube, level1, face, u, v), lod - level0);
+        }
+
+        // CubePass渲染每个面时使用的旋转，帧缓冲的像素直接拷贝到对应面的texel
+        const std::vector<glm::mat3> &getFaceRotations() {
+            static const std::vector<glm::mat3> rotations = {
+                    glm::mat3(glm::rotate(glm::rotate(glm::mat4(1.0f), glm::radians(90.0f), glm::vec3(0.0f, 1.0f, 0.0f)),
+                                          glm::radians(180.0f), glm::vec3(1.0f, 0.0f, 0.0f))),
+                    glm::mat3(glm::rotate(glm::rotate(glm::mat4(1.0f), glm::radians(-90.0f), glm::vec3(0.0f, 1.0f, 0.0f)),
+                                          glm::radians(180.0f), glm::vec3(1.0f, 0.0f, 0.0f))),
+                    glm::mat3(glm::rotate(glm::mat4(1.0f), glm::radians(-90.0f), glm::vec3(1.0f, 0.0f, 0.0f))),
+                    glm::mat3(glm::rotate(glm::mat4(1.0f), glm::radians(90.0f), glm::vec3(1.0f, 0.0f, 0.0f))),
+                    glm::mat3(glm::rotate(glm::mat4(1.0f), glm::radians(180.0f), glm::vec3(1.0f, 0.0f, 0.0f))),
+                    glm::mat3(glm::rotate(glm::mat4(1.0f), glm::radians(180.0f), glm::vec3(0.0f, 0.0f, 1.0f))),
+            };
+            return rotations;
+        }
+
+        // 90度透视投影下像素中心对应的方向，Vulkan的NDC中y向下
+        glm::vec3 texelDirection(uint32_t face, uint32_t x, uint32_t y, uint32_t dim) {
+            const glm::vec3 view((x + 0.5f) / dim * 2.0f - 1.0f, (y + 0.5f) / dim * 2.0f - 1.0f, -1.0f);
+            return glm::normalize(glm::transpose(getFaceRotations()[face]) * view);
+        }
+
+        float random(const glm::vec2 &co) {
+            const float dt = glm::dot(co, glm::vec2(12.9898f, 78.233f));
+            const float sn = dt - 3.14f * std::floor(dt / 3.14f);
+            return glm::fract(std::sin(sn) * 43758.5453f);
+        }
+
+        glm::vec2 hammersley2d(uint32_t i, uint32_t n) {
+            uint32_t bits = (i << 16u) | (i >> 16u);
+            bits = ((bits & 0x55555555u) << 1u) | ((bits & 0xAAAAAAAAu) >> 1u);
+            bits = ((bits & 0x33333333u) << 2u) | ((bits & 0xCCCCCCCCu) >> 2u);
+            bits = ((bits & 0x0F0F0F0Fu) << 4u) | ((bits & 0xF0F0F0F0u) >> 4u);
+            bits = ((bits & 0x00FF00FFu) << 8u) | ((bits & 0xFF00FF00u) >> 8u);
+            return glm::vec2(float(i) / float(n), float(bits) * 2.3283064365386963e-10f);
+        }
+
+        glm::vec3 importanceSampleGGX(const glm::vec2 &xi, float roughness, const glm::vec3 &normal) {
+            const float alpha = roughness * roughness;
+            const float phi = 2.0f * kPi * xi.x + random(glm::vec2(normal.x, normal.z)) * 0.1f;
+            const float cosTheta = std::sqrt((1.0f - xi.y) / (1.0f + (alpha * alpha - 1.0f) * xi.y));
+            const float sinTheta = std::sqrt(1.0f - cosTheta * cosTheta);
+            const glm::vec3 h(sinTheta * std::cos(phi), sinTheta * std::sin(phi), cosTheta);
+            const glm::vec3 up = std::abs(normal.z) < 0.999f ? glm::vec3(0.0f, 0.0f, 1.0f) : glm::vec3(1.0f, 0.0f, 0.0f);
+            const glm::vec3 tangentX = glm::normalize(glm::cross(up, normal));
+            const glm::vec3 tangentY = glm::normalize(glm::cross(normal, tangentX));
+            return glm::normalize(tangentX * h.x + tangentY * h.y + normal * h.z);
+        }
+
+        float distributionGGX(float dotNH, float roughness) {
+            const float alpha = roughness * roughness;
+            const float alpha2 = alpha * alpha;
+            const float denom = dotNH * dotNH * (alpha2 - 1.0f) + 1.0f;
+            return alpha2 / (kPi * denom * denom);
+        }
+
+        float geometrySchlickSmithGGX(float dotNL, float dotNV, float roughness) {
+            const float r = roughness + 1.0f;
+            const float k = r * r / 8.0f;
+            return dotNL / (dotNL * (1.0f - k) + k) * dotNV / (dotNV * (1.0f - k) + k);
+        }
+
+        // 每个角度的cos和sin
+        std::vector<glm::vec2> makeAngleTable(float end, float delta) {
+            std::vector<glm::vec2> table;
+            for (float angle = 0.0f; angle < end; angle += delta) {
+                table.emplace_back(std::cos(angle), std::sin(angle));
+            }
+            return table;
+        }
+
+        glm::vec3 irradiance(const CubeImage &environment, const glm::vec3 &n, float lod) {
+            glm::vec3 up(0.0f, 1.0f, 0.0f);
+            const glm::vec3 right = glm::normalize(glm::cross(up, n));
+            up = glm::cross(n, right);
+            // 和shader一样用float累加得到采样角度，保证采样数相同
+            static const std::vector<glm::vec2> phis = makeAngleTable(2.0f * kPi, kIrradianceDeltaPhi);
+            static const std::vector<glm::vec2> thetas = makeAngleTable(0.5f * kPi, kIrradianceDeltaTheta);
+            glm::vec3 color(0.0f);
+            for (const glm::vec2 &phi: phis) {
+                const glm::vec3 tempVec = phi.x * right + phi.y * up;
+                for (const glm::vec2 &theta: thetas) {
+                    const glm::vec3 sampleVector = theta.x * n + theta.y * tempVec;
+                    color += sampleCube(environment, sampleVector, lod) * theta.x * theta.y;
+                }
+            }
+            return kPi * color / float(phis.size() * thetas.size());
+        }
+
+        glm::vec3 prefilter(const CubeImage &environment, const glm::vec3 &r, float roughness) {
+            const glm::vec3 n = r, v = r;
+            glm::vec3 color(0.0f);
+            float totalWeight = 0.0f;
+            const float envMapDim = static_cast<float>(environment.dim);
+            for (uint32_t i = 0; i < kPrefilterSamples; i++) {
+                const glm::vec3 h = importanceSampleGGX(hammersley2d(i, kPrefilterSamples), roughness, n);
+                const glm::vec3 l = 2.0f * glm::dot(v, h) * h - v;
+                const float dotNL = glm::clamp(glm::dot(n, l), 0.0f, 1.0f);
+                if (dotNL > 0.0f) {
+                    const float dotNH = glm::clamp(glm::dot(n, h), 0.0f, 1.0f);
+                    const float dotVH = glm::clamp(glm::dot(v, h), 0.0f, 1.0f);
+                    const float pdf = distributionGGX(dotNH, roughness) * dotNH / (4.0f * dotVH) + 0.0001f;
+                    const float omegaS = 1.0f / (float(kPrefilterSamples) * pdf);
+                    const float omegaP = 4.0f * kPi / (6.0f * envMapDim * envMapDim);
+                    const float mipLevel =
+                            roughness == 0.0f ? 0.0f : std::max(0.5f * std::log2(omegaS / omegaP) + 1.0f, 0.0f);
+                    color += sampleCube(environment, l, mipLevel) * dotNL;
+                    totalWeight += dotNL;
+                }
+            }
+            return color / totalWeight;
+        }
+
+        glm::vec2 integrateBrdf(float dotNV, float roughness) {
+            const glm::vec3 n(0.0f, 0.0f, 1.0f);
+            const glm::vec3 v(std::sqrt(1.0f - dotNV * dotNV), 0.0f, dotNV);
+            glm::vec2 lut(0.0f);
+            for (uint32_t i = 0; i < kLutSamples; i++) {
+                const glm::vec3 h = importanceSampleGGX(hammersley2d(i, kLutSamples), roughness, n);
+                const glm::vec3 l = 2.0f * glm::dot(v, h) * h - v;
+                const float dotNL = std::max(glm::dot(n, l), 0.0f);
+                const float dotVH = std::max(glm::dot(v, h), 0.0f);
+                const float dotNH = std::max(glm::dot(h, n), 0.0f);
+                if (dotNL > 0.0f) {
+                    const float g = geometrySchlickSmithGGX(dotNL, dotNV, roughness);
+                    const float gVis = g * dotVH / (dotNH * dotNV);
+                    const float fc = std::pow(1.0f - dotVH, 5.0f);
+                    lut += glm::vec2((1.0f - fc) * gVis, fc * gVis);
+                }
+            }
+            return lut / float(kLutSamples);
+        }
+
+        // KTX1，不带key/value数据，images的下标为level * faceCount + face
+        bool writeKtx(const std::string &filename, uint32_t glInternalFormat, uint32_t glFormat, uint32_t dim,
+                      uint32_t faceCount, uint32_t levelCount, const std::vector<std::vector<uint16_t>> &images) {
+            static const uint8_t identifier[12] = {0xAB, 'K', 'T', 'X', ' ', '1', '1', 0xBB, '\r', '\n', 0x1A, '\n'};
+            const uint32_t header[13] = {0x04030201, kGlHalfFloat, 2, glFormat, glInternalFormat, glFormat, dim, dim,
+                                         0, 0, faceCount, levelCount, 0};
+            const std::string tempPath = filename + ".tmp";
+            {
+                std::ofstream out(tempPath, std::ios::binary | std::ios::trunc);
+                if (!out) {
+                    std::cerr << "Could not write \"" << tempPath << "\"" << std::endl;
+                    return false;
+                }
+                out.write(reinterpret_cast<const char *>(identifier), sizeof(identifier));
+                out.write(reinterpret_cast<const char *>(header), sizeof(header));
+                // 半精度RG/RGBA的行总是4字节对齐，不需要填充
+                for (uint32_t level = 0; level < levelCount; level++) {
+                    const uint32_t imageSize =
+                            static_cast<uint32_t>(images[level * faceCount].size() * sizeof(uint16_t));
+                    out.write(reinterpret_cast<const char *>(&imageSize), sizeof(imageSize));
+                    for (uint32_t face = 0; face < faceCount; face++) {
+                        const std::vector<uint16_t> &image = images[level * faceCount + face];
+                        out.write(reinterpret_cast<const char *>(image.data()),
+                                  static_cast<std::streamsize>(image.size() * sizeof(uint16_t)));
+                    }
+                }
+                if (!out) {
+                    out.close();
+                    std::remove(tempPath.c_str());
+                    return false;
+                }
+            }
+            std::remove(filename.c_str());
+            if (std::rename(tempPath.c_str(), filename.c_str()) != 0) {
+                std::remove(tempPath.c_str());
+                return false;
+            }
+            return true;
+        }
+
+        // 逐mip逐面渲染一个立方体贴图，函数的参数为方向、mip和该mip的尺寸
+        template<typename Function>
+        std::vector<std::vector<uint16_t>> renderCube(uint32_t levelCount, Function &&function) {
+            std::vector<std::vector<uint16_t>> images(levelCount * 6);
+            for (uint32_t level = 0; level < levelCount; level++) {
+                const uint32_t dim = std::max(1u, kCubeDim >> level);
+                for (uint32_t face = 0; face < 6; face++) {
+                    images[level * 6 + face].resize(dim * dim * 4);
+                }
+                ThreadPool::global().parallelFor(6 * dim, [&](uint32_t row) {
+                    const uint32_t face = row / dim, y = row % dim;
+                    uint16_t *dst = images[level * 6 + face].data() + y * dim * 4;
+                    for (uint32_t x = 0; x < dim; x++) {
+                        const glm::vec3 color = function(texelDirection(face, x, y, dim), level, dim);
+                        dst[x * 4 + 0] = glm::packHalf1x16(color.r);
+                        dst[x * 4 + 1] = glm::packHalf1x16(color.g);
+                        dst[x * 4 + 2] = glm::packHalf1x16(color.b);
+                        dst[x * 4 + 3] = glm::packHalf1x16(1.0f);
+                    }
+                });
+            }
+            return images;
+        }
+
+        std::string hashSuffix(uint64_t hash, const char *name) {
+            char suffix[64];
+            snprintf(suffix, sizeof(suffix), ".%016llx.%s.ktx", static_cast<unsigned long long>(hash), name);
+            return suffix;
+        }
+    }
+
+    bool getBakedIblPaths(const std::string &environmentFile, BakedIblPaths &paths) {
+        VirtualFile file;
+        if (!VirtualFileSystem::global().open(environmentFile, file)) {
+            return false;
+        }
+        const uint32_t parameters[] = {kBakeVersion, kCubeDim, kPrefilterSamples, kGlRgba16f};
+        const uint64_t hash = hash_bytes(parameters, sizeof(parameters), hash_bytes(file.data(), file.size()));
+        paths.irradiance = environmentFile + hashSuffix(hash, "irradiance");
+        paths.prefiltered = environmentFile + hashSuffix(hash, "prefiltered");
+        return true;
+    }
+
+    std::string getBakedBrdfLutPath(const std::string &directory) {
+        const uint32_t parameters[] = {kBakeVersion, kLutDim, kLutSamples, kGlRg16f};
+        return directory + "brdf_lut" + hashSuffix(hash_bytes(parameters, sizeof(parameters)), "lut");
+    }
+
+    bool isBakeableEnvironmentMap(const std::string &environmentFile) {
+        VirtualFile file;
+        if (!VirtualFileSystem::global().open(environmentFile, file)) {
+            return false;
+        }
+        ktxTexture *texture = nullptr;
+        if (ktxTexture_CreateFromMemory(file.data(), file.size(), KTX_TEXTURE_CREATE_NO_FLAGS,
+                                        &texture) != KTX_SUCCESS) {
+            return false;
+        }
+        const bool bakeable = texture->numFaces == 6 && texture->baseWidth == texture->baseHeight &&
+                              (texture->glInternalformat == kGlRgba16f || texture->glInternalformat == kGlRgba32f);
+        ktxTexture_Destroy(texture);
+        return bakeable;
+    }
+
+    bool bakeEnvironmentMaps(const std::string &environmentFile, const BakedIblPaths &paths) {
+        CubeImage environment;
+        if (!readEnvironmentMap(environmentFile, environment)) {
+            std::cerr << "\"" << environmentFile << "\" is not a RGBA16F/RGBA32F cube map" << std::endl;
+            return false;
+        }
+        const uint32_t levelCount = static_cast<uint32_t>(std::floor(std::log2(kCubeDim))) + 1;
+        // shader中texture()隐式选择的mip，近似为环境贴图和输出的尺寸比
+        const auto irradianceImages = renderCube(levelCount, [&](const glm::vec3 &n, uint32_t, uint32_t dim) {
+            return irradiance(environment, n, std::log2(static_cast<float>(environment.dim) / dim));
+        });
+        const auto prefilteredImages = renderCube(levelCount, [&](const glm::vec3 &n, uint32_t level, uint32_t) {
+            return prefilter(environment, n, static_cast<float>(level) / static_cast<float>(levelCount - 1));
+        });
+        return writeKtx(paths.irradiance, kGlRgba16f, kGlRgba, kCubeDim, 6, levelCount, irradianceImages) &&
+               writeKtx(paths.prefiltered, kGlRgba16f, kGlRgba, kCubeDim, 6, levelCount, prefilteredImages);
+    }
+
+    bool bakeBrdfLut(const std::string &filename) {
+        std::vector<std::vector<uint16_t>> image(1);
+        image[0].resize(kLutDim * kLutDim * 2);
+        ThreadPool::global().parallelFor(kLutDim, [&](uint32_t y) {
+            // 和deferred.vert中全屏三角形的uv一致，第0行对应t=0
+            const float roughness = (y + 0.5f) / kLutDim;
+            for (uint32_t x = 0; x < kLutDim; x++) {
+                const glm::vec2 lut = integrateBrdf((x + 0.5f) / kLutDim, roughness);
+                image[0][(y * kLutDim + x) * 2 + 0] = glm::packHalf1x16(lut.x);
+                image[0][(y * kLutDim + x) * 2 + 1] = glm::packHalf1x16(lut.y);
+            }
+        });
+        return writeKtx(filename, kGlRg16f, kGlRg, kLutDim, 1, 1, image);
+    }
+
+    bool saveBakedCube(const std::string &filename, uint32_t dim, uint32_t levelCount,
+                       const std::vector<std::vector<uint16_t>> &images) {
+        return writeKtx(filename, kGlRgba16f, kGlRgba, dim, 6, levelCount, images);
+    }
+
+    bool saveBakedBrdfLut(const std::string &filename, uint32_t dim, const std::vector<uint16_t> &image) {
+        return writeKtx(filename, kGlRg16f, kGlRg, dim, 1, 1, {image});
+    }
+}
@@ -0,0 +1,42 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace MW {
+    // PbrIblPass的GPU预计算和离线烘焙共用的参数，都是缓存key的一部分
+    constexpr uint32_t IBL_CUBE_DIM = 64;
+    constexpr uint32_t IBL_PREFILTER_SAMPLES = 32;
+    constexpr uint32_t IBL_LUT_DIM = 512;
+    constexpr uint32_t IBL_LUT_SAMPLES = 1024;
+
+    // 烘焙的IBL贴图，文件名带环境贴图内容和烘焙参数的hash，源文件或参数修改后自动失效。
+    // MWCooker离线生成，或者PbrIblPass在缓存缺失时用GPU生成后写入
+    struct BakedIblPaths {
+        std::string irradiance;
+        std::string prefiltered;
+    };
+
+    bool getBakedIblPaths(const std::string &environmentFile, BakedIblPaths &paths);
+
+    // BRDF LUT和环境贴图无关，directory下只需要一份
+    std::string getBakedBrdfLutPath(const std::string &directory);
+
+    // 环境贴图是否是可以烘焙的RGBA16F/RGBA32F立方体贴图
+    bool isBakeableEnvironmentMap(const std::string &environmentFile);
+
+    // 在CPU上复现irradiance_cube.frag和prefilter_env_map.frag，结果存为RGBA16F的KTX立方体贴图，
+    // 按行在全局线程池上并行
+    bool bakeEnvironmentMaps(const std::string &environmentFile, const BakedIblPaths &paths);
+
+    // 复现brdf_lut.frag，结果存为RG16F的KTX贴图
+    bool bakeBrdfLut(const std::string &filename);
+
+    // 保存GPU生成的结果，images的下标为level * 6 + face，每个image为RGBA16F
+    bool saveBakedCube(const std::string &filename, uint32_t dim, uint32_t levelCount,
+                       const std::vector<std::vector<uint16_t>> &images);
+
+    // image为RG16F
+    bool saveBakedBrdfLut(const std::string &filename, uint32_t dim, const std::vector<uint16_t> &image);
+}
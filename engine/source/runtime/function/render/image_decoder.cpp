@@ -0,0 +1,257 @@
+#include "image_decoder.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <iostream>
+
+#include "core/base/cpu_features.h"
+
+#if defined(MW_SIMD_X86)
+#include <tmmintrin.h>
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
+#include "stb_image.h"
+#include "core/file/virtual_file_system.h"
+
+namespace MW {
+#if defined(MW_SIMD_X86)
+    namespace {
+        // 每次处理4个像素，读取16字节，因此至少要剩余6个像素，返回已处理的像素数
+        MW_TARGET_SSSE3 size_t expandRgbToRgbaSSSE3(unsigned char *rgba, const unsigned char *rgb, size_t pixelCount) {
+            const __m128i shuffle = _mm_setr_epi8(0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11, -1);
+            const __m128i alpha = _mm_set1_epi32(static_cast<int>(0xff000000u));
+            size_t i = 0;
+            for (; i + 6 <= pixelCount; i += 4) {
+                __m128i source = _mm_loadu_si128(reinterpret_cast<const __m128i *>(rgb + i * 3));
+                __m128i expanded = _mm_or_si128(_mm_shuffle_epi8(source, shuffle), alpha);
+                _mm_storeu_si128(reinterpret_cast<__m128i *>(rgba + i * 4), expanded);
+            }
+            return i;
+        }
+    }
+#endif
+
+    void expandRgbToRgba(unsigned char *rgba, const unsigned char *rgb, size_t pixelCount) {
+        size_t i = 0;
+#if defined(MW_SIMD_X86)
+        if (cpuSupportsSSSE3()) {
+            i = expandRgbToRgbaSSSE3(rgba, rgb, pixelCount);
+        }
+#elif defined(__ARM_NEON)
+        for (; i + 16 <= pixelCount; i += 16) {
+            uint8x16x3_t source = vld3q_u8(rgb + i * 3);
+            uint8x16x4_t expanded;
+            expanded.val[0] = source.val[0];
+            expanded.val[1] = source.val[1];
+            expanded.val[2] = source.val[2];
+            expanded.val[3] = vdupq_n_u8(0xff);
+            vst4q_u8(rgba + i * 4, expanded);
+        }
+#endif
+        // 按32位整字读写，最后一个像素单独处理以免越界读
+        for (; i + 1 < pixelCount; ++i) {
+            uint32_t pixel;
+            memcpy(&pixel, rgb + i * 3, sizeof(pixel));
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+            pixel = (pixel & 0xffffff00u) | 0xffu;
+#else
+            pixel = (pixel & 0x00ffffffu) | 0xff000000u;
+#endif
+            memcpy(rgba + i * 4, &pixel, sizeof(pixel));
+        }
+        for (; i < pixelCount; ++i) {
+            rgba[i * 4 + 0] = rgb[i * 3 + 0];
+            rgba[i * 4 + 1] = rgb[i * 3 + 1];
+            rgba[i * 4 + 2] = rgb[i * 3 + 2];
+            rgba[i * 4 + 3] = 0xff;
+        }
+    }
+
+    void downsampleRgba8(unsigned char *dst, const unsigned char *src, uint32_t srcWidth, uint32_t srcHeight) {
+        const uint32_t dstWidth = std::max(1u, srcWidth >> 1);
+        const uint32_t dstHeight = std::max(1u, srcHeight >> 1);
+        for (uint32_t y = 0; y < dstHeight; ++y) {
+            const unsigned char *row0 = src + static_cast<size_t>(std::min(y * 2, srcHeight - 1)) * srcWidth * 4;
+            const unsigned char *row1 = src + static_cast<size_t>(std::min(y * 2 + 1, srcHeight - 1)) * srcWidth * 4;
+            unsigned char *out = dst + static_cast<size_t>(y) * dstWidth * 4;
+            for (uint32_t x = 0; x < dstWidth; ++x) {
+                const uint32_t x0 = std::min(x * 2, srcWidth - 1) * 4;
+                const uint32_t x1 = std::min(x * 2 + 1, srcWidth - 1) * 4;
+                for (uint32_t c = 0; c < 4; ++c) {
+                    out[x * 4 + c] = static_cast<unsigned char>(
+                            (row0[x0 + c] + row0[x1 + c] + row1[x0 + c] + row1[x1 + c] + 2) >> 2);
+                }
+            }
+        }
+    }
+
+    std::vector<std::vector<unsigned char>>
+    generateMipChain(const unsigned char *pixels, uint32_t width, uint32_t height, uint32_t component,
+                     uint32_t firstLevel) {
+        const uint32_t mipLevels = static_cast<uint32_t>(std::floor(std::log2(std::max(width, height)))) + 1;
+        std::vector<std::vector<unsigned char>> levels;
+        if (firstLevel >= mipLevels) {
+            return levels;
+        }
+        levels.reserve(mipLevels - firstLevel);
+
+        std::vector<unsigned char> current;
+        const unsigned char *source = pixels;
+        if (component == 3) {
+            current.resize(static_cast<size_t>(width) * height * 4);
+            expandRgbToRgba(current.data(), pixels, static_cast<size_t>(width) * height);
+            source = current.data();
+        } else if (firstLevel == 0) {
+            current.assign(pixels, pixels + static_cast<size_t>(width) * height * 4);
+            source = current.data();
+        }
+        if (firstLevel == 0) {
+            levels.push_back(current);
+        }
+
+        uint32_t levelWidth = width, levelHeight = height;
+        for (uint32_t level = 1; level < mipLevels; ++level) {
+            std::vector<unsigned char> next(static_cast<size_t>(std::max(1u, levelWidth >> 1)) *
+                                            std::max(1u, levelHeight >> 1) * 4);
+            downsampleRgba8(next.data(), source, levelWidth, levelHeight);
+            levelWidth = std::max(1u, levelWidth >> 1);
+            levelHeight = std::max(1u, levelHeight >> 1);
+            current = std::move(next);
+            source = current.data();
+            if (level >= firstLevel) {
+                levels.push_back(current);
+            }
+        }
+        return levels;
+    }
+
+    ImageDecodeQueue::ImageDecodeQueue(std::vector<Request> requests, size_t maxInFlightBytes,
+                                       ThreadPool &threadPool, AsyncFileReader::Priority priority)
+            : requests(std::move(requests)), maxInFlightBytes(maxInFlightBytes) {
+        pendingCount = static_cast<uint32_t>(this->requests.size());
+        for (uint32_t i = 0; i < this->requests.size(); ++i) {
+            if (this->requests[i].data != nullptr) {
+                threadPool.submit([this, i]() { decode(i, nullptr); });
+                continue;
+            }
+            // 归档中的文件在解码线程上直接读取和解压
+            if (VirtualFileSystem::global().isArchived(this->requests[i].filename)) {
+                threadPool.submit([this, i]() {
+                    std::vector<unsigned char> data;
+                    VirtualFileSystem::global().readFile(this->requests[i].filename, data);
+                    decode(i, &data);
+                });
+                continue;
+            }
+            // 先把所有文件的读请求发出去，读完一个解码一个
+            AsyncFileReader::RequestId id = AsyncFileReader::global().read(
+                    this->requests[i].filename, priority,
+                    [this, i, &threadPool](AsyncFileReader::Result &result) {
+                        auto data = std::make_shared<std::vector<unsigned char>>(std::move(result.data));
+                        threadPool.submit([this, i, data]() { decode(i, data.get()); });
+                    });
+            std::lock_guard<std::mutex> lock(mutex);
+            reads.push_back(id);
+        }
+    }
+
+    ImageDecodeQueue::~ImageDecodeQueue() {
+        std::vector<AsyncFileReader::RequestId> pendingReads;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            cancelled = true;
+            pendingReads.swap(reads);
+        }
+        budgetCondition.notify_all();
+        // 取消的读仍然会回调，decode看到cancelled后直接返回
+        for (AsyncFileReader::RequestId id: pendingReads) {
+            AsyncFileReader::global().cancel(id);
+        }
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            finishedCondition.wait(lock, [this]() { return pendingCount == 0; });
+        }
+        for (Result &result: completed) {
+            stbi_image_free(result.pixels);
+        }
+    }
+
+    void ImageDecodeQueue::decode(uint32_t index, const std::vector<unsigned char> *fileData) {
+        const Request &request = requests[index];
+        const unsigned char *data = request.data;
+        size_t size = request.size;
+        if (fileData != nullptr) {
+            data = fileData->data();
+            size = fileData->size();
+        }
+
+        Result result{};
+        result.index = index;
+        int width = 0, height = 0, component = 0;
+        const bool valid = data != nullptr && size > 0 &&
+                           stbi_info_from_memory(data, static_cast<int>(size), &width, &height, &component) != 0;
+        // 只有RGB保留3通道，上传时再展开，其余格式统一解码为RGBA
+        const int requestedComponent = component == 3 ? 3 : 4;
+        const size_t bytes = valid ? static_cast<size_t>(width) * height * requestedComponent : 0;
+
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            budgetCondition.wait(lock, [&]() {
+                return cancelled || inFlightBytes == 0 || inFlightBytes + bytes <= maxInFlightBytes;
+            });
+            if (cancelled) {
+                --pendingCount;
+                finishedCondition.notify_all();
+                return;
+            }
+            inFlightBytes += bytes;
+        }
+
+        if (valid) {
+            result.pixels = stbi_load_from_memory(data, static_cast<int>(size), &width, &height, &component,
+                                                  requestedComponent);
+        }
+        if (result.pixels) {
+            result.width = static_cast<uint32_t>(width);
+            result.height = static_cast<uint32_t>(height);
+            result.component = static_cast<uint32_t>(requestedComponent);
+        } else {
+            std::cerr << "Could not decode image " << index << " " << request.filename << ": "
+                      << (valid ? stbi_failure_reason() : "unknown format") << std::endl;
+        }
+        result.bytes = bytes;
+
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            completed.push_back(result);
+            --pendingCount;
+        }
+        completedCondition.notify_one();
+        finishedCondition.notify_all();
+    }
+
+    bool ImageDecodeQueue::pop(Result &result) {
+        std::unique_lock<std::mutex> lock(mutex);
+        if (returnedCount == requests.size()) {
+            return false;
+        }
+        completedCondition.wait(lock, [this]() { return !completed.empty(); });
+        result = completed.front();
+        completed.pop_front();
+        ++returnedCount;
+        return true;
+    }
+
+    void ImageDecodeQueue::release(Result &result) {
+        stbi_image_free(result.pixels);
+        result.pixels = nullptr;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            inFlightBytes -= result.bytes;
+        }
+        budgetCondition.notify_all();
+    }
+}
@@ -0,0 +1,84 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <future>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "core/base/thread_pool.h"
+#include "core/file/async_file_reader.h"
+
+namespace MW {
+    // RGB8转RGBA8，alpha填255
+    void expandRgbToRgba(unsigned char *rgba, const unsigned char *rgb, size_t pixelCount);
+
+    // RGBA8 2x2盒式滤波，奇数尺寸时边缘像素重复使用，输出max(1, w/2) x max(1, h/2)
+    void downsampleRgba8(unsigned char *dst, const unsigned char *src, uint32_t srcWidth, uint32_t srcHeight);
+
+    // 在CPU上生成mip链，只返回firstLevel及之后的level，每级都是RGBA8
+    std::vector<std::vector<unsigned char>>
+    generateMipChain(const unsigned char *pixels, uint32_t width, uint32_t height, uint32_t component,
+                     uint32_t firstLevel);
+
+    /*
+        Decodes png/jpg images on the thread pool and hands them out in completion order,
+        decoded images that have not been released yet are limited to maxInFlightBytes.
+        Image files are read through AsyncFileReader, so reads overlap with decoding and upload
+    */
+    class ImageDecodeQueue {
+    public:
+        struct Request {
+            // 内存中的已编码数据，为空时从filename读取
+            const unsigned char *data{nullptr};
+            size_t size{0};
+            std::string filename;
+        };
+
+        struct Result {
+            uint32_t index{0};
+            unsigned char *pixels{nullptr}; // 解码失败时为nullptr
+            uint32_t width{0};
+            uint32_t height{0};
+            uint32_t component{0}; // 3或4
+            size_t bytes{0};
+        };
+
+        ImageDecodeQueue(std::vector<Request> requests, size_t maxInFlightBytes,
+                         ThreadPool &threadPool = ThreadPool::global(),
+                         AsyncFileReader::Priority priority = AsyncFileReader::Priority::High);
+
+        ~ImageDecodeQueue();
+
+        ImageDecodeQueue(const ImageDecodeQueue &) = delete;
+
+        ImageDecodeQueue &operator=(const ImageDecodeQueue &) = delete;
+
+        // 阻塞直到有图片解码完成，全部取出后返回false
+        bool pop(Result &result);
+
+        // 上传完成后释放像素并归还内存额度
+        void release(Result &result);
+
+    private:
+        // fileData为读到的文件内容，内存中的请求为nullptr
+        void decode(uint32_t index, const std::vector<unsigned char> *fileData);
+
+        std::vector<Request> requests;
+        size_t maxInFlightBytes;
+        size_t inFlightBytes{0};
+        uint32_t returnedCount{0};
+        bool cancelled{false};
+        std::deque<Result> completed;
+        std::vector<AsyncFileReader::RequestId> reads;
+        // 还没有执行完decode的请求数
+        uint32_t pendingCount{0};
+        std::mutex mutex;
+        std::condition_variable completedCondition;
+        std::condition_variable budgetCondition;
+        std::condition_variable finishedCondition;
+    };
+}
@@ -0,0 +1,352 @@
+#include "mesh_optimizer.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <cstring>
+
+namespace MW {
+    namespace {
+        // Forsyth, "Linear-Speed Vertex Cache Optimisation"
+        constexpr uint32_t kForsythCacheSize = 32;
+        constexpr float kCacheDecayPower = 1.5f;
+        constexpr float kLastTriangleScore = 0.75f;
+        constexpr float kValenceBoostScale = 2.0f;
+        constexpr float kValenceBoostPower = 0.5f;
+        constexpr uint32_t kInvalidIndex = ~0u;
+
+        float forsythVertexScore(int cachePosition, uint32_t liveTriangles) {
+            if (liveTriangles == 0) {
+                // 没有剩余三角形的顶点不再参与评分
+                return -1.0f;
+            }
+            float score = 0.0f;
+            if (cachePosition >= 0) {
+                if (cachePosition < 3) {
+                    score = kLastTriangleScore;
+                } else {
+                    const float scaler = 1.0f / (kForsythCacheSize - 3);
+                    score = std::pow(1.0f - (cachePosition - 3) * scaler, kCacheDecayPower);
+                }
+            }
+            score += kValenceBoostScale * std::pow(static_cast<float>(liveTriangles), -kValenceBoostPower);
+            return score;
+        }
+
+        struct TriangleAdjacency {
+            std::vector<uint32_t> counts;
+            std::vector<uint32_t> offsets;
+            std::vector<uint32_t> data;
+
+            void build(const uint32_t *indices, size_t indexCount, size_t vertexCount) {
+                counts.assign(vertexCount, 0);
+                offsets.assign(vertexCount, 0);
+                data.resize(indexCount);
+                for (size_t i = 0; i < indexCount; ++i) {
+                    assert(indices[i] < vertexCount);
+                    counts[indices[i]]++;
+                }
+                uint32_t offset = 0;
+                for (size_t v = 0; v < vertexCount; ++v) {
+                    offsets[v] = offset;
+                    offset += counts[v];
+                }
+                std::vector<uint32_t> fill(offsets);
+                for (size_t i = 0; i < indexCount; ++i) {
+                    data[fill[indices[i]]++] = static_cast<uint32_t>(i / 3);
+                }
+            }
+        };
+
+        uint32_t simulateFifo(std::vector<uint32_t> &timestamps, uint32_t &time, uint32_t cacheSize,
+                              const uint32_t *triangle) {
+            uint32_t misses = 0;
+            for (int k = 0; k < 3; ++k) {
+                uint32_t v = triangle[k];
+                // timestamp在窗口内表示仍在cache中
+                if (time - timestamps[v] > cacheSize) {
+                    timestamps[v] = time++;
+                    misses++;
+                }
+            }
+            return misses;
+        }
+    }
+
+    VertexCacheStatistics MeshOptimizer::analyzeVertexCache(const uint32_t *indices, size_t indexCount,
+                                                            size_t vertexCount, uint32_t cacheSize) {
+        VertexCacheStatistics statistics{};
+        if (indexCount == 0) {
+            return statistics;
+        }
+        std::vector<uint32_t> timestamps(vertexCount, 0);
+        std::vector<bool> referenced(vertexCount, false);
+        uint32_t time = cacheSize + 1;
+        for (size_t i = 0; i + 2 < indexCount; i += 3) {
+            statistics.vertexTransforms += simulateFifo(timestamps, time, cacheSize, indices + i);
+            statistics.triangleCount++;
+        }
+        for (size_t i = 0; i < indexCount; ++i) {
+            if (!referenced[indices[i]]) {
+                referenced[indices[i]] = true;
+                statistics.vertexCount++;
+            }
+        }
+        statistics.acmr = statistics.triangleCount ? float(statistics.vertexTransforms) / statistics.triangleCount : 0.0f;
+        statistics.atvr = statistics.vertexCount ? float(statistics.vertexTransforms) / statistics.vertexCount : 0.0f;
+        return statistics;
+    }
+
+    void MeshOptimizer::optimizeVertexCache(uint32_t *destination, const uint32_t *indices, size_t indexCount,
+                                            size_t vertexCount) {
+        assert(indexCount % 3 == 0);
+        const size_t triangleCount = indexCount / 3;
+        if (triangleCount == 0) {
+            return;
+        }
+        // 支持原地优化
+        std::vector<uint32_t> source(indices, indices + indexCount);
+
+        TriangleAdjacency adjacency;
+        adjacency.build(source.data(), indexCount, vertexCount);
+
+        std::vector<uint32_t> liveTriangles(adjacency.counts);
+        std::vector<int> cachePositions(vertexCount, -1);
+        std::vector<float> vertexScores(vertexCount);
+        for (size_t v = 0; v < vertexCount; ++v) {
+            vertexScores[v] = forsythVertexScore(-1, liveTriangles[v]);
+        }
+        std::vector<float> triangleScores(triangleCount);
+        std::vector<bool> emitted(triangleCount, false);
+        for (size_t t = 0; t < triangleCount; ++t) {
+            const uint32_t *tri = &source[t * 3];
+            triangleScores[t] = vertexScores[tri[0]] + vertexScores[tri[1]] + vertexScores[tri[2]];
+        }
+
+        uint32_t cache[kForsythCacheSize + 3];
+        uint32_t newCache[kForsythCacheSize + 3];
+        uint32_t cacheCount = 0;
+
+        uint32_t bestTriangle = 0;
+        size_t inputCursor = 0;
+        for (size_t out = 0; out < triangleCount; ++out) {
+            if (bestTriangle == kInvalidIndex) {
+                // dead-end：按输入顺序找下一个还没输出的三角形
+                while (emitted[inputCursor]) {
+                    inputCursor++;
+                }
+                bestTriangle = static_cast<uint32_t>(inputCursor);
+            }
+            const uint32_t *tri = &source[bestTriangle * 3];
+            std::memcpy(destination + out * 3, tri, sizeof(uint32_t) * 3);
+            emitted[bestTriangle] = true;
+
+            // 从邻接表中移除该三角形
+            for (int k = 0; k < 3; ++k) {
+                uint32_t v = tri[k];
+                uint32_t *list = &adjacency.data[adjacency.offsets[v]];
+                uint32_t &count = liveTriangles[v];
+                for (uint32_t i = 0; i < count; ++i) {
+                    if (list[i] == bestTriangle) {
+                        list[i] = list[count - 1];
+                        break;
+                    }
+                }
+                count--;
+            }
+
+            // 刚用过的顶点放到LRU cache最前面
+            uint32_t newCacheCount = 0;
+            for (int k = 0; k < 3; ++k) {
+                newCache[newCacheCount++] = tri[k];
+            }
+            for (uint32_t i = 0; i < cacheCount; ++i) {
+                uint32_t v = cache[i];
+                if (v != tri[0] && v != tri[1] && v != tri[2]) {
+                    newCache[newCacheCount++] = v;
+                }
+            }
+            for (uint32_t i = kForsythCacheSize; i < newCacheCount; ++i) {
+                cachePositions[newCache[i]] = -1;
+            }
+
+            bestTriangle = kInvalidIndex;
+            float bestScore = 0.0f;
+            for (uint32_t i = 0; i < newCacheCount; ++i) {
+                uint32_t v = newCache[i];
+                int position = i < kForsythCacheSize ? static_cast<int>(i) : -1;
+                cachePositions[v] = position;
+                float score = forsythVertexScore(position, liveTriangles[v]);
+                float delta = score - vertexScores[v];
+                vertexScores[v] = score;
+                const uint32_t *list = &adjacency.data[adjacency.offsets[v]];
+                for (uint32_t j = 0; j < liveTriangles[v]; ++j) {
+                    uint32_t t = list[j];
+                    triangleScores[t] += delta;
+                    if (triangleScores[t] > bestScore) {
+                        bestScore = triangleScores[t];
+                        bestTriangle = t;
+                    }
+                }
+            }
+            cacheCount = std::min(newCacheCount, kForsythCacheSize);
+            std::memcpy(cache, newCache, cacheCount * sizeof(uint32_t));
+        }
+    }
+
+    void MeshOptimizer::optimizeOverdraw(uint32_t *destination, const uint32_t *indices, size_t indexCount,
+                                         const float *vertexPositions, size_t vertexCount,
+                                         size_t vertexPositionsStride, float threshold) {
+        assert(indexCount % 3 == 0);
+        const size_t triangleCount = indexCount / 3;
+        if (triangleCount == 0) {
+            return;
+        }
+        std::vector<uint32_t> source(indices, indices + indexCount);
+        const size_t stride = vertexPositionsStride / sizeof(float);
+        auto position = [&](uint32_t v) { return vertexPositions + v * stride; };
+
+        // cache被完全刷新(三个顶点都miss)的位置作为hard boundary
+        constexpr uint32_t cacheSize = 16;
+        std::vector<uint32_t> timestamps(vertexCount, 0);
+        uint32_t time = cacheSize + 1;
+        std::vector<uint32_t> hardClusters;
+        for (size_t t = 0; t < triangleCount; ++t) {
+            if (simulateFifo(timestamps, time, cacheSize, &source[t * 3]) == 3) {
+                hardClusters.push_back(static_cast<uint32_t>(t));
+            }
+        }
+
+        // 在hard cluster内部，只要前缀ACMR不超过阈值就继续切成更小的soft cluster
+        std::vector<uint32_t> clusters;
+        for (size_t c = 0; c < hardClusters.size(); ++c) {
+            uint32_t begin = hardClusters[c];
+            uint32_t end = c + 1 < hardClusters.size() ? hardClusters[c + 1] : static_cast<uint32_t>(triangleCount);
+
+            time += cacheSize + 1;
+            uint32_t clusterMisses = 0;
+            for (uint32_t t = begin; t < end; ++t) {
+                clusterMisses += simulateFifo(timestamps, time, cacheSize, &source[t * 3]);
+            }
+            const float clusterThreshold = threshold * float(clusterMisses) / float(end - begin);
+
+            clusters.push_back(begin);
+            time += cacheSize + 1;
+            uint32_t misses = 0;
+            uint32_t start = begin;
+            for (uint32_t t = begin; t < end; ++t) {
+                misses += simulateFifo(timestamps, time, cacheSize, &source[t * 3]);
+                if (t + 1 < end && float(misses) / float(t + 1 - start) <= clusterThreshold) {
+                    clusters.push_back(t + 1);
+                    start = t + 1;
+                    misses = 0;
+                    time += cacheSize + 1;
+                }
+            }
+        }
+
+        // 面积加权的cluster中心与法线
+        struct ClusterSortData {
+            uint32_t cluster;
+            float key;
+        };
+        const size_t clusterCount = clusters.size();
+        std::vector<float> clusterData(clusterCount * 6, 0.0f);
+        float meshCentroid[3] = {0.0f, 0.0f, 0.0f};
+        float meshArea = 0.0f;
+        for (size_t c = 0; c < clusterCount; ++c) {
+            uint32_t begin = clusters[c];
+            uint32_t end = c + 1 < clusterCount ? clusters[c + 1] : static_cast<uint32_t>(triangleCount);
+            float *centroid = &clusterData[c * 6];
+            float *normal = &clusterData[c * 6 + 3];
+            float clusterArea = 0.0f;
+            for (uint32_t t = begin; t < end; ++t) {
+                const float *p0 = position(source[t * 3 + 0]);
+                const float *p1 = position(source[t * 3 + 1]);
+                const float *p2 = position(source[t * 3 + 2]);
+                float e1[3] = {p1[0] - p0[0], p1[1] - p0[1], p1[2] - p0[2]};
+                float e2[3] = {p2[0] - p0[0], p2[1] - p0[1], p2[2] - p0[2]};
+                float n[3] = {e1[1] * e2[2] - e1[2] * e2[1], e1[2] * e2[0] - e1[0] * e2[2],
+                              e1[0] * e2[1] - e1[1] * e2[0]};
+                float area = std::sqrt(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+                for (int k = 0; k < 3; ++k) {
+                    centroid[k] += (p0[k] + p1[k] + p2[k]) / 3.0f * area;
+                    normal[k] += n[k];
+                }
+                clusterArea += area;
+            }
+            for (int k = 0; k < 3; ++k) {
+                meshCentroid[k] += centroid[k];
+                centroid[k] /= clusterArea > 0.0f ? clusterArea : 1.0f;
+            }
+            meshArea += clusterArea;
+        }
+        for (int k = 0; k < 3; ++k) {
+            meshCentroid[k] /= meshArea > 0.0f ? meshArea : 1.0f;
+        }
+
+        // 越朝外的cluster越先画，先画的面更可能遮挡后画的面
+        std::vector<ClusterSortData> sortData(clusterCount);
+        for (size_t c = 0; c < clusterCount; ++c) {
+            const float *centroid = &clusterData[c * 6];
+            const float *normal = &clusterData[c * 6 + 3];
+            float length = std::sqrt(normal[0] * normal[0] + normal[1] * normal[1] + normal[2] * normal[2]);
+            float key = 0.0f;
+            if (length > 0.0f) {
+                for (int k = 0; k < 3; ++k) {
+                    key += (centroid[k] - meshCentroid[k]) * normal[k] / length;
+                }
+            }
+            sortData[c] = {static_cast<uint32_t>(c), key};
+        }
+        std::stable_sort(sortData.begin(), sortData.end(),
+                         [](const ClusterSortData &a, const ClusterSortData &b) { return a.key > b.key; });
+
+        size_t offset = 0;
+        for (const ClusterSortData &data: sortData) {
+            uint32_t begin = clusters[data.cluster];
+            uint32_t end = data.cluster + 1 < clusterCount ? clusters[data.cluster + 1]
+                                                           : static_cast<uint32_t>(triangleCount);
+            size_t count = (end - begin) * 3;
+            std::memcpy(destination + offset, &source[begin * 3], count * sizeof(uint32_t));
+            offset += count;
+        }
+        assert(offset == indexCount);
+    }
+
+    size_t MeshOptimizer::optimizeVertexFetchRemap(uint32_t *remap, const uint32_t *indices, size_t indexCount,
+                                                   size_t vertexCount) {
+        std::fill(remap, remap + vertexCount, kInvalidIndex);
+        uint32_t next = 0;
+        for (size_t i = 0; i < indexCount; ++i) {
+            uint32_t v = indices[i];
+            assert(v < vertexCount);
+            if (remap[v] == kInvalidIndex) {
+                remap[v] = next++;
+            }
+        }
+        size_t referenced = next;
+        for (size_t v = 0; v < vertexCount; ++v) {
+            if (remap[v] == kInvalidIndex) {
+                remap[v] = next++;
+            }
+        }
+        return referenced;
+    }
+
+    void MeshOptimizer::remapIndexBuffer(uint32_t *indices, size_t indexCount, const uint32_t *remap) {
+        for (size_t i = 0; i < indexCount; ++i) {
+            indices[i] = remap[indices[i]];
+        }
+    }
+
+    void MeshOptimizer::remapVertexBuffer(void *destination, const void *vertices, size_t vertexCount,
+                                          size_t vertexSize, const uint32_t *remap) {
+        assert(destination != vertices);
+        const char *src = static_cast<const char *>(vertices);
+        char *dst = static_cast<char *>(destination);
+        for (size_t v = 0; v < vertexCount; ++v) {
+            std::memcpy(dst + size_t(remap[v]) * vertexSize, src + v * vertexSize, vertexSize);
+        }
+    }
+}
@@ -0,0 +1,50 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace MW {
+    /*
+        Import-time index/vertex buffer optimization.
+        All functions work on a primitive-local index buffer (indices in [0, vertexCount)).
+    */
+    struct VertexCacheStatistics {
+        uint32_t vertexTransforms{0};
+        uint32_t triangleCount{0};
+        uint32_t vertexCount{0};
+        float acmr{0.0f}; // transformed vertices / triangles
+        float atvr{0.0f}; // transformed vertices / referenced vertices
+    };
+
+    namespace MeshOptimizer {
+        // 模拟FIFO post-transform cache，统计ACMR/ATVR
+        VertexCacheStatistics analyzeVertexCache(const uint32_t *indices, size_t indexCount, size_t vertexCount,
+                                                 uint32_t cacheSize = 16);
+
+        // Forsyth线性时间顶点缓存排序
+        void optimizeVertexCache(uint32_t *destination, const uint32_t *indices, size_t indexCount,
+                                 size_t vertexCount);
+
+        // 按cache边界切分cluster，再按cluster朝外程度排序以减少overdraw（Sander et al. 2007）
+        // threshold: 允许ACMR变差的比例，1.05表示最多变差5%
+        void optimizeOverdraw(uint32_t *destination, const uint32_t *indices, size_t indexCount,
+                              const float *vertexPositions, size_t vertexCount, size_t vertexPositionsStride,
+                              float threshold = 1.05f);
+
+        // 按首次引用顺序生成顶点重映射表，未被引用的顶点排在末尾，返回被引用的顶点数
+        size_t optimizeVertexFetchRemap(uint32_t *remap, const uint32_t *indices, size_t indexCount,
+                                        size_t vertexCount);
+
+        // quadric error边折叠简化，接缝与开放边界上的顶点只允许沿边界折叠，折叠只会复用已有顶点
+        // targetError与resultError都是对象空间下的几何误差，返回简化后的index数量
+        size_t simplify(uint32_t *destination, const uint32_t *indices, size_t indexCount,
+                        const float *vertexPositions, size_t vertexCount, size_t vertexPositionsStride,
+                        size_t targetIndexCount, float targetError, float *resultError = nullptr);
+
+        void remapIndexBuffer(uint32_t *indices, size_t indexCount, const uint32_t *remap);
+
+        void remapVertexBuffer(void *destination, const void *vertices, size_t vertexCount, size_t vertexSize,
+                               const uint32_t *remap);
+    }
+}
@@ -0,0 +1,524 @@
+#include "mesh_optimizer.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <cstring>
+#include <unordered_map>
+
+namespace MW {
+    namespace {
+        constexpr uint32_t kNoEdge = ~0u;
+        constexpr uint32_t kMultipleEdges = ~1u;
+        // 开放边界的约束平面权重，保证边界轮廓尽量不变
+        constexpr float kBoundaryWeight = 10.0f;
+
+        enum VertexKind : uint8_t {
+            Manifold, // 普通顶点，可以向任意相邻顶点折叠
+            Border,   // 开放边界上的顶点，只能沿边界折叠
+            Seam,     // UV/法线接缝上的顶点（同位置两个顶点），两侧必须一起沿接缝折叠
+            Locked    // 复杂拓扑，不折叠
+        };
+
+        struct Vec3 {
+            float x, y, z;
+        };
+
+        Vec3 sub(const Vec3 &a, const Vec3 &b) { return {a.x - b.x, a.y - b.y, a.z - b.z}; }
+
+        Vec3 cross(const Vec3 &a, const Vec3 &b) {
+            return {a.y * b.z - a.z * b.y, a.z * b.x - a.x * b.z, a.x * b.y - a.y * b.x};
+        }
+
+        float dot(const Vec3 &a, const Vec3 &b) { return a.x * b.x + a.y * b.y + a.z * b.z; }
+
+        struct Quadric {
+            // 对称矩阵A的上三角、向量b、常数c以及累积权重w
+            double a00{0}, a11{0}, a22{0}, a10{0}, a20{0}, a21{0};
+            double b0{0}, b1{0}, b2{0}, c{0};
+            double w{0};
+
+            static Quadric fromPlane(double nx, double ny, double nz, double d, double weight) {
+                Quadric q;
+                q.a00 = nx * nx * weight;
+                q.a11 = ny * ny * weight;
+                q.a22 = nz * nz * weight;
+                q.a10 = nx * ny * weight;
+                q.a20 = nx * nz * weight;
+                q.a21 = ny * nz * weight;
+                q.b0 = nx * d * weight;
+                q.b1 = ny * d * weight;
+                q.b2 = nz * d * weight;
+                q.c = d * d * weight;
+                q.w = weight;
+                return q;
+            }
+
+            Quadric &operator+=(const Quadric &o) {
+                a00 += o.a00;
+                a11 += o.a11;
+                a22 += o.a22;
+                a10 += o.a10;
+                a20 += o.a20;
+                a21 += o.a21;
+                b0 += o.b0;
+                b1 += o.b1;
+                b2 += o.b2;
+                c += o.c;
+                w += o.w;
+                return *this;
+            }
+
+            // 返回加权平均的平方距离
+            float error(const Vec3 &p) const {
+                double x = p.x, y = p.y, z = p.z;
+                double rx = a00 * x + a10 * y + a20 * z;
+                double ry = a10 * x + a11 * y + a21 * z;
+                double rz = a20 * x + a21 * y + a22 * z;
+                double r = rx * x + ry * y + rz * z + 2.0 * (b0 * x + b1 * y + b2 * z) + c;
+                return w > 0.0 ? static_cast<float>(std::max(r / w, 0.0)) : 0.0f;
+            }
+        };
+
+        struct PositionKey {
+            uint32_t x, y, z;
+
+            bool operator==(const PositionKey &o) const { return x == o.x && y == o.y && z == o.z; }
+        };
+
+        struct PositionKeyHash {
+            size_t operator()(const PositionKey &k) const {
+                size_t h = k.x * 73856093u;
+                h ^= k.y * 19349663u;
+                h ^= k.z * 83492791u;
+                return h;
+            }
+        };
+
+        struct VertexTriangles {
+            std::vector<uint32_t> offsets;
+            std::vector<uint32_t> counts;
+            std::vector<uint32_t> data;
+
+            void build(const uint32_t *indices, size_t indexCount, size_t vertexCount) {
+                counts.assign(vertexCount, 0);
+                offsets.assign(vertexCount, 0);
+                data.resize(indexCount);
+                for (size_t i = 0; i < indexCount; ++i) {
+                    counts[indices[i]]++;
+                }
+                uint32_t offset = 0;
+                for (size_t v = 0; v < vertexCount; ++v) {
+                    offsets[v] = offset;
+                    offset += counts[v];
+                }
+                std::vector<uint32_t> fill(offsets);
+                for (size_t i = 0; i < indexCount; ++i) {
+                    data[fill[indices[i]]++] = static_cast<uint32_t>(i / 3);
+                }
+            }
+        };
+
+        struct Collapse {
+            uint32_t from;
+            uint32_t to;
+            float error;
+        };
+
+        class Simplifier {
+        public:
+            Simplifier(const uint32_t *indices, size_t indexCount, const float *vertexPositions, size_t vertexCount,
+                       size_t stride)
+                    : vertexCount(vertexCount), positions(vertexCount), remap(vertexCount), wedge(vertexCount),
+                      kinds(vertexCount, Locked), openOut(vertexCount, kNoEdge), openIn(vertexCount, kNoEdge) {
+                const size_t floatStride = stride / sizeof(float);
+                for (size_t v = 0; v < vertexCount; ++v) {
+                    const float *p = vertexPositions + v * floatStride;
+                    positions[v] = {p[0], p[1], p[2]};
+                }
+                buildWedges();
+                classifyVertices(indices, indexCount);
+                computeQuadrics(indices, indexCount);
+            }
+
+            size_t simplify(uint32_t *result, size_t indexCount, size_t targetIndexCount, float targetError,
+                            float &resultError) {
+                const float errorLimit = targetError * targetError;
+                float maxError = 0.0f;
+                std::vector<uint32_t> collapseRemap(vertexCount);
+                std::vector<bool> locked(vertexCount);
+                std::vector<Collapse> collapses;
+                VertexTriangles triangles;
+
+                while (indexCount > targetIndexCount) {
+                    triangles.build(result, indexCount, vertexCount);
+
+                    collapses.clear();
+                    for (size_t i = 0; i < indexCount; i += 3) {
+                        for (int e = 0; e < 3; ++e) {
+                            uint32_t a = result[i + e];
+                            uint32_t b = result[i + (e + 1) % 3];
+                            pushCollapse(collapses, a, b);
+                            pushCollapse(collapses, b, a);
+                        }
+                    }
+                    if (collapses.empty()) {
+                        break;
+                    }
+                    std::sort(collapses.begin(), collapses.end(),
+                              [](const Collapse &l, const Collapse &r) { return l.error < r.error; });
+
+                    for (size_t v = 0; v < vertexCount; ++v) {
+                        collapseRemap[v] = static_cast<uint32_t>(v);
+                    }
+                    std::fill(locked.begin(), locked.end(), false);
+
+                    const size_t triangleGoal = (indexCount - targetIndexCount) / 3;
+                    size_t collapsedTriangles = 0;
+                    size_t performed = 0;
+                    for (const Collapse &collapse: collapses) {
+                        if (collapse.error > errorLimit || collapsedTriangles >= triangleGoal) {
+                            break;
+                        }
+                        const uint32_t from = collapse.from;
+                        const uint32_t to = collapse.to;
+                        if (locked[remap[from]] || locked[remap[to]]) {
+                            continue;
+                        }
+                        if (!linkConditionHolds(result, triangles, from, to) ||
+                            flipsTriangles(result, triangles, from, to)) {
+                            continue;
+                        }
+
+                        collapseRemap[from] = to;
+                        if (kinds[from] == Seam) {
+                            uint32_t twin = wedge[from];
+                            uint32_t twinTarget = to == openOut[from] ? openIn[twin] : openOut[twin];
+                            collapseRemap[twin] = twinTarget;
+                            updateOpenEdges(twin, twinTarget);
+                        }
+                        if (kinds[from] != Manifold) {
+                            updateOpenEdges(from, to);
+                        }
+                        lockNeighborhood(result, triangles, from, locked);
+                        locked[remap[to]] = true;
+
+                        quadrics[remap[to]] += quadrics[remap[from]];
+                        maxError = std::max(maxError, collapse.error);
+                        collapsedTriangles += kinds[from] == Manifold ? 2 : 1;
+                        performed++;
+                    }
+                    if (performed == 0) {
+                        break;
+                    }
+
+                    // 重写index并去掉退化三角形
+                    size_t write = 0;
+                    for (size_t i = 0; i < indexCount; i += 3) {
+                        uint32_t a = collapseRemap[result[i + 0]];
+                        uint32_t b = collapseRemap[result[i + 1]];
+                        uint32_t c = collapseRemap[result[i + 2]];
+                        if (remap[a] == remap[b] || remap[b] == remap[c] || remap[c] == remap[a]) {
+                            continue;
+                        }
+                        result[write++] = a;
+                        result[write++] = b;
+                        result[write++] = c;
+                    }
+                    indexCount = write;
+                }
+                resultError = std::sqrt(maxError);
+                return indexCount;
+            }
+
+        private:
+            size_t vertexCount;
+            std::vector<Vec3> positions;
+            std::vector<uint32_t> remap; // 同位置顶点中的代表顶点
+            std::vector<uint32_t> wedge; // 同位置顶点组成的环形链表
+            std::vector<VertexKind> kinds;
+            std::vector<uint32_t> openOut;
+            std::vector<uint32_t> openIn;
+            std::vector<Quadric> quadrics; // 以remap后的顶点为下标
+            std::vector<uint32_t> fromNeighbors;
+            std::vector<uint32_t> toNeighbors;
+
+            void buildWedges() {
+                std::unordered_map<PositionKey, uint32_t, PositionKeyHash> table;
+                table.reserve(vertexCount);
+                for (size_t v = 0; v < vertexCount; ++v) {
+                    PositionKey key{};
+                    std::memcpy(&key, &positions[v], sizeof(key));
+                    auto it = table.emplace(key, static_cast<uint32_t>(v)).first;
+                    remap[v] = it->second;
+                    wedge[v] = static_cast<uint32_t>(v);
+                    if (remap[v] != v) {
+                        uint32_t r = remap[v];
+                        wedge[v] = wedge[r];
+                        wedge[r] = static_cast<uint32_t>(v);
+                    }
+                }
+            }
+
+            static bool hasEdge(const uint32_t *indices, const VertexTriangles &triangles, uint32_t a, uint32_t b) {
+                const uint32_t *list = &triangles.data[triangles.offsets[a]];
+                for (uint32_t i = 0; i < triangles.counts[a]; ++i) {
+                    const uint32_t *tri = &indices[list[i] * 3];
+                    for (int e = 0; e < 3; ++e) {
+                        if (tri[e] == a && tri[(e + 1) % 3] == b) {
+                            return true;
+                        }
+                    }
+                }
+                return false;
+            }
+
+            bool hasPositionEdge(const uint32_t *indices, const VertexTriangles &triangles, uint32_t a,
+                                 uint32_t b) const {
+                uint32_t wa = a;
+                do {
+                    uint32_t wb = b;
+                    do {
+                        if (hasEdge(indices, triangles, wa, wb)) {
+                            return true;
+                        }
+                        wb = wedge[wb];
+                    } while (wb != b);
+                    wa = wedge[wa];
+                } while (wa != a);
+                return false;
+            }
+
+            void classifyVertices(const uint32_t *indices, size_t indexCount) {
+                VertexTriangles triangles;
+                triangles.build(indices, indexCount, vertexCount);
+
+                for (size_t i = 0; i < indexCount; i += 3) {
+                    for (int e = 0; e < 3; ++e) {
+                        uint32_t a = indices[i + e];
+                        uint32_t b = indices[i + (e + 1) % 3];
+                        if (!hasEdge(indices, triangles, b, a)) {
+                            openOut[a] = openOut[a] == kNoEdge || openOut[a] == b ? b : kMultipleEdges;
+                            openIn[b] = openIn[b] == kNoEdge || openIn[b] == a ? a : kMultipleEdges;
+                        }
+                    }
+                }
+
+                auto isSingle = [](uint32_t edge) { return edge != kNoEdge && edge != kMultipleEdges; };
+                for (size_t v = 0; v < vertexCount; ++v) {
+                    if (triangles.counts[v] == 0) {
+                        kinds[v] = Locked;
+                    } else if (wedge[v] == v) {
+                        if (openOut[v] == kNoEdge && openIn[v] == kNoEdge) {
+                            kinds[v] = Manifold;
+                        } else if (isSingle(openOut[v]) && isSingle(openIn[v])) {
+                            kinds[v] = Border;
+                        } else {
+                            kinds[v] = Locked;
+                        }
+                    } else if (wedge[wedge[v]] == v) {
+                        uint32_t w = wedge[v];
+                        // 两侧的开放边在位置上互相对应时才是接缝
+                        if (isSingle(openOut[v]) && isSingle(openIn[v]) && isSingle(openOut[w]) &&
+                            isSingle(openIn[w]) && remap[openOut[v]] == remap[openIn[w]] &&
+                            remap[openIn[v]] == remap[openOut[w]] &&
+                            hasPositionEdge(indices, triangles, openOut[v], static_cast<uint32_t>(v)) &&
+                            hasPositionEdge(indices, triangles, static_cast<uint32_t>(v), openIn[v])) {
+                            kinds[v] = Seam;
+                        } else {
+                            kinds[v] = Locked;
+                        }
+                    } else {
+                        kinds[v] = Locked;
+                    }
+                }
+            }
+
+            void computeQuadrics(const uint32_t *indices, size_t indexCount) {
+                quadrics.assign(vertexCount, Quadric{});
+                for (size_t i = 0; i < indexCount; i += 3) {
+                    const Vec3 &p0 = positions[indices[i + 0]];
+                    const Vec3 &p1 = positions[indices[i + 1]];
+                    const Vec3 &p2 = positions[indices[i + 2]];
+                    Vec3 n = cross(sub(p1, p0), sub(p2, p0));
+                    float length = std::sqrt(dot(n, n));
+                    if (length <= 0.0f) {
+                        continue;
+                    }
+                    double nx = n.x / length, ny = n.y / length, nz = n.z / length;
+                    double d = -(nx * p0.x + ny * p0.y + nz * p0.z);
+                    Quadric q = Quadric::fromPlane(nx, ny, nz, d, length * 0.5);
+                    for (int k = 0; k < 3; ++k) {
+                        quadrics[remap[indices[i + k]]] += q;
+                    }
+
+                    // 几何意义上的开放边界：加一个垂直于三角形的约束平面
+                    for (int e = 0; e < 3; ++e) {
+                        uint32_t a = indices[i + e];
+                        uint32_t b = indices[i + (e + 1) % 3];
+                        if (kinds[a] != Border || openOut[a] != b) {
+                            continue;
+                        }
+                        Vec3 edge = sub(positions[b], positions[a]);
+                        float edgeLength = std::sqrt(dot(edge, edge));
+                        if (edgeLength <= 0.0f) {
+                            continue;
+                        }
+                        Vec3 en = cross(edge, n);
+                        float enLength = std::sqrt(dot(en, en));
+                        if (enLength <= 0.0f) {
+                            continue;
+                        }
+                        double ex = en.x / enLength, ey = en.y / enLength, ez = en.z / enLength;
+                        double ed = -(ex * positions[a].x + ey * positions[a].y + ez * positions[a].z);
+                        Quadric eq = Quadric::fromPlane(ex, ey, ez, ed, edgeLength * edgeLength * kBoundaryWeight);
+                        quadrics[remap[a]] += eq;
+                        quadrics[remap[b]] += eq;
+                    }
+                }
+            }
+
+            bool canCollapse(uint32_t from, uint32_t to) const {
+                if (remap[from] == remap[to]) {
+                    return false;
+                }
+                switch (kinds[from]) {
+                    case Manifold:
+                        return true;
+                    case Border:
+                        return to == openOut[from] || to == openIn[from];
+                    case Seam: {
+                        if (to != openOut[from] && to != openIn[from]) {
+                            return false;
+                        }
+                        uint32_t twin = wedge[from];
+                        uint32_t twinTarget = to == openOut[from] ? openIn[twin] : openOut[twin];
+                        return remap[twinTarget] == remap[to];
+                    }
+                    default:
+                        return false;
+                }
+            }
+
+            void pushCollapse(std::vector<Collapse> &collapses, uint32_t from, uint32_t to) const {
+                if (canCollapse(from, to)) {
+                    collapses.push_back({from, to, quadrics[remap[from]].error(positions[to])});
+                }
+            }
+
+            void collectNeighbors(const uint32_t *indices, const VertexTriangles &triangles, uint32_t v,
+                                  std::vector<uint32_t> &neighbors) const {
+                neighbors.clear();
+                uint32_t w = v;
+                do {
+                    const uint32_t *list = &triangles.data[triangles.offsets[w]];
+                    for (uint32_t i = 0; i < triangles.counts[w]; ++i) {
+                        const uint32_t *tri = &indices[list[i] * 3];
+                        for (int k = 0; k < 3; ++k) {
+                            if (remap[tri[k]] != remap[v]) {
+                                neighbors.push_back(remap[tri[k]]);
+                            }
+                        }
+                    }
+                    w = wedge[w];
+                } while (w != v);
+                std::sort(neighbors.begin(), neighbors.end());
+                neighbors.erase(std::unique(neighbors.begin(), neighbors.end()), neighbors.end());
+            }
+
+            // 折叠边两端的公共邻居只能是边两侧三角形的第三个顶点，否则会产生非流形的结构
+            bool linkConditionHolds(const uint32_t *indices, const VertexTriangles &triangles, uint32_t from,
+                                    uint32_t to) {
+                collectNeighbors(indices, triangles, from, fromNeighbors);
+                collectNeighbors(indices, triangles, to, toNeighbors);
+                size_t common = 0;
+                for (size_t i = 0, j = 0; i < fromNeighbors.size() && j < toNeighbors.size();) {
+                    if (fromNeighbors[i] < toNeighbors[j]) {
+                        i++;
+                    } else if (fromNeighbors[i] > toNeighbors[j]) {
+                        j++;
+                    } else {
+                        common++;
+                        i++;
+                        j++;
+                    }
+                }
+                return common <= (kinds[from] == Manifold ? 2u : 1u);
+            }
+
+            // 沿开放边折叠后，把边界链上的邻接关系接到新的顶点上
+            void updateOpenEdges(uint32_t from, uint32_t to) {
+                if (to == openOut[from]) {
+                    uint32_t previous = openIn[from];
+                    openOut[previous] = to;
+                    openIn[to] = previous;
+                } else {
+                    uint32_t next = openOut[from];
+                    openIn[next] = to;
+                    openOut[to] = next;
+                }
+            }
+
+            bool flipsTriangles(const uint32_t *indices, const VertexTriangles &triangles, uint32_t from,
+                                uint32_t to) const {
+                const Vec3 &target = positions[to];
+                uint32_t w = from;
+                do {
+                    const uint32_t *list = &triangles.data[triangles.offsets[w]];
+                    for (uint32_t i = 0; i < triangles.counts[w]; ++i) {
+                        const uint32_t *tri = &indices[list[i] * 3];
+                        if (remap[tri[0]] == remap[to] || remap[tri[1]] == remap[to] || remap[tri[2]] == remap[to]) {
+                            continue; // 折叠后退化，会被删除
+                        }
+                        Vec3 p[3] = {positions[tri[0]], positions[tri[1]], positions[tri[2]]};
+                        Vec3 oldNormal = cross(sub(p[1], p[0]), sub(p[2], p[0]));
+                        for (int k = 0; k < 3; ++k) {
+                            if (tri[k] == w) {
+                                p[k] = target;
+                            }
+                        }
+                        Vec3 newNormal = cross(sub(p[1], p[0]), sub(p[2], p[0]));
+                        if (dot(oldNormal, newNormal) <= 0.0f) {
+                            return true;
+                        }
+                    }
+                    w = wedge[w];
+                } while (w != from);
+                return false;
+            }
+
+            void lockNeighborhood(const uint32_t *indices, const VertexTriangles &triangles, uint32_t from,
+                                  std::vector<bool> &locked) const {
+                uint32_t w = from;
+                do {
+                    const uint32_t *list = &triangles.data[triangles.offsets[w]];
+                    for (uint32_t i = 0; i < triangles.counts[w]; ++i) {
+                        const uint32_t *tri = &indices[list[i] * 3];
+                        for (int k = 0; k < 3; ++k) {
+                            locked[remap[tri[k]]] = true;
+                        }
+                    }
+                    w = wedge[w];
+                } while (w != from);
+            }
+        };
+    }
+
+    size_t MeshOptimizer::simplify(uint32_t *destination, const uint32_t *indices, size_t indexCount,
+                                   const float *vertexPositions, size_t vertexCount, size_t vertexPositionsStride,
+                                   size_t targetIndexCount, float targetError, float *resultError) {
+        assert(indexCount % 3 == 0);
+        assert(vertexPositionsStride >= sizeof(float) * 3 && vertexPositionsStride % sizeof(float) == 0);
+        std::vector<uint32_t> result(indices, indices + indexCount);
+        float error = 0.0f;
+        if (indexCount > targetIndexCount) {
+            Simplifier simplifier(indices, indexCount, vertexPositions, vertexCount, vertexPositionsStride);
+            indexCount = simplifier.simplify(result.data(), indexCount, targetIndexCount, targetError, error);
+        }
+        std::memcpy(destination, result.data(), indexCount * sizeof(uint32_t));
+        if (resultError) {
+            *resultError = error;
+        }
+        return indexCount;
+    }
+}
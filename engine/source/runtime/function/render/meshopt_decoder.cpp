@@ -0,0 +1,555 @@
+#include "meshopt_decoder.h"
+
+#include <cmath>
+#include <cstring>
+
+#include "core/base/cpu_features.h"
+
+#if defined(MW_SIMD_X86)
+#include <tmmintrin.h>
+#endif
+
+namespace MW {
+    namespace {
+        constexpr uint8_t kVertexHeader = 0xa0;
+        constexpr uint8_t kIndexHeader = 0xe0;
+        constexpr uint8_t kSequenceHeader = 0xd0;
+
+        constexpr size_t kVertexBlockSizeBytes = 8192;
+        constexpr size_t kVertexBlockMaxSize = 256;
+        constexpr size_t kByteGroupSize = 16;
+        // 解码一个字节组最多读取的字节数，剩余数据不足时码流一定不完整
+        constexpr size_t kByteGroupDecodeLimit = 24;
+        constexpr size_t kTailMaxSize = 32;
+
+        size_t getVertexBlockSize(size_t stride) {
+            // 一个block的数据放得下scratch buffer，顶点数按字节组对齐
+            size_t result = kVertexBlockSizeBytes / stride;
+            result &= ~(kByteGroupSize - 1);
+            return result < kVertexBlockMaxSize ? result : kVertexBlockMaxSize;
+        }
+
+        uint8_t unzigzag8(uint8_t v) {
+            return static_cast<uint8_t>(-(v & 1) ^ (v >> 1));
+        }
+
+        // 每组16个字节，按头部的2bit选择0/2/4/8位编码，全1的值表示后面跟着一个完整字节
+        const uint8_t *decodeBytesGroup(const uint8_t *data, uint8_t *buffer, int bitslog2) {
+            switch (bitslog2) {
+                case 0:
+                    memset(buffer, 0, kByteGroupSize);
+                    return data;
+                case 1:
+                case 2: {
+                    const int bits = 1 << bitslog2;
+                    const int escape = (1 << bits) - 1;
+                    const uint8_t *dataVar = data + kByteGroupSize * bits / 8;
+                    for (size_t i = 0; i < kByteGroupSize; i++) {
+                        const int shift = 8 - bits - static_cast<int>(i * bits % 8);
+                        const int enc = (data[i * bits / 8] >> shift) & escape;
+                        buffer[i] = enc == escape ? *dataVar++ : static_cast<uint8_t>(enc);
+                    }
+                    return dataVar;
+                }
+                default:
+                    memcpy(buffer, data, kByteGroupSize);
+                    return data + kByteGroupSize;
+            }
+        }
+
+#if defined(MW_SIMD_X86)
+        // 按转义位的掩码把后续的完整字节散布到对应位置
+        struct ByteGroupTables {
+            alignas(16) uint8_t shuffle[256][8];
+            uint8_t count[256];
+
+            ByteGroupTables() {
+                for (int mask = 0; mask < 256; ++mask) {
+                    uint8_t next = 0;
+                    for (int i = 0; i < 8; ++i) {
+                        const bool escaped = (mask >> i) & 1;
+                        shuffle[mask][i] = escaped ? next : 0x80;
+                        next += escaped;
+                    }
+                    count[mask] = next;
+                }
+            }
+        };
+
+        const ByteGroupTables &getByteGroupTables() {
+            static const ByteGroupTables tables;
+            return tables;
+        }
+
+        MW_TARGET_SSSE3 const uint8_t *decodeBytesGroupSimd(const uint8_t *data, uint8_t *buffer, int bitslog2,
+                                                            const ByteGroupTables &tables) {
+            __m128i sel;
+            const uint8_t *rest;
+            switch (bitslog2) {
+                case 0:
+                    _mm_storeu_si128(reinterpret_cast<__m128i *>(buffer), _mm_setzero_si128());
+                    return data;
+                case 1: {
+                    int packed;
+                    memcpy(&packed, data, sizeof(packed));
+                    // 展开成每字节一个2bit的值，高位在前
+                    const __m128i sel2 = _mm_cvtsi32_si128(packed);
+                    const __m128i sel22 = _mm_unpacklo_epi8(_mm_srli_epi16(sel2, 4), sel2);
+                    const __m128i sel2222 = _mm_unpacklo_epi8(_mm_srli_epi16(sel22, 2), sel22);
+                    sel = _mm_and_si128(sel2222, _mm_set1_epi8(3));
+                    rest = data + 4;
+                    break;
+                }
+                case 2: {
+                    const __m128i sel4 = _mm_loadl_epi64(reinterpret_cast<const __m128i *>(data));
+                    const __m128i sel44 = _mm_unpacklo_epi8(_mm_srli_epi16(sel4, 4), sel4);
+                    sel = _mm_and_si128(sel44, _mm_set1_epi8(15));
+                    rest = data + 8;
+                    break;
+                }
+                default:
+                    _mm_storeu_si128(reinterpret_cast<__m128i *>(buffer),
+                                     _mm_loadu_si128(reinterpret_cast<const __m128i *>(data)));
+                    return data + kByteGroupSize;
+            }
+            const __m128i escape = _mm_set1_epi8(static_cast<char>(bitslog2 == 1 ? 3 : 15));
+            const __m128i mask = _mm_cmpeq_epi8(sel, escape);
+            const int mask16 = _mm_movemask_epi8(mask);
+            const int mask0 = mask16 & 255;
+            const int mask1 = mask16 >> 8;
+            const __m128i shuffle0 = _mm_loadl_epi64(reinterpret_cast<const __m128i *>(tables.shuffle[mask0]));
+            const __m128i shuffle1 = _mm_add_epi8(
+                    _mm_loadl_epi64(reinterpret_cast<const __m128i *>(tables.shuffle[mask1])),
+                    _mm_set1_epi8(static_cast<char>(tables.count[mask0])));
+            const __m128i shuffle = _mm_unpacklo_epi64(shuffle0, shuffle1);
+            const __m128i escaped = _mm_shuffle_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i *>(rest)),
+                                                     shuffle);
+            _mm_storeu_si128(reinterpret_cast<__m128i *>(buffer),
+                             _mm_or_si128(escaped, _mm_andnot_si128(mask, sel)));
+            return rest + tables.count[mask0] + tables.count[mask1];
+        }
+
+        MW_TARGET_SSSE3 const uint8_t *decodeBytesSimd(const uint8_t *data, const uint8_t *dataEnd, uint8_t *buffer,
+                                                       size_t size, const ByteGroupTables &tables) {
+            const uint8_t *header = data;
+            const size_t headerSize = (size / kByteGroupSize + 3) / 4;
+            if (static_cast<size_t>(dataEnd - data) < headerSize) {
+                return nullptr;
+            }
+            data += headerSize;
+            for (size_t i = 0; i < size; i += kByteGroupSize) {
+                if (static_cast<size_t>(dataEnd - data) < kByteGroupDecodeLimit) {
+                    return nullptr;
+                }
+                const size_t group = i / kByteGroupSize;
+                const int bitslog2 = (header[group / 4] >> ((group % 4) * 2)) & 3;
+                data = decodeBytesGroupSimd(data, buffer + i, bitslog2, tables);
+            }
+            return data;
+        }
+#endif
+
+        const uint8_t *decodeBytes(const uint8_t *data, const uint8_t *dataEnd, uint8_t *buffer, size_t size) {
+            // 每个字节组占头部的2bit
+            const uint8_t *header = data;
+            const size_t headerSize = (size / kByteGroupSize + 3) / 4;
+            if (static_cast<size_t>(dataEnd - data) < headerSize) {
+                return nullptr;
+            }
+            data += headerSize;
+            for (size_t i = 0; i < size; i += kByteGroupSize) {
+                if (static_cast<size_t>(dataEnd - data) < kByteGroupDecodeLimit) {
+                    return nullptr;
+                }
+                const size_t group = i / kByteGroupSize;
+                const int bitslog2 = (header[group / 4] >> ((group % 4) * 2)) & 3;
+                data = decodeBytesGroup(data, buffer + i, bitslog2);
+            }
+            return data;
+        }
+
+#if defined(MW_SIMD_X86)
+        // 一次解码4个字节流，stride必须是4的倍数
+        MW_TARGET_SSSE3 const uint8_t *decodeVertexBlockSimd(const uint8_t *data, const uint8_t *dataEnd,
+                                                             uint8_t *vertexData, size_t count, size_t stride,
+                                                             const uint8_t lastVertex[256]) {
+            const size_t alignedCount = (count + kByteGroupSize - 1) & ~(kByteGroupSize - 1);
+            const ByteGroupTables &tables = getByteGroupTables();
+            // 转置成16个顶点的32位数据后按字节做前缀和
+            alignas(16) uint8_t buffer[kVertexBlockMaxSize * 4];
+            alignas(16) uint32_t words[16];
+            const __m128i one = _mm_set1_epi8(1);
+            const __m128i low7 = _mm_set1_epi8(127);
+            for (size_t k = 0; k < stride; k += 4) {
+                for (size_t j = 0; j < 4; ++j) {
+                    data = decodeBytesSimd(data, dataEnd, buffer + j * alignedCount, alignedCount, tables);
+                    if (!data) {
+                        return nullptr;
+                    }
+                }
+                int last;
+                memcpy(&last, lastVertex + k, sizeof(last));
+                __m128i previous = _mm_set1_epi32(last);
+                for (size_t i = 0; i < count; i += kByteGroupSize) {
+                    const __m128i r0 = _mm_load_si128(reinterpret_cast<const __m128i *>(buffer + i));
+                    const __m128i r1 = _mm_load_si128(reinterpret_cast<const __m128i *>(buffer + alignedCount + i));
+                    const __m128i r2 = _mm_load_si128(
+                            reinterpret_cast<const __m128i *>(buffer + alignedCount * 2 + i));
+                    const __m128i r3 = _mm_load_si128(
+                            reinterpret_cast<const __m128i *>(buffer + alignedCount * 3 + i));
+                    const __m128i t0 = _mm_unpacklo_epi8(r0, r1);
+                    const __m128i t1 = _mm_unpackhi_epi8(r0, r1);
+                    const __m128i t2 = _mm_unpacklo_epi8(r2, r3);
+                    const __m128i t3 = _mm_unpackhi_epi8(r2, r3);
+                    __m128i vertices[4] = {_mm_unpacklo_epi16(t0, t2), _mm_unpackhi_epi16(t0, t2),
+                                           _mm_unpacklo_epi16(t1, t3), _mm_unpackhi_epi16(t1, t3)};
+                    for (int m = 0; m < 4; ++m) {
+                        __m128i v = vertices[m];
+                        v = _mm_xor_si128(_mm_sub_epi8(_mm_setzero_si128(), _mm_and_si128(v, one)),
+                                          _mm_and_si128(_mm_srli_epi16(v, 1), low7));
+                        v = _mm_add_epi8(v, _mm_slli_si128(v, 4));
+                        v = _mm_add_epi8(v, _mm_slli_si128(v, 8));
+                        v = _mm_add_epi8(v, previous);
+                        previous = _mm_shuffle_epi32(v, 0xff);
+                        _mm_store_si128(reinterpret_cast<__m128i *>(words + m * 4), v);
+                    }
+                    const size_t groupCount = count - i < kByteGroupSize ? count - i : kByteGroupSize;
+                    for (size_t v = 0; v < groupCount; ++v) {
+                        memcpy(vertexData + (i + v) * stride + k, &words[v], sizeof(uint32_t));
+                    }
+                }
+            }
+            return data;
+        }
+#endif
+
+        // 顶点的每个字节单独成流，存的是和上一个顶点同一字节的zigzag差值
+        const uint8_t *decodeVertexBlock(const uint8_t *data, const uint8_t *dataEnd, uint8_t *vertexData,
+                                         size_t count, size_t stride, uint8_t lastVertex[256]) {
+#if defined(MW_SIMD_X86)
+            if (cpuSupportsSSSE3()) {
+                data = decodeVertexBlockSimd(data, dataEnd, vertexData, count, stride, lastVertex);
+                if (!data) {
+                    return nullptr;
+                }
+                memcpy(lastVertex, vertexData + (count - 1) * stride, stride);
+                return data;
+            }
+#endif
+            const size_t alignedCount = (count + kByteGroupSize - 1) & ~(kByteGroupSize - 1);
+            uint8_t buffer[kVertexBlockMaxSize];
+            for (size_t k = 0; k < stride; ++k) {
+                data = decodeBytes(data, dataEnd, buffer, alignedCount);
+                if (!data) {
+                    return nullptr;
+                }
+                uint8_t previous = lastVertex[k];
+                for (size_t i = 0; i < count; ++i) {
+                    previous = static_cast<uint8_t>(unzigzag8(buffer[i]) + previous);
+                    vertexData[i * stride + k] = previous;
+                }
+            }
+            memcpy(lastVertex, vertexData + (count - 1) * stride, stride);
+            return data;
+        }
+
+        uint32_t decodeVByte(const uint8_t *&data) {
+            const uint8_t lead = *data++;
+            if (lead < 128) {
+                return lead;
+            }
+            // 小端的7位分组，最多5个字节
+            uint32_t result = lead & 127;
+            uint32_t shift = 7;
+            for (int i = 0; i < 4; ++i) {
+                const uint8_t group = *data++;
+                result |= static_cast<uint32_t>(group & 127) << shift;
+                shift += 7;
+                if (group < 128) {
+                    break;
+                }
+            }
+            return result;
+        }
+
+        uint32_t decodeIndex(const uint8_t *&data, uint32_t last) {
+            const uint32_t v = decodeVByte(data);
+            const uint32_t delta = (v >> 1) ^ (0u - (v & 1));
+            return last + delta;
+        }
+
+        void writeIndex(void *destination, size_t offset, size_t indexSize, uint32_t index) {
+            if (indexSize == 2) {
+                static_cast<uint16_t *>(destination)[offset] = static_cast<uint16_t>(index);
+            } else {
+                static_cast<uint32_t *>(destination)[offset] = index;
+            }
+        }
+
+        void writeTriangle(void *destination, size_t offset, size_t indexSize, uint32_t a, uint32_t b, uint32_t c) {
+            writeIndex(destination, offset + 0, indexSize, a);
+            writeIndex(destination, offset + 1, indexSize, b);
+            writeIndex(destination, offset + 2, indexSize, c);
+        }
+
+        // 最近16个顶点和16条边的环形缓冲，编码器和解码器必须以完全相同的顺序写入
+        struct IndexFifo {
+            uint32_t vertices[16];
+            uint32_t edges[16][2];
+            size_t vertexOffset{0};
+            size_t edgeOffset{0};
+
+            IndexFifo() {
+                memset(vertices, -1, sizeof(vertices));
+                memset(edges, -1, sizeof(edges));
+            }
+
+            void pushVertex(uint32_t v, bool condition = true) {
+                vertices[vertexOffset] = v;
+                vertexOffset = (vertexOffset + (condition ? 1 : 0)) & 15;
+            }
+
+            void pushEdge(uint32_t a, uint32_t b) {
+                edges[edgeOffset][0] = a;
+                edges[edgeOffset][1] = b;
+                edgeOffset = (edgeOffset + 1) & 15;
+            }
+        };
+
+        template<typename T>
+        void decodeOctahedral(T *data, size_t count) {
+            const float maxValue = static_cast<float>((1 << (sizeof(T) * 8 - 1)) - 1);
+            for (size_t i = 0; i < count; ++i) {
+                // z分量存的是1.0的编码，据此还原八面体映射
+                float x = static_cast<float>(data[i * 4 + 0]);
+                float y = static_cast<float>(data[i * 4 + 1]);
+                const float z = static_cast<float>(data[i * 4 + 2]) - std::fabs(x) - std::fabs(y);
+                const float t = z < 0.0f ? z : 0.0f;
+                x += x >= 0.0f ? t : -t;
+                y += y >= 0.0f ? t : -t;
+                const float scale = maxValue / std::sqrt(x * x + y * y + z * z);
+                data[i * 4 + 0] = static_cast<T>(static_cast<int>(x * scale + (x >= 0.0f ? 0.5f : -0.5f)));
+                data[i * 4 + 1] = static_cast<T>(static_cast<int>(y * scale + (y >= 0.0f ? 0.5f : -0.5f)));
+                data[i * 4 + 2] = static_cast<T>(static_cast<int>(z * scale + (z >= 0.0f ? 0.5f : -0.5f)));
+            }
+        }
+
+        void decodeQuaternion(int16_t *data, size_t count) {
+            const float scale = 1.0f / std::sqrt(2.0f);
+            for (size_t i = 0; i < count; ++i) {
+                // 第4个分量的高位是量化的范围，低2位是省略的最大分量的下标
+                const int range = data[i * 4 + 3] | 3;
+                const float rangeScale = scale / static_cast<float>(range);
+                const float x = static_cast<float>(data[i * 4 + 0]) * rangeScale;
+                const float y = static_cast<float>(data[i * 4 + 1]) * rangeScale;
+                const float z = static_cast<float>(data[i * 4 + 2]) * rangeScale;
+                const float ww = 1.0f - x * x - y * y - z * z;
+                const float w = std::sqrt(ww >= 0.0f ? ww : 0.0f);
+                const int xf = static_cast<int>(x * 32767.0f + (x >= 0.0f ? 0.5f : -0.5f));
+                const int yf = static_cast<int>(y * 32767.0f + (y >= 0.0f ? 0.5f : -0.5f));
+                const int zf = static_cast<int>(z * 32767.0f + (z >= 0.0f ? 0.5f : -0.5f));
+                const int wf = static_cast<int>(w * 32767.0f + 0.5f);
+                const int component = data[i * 4 + 3] & 3;
+                data[i * 4 + ((component + 1) & 3)] = static_cast<int16_t>(xf);
+                data[i * 4 + ((component + 2) & 3)] = static_cast<int16_t>(yf);
+                data[i * 4 + ((component + 3) & 3)] = static_cast<int16_t>(zf);
+                data[i * 4 + ((component + 0) & 3)] = static_cast<int16_t>(wf);
+            }
+        }
+
+        void decodeExponential(uint32_t *data, size_t count) {
+            for (size_t i = 0; i < count; ++i) {
+                // 24位有符号尾数和8位有符号指数，等价于ldexp(mantissa, exponent)
+                const uint32_t v = data[i];
+                const int32_t mantissa = static_cast<int32_t>(v << 8) >> 8;
+                const int32_t exponent = static_cast<int32_t>(v) >> 24;
+                float value;
+                const uint32_t bits = static_cast<uint32_t>(exponent + 127) << 23;
+                memcpy(&value, &bits, sizeof(value));
+                value *= static_cast<float>(mantissa);
+                memcpy(&data[i], &value, sizeof(value));
+            }
+        }
+    }
+
+    bool decodeMeshoptVertexBuffer(void *destination, size_t count, size_t stride, const uint8_t *data, size_t size) {
+        if (stride == 0 || stride > 256 || stride % 4 != 0) {
+            return false;
+        }
+        const uint8_t *dataEnd = data + size;
+        if (size < 1 + stride || (data[0] & 0xf0) != kVertexHeader || (data[0] & 0x0f) != 0) {
+            return false;
+        }
+        ++data;
+        // 码流末尾存着第一个顶点的基准值
+        uint8_t lastVertex[256];
+        memcpy(lastVertex, dataEnd - stride, stride);
+
+        uint8_t *vertexData = static_cast<uint8_t *>(destination);
+        const size_t blockSize = getVertexBlockSize(stride);
+        for (size_t offset = 0; offset < count; offset += blockSize) {
+            const size_t blockCount = offset + blockSize < count ? blockSize : count - offset;
+            data = decodeVertexBlock(data, dataEnd, vertexData + offset * stride, blockCount, stride, lastVertex);
+            if (!data) {
+                return false;
+            }
+        }
+        const size_t tailSize = stride < kTailMaxSize ? kTailMaxSize : stride;
+        return static_cast<size_t>(dataEnd - data) == tailSize;
+    }
+
+    bool decodeMeshoptIndexBuffer(void *destination, size_t count, size_t indexSize, const uint8_t *data,
+                                  size_t size) {
+        if (count % 3 != 0 || (indexSize != 2 && indexSize != 4)) {
+            return false;
+        }
+        // 至少有头部、每个三角形1字节的code和16字节的codeaux表
+        if (size < 1 + count / 3 + 16 || (data[0] & 0xf0) != kIndexHeader) {
+            return false;
+        }
+        const int version = data[0] & 0x0f;
+        if (version > 1) {
+            return false;
+        }
+        IndexFifo fifo;
+        uint32_t next = 0;
+        uint32_t last = 0;
+        // 版本1中13/14表示上一个自由索引+-1
+        const int fecMax = version >= 1 ? 13 : 15;
+
+        const uint8_t *code = data + 1;
+        const uint8_t *stream = code + count / 3;
+        const uint8_t *streamEnd = data + size - 16;
+        const uint8_t *codeauxTable = streamEnd;
+
+        for (size_t i = 0; i < count; i += 3) {
+            // 每个三角形最多读取16字节，之后的读取不用再检查边界
+            if (stream > streamEnd) {
+                return false;
+            }
+            const uint8_t codetri = *code++;
+            if (codetri < 0xf0) {
+                // 复用fifo中的一条边
+                const int fe = codetri >> 4;
+                const uint32_t a = fifo.edges[(fifo.edgeOffset - 1 - fe) & 15][0];
+                const uint32_t b = fifo.edges[(fifo.edgeOffset - 1 - fe) & 15][1];
+                const int fec = codetri & 15;
+                uint32_t c;
+                if (fec < fecMax) {
+                    c = fec == 0 ? next : fifo.vertices[(fifo.vertexOffset - 1 - fec) & 15];
+                    next += fec == 0;
+                    fifo.pushVertex(c, fec == 0);
+                } else {
+                    last = c = fec != 15 ? last + (fec - (fec ^ 3)) : decodeIndex(stream, last);
+                    fifo.pushVertex(c);
+                }
+                writeTriangle(destination, i, indexSize, a, b, c);
+                fifo.pushEdge(c, b);
+                fifo.pushEdge(a, c);
+            } else if (codetri < 0xfe) {
+                // 常见的三个顶点组合查表得到
+                const uint8_t codeaux = codeauxTable[codetri & 15];
+                const int feb = codeaux >> 4;
+                const int fec = codeaux & 15;
+                const uint32_t a = next++;
+                const uint32_t b = feb == 0 ? next : fifo.vertices[(fifo.vertexOffset - feb) & 15];
+                next += feb == 0;
+                const uint32_t c = fec == 0 ? next : fifo.vertices[(fifo.vertexOffset - fec) & 15];
+                next += fec == 0;
+                writeTriangle(destination, i, indexSize, a, b, c);
+                fifo.pushVertex(a);
+                fifo.pushVertex(b, feb == 0);
+                fifo.pushVertex(c, fec == 0);
+                fifo.pushEdge(b, a);
+                fifo.pushEdge(c, b);
+                fifo.pushEdge(a, c);
+            } else {
+                const uint8_t codeaux = *stream++;
+                const int fea = codetri == 0xfe ? 0 : 15;
+                const int feb = codeaux >> 4;
+                const int fec = codeaux & 15;
+                // codeaux为0时重置next
+                if (codeaux == 0) {
+                    next = 0;
+                }
+                uint32_t a = fea == 0 ? next++ : 0;
+                uint32_t b = feb == 0 ? next++ : fifo.vertices[(fifo.vertexOffset - feb) & 15];
+                uint32_t c = fec == 0 ? next++ : fifo.vertices[(fifo.vertexOffset - fec) & 15];
+                if (fea == 15) {
+                    last = a = decodeIndex(stream, last);
+                }
+                if (feb == 15) {
+                    last = b = decodeIndex(stream, last);
+                }
+                if (fec == 15) {
+                    last = c = decodeIndex(stream, last);
+                }
+                writeTriangle(destination, i, indexSize, a, b, c);
+                fifo.pushVertex(a);
+                fifo.pushVertex(b, feb == 0 || feb == 15);
+                fifo.pushVertex(c, fec == 0 || fec == 15);
+                fifo.pushEdge(b, a);
+                fifo.pushEdge(c, b);
+                fifo.pushEdge(a, c);
+            }
+        }
+        return stream == streamEnd;
+    }
+
+    bool decodeMeshoptIndexSequence(void *destination, size_t count, size_t indexSize, const uint8_t *data,
+                                    size_t size) {
+        if (indexSize != 2 && indexSize != 4) {
+            return false;
+        }
+        // 至少有头部、每个索引1字节和4字节的结尾
+        if (size < 1 + count + 4 || (data[0] & 0xf0) != kSequenceHeader || (data[0] & 0x0f) > 1) {
+            return false;
+        }
+        const uint8_t *stream = data + 1;
+        const uint8_t *streamEnd = data + size - 4;
+        // 两个基准交替使用，最低位选择基准
+        uint32_t last[2] = {0, 0};
+        for (size_t i = 0; i < count; ++i) {
+            if (stream >= streamEnd) {
+                return false;
+            }
+            uint32_t v = decodeVByte(stream);
+            const uint32_t baseline = v & 1;
+            v >>= 1;
+            const uint32_t delta = (v >> 1) ^ (0u - (v & 1));
+            last[baseline] += delta;
+            writeIndex(destination, i, indexSize, last[baseline]);
+        }
+        return stream == streamEnd;
+    }
+
+    bool applyMeshoptFilter(MeshoptFilter filter, void *data, size_t count, size_t stride) {
+        switch (filter) {
+            case MeshoptFilter::None:
+                return true;
+            case MeshoptFilter::Octahedral:
+                if (stride == 4) {
+                    decodeOctahedral(static_cast<int8_t *>(data), count);
+                    return true;
+                }
+                if (stride == 8) {
+                    decodeOctahedral(static_cast<int16_t *>(data), count);
+                    return true;
+                }
+                return false;
+            case MeshoptFilter::Quaternion:
+                if (stride != 8) {
+                    return false;
+                }
+                decodeQuaternion(static_cast<int16_t *>(data), count);
+                return true;
+            case MeshoptFilter::Exponential:
+                if (stride % 4 != 0) {
+                    return false;
+                }
+                decodeExponential(static_cast<uint32_t *>(data), count * stride / 4);
+                return true;
+        }
+        return false;
+    }
+}
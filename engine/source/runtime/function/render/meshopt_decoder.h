@@ -0,0 +1,30 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+namespace MW {
+    enum class MeshoptFilter : uint32_t {
+        None,
+        Octahedral,
+        Quaternion,
+        Exponential
+    };
+
+    // EXT_meshopt_compression的三种码流，格式和meshoptimizer的编码器一致(顶点码流版本0，索引码流版本0/1)
+    // 数据不完整或格式不对时返回false
+
+    // stride必须是4的倍数且不超过256
+    bool decodeMeshoptVertexBuffer(void *destination, size_t count, size_t stride, const uint8_t *data, size_t size);
+
+    // 三角形列表，indexSize为2或4
+    bool decodeMeshoptIndexBuffer(void *destination, size_t count, size_t indexSize, const uint8_t *data,
+                                  size_t size);
+
+    // 任意顺序的索引序列，indexSize为2或4
+    bool decodeMeshoptIndexSequence(void *destination, size_t count, size_t indexSize, const uint8_t *data,
+                                    size_t size);
+
+    // 在解码后的顶点数据上原地还原filter，返回stride是否和filter匹配
+    bool applyMeshoptFilter(MeshoptFilter filter, void *data, size_t count, size_t stride);
+}
@@ -0,0 +1,315 @@
+#include "model_cache.h"
+
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+
+#include "core/base/hash.h"
+
+namespace MW {
+    namespace {
+        constexpr char kModelCacheMagic[4] = {'M', 'W', 'M', 'C'};
+        constexpr size_t kSectionAlignment = 16;
+        constexpr uint32_t kSectionCount = static_cast<uint32_t>(ModelCacheSection::Count);
+
+        size_t alignUp(size_t value, size_t alignment) {
+            return (value + alignment - 1) / alignment * alignment;
+        }
+
+        std::string getDirectory(const std::string &filename) {
+            size_t pos = filename.find_last_of("/\\");
+            return pos == std::string::npos ? std::string(".") : filename.substr(0, pos);
+        }
+
+        // 每个section的元素大小，为0时这个缓存不包含该section
+        size_t getElementSize(ModelCacheSection section, const ModelCacheHeader &header) {
+            switch (section) {
+                case ModelCacheSection::Vertices:
+                    return header.vertexStride;
+                case ModelCacheSection::MeshVertices:
+                    return header.meshVertexStride;
+                case ModelCacheSection::Indices:
+                    return sizeof(uint32_t);
+                case ModelCacheSection::Meshlets:
+                    return header.meshletStride;
+                case ModelCacheSection::Nodes:
+                    return sizeof(CachedNode);
+                case ModelCacheSection::Primitives:
+                    return sizeof(CachedPrimitive);
+                case ModelCacheSection::Lods:
+                    return sizeof(CachedLod);
+                case ModelCacheSection::Materials:
+                    return sizeof(CachedMaterial);
+                case ModelCacheSection::Images:
+                    return sizeof(CachedImage);
+                case ModelCacheSection::Dependencies:
+                    return sizeof(CachedString);
+                case ModelCacheSection::Strings:
+                    return sizeof(char);
+                default:
+                    return 0;
+            }
+        }
+
+        bool isValidRange(uint32_t first, uint32_t count, size_t total) {
+            return static_cast<uint64_t>(first) + count <= total;
+        }
+
+        // -1表示没有贴图，-2表示emptyTexture
+        bool isValidImageIndex(int32_t index, size_t imageCount) {
+            return index == -1 || index == -2 || (index >= 0 && static_cast<size_t>(index) < imageCount);
+        }
+    }
+
+    std::string ModelCache::getCachePath(const std::string &filename, uint32_t fileLoadingFlags) {
+        char flags[16];
+        snprintf(flags, sizeof(flags), "%08x", fileLoadingFlags);
+        return filename + "." + flags + ".mwcache";
+    }
+
+    bool ModelCache::computeSourceHash(const std::string &filename, const std::vector<std::string> &dependencies,
+                                       uint64_t &hash) {
+        VirtualFile source;
+        if (!VirtualFileSystem::global().open(filename, source)) {
+            return false;
+        }
+        hash = hash_bytes(source.data(), source.size(), VERSION);
+        const std::string directory = getDirectory(filename);
+        for (const std::string &dependency: dependencies) {
+            VirtualFile dependencyFile;
+            if (!VirtualFileSystem::global().open(directory + "/" + dependency, dependencyFile)) {
+                return false;
+            }
+            hash = hash_bytes(dependencyFile.data(), dependencyFile.size(), hash);
+        }
+        return true;
+    }
+
+    bool ModelCache::open(const std::string &cachePath, const std::string &filename, uint32_t fileLoadingFlags,
+                          uint32_t vertexStride, uint32_t meshVertexStride, uint32_t meshletStride) {
+        close();
+        if (!VirtualFileSystem::global().open(cachePath, file)) {
+            return false;
+        }
+        const size_t tableSize = sizeof(ModelCacheHeader) + sizeof(ModelCacheSectionEntry) * kSectionCount;
+        if (file.size() < tableSize) {
+            close();
+            return false;
+        }
+        memcpy(&header, file.data(), sizeof(header));
+        if (memcmp(header.magic, kModelCacheMagic, sizeof(kModelCacheMagic)) != 0 || header.version != VERSION ||
+            header.fileLoadingFlags != fileLoadingFlags || header.vertexStride != vertexStride ||
+            header.meshVertexStride != meshVertexStride || header.meshletStride != meshletStride ||
+            header.sectionCount != kSectionCount) {
+            close();
+            return false;
+        }
+        memcpy(sections, file.data() + sizeof(ModelCacheHeader), sizeof(ModelCacheSectionEntry) * kSectionCount);
+        if (!validate()) {
+            std::cerr << "Ignoring corrupt model cache \"" << cachePath << "\"" << std::endl;
+            close();
+            return false;
+        }
+
+        // 依赖文件列表存在缓存里，源文件或任何一个依赖变化都会让缓存失效
+        size_t dependencyCount = 0;
+        const CachedString *dependencyList = getSection<CachedString>(ModelCacheSection::Dependencies,
+                                                                      dependencyCount);
+        std::vector<std::string> dependencyNames;
+        for (size_t i = 0; i < dependencyCount; ++i) {
+            dependencyNames.push_back(getString(dependencyList[i]));
+        }
+        uint64_t sourceHash = 0;
+        if (!computeSourceHash(filename, dependencyNames, sourceHash) || sourceHash != header.sourceHash) {
+            close();
+            return false;
+        }
+        return true;
+    }
+
+    void ModelCache::close() {
+        file.close();
+        header = {};
+        memset(sections, 0, sizeof(sections));
+    }
+
+    const void *ModelCache::getSectionData(ModelCacheSection section, size_t &size) const {
+        const ModelCacheSectionEntry &entry = sections[static_cast<uint32_t>(section)];
+        size = entry.size;
+        return entry.size ? file.data() + entry.offset : nullptr;
+    }
+
+    std::string ModelCache::getString(const CachedString &string) const {
+        size_t size = 0;
+        const char *data = static_cast<const char *>(getSectionData(ModelCacheSection::Strings, size));
+        if (data == nullptr || static_cast<uint64_t>(string.offset) + string.length > size) {
+            return {};
+        }
+        return std::string(data + string.offset, string.length);
+    }
+
+    bool ModelCache::isValidString(const CachedString &string) const {
+        return isValidRange(string.offset, string.length,
+                            sections[static_cast<uint32_t>(ModelCacheSection::Strings)].size);
+    }
+
+    bool ModelCache::validate() const {
+        for (uint32_t i = 0; i < kSectionCount; ++i) {
+            const ModelCacheSectionEntry &entry = sections[i];
+            const uint64_t elementSize = getElementSize(static_cast<ModelCacheSection>(i), header);
+            if (entry.type != i || entry.offset % kSectionAlignment != 0 || entry.size > file.size() ||
+                entry.offset > file.size() - entry.size) {
+                return false;
+            }
+            if (elementSize == 0 ? entry.elementCount != 0 : entry.elementCount * elementSize > entry.size) {
+                return false;
+            }
+        }
+
+        size_t vertexCount = 0, indexCount = 0, meshletCount = 0, nodeCount = 0, primitiveCount = 0, lodCount = 0;
+        size_t materialCount = 0, imageCount = 0, dependencyCount = 0;
+        getSection<char>(ModelCacheSection::Vertices, vertexCount);
+        getSection<char>(ModelCacheSection::Meshlets, meshletCount);
+        const uint32_t *indices = getSection<uint32_t>(ModelCacheSection::Indices, indexCount);
+        const CachedNode *nodes = getSection<CachedNode>(ModelCacheSection::Nodes, nodeCount);
+        const CachedPrimitive *primitives = getSection<CachedPrimitive>(ModelCacheSection::Primitives, primitiveCount);
+        const CachedLod *lods = getSection<CachedLod>(ModelCacheSection::Lods, lodCount);
+        const CachedMaterial *materials = getSection<CachedMaterial>(ModelCacheSection::Materials, materialCount);
+        const CachedImage *images = getSection<CachedImage>(ModelCacheSection::Images, imageCount);
+        const CachedString *dependencyList = getSection<CachedString>(ModelCacheSection::Dependencies,
+                                                                      dependencyCount);
+
+        for (size_t i = 0; i < dependencyCount; ++i) {
+            if (!isValidString(dependencyList[i])) {
+                return false;
+            }
+        }
+        for (size_t i = 0; i < imageCount; ++i) {
+            if (!isValidString(images[i].uri)) {
+                return false;
+            }
+        }
+        for (size_t i = 0; i < materialCount; ++i) {
+            const CachedMaterial &material = materials[i];
+            if (!isValidImageIndex(material.baseColorTexture, imageCount) ||
+                !isValidImageIndex(material.metallicRoughnessTexture, imageCount) ||
+                !isValidImageIndex(material.normalTexture, imageCount) ||
+                !isValidImageIndex(material.occlusionTexture, imageCount) ||
+                !isValidImageIndex(material.emissiveTexture, imageCount)) {
+                return false;
+            }
+        }
+        for (size_t i = 0; i < nodeCount; ++i) {
+            const CachedNode &node = nodes[i];
+            if (node.parent >= static_cast<int64_t>(nodeCount) || !isValidString(node.name) ||
+                !isValidString(node.meshName) || !isValidRange(node.firstPrimitive, node.primitiveCount,
+                                                                primitiveCount)) {
+                return false;
+            }
+        }
+        for (size_t i = 0; i < primitiveCount; ++i) {
+            const CachedPrimitive &primitive = primitives[i];
+            if (primitive.material >= materialCount ||
+                !isValidRange(primitive.firstIndex, primitive.indexCount, indexCount) ||
+                !isValidRange(primitive.firstVertex, primitive.vertexCount, vertexCount) ||
+                !isValidRange(primitive.firstLod, primitive.lodCount, lodCount) ||
+                !isValidRange(primitive.firstMeshlet, primitive.meshletsCount, meshletCount)) {
+                return false;
+            }
+        }
+        for (size_t i = 0; i < lodCount; ++i) {
+            if (!isValidRange(lods[i].firstIndex, lods[i].indexCount, indexCount) ||
+                !isValidRange(lods[i].firstMeshlet, lods[i].meshletsCount, meshletCount)) {
+                return false;
+            }
+        }
+        // 索引直接进入GPU，越界的顶点下标同样拒绝
+        for (size_t i = 0; i < indexCount; ++i) {
+            if (indices[i] >= vertexCount) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    void ModelCache::addSection(ModelCacheSection section, const void *data, size_t size, size_t elementCount) {
+        PendingSection &pending = pendingSections[static_cast<uint32_t>(section)];
+        pending.data = data;
+        pending.size = size;
+        pending.elementCount = elementCount;
+    }
+
+    CachedString ModelCache::addString(const std::string &string) {
+        CachedString cached{static_cast<uint32_t>(strings.size()), static_cast<uint32_t>(string.size())};
+        strings.insert(strings.end(), string.begin(), string.end());
+        return cached;
+    }
+
+    bool ModelCache::write(const std::string &cachePath, const std::string &filename, uint32_t fileLoadingFlags,
+                           uint32_t vertexStride, uint32_t meshVertexStride, uint32_t meshletStride,
+                           uint32_t modelFlags) {
+        ModelCacheHeader newHeader{};
+        memcpy(newHeader.magic, kModelCacheMagic, sizeof(kModelCacheMagic));
+        newHeader.version = VERSION;
+        newHeader.fileLoadingFlags = fileLoadingFlags;
+        newHeader.vertexStride = vertexStride;
+        newHeader.meshVertexStride = meshVertexStride;
+        newHeader.meshletStride = meshletStride;
+        newHeader.modelFlags = modelFlags;
+        newHeader.sectionCount = kSectionCount;
+        if (!computeSourceHash(filename, dependencies, newHeader.sourceHash)) {
+            return false;
+        }
+
+        dependencyStrings.clear();
+        for (const std::string &dependency: dependencies) {
+            dependencyStrings.push_back(addString(dependency));
+        }
+        addSection(ModelCacheSection::Dependencies, dependencyStrings);
+        addSection(ModelCacheSection::Strings, strings.data(), strings.size(), strings.size());
+
+        ModelCacheSectionEntry entries[kSectionCount]{};
+        size_t offset = alignUp(sizeof(ModelCacheHeader) + sizeof(entries), kSectionAlignment);
+        for (uint32_t i = 0; i < kSectionCount; ++i) {
+            entries[i].type = i;
+            entries[i].elementCount = static_cast<uint32_t>(pendingSections[i].elementCount);
+            entries[i].offset = offset;
+            entries[i].size = pendingSections[i].size;
+            offset = alignUp(offset + pendingSections[i].size, kSectionAlignment);
+        }
+
+        // 先写临时文件再重命名，避免中途失败留下损坏的缓存
+        const std::string tempPath = cachePath + ".tmp";
+        {
+            std::ofstream out(tempPath, std::ios::binary | std::ios::trunc);
+            if (!out) {
+                std::cerr << "Could not write model cache \"" << tempPath << "\"" << std::endl;
+                return false;
+            }
+            out.write(reinterpret_cast<const char *>(&newHeader), sizeof(newHeader));
+            out.write(reinterpret_cast<const char *>(entries), sizeof(entries));
+            size_t written = sizeof(newHeader) + sizeof(entries);
+            static const char padding[kSectionAlignment] = {};
+            for (uint32_t i = 0; i < kSectionCount; ++i) {
+                out.write(padding, static_cast<std::streamsize>(entries[i].offset - written));
+                if (entries[i].size) {
+                    out.write(static_cast<const char *>(pendingSections[i].data),
+                              static_cast<std::streamsize>(entries[i].size));
+                }
+                written = entries[i].offset + entries[i].size;
+            }
+            if (!out) {
+                out.close();
+                std::remove(tempPath.c_str());
+                return false;
+            }
+        }
+        std::remove(cachePath.c_str());
+        if (std::rename(tempPath.c_str(), cachePath.c_str()) != 0) {
+            std::remove(tempPath.c_str());
+            return false;
+        }
+        return true;
+    }
+}
@@ -0,0 +1,182 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "core/file/virtual_file_system.h"
+
+namespace MW {
+    /*
+        Cooked binary model cache
+        文件由header、section表和按16字节对齐的section数据组成，加载时整个文件被映射到内存中，
+        顶点/索引/meshlet数组可以直接拷贝进staging buffer
+    */
+    enum class ModelCacheSection : uint32_t {
+        Vertices = 0,
+        MeshVertices,
+        Indices,
+        Meshlets,
+        Nodes,
+        Primitives,
+        Lods,
+        Materials,
+        Images,
+        Dependencies,
+        Strings,
+        Count
+    };
+
+    struct ModelCacheHeader {
+        char magic[4];
+        uint32_t version;
+        uint64_t sourceHash;
+        uint32_t fileLoadingFlags;
+        uint32_t vertexStride;
+        uint32_t meshVertexStride;
+        uint32_t meshletStride;
+        uint32_t modelFlags;
+        uint32_t sectionCount;
+    };
+
+    struct ModelCacheSectionEntry {
+        uint32_t type;
+        uint32_t elementCount;
+        uint64_t offset;
+        uint64_t size;
+    };
+
+    // 字符串统一存放在Strings section中
+    struct CachedString {
+        uint32_t offset;
+        uint32_t length;
+    };
+
+    struct CachedNode {
+        int32_t parent; // linearNodes中的下标
+        uint32_t index;
+        int32_t skinIndex;
+        CachedString name;
+        float matrix[16];
+        float translation[3];
+        float rotation[4];
+        float scale[3];
+        int32_t hasMesh;
+        CachedString meshName;
+        uint32_t firstPrimitive;
+        uint32_t primitiveCount;
+    };
+
+    struct CachedPrimitive {
+        uint32_t firstIndex;
+        uint32_t indexCount;
+        uint32_t firstVertex;
+        uint32_t vertexCount;
+        uint32_t material;
+        float dimensionsMin[3];
+        float dimensionsMax[3];
+        float boundsCenter[3];
+        float boundsRadius;
+        uint32_t firstLod;
+        uint32_t lodCount;
+        uint32_t firstMeshlet;
+        uint32_t meshletsCount;
+    };
+
+    struct CachedLod {
+        uint32_t firstIndex;
+        uint32_t indexCount;
+        float error;
+        uint32_t firstMeshlet;
+        uint32_t meshletsCount;
+    };
+
+    struct CachedMaterial {
+        uint32_t alphaMode;
+        float alphaCutoff;
+        float metallicFactor;
+        float roughnessFactor;
+        float baseColorFactor[4];
+        // 图片下标，-1表示没有，-2表示emptyTexture
+        int32_t baseColorTexture;
+        int32_t metallicRoughnessTexture;
+        int32_t normalTexture;
+        int32_t occlusionTexture;
+        int32_t emissiveTexture;
+    };
+
+    struct CachedImage {
+        CachedString uri;
+    };
+
+    class ModelCache {
+    public:
+        static constexpr uint32_t VERSION = 1;
+
+        enum ModelFlags {
+            MetallicRoughnessWorkflow = 0x00000001,
+            HasMeshVertices = 0x00000002
+        };
+
+        // 同一个源文件不同的加载参数对应不同的缓存文件
+        static std::string getCachePath(const std::string &filename, uint32_t fileLoadingFlags);
+
+        // 源文件与所有依赖文件(相对源文件目录)的内容哈希
+        static bool computeSourceHash(const std::string &filename, const std::vector<std::string> &dependencies,
+                                      uint64_t &hash);
+
+        // 映射缓存文件并校验版本、布局和源文件哈希
+        bool open(const std::string &cachePath, const std::string &filename, uint32_t fileLoadingFlags,
+                  uint32_t vertexStride, uint32_t meshVertexStride, uint32_t meshletStride);
+
+        void close();
+
+        const ModelCacheHeader &getHeader() const { return header; }
+
+        template<typename T>
+        const T *getSection(ModelCacheSection section, size_t &count) const {
+            const ModelCacheSectionEntry &entry = sections[static_cast<uint32_t>(section)];
+            count = entry.elementCount;
+            return entry.size ? reinterpret_cast<const T *>(file.data() + entry.offset) : nullptr;
+        }
+
+        const void *getSectionData(ModelCacheSection section, size_t &size) const;
+
+        std::string getString(const CachedString &string) const;
+
+        // 写入
+        void addSection(ModelCacheSection section, const void *data, size_t size, size_t elementCount);
+
+        template<typename T>
+        void addSection(ModelCacheSection section, const std::vector<T> &elements) {
+            addSection(section, elements.data(), elements.size() * sizeof(T), elements.size());
+        }
+
+        CachedString addString(const std::string &string);
+
+        std::vector<std::string> &getDependencies() { return dependencies; }
+
+        bool write(const std::string &cachePath, const std::string &filename, uint32_t fileLoadingFlags,
+                   uint32_t vertexStride, uint32_t meshVertexStride, uint32_t meshletStride, uint32_t modelFlags);
+
+    private:
+        // 校验每个section的元素数量、字符串和section之间的下标，损坏或截断的缓存直接拒绝
+        bool validate() const;
+
+        bool isValidString(const CachedString &string) const;
+
+        VirtualFile file;
+        ModelCacheHeader header{};
+        ModelCacheSectionEntry sections[static_cast<uint32_t>(ModelCacheSection::Count)]{};
+
+        struct PendingSection {
+            const void *data{nullptr};
+            size_t size{0};
+            size_t elementCount{0};
+        };
+        PendingSection pendingSections[static_cast<uint32_t>(ModelCacheSection::Count)]{};
+        std::vector<char> strings;
+        std::vector<std::string> dependencies;
+        std::vector<CachedString> dependencyStrings;
+    };
+}
@@ -3,6 +3,9 @@
 #include "function/render/render_resource.h"
 #include "deferred_vert.h"
 #include "ssao_frag.h"
+#include "ssao_temporal_frag.h"
+#include "ssao_upsample_frag.h"
+#include "function/render/pass/ui_pass/VulkanUIOverlay.h"
 #include <random>
 
 namespace MW {
@@ -20,6 +23,8 @@ namespace MW {
         fatherFramebuffer = _info->frameBuffer;
         createUniformBuffer();
         createDescriptorSets();
+        createTemporalImages();
+        createTemporalDescriptorSets();
         createPipelines();
         createSSAOGlobalDescriptor();
     }
@@ -38,12 +43,38 @@ namespace MW {
         device->unMapMemory(SSAOKernelBuffer);
         device->DestroyVulkanBuffer(SSAOKernelBuffer);
         SSAONoise.destroy(device);
+        device->DestroyDescriptorSetLayout(temporalDescriptorSetLayout);
+        for (auto &buffer: temporalUboBuffers) {
+            device->unMapMemory(buffer);
+            device->DestroyVulkanBuffer(buffer);
+        }
+        destroyTemporalImages();
         PassBase::clean();
     }
 
     void SSAOPass::preparePassData() {
         SSAOUbo.projection = renderResource->cameraObject.projMatrix;
         memcpy(cameraUboBuffer.mapped, &SSAOUbo, sizeof(SSAOUbo));
+
+        // 这里还没有等待fence，slot的UBO在drawLowResolution中写入
+        const glm::mat4 &view = renderResource->cameraObject.viewMatrix;
+        const glm::mat4 &projection = renderResource->cameraObject.projMatrix;
+        temporalUbo.projection = projection;
+        temporalUbo.currentToPrevView = prevView * glm::inverse(view);
+        temporalUbo.prevProjection = prevProjection;
+        prevView = view;
+        prevProjection = projection;
+    }
+
+    uint32_t SSAOPass::getResolutionScale() const {
+        switch (resolution) {
+            case SSAOHalfResolution:
+                return 2;
+            case SSAOQuarterResolution:
+                return 4;
+            default:
+                return 1;
+        }
     }
 
     void SSAOPass::createUniformBuffer() {
@@ -82,6 +113,118 @@ namespace MW {
         // Upload as texture
         SSAONoise.fromBuffer(ssaoNoise.data(), ssaoNoise.size() * sizeof(glm::vec4), VK_FORMAT_R32G32B32A32_SFLOAT,
                              SSAO_NOISE_DIM, SSAO_NOISE_DIM, device, VK_FILTER_NEAREST);
+
+        for (auto &buffer: temporalUboBuffers) {
+            device->CreateBuffer(
+                    VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT,
+                    VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+                    buffer,
+                    sizeof(SSAOTemporalUniformBufferObject));
+            device->MapMemory(buffer);
+        }
+    }
+
+    void SSAOPass::createTemporalImages() {
+        // 按半分辨率分配，四分之一分辨率时只使用左上角
+        const VkExtent2D extent = device->getSwapchainInfo().extent;
+        temporalExtent = {(extent.width + 1) / 2, (extent.height + 1) / 2};
+        for (auto &image: temporalImages) {
+            image.format = VK_FORMAT_R16G16B16A16_SFLOAT;
+            VkImageCreateInfo imageInfo{};
+            imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+            imageInfo.imageType = VK_IMAGE_TYPE_2D;
+            imageInfo.extent = {temporalExtent.width, temporalExtent.height, 1};
+            imageInfo.mipLevels = 1;
+            imageInfo.arrayLayers = 1;
+            imageInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+            imageInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+            imageInfo.format = image.format;
+            imageInfo.usage = VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_SAMPLED_BIT;
+            device->CreateImageWithInfo(imageInfo, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, image.image, image.mem);
+
+            VkImageViewCreateInfo viewInfo{};
+            viewInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+            viewInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
+            viewInfo.format = image.format;
+            viewInfo.subresourceRange = {VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1};
+            viewInfo.image = image.image;
+            device->CreateImageView(&viewInfo, &image.view);
+            // 一直保持GENERAL，既做storage image写入也被采样
+            device->transitionImageLayout(image.image, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_GENERAL);
+        }
+        lastTemporalSlot = -1;
+    }
+
+    void SSAOPass::destroyTemporalImages() {
+        for (auto &image: temporalImages) {
+            device->DestroyImageView(image.view);
+            device->DestroyImage(image.image);
+            device->FreeMemory(image.mem);
+        }
+    }
+
+    void SSAOPass::createTemporalDescriptorSets() {
+        std::vector<VkDescriptorSetLayoutBinding> setLayoutBindings = {
+                CreateDescriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
+                                                 VK_SHADER_STAGE_FRAGMENT_BIT, 0),  // FS Position+Depth
+                CreateDescriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
+                                                 VK_SHADER_STAGE_FRAGMENT_BIT, 1),  // FS Normals
+                CreateDescriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
+                                                 VK_SHADER_STAGE_FRAGMENT_BIT, 2),  // FS SSAO Noise
+                CreateDescriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, VK_SHADER_STAGE_FRAGMENT_BIT, 3),
+                CreateDescriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, VK_SHADER_STAGE_FRAGMENT_BIT, 4),
+                CreateDescriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
+                                                 VK_SHADER_STAGE_FRAGMENT_BIT, 5),  // FS History
+                CreateDescriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, VK_SHADER_STAGE_FRAGMENT_BIT, 6),
+                CreateDescriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
+                                                 VK_SHADER_STAGE_FRAGMENT_BIT, 7),  // FS Low Resolution AO
+        };
+        auto setLayoutCreateInfo = CreateDescriptorSetLayoutCreateInfo(setLayoutBindings.data(),
+                                                                       static_cast<uint32_t>(setLayoutBindings.size()));
+        device->CreateDescriptorSetLayout(&setLayoutCreateInfo, &temporalDescriptorSetLayout);
+        device->CreateDescriptorPool(setLayoutBindings, static_cast<uint32_t>(temporalDescriptorSets.size()),
+                                     descriptorPool);
+        for (auto &descriptorSet: temporalDescriptorSets) {
+            device->CreateDescriptorSet(descriptorPool, temporalDescriptorSetLayout, descriptorSet);
+        }
+        updateTemporalDescriptorSets();
+    }
+
+    void SSAOPass::updateTemporalDescriptorSets() {
+        const VkSampler sampler = device->getOrCreateDefaultSampler(VK_FILTER_NEAREST);
+        for (uint32_t i = 0; i < temporalDescriptorSets.size(); i++) {
+            const uint32_t prev = (i + temporalDescriptorSets.size() - 1) % temporalDescriptorSets.size();
+            std::vector<VkDescriptorImageInfo> imageDescriptors = {
+                    CreateDescriptorImageInfo(sampler, fatherFramebuffer->attachments[g_buffer_view_position].view,
+                                              VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL),
+                    CreateDescriptorImageInfo(sampler, fatherFramebuffer->attachments[g_buffer_normal].view,
+                                              VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL),
+                    CreateDescriptorImageInfo(sampler, temporalImages[prev].view, VK_IMAGE_LAYOUT_GENERAL),
+                    CreateDescriptorImageInfo(VK_NULL_HANDLE, temporalImages[i].view, VK_IMAGE_LAYOUT_GENERAL),
+                    CreateDescriptorImageInfo(sampler, temporalImages[i].view, VK_IMAGE_LAYOUT_GENERAL),
+            };
+            const VkDescriptorSet descriptorSet = temporalDescriptorSets[i];
+            std::vector<VkWriteDescriptorSet> writeDescriptorSets = {
+                    CreateWriteDescriptorSet(descriptorSet, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 0,
+                                             &imageDescriptors[0]),
+                    CreateWriteDescriptorSet(descriptorSet, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1,
+                                             &imageDescriptors[1]),
+                    CreateWriteDescriptorSet(descriptorSet, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 2,
+                                             &SSAONoise.descriptor),
+                    CreateWriteDescriptorSet(descriptorSet, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 3,
+                                             &SSAOKernelBuffer.descriptor),
+                    CreateWriteDescriptorSet(descriptorSet, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 4,
+                                             &temporalUboBuffers[i].descriptor),
+                    CreateWriteDescriptorSet(descriptorSet, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 5,
+                                             &imageDescriptors[2]),
+                    CreateWriteDescriptorSet(descriptorSet, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 6,
+                                             &imageDescriptors[3]),
+                    CreateWriteDescriptorSet(descriptorSet, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 7,
+                                             &imageDescriptors[4]),
+            };
+            device->UpdateDescriptorSets(static_cast<uint32_t>(writeDescriptorSets.size()),
+                                         writeDescriptorSets.data());
+        }
     }
 
     void SSAOPass::createDescriptorSets() {
@@ -250,12 +393,107 @@ namespace MW {
 
         device->CreateGraphicsPipelines(&pipelineInfo, &pipelines[0].pipeline);
 
+        // 低分辨率时间累积和上采样，其余状态和全分辨率的pipeline相同
+        pipelines.resize(3);
+        pipelineLayoutInfo.setLayoutCount = 1;
+        pipelineLayoutInfo.pSetLayouts = &temporalDescriptorSetLayout;
+        device->CreatePipelineLayout(&pipelineLayoutInfo, &pipelines[1].layout);
+        device->CreatePipelineLayout(&pipelineLayoutInfo, &pipelines[2].layout);
+
+        auto temporalShaderModule = device->CreateShaderModule(SSAO_TEMPORAL_FRAG);
+        auto upsampleShaderModule = device->CreateShaderModule(SSAO_UPSAMPLE_FRAG);
+
+        struct TemporalSpecializationData {
+            uint32_t kernelSize = SSAO_KERNEL_SIZE;
+            float radius = SSAO_RADIUS;
+            uint32_t sampleCount = SSAO_TEMPORAL_SAMPLE_COUNT;
+        } temporalSpecializationData;
+        std::array<VkSpecializationMapEntry, 3> temporalSpecializationMapEntries = {
+                CreateSpecializationMapEntry(0, offsetof(TemporalSpecializationData, kernelSize),
+                                             sizeof(TemporalSpecializationData::kernelSize)),
+                CreateSpecializationMapEntry(1, offsetof(TemporalSpecializationData, radius),
+                                             sizeof(TemporalSpecializationData::radius)),
+                CreateSpecializationMapEntry(2, offsetof(TemporalSpecializationData, sampleCount),
+                                             sizeof(TemporalSpecializationData::sampleCount))
+        };
+        auto temporalSpecializationInfo = CreateSpecializationInfo(3, temporalSpecializationMapEntries.data(),
+                                                                   sizeof(temporalSpecializationData),
+                                                                   &temporalSpecializationData);
+        VkPipelineShaderStageCreateInfo temporalShaderStages[] = {vertShaderStageInfo, fragShaderStageInfo};
+        temporalShaderStages[1].module = temporalShaderModule;
+        temporalShaderStages[1].pSpecializationInfo = &temporalSpecializationInfo;
+        // 结果用imageStore写入，这个subpass没有color attachment
+        colorBlending.attachmentCount = 0;
+        pipelineInfo.pStages = temporalShaderStages;
+        pipelineInfo.layout = pipelines[1].layout;
+        pipelineInfo.subpass = main_camera_subpass_ssao_low_res_pass;
+        device->CreateGraphicsPipelines(&pipelineInfo, &pipelines[1].pipeline);
+
+        VkPipelineShaderStageCreateInfo upsampleShaderStages[] = {vertShaderStageInfo, fragShaderStageInfo};
+        upsampleShaderStages[1].module = upsampleShaderModule;
+        upsampleShaderStages[1].pSpecializationInfo = nullptr;
+        colorBlending.attachmentCount = 1;
+        pipelineInfo.pStages = upsampleShaderStages;
+        pipelineInfo.layout = pipelines[2].layout;
+        pipelineInfo.subpass = main_camera_subpass_ssao_pass;
+        device->CreateGraphicsPipelines(&pipelineInfo, &pipelines[2].pipeline);
+
+        device->DestroyShaderModule(upsampleShaderModule);
+        device->DestroyShaderModule(temporalShaderModule);
         device->DestroyShaderModule(fragShaderModule);
         device->DestroyShaderModule(vertShaderModule);
     }
 
+    void SSAOPass::drawLowResolution() {
+        if (resolution == SSAOFullResolution) {
+            lastTemporalResolution = -1;
+            return;
+        }
+        auto commandBuffer = device->getCurrentCommandBuffer();
+        const int32_t slot = device->getFrameIndex();
+        const int32_t prevSlot = (slot + VulkanDevice::MAX_FRAMES_IN_FLIGHT - 1) % VulkanDevice::MAX_FRAMES_IN_FLIGHT;
+        temporalUbo.frameIndex = temporalFrame++;
+        temporalUbo.scale = getResolutionScale();
+        temporalUbo.temporalBlend = temporalBlend;
+        // 上一帧没有写入history所在的slot(跳过的帧、分辨率切换、重建图像)时只用这一帧的结果
+        temporalUbo.historyValid = lastTemporalSlot == prevSlot && lastTemporalResolution == resolution;
+        memcpy(temporalUboBuffers[slot].mapped, &temporalUbo, sizeof(temporalUbo));
+        lastTemporalSlot = slot;
+        lastTemporalResolution = resolution;
+
+        const VkExtent2D extent = device->getSwapchainInfo().extent;
+        const VkRect2D lowResRect{{0, 0}, {(extent.width + temporalUbo.scale - 1) / temporalUbo.scale,
+                                           (extent.height + temporalUbo.scale - 1) / temporalUbo.scale}};
+        VkViewport viewport{};
+        viewport.width = static_cast<float>(lowResRect.extent.width);
+        viewport.height = static_cast<float>(lowResRect.extent.height);
+        viewport.minDepth = 0.0f;
+        viewport.maxDepth = 1.0f;
+        vkCmdSetViewport(commandBuffer, 0, 1, &viewport);
+        vkCmdSetScissor(commandBuffer, 0, 1, &lowResRect);
+
+        vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelines[1].layout,
+                                0, 1, &temporalDescriptorSets[slot], 0, nullptr);
+        vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelines[1].pipeline);
+        vkCmdDraw(commandBuffer, 3, 1, 0, 0);
+
+        // 后面的subpass使用全分辨率的viewport
+        viewport.width = static_cast<float>(extent.width);
+        viewport.height = static_cast<float>(extent.height);
+        vkCmdSetViewport(commandBuffer, 0, 1, &viewport);
+        vkCmdSetScissor(commandBuffer, 0, 1, device->getSwapchainInfo().scissor);
+    }
+
     void SSAOPass::draw() {
         auto commandBuffer = device->getCurrentCommandBuffer();
+        if (resolution != SSAOFullResolution) {
+            // 按深度和法线加权，从低分辨率结果上采样
+            vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelines[2].layout,
+                                    0, 1, &temporalDescriptorSets[device->getFrameIndex()], 0, nullptr);
+            vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelines[2].pipeline);
+            vkCmdDraw(commandBuffer, 3, 1, 0, 0);
+            return;
+        }
         vkCmdBindDescriptorSets(device->getCurrentCommandBuffer(), VK_PIPELINE_BIND_POINT_GRAPHICS, pipelines[0].layout,
                                 0, 1, &descriptors[0].descriptorSet, 0, nullptr);
 
@@ -293,6 +531,17 @@ namespace MW {
     void SSAOPass::updateAfterFramebufferRecreate() {
         createDescriptorSets();
         createSSAOGlobalDescriptor();
+        destroyTemporalImages();
+        createTemporalImages();
+        updateTemporalDescriptorSets();
+    }
+
+    void SSAOPass::updateUIOverlay(UIOverlay *overlay) {
+        overlay->header("SSAO Settings");
+        overlay->comboBox("SSAO Resolution", &resolution, {"Full", "Half", "Quarter"});
+        if (resolution != SSAOFullResolution) {
+            overlay->sliderFloat("SSAO Temporal Blend", &temporalBlend, 0.02f, 1.0f);
+        }
     }
 
 }
\ No newline at end of file
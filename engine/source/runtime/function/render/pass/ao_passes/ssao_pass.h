@@ -9,12 +9,32 @@
 #include "glm/glm.hpp"
 
 namespace MW {
+    class UIOverlay;
+
     constexpr uint32_t SSAO_KERNEL_SIZE = 64;
     constexpr float SSAO_RADIUS = 0.3f;
     constexpr uint32_t SSAO_NOISE_DIM = 4;
+    // 低分辨率模式下每帧使用的样本数，kernel中的样本分在SSAO_KERNEL_SIZE / SSAO_TEMPORAL_SAMPLE_COUNT帧中轮流使用
+    constexpr uint32_t SSAO_TEMPORAL_SAMPLE_COUNT = 8;
+    enum SSAOResolution {
+        SSAOFullResolution,     // 每帧全分辨率计算SSAO_KERNEL_SIZE个样本，没有时间累积
+        SSAOHalfResolution,
+        SSAOQuarterResolution
+    };
     struct SSAOUniformBufferObject {
         glm::mat4 projection;
     };
+    // 和ssao_temporal.frag、ssao_upsample.frag中的UBO一致
+    struct SSAOTemporalUniformBufferObject {
+        glm::mat4 projection;
+        // 这一帧的view空间到上一帧的view空间
+        glm::mat4 currentToPrevView;
+        glm::mat4 prevProjection;
+        uint32_t frameIndex;
+        uint32_t scale;         // 一个低分辨率像素覆盖的全分辨率像素边长
+        float temporalBlend;    // 新结果的权重
+        uint32_t historyValid;
+    };
 
     struct SSAOPassInitInfo : public RenderPassInitInfo {
         PassBase::Framebuffer *frameBuffer;
@@ -22,10 +42,18 @@ namespace MW {
         explicit SSAOPassInitInfo(const RenderPassInitInfo *info) : RenderPassInitInfo(*info) {};
     };
 
+    /*
+        Screen space ambient occlusion. At full resolution every pixel takes all kernel samples each frame.
+        At half or quarter resolution a few rotated samples are taken per frame and accumulated over time with
+        reprojection, then upsampled with depth and normal aware weights into main_camera_ao
+    */
     class SSAOPass : public PassBase {
     public:
         void draw() override;
 
+        // 在main_camera_subpass_ssao_low_res_pass中录制
+        void drawLowResolution();
+
         void initialize(const RenderPassInitInfo *info) override;
 
         void clean();
@@ -33,6 +61,11 @@ namespace MW {
         void preparePassData() override;
 
         void updateAfterFramebufferRecreate();
+
+        void updateUIOverlay(UIOverlay *overlay);
+
+        int32_t resolution{SSAOHalfResolution};
+        float temporalBlend{0.1f};
     protected:
         void createUniformBuffer();
 
@@ -42,10 +75,34 @@ namespace MW {
 
         virtual void createPipelines();
 
+        void createTemporalImages();
+
+        void destroyTemporalImages();
+
+        void createTemporalDescriptorSets();
+
+        void updateTemporalDescriptorSets();
+
+        uint32_t getResolutionScale() const;
+
         VulkanBuffer SSAOKernelBuffer;
         VulkanTexture2D SSAONoise;
         VulkanBuffer cameraUboBuffer;
         SSAOUniformBufferObject SSAOUbo;
         Framebuffer* fatherFramebuffer;
+
+        // 每个frame slot写入自己的图像，读取上一帧的slot的图像作为history
+        std::array<FrameBufferAttachment, VulkanDevice::MAX_FRAMES_IN_FLIGHT> temporalImages{};
+        std::array<VulkanBuffer, VulkanDevice::MAX_FRAMES_IN_FLIGHT> temporalUboBuffers;
+        std::array<VkDescriptorSet, VulkanDevice::MAX_FRAMES_IN_FLIGHT> temporalDescriptorSets{};
+        VkDescriptorSetLayout temporalDescriptorSetLayout{VK_NULL_HANDLE};
+        VkExtent2D temporalExtent{0, 0};
+        SSAOTemporalUniformBufferObject temporalUbo{};
+        glm::mat4 prevView{1.0f};
+        glm::mat4 prevProjection{1.0f};
+        uint32_t temporalFrame{0};
+        // 上一次写入低分辨率结果的slot和分辨率，不连续时丢弃history
+        int32_t lastTemporalSlot{-1};
+        int32_t lastTemporalResolution{-1};
     };
-}
\ No newline at end of file
+}
@@ -41,17 +41,22 @@ namespace MW {
     }
     void MeshBaseBufferPass::createPipelines() {
         pipelines.resize(1);
-        VkPushConstantRange pushConstantRange = CreatePushConstantRange(VK_SHADER_STAGE_MESH_BIT_NV,
-                                                                        sizeof(PushConstBlock), 0);
+        std::array<VkPushConstantRange, 2> pushConstantRanges = {
+                CreatePushConstantRange(VK_SHADER_STAGE_MESH_BIT_NV, sizeof(PushConstBlock), 0),
+                CreatePushConstantRange(VK_SHADER_STAGE_FRAGMENT_BIT, sizeof(uint32_t),
+                                        virtualTexturePushConstantOffset)
+        };
+        // set 2是scene_gbuffer.frag的虚拟贴图
         std::vector<VkDescriptorSetLayout> layouts = {descriptors[0].layout, descriptorSetLayoutImage,
+                                                      engineGlobalContext.getScene()->getVirtualTexture()->getDescriptorSetLayout(),
                                                       descriptorSetLayoutVertexStorage,
                                                       descriptorSetLayoutMeshlet};
         VkPipelineLayoutCreateInfo pipelineLayoutInfo{};
         pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
         pipelineLayoutInfo.setLayoutCount = layouts.size();
         pipelineLayoutInfo.pSetLayouts = layouts.data();
-        pipelineLayoutInfo.pushConstantRangeCount = 1;
-        pipelineLayoutInfo.pPushConstantRanges = &pushConstantRange;
+        pipelineLayoutInfo.pushConstantRangeCount = pushConstantRanges.size();
+        pipelineLayoutInfo.pPushConstantRanges = pushConstantRanges.data();
         device->CreatePipelineLayout(&pipelineLayoutInfo, &pipelines[0].layout);
 
         auto meshShaderModule = device->CreateShaderModule(BASE_PASS_MS_MESH);
@@ -174,11 +179,18 @@ namespace MW {
         vkCmdBindDescriptorSets(device->getCurrentCommandBuffer(), VK_PIPELINE_BIND_POINT_GRAPHICS, pipelines[0].layout,
                                 0, 1, &descriptors[0].descriptorSet, 0, nullptr);
 
+        VkDescriptorSet virtualTextureSet = engineGlobalContext.getScene()->getVirtualTexture()->getDescriptorSet();
+        vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelines[0].layout,
+                                2, 1, &virtualTextureSet, 0, nullptr);
+
         vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelines[0].pipeline);
 
         PushConstBlock pushConstant;
-        engineGlobalContext.getScene()->draw(device->getCurrentCommandBuffer(), RenderFlags::BindImages,
-                                             pipelines[0].layout, 1, &pushConstant, sizeof(pushConstant), true);
+        LodSelection lodSelection = engineGlobalContext.getScene()->getMainViewLodSelection();
+        engineGlobalContext.getScene()->draw(device->getCurrentCommandBuffer(),
+                                             RenderFlags::BindImages | RenderFlags::PushVirtualTexture,
+                                             pipelines[0].layout, 1, &pushConstant, sizeof(pushConstant), true,
+                                             &lodSelection);
     }
 }
 #endif
\ No newline at end of file
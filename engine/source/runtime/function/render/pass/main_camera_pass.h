@@ -57,6 +57,8 @@ namespace MW {
 
         virtual void OnUpdateUIOverlay(UIOverlay* overlay);
 
+        void updateLodOverlay(UIOverlay* overlay);
+
         virtual void createRenderPass();
 
         virtual void createDescriptorSets();
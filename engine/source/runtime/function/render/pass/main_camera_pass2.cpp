@@ -134,6 +134,24 @@ namespace MW {
             subpassDescs[main_camera_subpass_csm_pass].colorAttachmentCount = CSMOutputAttachmentReferences.size();
             subpassDescs[main_camera_subpass_csm_pass].pColorAttachments = CSMOutputAttachmentReferences.data();
         }
+        {
+            // Create SSAO Low Resolution SubPass;
+            // 结果用imageStore写入SSAOPass自己的低分辨率图像，没有color attachment
+            std::array<VkAttachmentReference2KHR, 2> SSAOLowResInputAttachmentReferences{};
+            setupAttachment2KHRType(SSAOLowResInputAttachmentReferences);
+            SSAOLowResInputAttachmentReferences[0].layout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+            SSAOLowResInputAttachmentReferences[0].attachment = g_buffer_normal;
+            SSAOLowResInputAttachmentReferences[1].layout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+            SSAOLowResInputAttachmentReferences[1].attachment = g_buffer_view_position;
+            std::array<uint32_t, 4> SSAOLowResPreserveAttachments = {g_buffer_material, g_buffer_albedo,
+                                                                     main_camera_shadow, main_camera_depth};
+
+            subpassDescs[main_camera_subpass_ssao_low_res_pass].pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
+            subpassDescs[main_camera_subpass_ssao_low_res_pass].inputAttachmentCount = SSAOLowResInputAttachmentReferences.size();
+            subpassDescs[main_camera_subpass_ssao_low_res_pass].pInputAttachments = SSAOLowResInputAttachmentReferences.data();
+            subpassDescs[main_camera_subpass_ssao_low_res_pass].preserveAttachmentCount = SSAOLowResPreserveAttachments.size();
+            subpassDescs[main_camera_subpass_ssao_low_res_pass].pPreserveAttachments = SSAOLowResPreserveAttachments.data();
+        }
         {
             // Create SSAO SubPass;
             std::array<VkAttachmentReference2KHR, 2> SSAOInputAttachmentReferences{};
@@ -214,7 +232,7 @@ namespace MW {
             subpassDescs[main_camera_subpass_ui_pass].pColorAttachments = UIOutputAttachmentReferences.data();
             subpassDescs[main_camera_subpass_ui_pass].pNext = VK_NULL_HANDLE;
         }
-        std::array<VkSubpassDependency2KHR, 8> dependencies = {};
+        std::array<VkSubpassDependency2KHR, 11> dependencies = {};
         for (auto &dependency: dependencies)
             dependency.sType = VK_STRUCTURE_TYPE_SUBPASS_DEPENDENCY_2;
         dependencies[0].srcSubpass = VK_SUBPASS_EXTERNAL;
@@ -296,6 +314,32 @@ namespace MW {
         dependencies[7].dstAccessMask = VK_ACCESS_INPUT_ATTACHMENT_READ_BIT;
         dependencies[7].dependencyFlags = VK_DEPENDENCY_BY_REGION_BIT;
 
+        // 低分辨率SSAO读取任意位置的g-buffer，写入的图像在SSAO subpass中被周围的像素读取，不能按region同步
+        dependencies[8].srcSubpass = main_camera_subpass_g_buffer_pass;
+        dependencies[8].dstSubpass = main_camera_subpass_ssao_low_res_pass;
+        dependencies[8].srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+        dependencies[8].dstStageMask = VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT;
+        dependencies[8].srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+        dependencies[8].dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+        dependencies[8].dependencyFlags = 0;
+
+        dependencies[9].srcSubpass = main_camera_subpass_ssao_low_res_pass;
+        dependencies[9].dstSubpass = main_camera_subpass_ssao_pass;
+        dependencies[9].srcStageMask = VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT;
+        dependencies[9].dstStageMask = VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT;
+        dependencies[9].srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+        dependencies[9].dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+        dependencies[9].dependencyFlags = 0;
+
+        // 上一帧写入的结果作为这一帧的history
+        dependencies[10].srcSubpass = VK_SUBPASS_EXTERNAL;
+        dependencies[10].dstSubpass = main_camera_subpass_ssao_low_res_pass;
+        dependencies[10].srcStageMask = VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT;
+        dependencies[10].dstStageMask = VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT;
+        dependencies[10].srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+        dependencies[10].dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+        dependencies[10].dependencyFlags = 0;
+
         VkRenderPassCreateInfo2KHR renderPassInfo = {};
         renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO_2;
         renderPassInfo.attachmentCount = static_cast<uint32_t>(attachments.size());
@@ -389,6 +433,9 @@ namespace MW {
         shadowMapPass->draw();
         vkCmdNextSubpass(device->getCurrentCommandBuffer(), VK_SUBPASS_CONTENTS_INLINE);
 
+        ssaoPass->drawLowResolution();
+        vkCmdNextSubpass(device->getCurrentCommandBuffer(), VK_SUBPASS_CONTENTS_INLINE);
+
         ssaoPass->draw();
         vkCmdNextSubpass(device->getCurrentCommandBuffer(), VK_SUBPASS_CONTENTS_INLINE);
 
@@ -400,6 +447,7 @@ namespace MW {
         vkCmdNextSubpass(device->getCurrentCommandBuffer(), VK_SUBPASS_CONTENTS_INLINE);
         drawUI(device->getCurrentCommandBuffer());
         vkCmdEndRenderPass(device->getCurrentCommandBuffer());
+        shadowMapPass->reduceDepth();
     }
 
     void MainCameraPass2::UpdateUIOverlay(UIOverlay *overlay) {
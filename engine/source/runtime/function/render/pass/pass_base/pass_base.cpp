@@ -9,6 +9,10 @@ namespace MW {
     void PassBase::preparePassData() {}
 
     void PassBase::clean() {
+        if (descriptorPool != VK_NULL_HANDLE && device) {
+            device->DestroyDescriptorPool(descriptorPool);
+            descriptorPool = VK_NULL_HANDLE;
+        }
         renderResource.reset();
         device.reset();
     }
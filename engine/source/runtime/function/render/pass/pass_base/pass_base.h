@@ -33,11 +33,12 @@ namespace MW {
     enum {
         main_camera_subpass_g_buffer_pass = 0,
         main_camera_subpass_csm_pass = 1,
-        main_camera_subpass_ssao_pass = 2,
-        main_camera_subpass_lighting_pass = 3,
-        main_camera_subpass_shading_pass = 4,
-        main_camera_subpass_ui_pass = 5,
-        main_camera_subpass_count = 6
+        main_camera_subpass_ssao_low_res_pass = 2, // 低分辨率的SSAO和时间累积，不使用attachment
+        main_camera_subpass_ssao_pass = 3,
+        main_camera_subpass_lighting_pass = 4,
+        main_camera_subpass_shading_pass = 5,
+        main_camera_subpass_ui_pass = 6,
+        main_camera_subpass_count = 7
     };
     struct RenderPassInitInfo {
         std::shared_ptr<VulkanDevice> device;
@@ -78,6 +79,8 @@ namespace MW {
         std::vector<Descriptor> descriptors;
         std::vector<RenderPipelineBase> pipelines;
         Framebuffer framebuffer;
+        // 可选的pass独占的descriptor pool，clean时销毁
+        VkDescriptorPool descriptorPool{VK_NULL_HANDLE};
 
         virtual void draw();
 
@@ -3,8 +3,34 @@
 #include "function/global/engine_global_context.h"
 #include "function/render/scene_manager.h"
 #include "cube_vert.h"
+#include "core/file/virtual_file_system.h"
+#include "function/render/ibl_baker.h"
+#include <iostream>
 
 namespace MW {
+    namespace {
+        // 渲染每个面时的旋转
+        const std::vector<glm::mat4> &getFaceMatrices() {
+            static const std::vector<glm::mat4> matrices = {
+                    // POSITIVE_X
+                    glm::rotate(glm::rotate(glm::mat4(1.0f), glm::radians(90.0f), glm::vec3(0.0f, 1.0f, 0.0f)),
+                                glm::radians(180.0f), glm::vec3(1.0f, 0.0f, 0.0f)),
+                    // NEGATIVE_X
+                    glm::rotate(glm::rotate(glm::mat4(1.0f), glm::radians(-90.0f), glm::vec3(0.0f, 1.0f, 0.0f)),
+                                glm::radians(180.0f), glm::vec3(1.0f, 0.0f, 0.0f)),
+                    // POSITIVE_Y
+                    glm::rotate(glm::mat4(1.0f), glm::radians(-90.0f), glm::vec3(1.0f, 0.0f, 0.0f)),
+                    // NEGATIVE_Y
+                    glm::rotate(glm::mat4(1.0f), glm::radians(90.0f), glm::vec3(1.0f, 0.0f, 0.0f)),
+                    // POSITIVE_Z
+                    glm::rotate(glm::mat4(1.0f), glm::radians(180.0f), glm::vec3(1.0f, 0.0f, 0.0f)),
+                    // NEGATIVE_Z
+                    glm::rotate(glm::mat4(1.0f), glm::radians(180.0f), glm::vec3(0.0f, 0.0f, 1.0f)),
+            };
+            return matrices;
+        }
+    }
+
     void CubePass::initialize(const RenderPassInitInfo *info) {
         PassBase::initialize(info);
 
@@ -16,6 +42,22 @@ namespace MW {
         imageDim = _info->imageDim;
         numMips = static_cast<uint32_t>(floor(log2(imageDim))) + 1;
         type = _info->type;
+        compShader = _info->compShader;
+        bakedFile = _info->bakedFile;
+        if (!bakedFile.empty() && VirtualFileSystem::global().exists(bakedFile)) {
+            cubeMap.loadFromFile(bakedFile, VK_FORMAT_R16G16B16A16_SFLOAT, device);
+            baked = true;
+            executed = true;
+            return;
+        }
+        if (compShader) {
+            // 和烘焙文件的格式一致，读回后可以直接保存
+            cubeMapFormat = VK_FORMAT_R16G16B16A16_SFLOAT;
+            createCubeMap();
+            createComputeDescriptorSets();
+            createComputePipelines();
+            return;
+        }
         loadCube();
         createCubeMap();
         createRenderPass();
@@ -25,28 +67,48 @@ namespace MW {
     }
 
     void CubePass::clean() {
-        for (auto &pipeline: pipelines) {
-            device->DestroyPipeline(pipeline.pipeline);
-            device->DestroyPipelineLayout(pipeline.layout);
-        }
-        for (size_t i = 0; i < framebuffer.attachments.size(); i++) {
-            device->DestroyImage(framebuffer.attachments[i].image);
-            device->DestroyImageView(framebuffer.attachments[i].view);
-            device->FreeMemory(framebuffer.attachments[i].mem);
-        }
-        device->DestroyFramebuffer(framebuffer.framebuffer);
-        for (auto &descriptor: descriptors) {
-            device->DestroyDescriptorSetLayout(descriptor.layout);
+        if (!baked && compShader) {
+            for (auto &pipeline: pipelines) {
+                device->DestroyPipeline(pipeline.pipeline);
+                device->DestroyPipelineLayout(pipeline.layout);
+            }
+            for (auto &descriptor: descriptors) {
+                device->DestroyDescriptorSetLayout(descriptor.layout);
+            }
+            for (auto view: mipViews) {
+                device->DestroyImageView(view);
+            }
+        } else if (!baked) {
+            for (auto &pipeline: pipelines) {
+                device->DestroyPipeline(pipeline.pipeline);
+                device->DestroyPipelineLayout(pipeline.layout);
+            }
+            for (size_t i = 0; i < framebuffer.attachments.size(); i++) {
+                device->DestroyImage(framebuffer.attachments[i].image);
+                device->DestroyImageView(framebuffer.attachments[i].view);
+                device->FreeMemory(framebuffer.attachments[i].mem);
+            }
+            device->DestroyFramebuffer(framebuffer.framebuffer);
+            for (auto &descriptor: descriptors) {
+                device->DestroyDescriptorSetLayout(descriptor.layout);
+            }
+            device->DestroyRenderPass(framebuffer.renderPass);
+            cube.clean();
         }
-        device->DestroyRenderPass(framebuffer.renderPass);
         cubeMap.destroy(device);
-        cube.clean();
         PassBase::clean();
     }
 
     void CubePass::draw() {
         if (executed) return;
         executed = true;
+        if (compShader) {
+            drawCompute();
+            if (!bakedFile.empty()) {
+                saveCubeMap();
+            }
+            return;
+        }
         // Render
 
         VkClearValue clearValues[1];
@@ -61,22 +123,7 @@ namespace MW {
         renderPassBeginInfo.clearValueCount = 1;
         renderPassBeginInfo.pClearValues = clearValues;
 
-        std::vector<glm::mat4> matrices = {
-                // POSITIVE_X
-                glm::rotate(glm::rotate(glm::mat4(1.0f), glm::radians(90.0f), glm::vec3(0.0f, 1.0f, 0.0f)),
-                            glm::radians(180.0f), glm::vec3(1.0f, 0.0f, 0.0f)),
-                // NEGATIVE_X
-                glm::rotate(glm::rotate(glm::mat4(1.0f), glm::radians(-90.0f), glm::vec3(0.0f, 1.0f, 0.0f)),
-                            glm::radians(180.0f), glm::vec3(1.0f, 0.0f, 0.0f)),
-                // POSITIVE_Y
-                glm::rotate(glm::mat4(1.0f), glm::radians(-90.0f), glm::vec3(1.0f, 0.0f, 0.0f)),
-                // NEGATIVE_Y
-                glm::rotate(glm::mat4(1.0f), glm::radians(90.0f), glm::vec3(1.0f, 0.0f, 0.0f)),
-                // POSITIVE_Z
-                glm::rotate(glm::mat4(1.0f), glm::radians(180.0f), glm::vec3(1.0f, 0.0f, 0.0f)),
-                // NEGATIVE_Z
-                glm::rotate(glm::mat4(1.0f), glm::radians(180.0f), glm::vec3(0.0f, 0.0f, 1.0f)),
-        };
+        const std::vector<glm::mat4> &matrices = getFaceMatrices();
 
         void *pushData = operator new(pushBlockBuffer.size);
         VkCommandBuffer cmdBuf = device->beginSingleTimeCommands();
@@ -363,6 +410,9 @@ namespace MW {
         imageCI.samples = VK_SAMPLE_COUNT_1_BIT;
         imageCI.tiling = VK_IMAGE_TILING_OPTIMAL;
         imageCI.usage = VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT;
+        if (compShader) {
+            imageCI.usage = VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT;
+        }
         imageCI.flags = VK_IMAGE_CREATE_CUBE_COMPATIBLE_BIT;
         device->CreateImageWithInfo(imageCI, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, cubeMap.image, cubeMap.deviceMemory);
 
@@ -411,4 +461,165 @@ namespace MW {
                 break;
         }
     }
-}
\ No newline at end of file
+
+    void CubePass::createComputeDescriptorSets() {
+        mipViews.resize(numMips);
+        std::vector<VkDescriptorImageInfo> mipImageInfos(numMips);
+        for (uint32_t m = 0; m < numMips; m++) {
+            VkImageViewCreateInfo viewCI = CreateImageViewCreateInfo();
+            viewCI.viewType = VK_IMAGE_VIEW_TYPE_2D_ARRAY;
+            viewCI.format = cubeMapFormat;
+            viewCI.subresourceRange = {VK_IMAGE_ASPECT_COLOR_BIT, m, 1, 0, 6};
+            viewCI.image = cubeMap.image;
+            device->CreateImageView(&viewCI, &mipViews[m]);
+            mipImageInfos[m] = CreateDescriptorImageInfo(VK_NULL_HANDLE, mipViews[m], VK_IMAGE_LAYOUT_GENERAL);
+        }
+
+        descriptors.resize(1);
+        std::vector<VkDescriptorSetLayoutBinding> setLayoutBindings = {
+                CreateDescriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
+                                                 VK_SHADER_STAGE_COMPUTE_BIT, 0),
+                CreateDescriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, VK_SHADER_STAGE_COMPUTE_BIT, 1,
+                                                 numMips),
+        };
+        VkDescriptorSetLayoutCreateInfo descriptorsetlayoutCI = CreateDescriptorSetLayoutCreateInfo(setLayoutBindings);
+        device->CreateDescriptorSetLayout(&descriptorsetlayoutCI, &descriptors[0].layout);
+        device->CreateDescriptorPool(setLayoutBindings, 1, descriptorPool);
+        device->CreateDescriptorSet(descriptorPool, descriptors[0].layout, descriptors[0].descriptorSet);
+        std::vector<VkWriteDescriptorSet> writeDescriptorSets = {
+                CreateWriteDescriptorSet(descriptors[0].descriptorSet, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 0,
+                                         &engineGlobalContext.getScene()->getSkyBox()->descriptor),
+                CreateWriteDescriptorSet(descriptors[0].descriptorSet, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 1,
+                                         mipImageInfos.data(), numMips),
+        };
+        device->UpdateDescriptorSets(static_cast<uint32_t>(writeDescriptorSets.size()), writeDescriptorSets.data());
+    }
+
+    void CubePass::createComputePipelines() {
+        pipelines.resize(1);
+        std::vector<VkPushConstantRange> pushConstantRanges = {
+                CreatePushConstantRange(VK_SHADER_STAGE_COMPUTE_BIT,
+                                        pushBlockBuffer.size + sizeof(CubeComputePushBlock), 0),
+        };
+        VkPipelineLayoutCreateInfo pipelineLayoutCI = CreatePipelineLayoutCreateInfo(&descriptors[0].layout);
+        pipelineLayoutCI.pushConstantRangeCount = 1;
+        pipelineLayoutCI.pPushConstantRanges = pushConstantRanges.data();
+        device->CreatePipelineLayout(&pipelineLayoutCI, &pipelines[0].layout);
+
+        // shader中storage image数组的大小
+        VkSpecializationMapEntry specializationMapEntry = CreateSpecializationMapEntry(0, 0, sizeof(uint32_t));
+        VkSpecializationInfo specializationInfo = CreateSpecializationInfo(1, &specializationMapEntry,
+                                                                           sizeof(uint32_t), &numMips);
+        auto compModule = device->CreateShaderModule(*compShader);
+        VkComputePipelineCreateInfo pipelineInfo{};
+        pipelineInfo.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+        pipelineInfo.stage = loadShader(compModule, VK_SHADER_STAGE_COMPUTE_BIT);
+        pipelineInfo.stage.pSpecializationInfo = &specializationInfo;
+        pipelineInfo.layout = pipelines[0].layout;
+        device->CreateComputePipelines(VK_NULL_HANDLE, 1, &pipelineInfo, &pipelines[0].pipeline);
+        device->DestroyShaderModule(compModule);
+    }
+
+    void CubePass::drawCompute() {
+        const std::vector<glm::mat4> &matrices = getFaceMatrices();
+        // irradiance_cube.frag中texture()隐式选择的mip，近似为环境贴图和输出的尺寸比
+        const float envDim = static_cast<float>(engineGlobalContext.getScene()->getSkyBox()->width);
+        std::vector<uint8_t> pushData(pushBlockBuffer.size + sizeof(CubeComputePushBlock));
+        VkCommandBuffer cmdBuf = device->beginSingleTimeCommands();
+
+        VkImageMemoryBarrier barrier{};
+        barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+        barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        barrier.image = cubeMap.image;
+        barrier.subresourceRange = {VK_IMAGE_ASPECT_COLOR_BIT, 0, numMips, 0, 6};
+        barrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+        barrier.newLayout = VK_IMAGE_LAYOUT_GENERAL;
+        barrier.srcAccessMask = 0;
+        barrier.dstAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+        vkCmdPipelineBarrier(cmdBuf, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 0,
+                             nullptr, 0, nullptr, 1, &barrier);
+
+        vkCmdBindPipeline(cmdBuf, VK_PIPELINE_BIND_POINT_COMPUTE, pipelines[0].pipeline);
+        vkCmdBindDescriptorSets(cmdBuf, VK_PIPELINE_BIND_POINT_COMPUTE, pipelines[0].layout, 0, 1,
+                                &descriptors[0].descriptorSet, 0, nullptr);
+        for (uint32_t m = 0; m < numMips; m++) {
+            updatePushBlock(m);
+            const uint32_t dim = std::max(1u, static_cast<uint32_t>(imageDim) >> m);
+            for (uint32_t f = 0; f < 6; f++) {
+                // 旋转的逆把面上的方向变换回立方体空间
+                pushBlockBuffer.pushBlock.mvp = glm::transpose(matrices[f]);
+                const CubeComputePushBlock computeBlock{m, f, dim, std::log2(envDim / static_cast<float>(dim))};
+                memcpy(pushData.data(), &pushBlockBuffer.pushBlock.mvp, sizeof(pushBlockBuffer.pushBlock.mvp));
+                memcpy(pushData.data() + sizeof(pushBlockBuffer.pushBlock.mvp), pushBlockBuffer.pushBlock.data,
+                       pushBlockBuffer.size - sizeof(pushBlockBuffer.pushBlock.mvp));
+                memcpy(pushData.data() + pushBlockBuffer.size, &computeBlock, sizeof(computeBlock));
+                vkCmdPushConstants(cmdBuf, pipelines[0].layout, VK_SHADER_STAGE_COMPUTE_BIT, 0,
+                                   static_cast<uint32_t>(pushData.size()), pushData.data());
+                vkCmdDispatch(cmdBuf, (dim + 7) / 8, (dim + 7) / 8, 1);
+            }
+        }
+
+        barrier.oldLayout = VK_IMAGE_LAYOUT_GENERAL;
+        barrier.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+        barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+        barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+        vkCmdPipelineBarrier(cmdBuf, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 0,
+                             0, nullptr, 0, nullptr, 1, &barrier);
+        device->endSingleTimeCommands(cmdBuf);
+    }
+
+    void CubePass::saveCubeMap() {
+        // 每个mip的6个面在buffer中连续，和KTX的顺序一致
+        std::vector<VkBufferImageCopy> regions(numMips);
+        VkDeviceSize size = 0;
+        for (uint32_t m = 0; m < numMips; m++) {
+            const uint32_t dim = std::max(1u, static_cast<uint32_t>(imageDim) >> m);
+            regions[m] = {};
+            regions[m].bufferOffset = size;
+            regions[m].imageSubresource = {VK_IMAGE_ASPECT_COLOR_BIT, m, 0, 6};
+            regions[m].imageExtent = {dim, dim, 1};
+            size += static_cast<VkDeviceSize>(dim) * dim * 4 * sizeof(uint16_t) * 6;
+        }
+        VulkanBuffer staging;
+        device->CreateBuffer(VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+                             VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+                             staging, size);
+
+        VkImageSubresourceRange subresourceRange = {VK_IMAGE_ASPECT_COLOR_BIT, 0, numMips, 0, 6};
+        VkCommandBuffer cmdBuf = device->beginSingleTimeCommands();
+        device->transitionImageLayout(cmdBuf, cubeMap.image, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+                                      VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, subresourceRange);
+        vkCmdCopyImageToBuffer(cmdBuf, cubeMap.image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, staging.buffer,
+                               numMips, regions.data());
+        VkBufferMemoryBarrier bufferBarrier{};
+        bufferBarrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+        bufferBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+        bufferBarrier.dstAccessMask = VK_ACCESS_HOST_READ_BIT;
+        bufferBarrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        bufferBarrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        bufferBarrier.buffer = staging.buffer;
+        bufferBarrier.size = VK_WHOLE_SIZE;
+        vkCmdPipelineBarrier(cmdBuf, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_HOST_BIT, 0, 0, nullptr, 1,
+                             &bufferBarrier, 0, nullptr);
+        device->transitionImageLayout(cmdBuf, cubeMap.image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+                                      VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, subresourceRange);
+        device->endSingleTimeCommands(cmdBuf);
+
+        device->MapMemory(staging);
+        std::vector<std::vector<uint16_t>> images(numMips * 6);
+        const auto *src = static_cast<const uint16_t *>(staging.mapped);
+        for (uint32_t m = 0; m < numMips; m++) {
+            const uint32_t dim = std::max(1u, static_cast<uint32_t>(imageDim) >> m);
+            for (uint32_t f = 0; f < 6; f++) {
+                images[m * 6 + f].assign(src, src + dim * dim * 4);
+                src += dim * dim * 4;
+            }
+        }
+        device->unMapMemory(staging);
+        device->DestroyVulkanBuffer(staging);
+        if (!saveBakedCube(bakedFile, imageDim, numMips, images)) {
+            std::cerr << "Could not save IBL cache \"" << bakedFile << "\"" << std::endl;
+        }
+    }
+}
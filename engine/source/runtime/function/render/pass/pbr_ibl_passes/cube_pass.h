@@ -30,12 +30,23 @@ namespace MW {
         prefilter_cube_pass,
         irradiance_cube_pass
     };
+    // compute shader中接在CubePushBlock之后的参数
+    struct CubeComputePushBlock {
+        uint32_t mip;
+        uint32_t face;
+        uint32_t dim;
+        float envLod;
+    };
     struct CubePassInitInfo : public RenderPassInitInfo {
         const std::vector<unsigned char> *fragShader{nullptr};
         bool useEnvironmentCube{true};
         CubePushBlockBuffer pushBlock;
         int32_t imageDim{64};
         CubePassType type;
+        // 烘焙的结果，文件存在时直接加载，不再渲染
+        std::string bakedFile;
+        // 不为空时用compute shader直接生成RGBA16F的结果，并写入bakedFile供下次启动加载
+        const std::vector<unsigned char> *compShader{nullptr};
 
         explicit CubePassInitInfo(const RenderPassInitInfo *info) : RenderPassInitInfo(*info) {};
     };
@@ -63,12 +74,26 @@ namespace MW {
 
         void loadCube();
 
-        static constexpr VkFormat cubeMapFormat = VK_FORMAT_R32G32B32A32_SFLOAT;
+        void createComputeDescriptorSets();
+
+        void createComputePipelines();
+
+        void drawCompute();
+
+        // 读回所有mip和面，保存到bakedFile
+        void saveCubeMap();
+
+        VkFormat cubeMapFormat{VK_FORMAT_R32G32B32A32_SFLOAT};
         CubePushBlockBuffer pushBlockBuffer;
         bool useEnvironmentCube{true};
         const std::vector<unsigned char> *fragShader{nullptr};
+        const std::vector<unsigned char> *compShader{nullptr};
+        std::string bakedFile;
+        // compute生成时每个mip的2D array view
+        std::vector<VkImageView> mipViews;
         int32_t imageDim{64};
         bool executed{false};
+        bool baked{false};
         uint32_t numMips;
         Model cube;
         CubePassType type;
@@ -1,7 +1,11 @@
 #include "lut_pass.h"
 #include "deferred_vert.h"
 #include "brdf_lut_frag.h"
+#include "brdf_lut_comp.h"
 #include <array>
+#include <iostream>
+#include "core/file/virtual_file_system.h"
+#include "function/render/ibl_baker.h"
 
 namespace MW {
 
@@ -9,24 +13,50 @@ namespace MW {
         PassBase::initialize(info);
         const auto *_info = static_cast<const LutPassInitInfo *>(info);
         imageDim = _info->imageDim;
+        sampleCount = _info->sampleCount;
+        bakedFile = _info->bakedFile;
+        if (!bakedFile.empty() && loadBakedLut(bakedFile)) {
+            baked = true;
+            executed = true;
+            return;
+        }
+        VkFormatProperties formatProperties;
+        device->GetPhysicalDeviceFormatProperties(lutFormat, &formatProperties);
+        useCompute = _info->useCompute &&
+                     (formatProperties.optimalTilingFeatures & VK_FORMAT_FEATURE_STORAGE_IMAGE_BIT) != 0;
         createLutTexture();
+        if (useCompute) {
+            createComputeDescriptorSets();
+            createComputePipelines();
+            return;
+        }
         createRenderPass();
         createFramebuffers();
         createPipelines();
     }
 
     void LutPass::clean(){
-        for (auto &pipeline: pipelines) {
-            device->DestroyPipeline(pipeline.pipeline);
-            device->DestroyPipelineLayout(pipeline.layout);
+        if (useCompute) {
+            for (auto &pipeline: pipelines) {
+                device->DestroyPipeline(pipeline.pipeline);
+                device->DestroyPipelineLayout(pipeline.layout);
+            }
+            for (auto &descriptor: descriptors) {
+                device->DestroyDescriptorSetLayout(descriptor.layout);
+            }
+        } else if (!baked) {
+            for (auto &pipeline: pipelines) {
+                device->DestroyPipeline(pipeline.pipeline);
+                device->DestroyPipelineLayout(pipeline.layout);
+            }
+            for (size_t i = 0; i < framebuffer.attachments.size(); i++) {
+                device->DestroyImage(framebuffer.attachments[i].image);
+                device->DestroyImageView(framebuffer.attachments[i].view);
+                device->FreeMemory(framebuffer.attachments[i].mem);
+            }
+            device->DestroyFramebuffer(framebuffer.framebuffer);
+            device->DestroyRenderPass(framebuffer.renderPass);
         }
-        for (size_t i = 0; i < framebuffer.attachments.size(); i++) {
-            device->DestroyImage(framebuffer.attachments[i].image);
-            device->DestroyImageView(framebuffer.attachments[i].view);
-            device->FreeMemory(framebuffer.attachments[i].mem);
-        }
-        device->DestroyFramebuffer(framebuffer.framebuffer);
-        device->DestroyRenderPass(framebuffer.renderPass);
         lutTexture.destroy(device);
         PassBase::clean();
     }
@@ -34,6 +64,13 @@ namespace MW {
     void LutPass::draw() {
         if (executed) return;
         executed = true;
+        if (useCompute) {
+            drawCompute();
+            if (!bakedFile.empty()) {
+                saveLut();
+            }
+            return;
+        }
         // Render
         VkClearValue clearValues[1];
         clearValues[0].color = {{0.0f, 0.0f, 0.0f, 1.0f}};
@@ -144,9 +181,13 @@ namespace MW {
         std::array<VkPipelineShaderStageCreateInfo, 2> shaderStages;
         auto vertModule = device->CreateShaderModule(DEFERRED_VERT);
         auto fragModule = device->CreateShaderModule(BRDF_LUT_FRAG);
+        VkSpecializationMapEntry specializationMapEntry = CreateSpecializationMapEntry(0, 0, sizeof(uint32_t));
+        VkSpecializationInfo specializationInfo = CreateSpecializationInfo(1, &specializationMapEntry,
+                                                                           sizeof(uint32_t), &sampleCount);
 
         shaderStages[0] = loadShader(vertModule, VK_SHADER_STAGE_VERTEX_BIT);
         shaderStages[1] = loadShader(fragModule, VK_SHADER_STAGE_FRAGMENT_BIT);
+        shaderStages[1].pSpecializationInfo = &specializationInfo;
 
         VkGraphicsPipelineCreateInfo pipelineCI = CreatePipelineCreateInfo(pipelines[0].layout, framebuffer.renderPass);
         pipelineCI.pInputAssemblyState = &inputAssemblyState;
@@ -176,7 +217,11 @@ namespace MW {
         imageCI.arrayLayers = 1;
         imageCI.samples = VK_SAMPLE_COUNT_1_BIT;
         imageCI.tiling = VK_IMAGE_TILING_OPTIMAL;
-        imageCI.usage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_SAMPLED_BIT;
+        imageCI.usage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_SAMPLED_BIT |
+                        VK_IMAGE_USAGE_TRANSFER_DST_BIT;
+        if (useCompute) {
+            imageCI.usage = VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT;
+        }
         device->CreateImageWithInfo(imageCI, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, lutTexture.image,
                                     lutTexture.deviceMemory);
         // Image view
@@ -204,4 +249,138 @@ namespace MW {
         lutTexture.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
         lutTexture.updateDescriptor();
     }
-}
\ No newline at end of file
+
+    bool LutPass::loadBakedLut(const std::string &filename) {
+        VirtualFile file;
+        if (!VirtualFileSystem::global().open(filename, file)) {
+            return false;
+        }
+        ktxTexture *texture = nullptr;
+        if (ktxTexture_CreateFromMemory(file.data(), file.size(), KTX_TEXTURE_CREATE_LOAD_IMAGE_DATA_BIT,
+                                        &texture) != KTX_SUCCESS) {
+            return false;
+        }
+        const ktx_size_t expectedSize = static_cast<ktx_size_t>(imageDim) * imageDim * 2 * sizeof(uint16_t);
+        if (texture->baseWidth != static_cast<uint32_t>(imageDim) ||
+            texture->baseHeight != static_cast<uint32_t>(imageDim) || ktxTexture_GetSize(texture) != expectedSize) {
+            ktxTexture_Destroy(texture);
+            return false;
+        }
+        createLutTexture();
+        VulkanBuffer staging;
+        device->CreateBuffer(VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+                             VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+                             staging, expectedSize, ktxTexture_GetData(texture));
+        ktxTexture_Destroy(texture);
+        device->transitionImageLayout(lutTexture.image, VK_IMAGE_LAYOUT_UNDEFINED,
+                                      VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL);
+        device->copyBufferToImage(staging.buffer, lutTexture.image, imageDim, imageDim, 1);
+        device->transitionImageLayout(lutTexture.image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+                                      VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+        device->DestroyVulkanBuffer(staging);
+        return true;
+    }
+
+    void LutPass::createComputeDescriptorSets() {
+        descriptors.resize(1);
+        std::vector<VkDescriptorSetLayoutBinding> setLayoutBindings = {
+                CreateDescriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, VK_SHADER_STAGE_COMPUTE_BIT, 0),
+        };
+        VkDescriptorSetLayoutCreateInfo descriptorLayoutInfo = CreateDescriptorSetLayoutCreateInfo(setLayoutBindings);
+        device->CreateDescriptorSetLayout(&descriptorLayoutInfo, &descriptors[0].layout);
+        device->CreateDescriptorPool(setLayoutBindings, 1, descriptorPool);
+        device->CreateDescriptorSet(descriptorPool, descriptors[0].layout, descriptors[0].descriptorSet);
+        VkDescriptorImageInfo imageInfo = CreateDescriptorImageInfo(VK_NULL_HANDLE, lutTexture.view,
+                                                                    VK_IMAGE_LAYOUT_GENERAL);
+        VkWriteDescriptorSet writeDescriptorSet = CreateWriteDescriptorSet(descriptors[0].descriptorSet,
+                                                                           VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 0,
+                                                                           &imageInfo);
+        device->UpdateDescriptorSets(1, &writeDescriptorSet);
+    }
+
+    void LutPass::createComputePipelines() {
+        pipelines.resize(1);
+        VkPipelineLayoutCreateInfo pipelineLayoutCI = CreatePipelineLayoutCreateInfo(&descriptors[0].layout);
+        device->CreatePipelineLayout(&pipelineLayoutCI, &pipelines[0].layout);
+
+        VkSpecializationMapEntry specializationMapEntry = CreateSpecializationMapEntry(0, 0, sizeof(uint32_t));
+        VkSpecializationInfo specializationInfo = CreateSpecializationInfo(1, &specializationMapEntry,
+                                                                           sizeof(uint32_t), &sampleCount);
+        auto compModule = device->CreateShaderModule(BRDF_LUT_COMP);
+        VkComputePipelineCreateInfo pipelineInfo{};
+        pipelineInfo.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+        pipelineInfo.stage = loadShader(compModule, VK_SHADER_STAGE_COMPUTE_BIT);
+        pipelineInfo.stage.pSpecializationInfo = &specializationInfo;
+        pipelineInfo.layout = pipelines[0].layout;
+        device->CreateComputePipelines(VK_NULL_HANDLE, 1, &pipelineInfo, &pipelines[0].pipeline);
+        device->DestroyShaderModule(compModule);
+    }
+
+    void LutPass::drawCompute() {
+        VkCommandBuffer cmdBuf = device->beginSingleTimeCommands();
+        VkImageMemoryBarrier barrier{};
+        barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+        barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        barrier.image = lutTexture.image;
+        barrier.subresourceRange = {VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1};
+        barrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+        barrier.newLayout = VK_IMAGE_LAYOUT_GENERAL;
+        barrier.srcAccessMask = 0;
+        barrier.dstAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+        vkCmdPipelineBarrier(cmdBuf, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 0,
+                             nullptr, 0, nullptr, 1, &barrier);
+
+        vkCmdBindPipeline(cmdBuf, VK_PIPELINE_BIND_POINT_COMPUTE, pipelines[0].pipeline);
+        vkCmdBindDescriptorSets(cmdBuf, VK_PIPELINE_BIND_POINT_COMPUTE, pipelines[0].layout, 0, 1,
+                                &descriptors[0].descriptorSet, 0, nullptr);
+        vkCmdDispatch(cmdBuf, (imageDim + 7) / 8, (imageDim + 7) / 8, 1);
+
+        barrier.oldLayout = VK_IMAGE_LAYOUT_GENERAL;
+        barrier.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+        barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+        barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+        vkCmdPipelineBarrier(cmdBuf, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 0,
+                             0, nullptr, 0, nullptr, 1, &barrier);
+        device->endSingleTimeCommands(cmdBuf);
+    }
+
+    void LutPass::saveLut() {
+        const VkDeviceSize size = static_cast<VkDeviceSize>(imageDim) * imageDim * 2 * sizeof(uint16_t);
+        VulkanBuffer staging;
+        device->CreateBuffer(VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+                             VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+                             staging, size);
+
+        VkBufferImageCopy region{};
+        region.imageSubresource = {VK_IMAGE_ASPECT_COLOR_BIT, 0, 0, 1};
+        region.imageExtent = {static_cast<uint32_t>(imageDim), static_cast<uint32_t>(imageDim), 1};
+        VkCommandBuffer cmdBuf = device->beginSingleTimeCommands();
+        device->transitionImageLayout(cmdBuf, lutTexture.image, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+                                      VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL);
+        vkCmdCopyImageToBuffer(cmdBuf, lutTexture.image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, staging.buffer, 1,
+                               &region);
+        VkBufferMemoryBarrier bufferBarrier{};
+        bufferBarrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+        bufferBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+        bufferBarrier.dstAccessMask = VK_ACCESS_HOST_READ_BIT;
+        bufferBarrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        bufferBarrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        bufferBarrier.buffer = staging.buffer;
+        bufferBarrier.size = VK_WHOLE_SIZE;
+        vkCmdPipelineBarrier(cmdBuf, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_HOST_BIT, 0, 0, nullptr, 1,
+                             &bufferBarrier, 0, nullptr);
+        device->transitionImageLayout(cmdBuf, lutTexture.image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+                                      VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+        device->endSingleTimeCommands(cmdBuf);
+
+        device->MapMemory(staging);
+        const auto *src = static_cast<const uint16_t *>(staging.mapped);
+        const std::vector<uint16_t> image(src, src + imageDim * imageDim * 2);
+        device->unMapMemory(staging);
+        device->DestroyVulkanBuffer(staging);
+        if (!saveBakedBrdfLut(bakedFile, static_cast<uint32_t>(imageDim), image)) {
+            std::cerr << "Could not save IBL cache \"" << bakedFile << "\"" << std::endl;
+        }
+    }
+}
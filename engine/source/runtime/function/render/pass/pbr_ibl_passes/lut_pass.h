@@ -6,6 +6,11 @@ namespace MW {
     class VulkanTexture2D;
     struct LutPassInitInfo : public RenderPassInitInfo {
         int32_t imageDim{512};
+        uint32_t sampleCount{1024};
+        // 烘焙的结果，文件存在时直接加载，不再渲染
+        std::string bakedFile;
+        // 缓存缺失时用compute shader生成，并写入bakedFile供下次启动加载；设备不支持RG16F storage image时仍用fragment shader
+        bool useCompute{true};
 
         explicit LutPassInitInfo(const RenderPassInitInfo *info) : RenderPassInitInfo(*info) {};
     };
@@ -25,8 +30,23 @@ namespace MW {
 
         void createLutTexture();
 
+        bool loadBakedLut(const std::string &filename);
+
+        void createComputeDescriptorSets();
+
+        void createComputePipelines();
+
+        void drawCompute();
+
+        // 读回LUT，保存到bakedFile
+        void saveLut();
+
         static constexpr VkFormat lutFormat = VK_FORMAT_R16G16_SFLOAT;
         bool executed{false};
+        bool baked{false};
+        bool useCompute{false};
         int32_t imageDim{512};
+        uint32_t sampleCount{1024};
+        std::string bakedFile;
     };
 }
\ No newline at end of file
@@ -1,11 +1,17 @@
 #include "pbr_ibl_pass.h"
 #include "lut_pass.h"
 #include "cube_pass.h"
+#include "sh_projection_pass.h"
 #include "prefilter_env_map_frag.h"
 #include "irradiance_cube_frag.h"
+#include "prefilter_env_map_comp.h"
+#include "irradiance_cube_comp.h"
 #include "deferred_vert.h"
 #include "pbribl_frag.h"
 #include "function/render/render_resource.h"
+#include "function/render/ibl_baker.h"
+#include "function/render/scene_manager.h"
+#include "function/global/engine_global_context.h"
 
 namespace MW {
     extern PassBase::Descriptor gBufferGlobalDescriptor;
@@ -15,6 +21,7 @@ namespace MW {
         PassBase::initialize(info);
         const auto *_info = static_cast<const PbrIblPassInitInfo *>(info);
         fatherFramebuffer = _info->frameBuffer;
+        useSHIrradiance = _info->useSHIrradiance;
         precompute(info);
         createUniformBuffer();
         createDescriptorSets();
@@ -34,11 +41,15 @@ namespace MW {
         device->unMapMemory(pbrIblUboBuffer);
         device->DestroyVulkanBuffer(pbrIblUboBuffer);
         lutPass->clean();
-        irradiancePass->clean();
+        if (irradiancePass) {
+            irradiancePass->clean();
+        }
         prefilteredPass->clean();
+        shProjectionPass->clean();
         lutPass.reset();
         irradiancePass.reset();
         prefilteredPass.reset();
+        shProjectionPass.reset();
         PassBase::clean();
     }
 
@@ -51,24 +62,47 @@ namespace MW {
 
     void PbrIblPass::precompute(const RenderPassInitInfo *info) {
         prefilteredPass = std::make_shared<CubePass>();
-        irradiancePass = std::make_shared<CubePass>();
         lutPass = std::make_shared<LutPass>();
+        // SH模式下系数的buffer也用来填充shader中未使用的binding
+        shProjectionPass = std::make_shared<SHProjectionPass>();
         CubePassInitInfo prefilteredInfo(info), irradianceInfo(info);
         LutPassInitInfo lutInfo(info);
+        SHProjectionPassInitInfo shProjectionInfo(info);
+        auto *prefilterBlock = new prefilterPushBlock();
+        prefilterBlock->numSamples = IBL_PREFILTER_SAMPLES;
         prefilteredInfo.fragShader = &PREFILTER_ENV_MAP_FRAG;
+        prefilteredInfo.compShader = &PREFILTER_ENV_MAP_COMP;
+        prefilteredInfo.imageDim = IBL_CUBE_DIM;
         prefilteredInfo.type = prefilter_cube_pass;
-        prefilteredInfo.pushBlock.pushBlock.data = new prefilterPushBlock();
+        prefilteredInfo.pushBlock.pushBlock.data = prefilterBlock;
         prefilteredInfo.pushBlock.size += sizeof(prefilterPushBlock);
         irradianceInfo.fragShader = &IRRADIANCE_CUBE_FRAG;
+        irradianceInfo.compShader = &IRRADIANCE_CUBE_COMP;
+        irradianceInfo.imageDim = IBL_CUBE_DIM;
         irradianceInfo.pushBlock.pushBlock.data = new irradiancePushBlock();
         irradianceInfo.pushBlock.size += sizeof(irradiancePushBlock);
         irradianceInfo.type = irradiance_cube_pass;
+        lutInfo.imageDim = IBL_LUT_DIM;
+        lutInfo.sampleCount = IBL_LUT_SAMPLES;
+        // 缓存(MWCooker离线烘焙或者上次启动时GPU生成)有效时直接加载，否则用compute shader生成后写入缓存
+        BakedIblPaths bakedPaths;
+        if (getBakedIblPaths(engineGlobalContext.getScene()->getSkyBoxFile(), bakedPaths)) {
+            prefilteredInfo.bakedFile = bakedPaths.prefiltered;
+            irradianceInfo.bakedFile = bakedPaths.irradiance;
+        }
+        lutInfo.bakedFile = getBakedBrdfLutPath(getAssetPath());
         prefilteredPass->initialize(&prefilteredInfo);
-        irradiancePass->initialize(&irradianceInfo);
         lutPass->initialize(&lutInfo);
+        shProjectionPass->initialize(&shProjectionInfo);
         prefilteredPass->draw();
-        irradiancePass->draw();
         lutPass->draw();
+        if (useSHIrradiance) {
+            shProjectionPass->draw();
+        } else {
+            irradiancePass = std::make_shared<CubePass>();
+            irradiancePass->initialize(&irradianceInfo);
+            irradiancePass->draw();
+        }
         delete static_cast<prefilterPushBlock *>(prefilteredInfo.pushBlock.pushBlock.data);
         delete static_cast<irradiancePushBlock *>(irradianceInfo.pushBlock.pushBlock.data);
     }
@@ -105,20 +139,26 @@ namespace MW {
                                                  VK_SHADER_STAGE_FRAGMENT_BIT, 2),
                 CreateDescriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
                                                  VK_SHADER_STAGE_FRAGMENT_BIT, 3),
+                CreateDescriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, VK_SHADER_STAGE_FRAGMENT_BIT, 4),
         };
         VkDescriptorSetLayoutCreateInfo descriptorLayoutInfo = CreateDescriptorSetLayoutCreateInfo(setLayoutBindings);
 
         device->CreateDescriptorSetLayout(&descriptorLayoutInfo, &descriptors[0].layout);
         device->CreateDescriptorSet(1, descriptors[0].layout, descriptors[0].descriptorSet);
+        // SH模式下shader不会采样irradiance立方体贴图，用prefiltered贴图占位
+        VkDescriptorImageInfo *irradianceDescriptor = irradiancePass ? &irradiancePass->cubeMap.descriptor
+                                                                     : &prefilteredPass->cubeMap.descriptor;
         std::vector<VkWriteDescriptorSet> writeDescriptorSets = {
                 CreateWriteDescriptorSet(descriptors[0].descriptorSet, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 0,
                                          &pbrIblUboBuffer.descriptor),
                 CreateWriteDescriptorSet(descriptors[0].descriptorSet, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1,
-                                         &irradiancePass->cubeMap.descriptor),
+                                         irradianceDescriptor),
                 CreateWriteDescriptorSet(descriptors[0].descriptorSet, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 2,
                                          &lutPass->lutTexture.descriptor),
                 CreateWriteDescriptorSet(descriptors[0].descriptorSet, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 3,
                                          &prefilteredPass->cubeMap.descriptor),
+                CreateWriteDescriptorSet(descriptors[0].descriptorSet, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 4,
+                                         &shProjectionPass->shBuffer.descriptor),
         };
         device->UpdateDescriptorSets(static_cast<uint32_t>(writeDescriptorSets.size()), writeDescriptorSets.data());
 
@@ -148,6 +188,11 @@ namespace MW {
         fragShaderStageInfo.stage = VK_SHADER_STAGE_FRAGMENT_BIT;
         fragShaderStageInfo.module = fragShaderModule;
         fragShaderStageInfo.pName = "main";
+        const uint32_t useSH = useSHIrradiance ? 1 : 0;
+        VkSpecializationMapEntry specializationMapEntry = CreateSpecializationMapEntry(0, 0, sizeof(uint32_t));
+        VkSpecializationInfo specializationInfo = CreateSpecializationInfo(1, &specializationMapEntry,
+                                                                           sizeof(uint32_t), &useSH);
+        fragShaderStageInfo.pSpecializationInfo = &specializationInfo;
 
         VkPipelineShaderStageCreateInfo shaderStages[] = {vertShaderStageInfo, fragShaderStageInfo};
 
@@ -7,6 +7,8 @@ namespace MW {
 
     class LutPass;
 
+    class SHProjectionPass;
+
     struct PbrIblUBO{
         glm::mat4 projViewMatrix;
         glm::vec4 lights[maxLightsCount];
@@ -14,6 +16,8 @@ namespace MW {
     };
     struct PbrIblPassInitInfo : public RenderPassInitInfo {
         PassBase::Framebuffer *frameBuffer;
+        // 漫反射IBL用L2球谐系数计算，不再预计算irradiance立方体贴图
+        bool useSHIrradiance{true};
 
         explicit PbrIblPassInitInfo(const RenderPassInitInfo *info) : RenderPassInitInfo(*info) {};
     };
@@ -33,6 +37,8 @@ namespace MW {
         std::shared_ptr<CubePass>   prefilteredPass;
         std::shared_ptr<CubePass>   irradiancePass;
         std::shared_ptr<LutPass>    lutPass;
+        std::shared_ptr<SHProjectionPass> shProjectionPass;
+        bool useSHIrradiance{true};
         Framebuffer* fatherFramebuffer;
         PbrIblUBO pbrIblUbo;
         VulkanBuffer pbrIblUboBuffer;
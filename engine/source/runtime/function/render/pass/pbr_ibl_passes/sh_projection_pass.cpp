@@ -0,0 +1,137 @@
+#include "sh_projection_pass.h"
+#include "sh_projection_comp.h"
+#include "sh_reduce_comp.h"
+#include <array>
+#include <cmath>
+#include "function/global/engine_global_context.h"
+#include "function/render/scene_manager.h"
+
+namespace MW {
+    // sh_projection.comp中workgroup的边长
+    constexpr uint32_t SH_PROJECTION_GROUP_SIZE = 16;
+
+    struct SHProjectionPushBlock {
+        uint32_t dim;
+        float envLod;
+    };
+
+    void SHProjectionPass::initialize(const RenderPassInitInfo *info) {
+        PassBase::initialize(info);
+        const auto *_info = static_cast<const SHProjectionPassInitInfo *>(info);
+        sampleDim = _info->sampleDim;
+        groupCountXY = (sampleDim + SH_PROJECTION_GROUP_SIZE - 1) / SH_PROJECTION_GROUP_SIZE;
+        createBuffers();
+        createDescriptorSets();
+        createPipelines();
+    }
+
+    void SHProjectionPass::clean() {
+        for (auto &pipeline: pipelines) {
+            device->DestroyPipeline(pipeline.pipeline);
+            device->DestroyPipelineLayout(pipeline.layout);
+        }
+        for (auto &descriptor: descriptors) {
+            device->DestroyDescriptorSetLayout(descriptor.layout);
+        }
+        device->DestroyVulkanBuffer(partialBuffer);
+        device->DestroyVulkanBuffer(shBuffer);
+        PassBase::clean();
+    }
+
+    void SHProjectionPass::createBuffers() {
+        const uint32_t groupCount = groupCountXY * groupCountXY * 6;
+        device->CreateBuffer(VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, partialBuffer,
+                             groupCount * SH_COEFFICIENT_COUNT * sizeof(glm::vec4));
+        device->CreateBuffer(VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT,
+                             VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, shBuffer,
+                             SH_COEFFICIENT_COUNT * sizeof(glm::vec4));
+    }
+
+    void SHProjectionPass::createDescriptorSets() {
+        descriptors.resize(1);
+        std::vector<VkDescriptorSetLayoutBinding> setLayoutBindings = {
+                CreateDescriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
+                                                 VK_SHADER_STAGE_COMPUTE_BIT, 0),
+                CreateDescriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT, 1),
+                CreateDescriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT, 2),
+        };
+        VkDescriptorSetLayoutCreateInfo descriptorLayoutInfo = CreateDescriptorSetLayoutCreateInfo(setLayoutBindings);
+        device->CreateDescriptorSetLayout(&descriptorLayoutInfo, &descriptors[0].layout);
+        device->CreateDescriptorPool(setLayoutBindings, 1, descriptorPool);
+        device->CreateDescriptorSet(descriptorPool, descriptors[0].layout, descriptors[0].descriptorSet);
+        std::vector<VkWriteDescriptorSet> writeDescriptorSets = {
+                CreateWriteDescriptorSet(descriptors[0].descriptorSet, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 0,
+                                         &engineGlobalContext.getScene()->getSkyBox()->descriptor),
+                CreateWriteDescriptorSet(descriptors[0].descriptorSet, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1,
+                                         &partialBuffer.descriptor),
+                CreateWriteDescriptorSet(descriptors[0].descriptorSet, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 2,
+                                         &shBuffer.descriptor),
+        };
+        device->UpdateDescriptorSets(static_cast<uint32_t>(writeDescriptorSets.size()), writeDescriptorSets.data());
+    }
+
+    void SHProjectionPass::createPipelines() {
+        // 0: 每个workgroup的部分和，1: 汇总
+        pipelines.resize(2);
+        std::array<const std::vector<unsigned char> *, 2> shaders = {&SH_PROJECTION_COMP, &SH_REDUCE_COMP};
+        std::array<uint32_t, 2> pushBlockSizes = {sizeof(SHProjectionPushBlock), sizeof(uint32_t)};
+        for (size_t i = 0; i < pipelines.size(); i++) {
+            VkPushConstantRange pushConstantRange = CreatePushConstantRange(VK_SHADER_STAGE_COMPUTE_BIT,
+                                                                            pushBlockSizes[i], 0);
+            VkPipelineLayoutCreateInfo pipelineLayoutCI = CreatePipelineLayoutCreateInfo(&descriptors[0].layout);
+            pipelineLayoutCI.pushConstantRangeCount = 1;
+            pipelineLayoutCI.pPushConstantRanges = &pushConstantRange;
+            device->CreatePipelineLayout(&pipelineLayoutCI, &pipelines[i].layout);
+
+            auto compModule = device->CreateShaderModule(*shaders[i]);
+            VkComputePipelineCreateInfo pipelineInfo{};
+            pipelineInfo.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+            pipelineInfo.stage = loadShader(compModule, VK_SHADER_STAGE_COMPUTE_BIT);
+            pipelineInfo.layout = pipelines[i].layout;
+            device->CreateComputePipelines(VK_NULL_HANDLE, 1, &pipelineInfo, &pipelines[i].pipeline);
+            device->DestroyShaderModule(compModule);
+        }
+    }
+
+    void SHProjectionPass::draw() {
+        if (executed) return;
+        executed = true;
+        const float envDim = static_cast<float>(engineGlobalContext.getScene()->getSkyBox()->width);
+        const SHProjectionPushBlock projectionBlock{sampleDim,
+                                                    std::max(0.0f, std::log2(envDim / static_cast<float>(sampleDim)))};
+        const uint32_t groupCount = groupCountXY * groupCountXY * 6;
+
+        VkCommandBuffer cmdBuf = device->beginSingleTimeCommands();
+        vkCmdBindDescriptorSets(cmdBuf, VK_PIPELINE_BIND_POINT_COMPUTE, pipelines[0].layout, 0, 1,
+                                &descriptors[0].descriptorSet, 0, nullptr);
+        vkCmdBindPipeline(cmdBuf, VK_PIPELINE_BIND_POINT_COMPUTE, pipelines[0].pipeline);
+        vkCmdPushConstants(cmdBuf, pipelines[0].layout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(projectionBlock),
+                           &projectionBlock);
+        vkCmdDispatch(cmdBuf, groupCountXY, groupCountXY, 6);
+
+        VkBufferMemoryBarrier bufferBarrier{};
+        bufferBarrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+        bufferBarrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+        bufferBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+        bufferBarrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        bufferBarrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        bufferBarrier.buffer = partialBuffer.buffer;
+        bufferBarrier.size = VK_WHOLE_SIZE;
+        vkCmdPipelineBarrier(cmdBuf, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 0,
+                             nullptr, 1, &bufferBarrier, 0, nullptr);
+
+        // push constant范围不同，两个pipeline layout不兼容，需要重新绑定descriptor set
+        vkCmdBindDescriptorSets(cmdBuf, VK_PIPELINE_BIND_POINT_COMPUTE, pipelines[1].layout, 0, 1,
+                                &descriptors[0].descriptorSet, 0, nullptr);
+        vkCmdBindPipeline(cmdBuf, VK_PIPELINE_BIND_POINT_COMPUTE, pipelines[1].pipeline);
+        vkCmdPushConstants(cmdBuf, pipelines[1].layout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(groupCount),
+                           &groupCount);
+        vkCmdDispatch(cmdBuf, 1, 1, 1);
+
+        bufferBarrier.dstAccessMask = VK_ACCESS_UNIFORM_READ_BIT;
+        bufferBarrier.buffer = shBuffer.buffer;
+        vkCmdPipelineBarrier(cmdBuf, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 0,
+                             0, nullptr, 1, &bufferBarrier, 0, nullptr);
+        device->endSingleTimeCommands(cmdBuf);
+    }
+}
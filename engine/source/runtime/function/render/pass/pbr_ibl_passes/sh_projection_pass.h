@@ -0,0 +1,43 @@
+#pragma once
+
+#include "runtime/function/render/pass/pass_base/pass_base.h"
+
+namespace MW {
+    // 和sh.glsl中的SH_COEFFICIENT_COUNT一致
+    constexpr uint32_t SH_COEFFICIENT_COUNT = 9;
+
+    struct SHProjectionPassInitInfo : public RenderPassInitInfo {
+        // 投影时把环境贴图看作边长为sampleDim的立方体贴图
+        uint32_t sampleDim{64};
+
+        explicit SHProjectionPassInitInfo(const RenderPassInitInfo *info) : RenderPassInitInfo(*info) {};
+    };
+
+    /*
+        Projects the environment cube map to L2 spherical harmonics for diffuse irradiance.
+        Every workgroup of sh_projection.comp reduces its texels to partial sums, sh_reduce.comp adds them up and
+        writes the convolved coefficients into shBuffer, which the lighting pass reads as a uniform buffer
+    */
+    class SHProjectionPass : public PassBase {
+    public:
+        void initialize(const RenderPassInitInfo *info) override;
+
+        void clean() override;
+
+        void draw() override;
+
+        // std140的vec4[SH_COEFFICIENT_COUNT]
+        VulkanBuffer shBuffer;
+    private:
+        void createBuffers();
+
+        void createDescriptorSets();
+
+        void createPipelines();
+
+        VulkanBuffer partialBuffer;
+        uint32_t sampleDim{64};
+        uint32_t groupCountXY{1};
+        bool executed{false};
+    };
+}
@@ -6,11 +6,14 @@
 #include "function/render/render_model.h"
 #include "function/global/engine_global_context.h"
 #include "function/render/scene_manager.h"
+#include "function/render/pass/ui_pass/VulkanUIOverlay.h"
 #include "cascade_shadow_map_vert.h"
 #include "cascade_shadow_map_frag.h"
 #include "debugshadowmap_vert.h"
 #include "debugshadowmap_frag.h"
 #include "depthpass_vert.h"
+#include <algorithm>
+#include <cmath>
 
 namespace MW {
     PassBase::Descriptor CSMGlobalDescriptor;
@@ -20,12 +23,8 @@ namespace MW {
 
         const auto *_info = static_cast<const CSMPassInitInfo *>(info);
         fatherFramebuffer = _info->frameBuffer;
-        DepthPassInitInfo depthInfo{info};
-        depthInfo.depthArrayLayers = CASCADE_COUNT;
-        depthInfo.depthImageWidth = DEFAULT_IMAGE_WIDTH;
-        depthInfo.depthImageWidth = DEFAULT_IMAGE_HEIGHT;
-        depthPass = std::make_shared<DepthPass>();
-        depthPass->initialize(&depthInfo);
+        createDepthPass(_info);
+        createDepthReductionPass(info);
 
 //        createRenderPass();
         createUniformBuffer();
@@ -34,6 +33,30 @@ namespace MW {
         createCSMGlobalDescriptor();
     }
 
+    void CascadeShadowMapPass::createDepthPass(const CSMPassInitInfo *info) {
+        cascadeCount = std::clamp(info->cascadeCount, 1u, MAX_CASCADE_COUNT);
+        DepthPassInitInfo depthInfo{info};
+        depthInfo.layerResolutions.resize(cascadeCount);
+        for (uint32_t i = 0; i < cascadeCount; ++i) {
+            // 默认每两级cascade边长减半，最小到四分之一
+            depthInfo.layerResolutions[i] = i < info->cascadeResolutions.size() ? info->cascadeResolutions[i]
+                                                                                 : DEFAULT_IMAGE_WIDTH >> std::min(i / 2, 2u);
+        }
+        depthInfo.prefer16BitDepth = info->use16BitDepth;
+        depthPass = std::make_shared<DepthPass>();
+        depthPass->initialize(&depthInfo);
+
+        shadowMapFSUbo.cascadeCount = static_cast<int32_t>(cascadeCount);
+        for (uint32_t i = 0; i < cascadeCount; ++i) {
+            shadowMapFSUbo.cascadeAtlasRects[i] = depthPass->getLayerAtlasRect(i);
+        }
+    }
+
+    void CascadeShadowMapPass::createDepthReductionPass(const RenderPassInitInfo *info) {
+        depthReductionPass = std::make_shared<DepthReductionPass>();
+        depthReductionPass->initialize(info);
+    }
+
     void CascadeShadowMapPass::clean() {
         device->DestroyDescriptorSetLayout(CSMGlobalDescriptor.layout);
         for (auto &pipeline: pipelines) {
@@ -49,34 +72,38 @@ namespace MW {
         device->DestroyVulkanBuffer(cameraUboBuffer);
         depthPass->clean();
         depthPass.reset();
+        depthReductionPass->clean();
+        depthReductionPass.reset();
         PassBase::clean();
     }
     void CascadeShadowMapPass::preparePassData() {
-        /* 原神分享会：8级cascade，前4级每帧更新，后4级8帧之内更新 */
-        static uint32_t frame = -1;
-        frame = (frame + 1) % CASCADE_COUNT;
-        depthPass->needUpdate.clear();
-        for (int i = 0; i < MIN_CASCADE_COUNT; ++i)
-            depthPass->needUpdate.emplace_back(i);
-        for (int i = MIN_CASCADE_COUNT; i < CASCADE_COUNT; ++i)
-            if (frame % (2 * (i - MIN_CASCADE_COUNT + 1)) == 0)
-                depthPass->needUpdate.emplace_back(i);
+        depthReductionPass->preparePassData();
         {
             static float lastSplitLambda = -1;
             if (lastSplitLambda != cascadeSplitLambda) {
-                setCascadeSplits();
+                splitMinZ = -1.0f;
                 lastSplitLambda = cascadeSplitLambda;
+                for (auto &state: cascadeStates) {
+                    state.valid = false;
+                }
+            }
+            // 深度范围变化后切片的包围球随之变化，由scheduleCascades决定是否重新拟合
+            float minZ, maxZ;
+            getVisibleDepthRange(minZ, maxZ);
+            if (minZ != splitMinZ || maxZ != splitMaxZ) {
+                setCascadeSplits(minZ, maxZ);
             }
         }
+        scheduleCascades();
         updateCascade();
 
-        for (int i = 0; i < CASCADE_COUNT; ++i)
+        for (uint32_t i = 0; i < cascadeCount; ++i)
             depthPass->uniformBufferObjects[i].projViewMatrix = cascades[i].lightProjViewMat;
 
         csmCameraProject.projection = renderResource->cameraObject.projMatrix;
         csmCameraProject.view = renderResource->cameraObject.viewMatrix;
         memcpy(cameraUboBuffer.mapped, &csmCameraProject, sizeof(csmCameraProject));
-        for (uint32_t i = 0; i < CASCADE_COUNT; i++) {
+        for (uint32_t i = 0; i < cascadeCount; i++) {
             shadowMapFSUbo.cascadeSplits[i] = cascades[i].splitDepth;
             shadowMapFSUbo.cascadeProjViewMat[i] = cascades[i].lightProjViewMat;
         }
@@ -84,6 +111,9 @@ namespace MW {
         shadowMapFSUbo.lightDir = normalize(-renderResource->cameraObject.directionalLightPos);
         shadowMapFSUbo.cameraPos = renderResource->cameraObject.position;
 //        shadowMapFSUbo.colorCascades = colorCascades;
+        shadowMapFSUbo.shadowFilter = shadowFilter;
+        shadowMapFSUbo.filterRadius = shadowFilterRadius;
+        shadowMapFSUbo.lightSize = shadowLightSize;
         memcpy(shadowMapFSBuffer.mapped, &shadowMapFSUbo, sizeof(shadowMapFSUbo));
         depthPass->preparePassData();
     }
@@ -354,64 +384,216 @@ namespace MW {
         }
     }
 
-    void CascadeShadowMapPass::updateCascade() {
+    void CascadeShadowMapPass::getCascadeSphere(uint32_t cascade, glm::vec3 &center, float &radius) {
         auto camera = engineGlobalContext.renderSystem->getRenderCamera();
+        float lastSplitDist = cascade == 0 ? cascadeStart : cascadeSplits[cascade - 1];
+        float splitDist = cascadeSplits[cascade];
+
+        glm::vec3 frustumCorners[8] = {
+                glm::vec3(-1.0f, 1.0f, 0.0f),
+                glm::vec3(1.0f, 1.0f, 0.0f),
+                glm::vec3(1.0f, -1.0f, 0.0f),
+                glm::vec3(-1.0f, -1.0f, 0.0f),
+                glm::vec3(-1.0f, 1.0f, 1.0f),
+                glm::vec3(1.0f, 1.0f, 1.0f),
+                glm::vec3(1.0f, -1.0f, 1.0f),
+                glm::vec3(-1.0f, -1.0f, 1.0f),
+        };
 
-        for (auto &cas: depthPass->needUpdate) {
-            float lastSplitDist = cas == 0 ? 0 : cascadeSplits[cas - 1];
-            float splitDist = cascadeSplits[cas];
-
-            glm::vec3 frustumCorners[8] = {
-                    glm::vec3(-1.0f, 1.0f, 0.0f),
-                    glm::vec3(1.0f, 1.0f, 0.0f),
-                    glm::vec3(1.0f, -1.0f, 0.0f),
-                    glm::vec3(-1.0f, -1.0f, 0.0f),
-                    glm::vec3(-1.0f, 1.0f, 1.0f),
-                    glm::vec3(1.0f, 1.0f, 1.0f),
-                    glm::vec3(1.0f, -1.0f, 1.0f),
-                    glm::vec3(-1.0f, -1.0f, 1.0f),
-            };
-
-            glm::mat4 invCam = glm::inverse(camera->matrices.perspective * camera->matrices.view);
-            for (uint32_t i = 0; i < 8; i++) {
-                glm::vec4 invCorner = invCam * glm::vec4(frustumCorners[i], 1.0f);
-                frustumCorners[i] = invCorner / invCorner.w;
-            }
+        glm::mat4 invCam = glm::inverse(camera->matrices.perspective * camera->matrices.view);
+        for (uint32_t i = 0; i < 8; i++) {
+            glm::vec4 invCorner = invCam * glm::vec4(frustumCorners[i], 1.0f);
+            frustumCorners[i] = invCorner / invCorner.w;
+        }
 
-            for (uint32_t i = 0; i < 4; i++) {
-                glm::vec3 dist = frustumCorners[i + 4] - frustumCorners[i];
-                frustumCorners[i + 4] = frustumCorners[i] + (dist * splitDist);
-                frustumCorners[i] = frustumCorners[i] + (dist * lastSplitDist);
-            }
+        for (uint32_t i = 0; i < 4; i++) {
+            glm::vec3 dist = frustumCorners[i + 4] - frustumCorners[i];
+            frustumCorners[i + 4] = frustumCorners[i] + (dist * splitDist);
+            frustumCorners[i] = frustumCorners[i] + (dist * lastSplitDist);
+        }
+
+        center = glm::vec3(0.0f);
+        for (uint32_t i = 0; i < 8; i++) {
+            center += frustumCorners[i];
+        }
+        center /= 8.0f;
 
-            glm::vec3 frustumCenter = glm::vec3(0.0f);
-            for (uint32_t i = 0; i < 8; i++) {
-                frustumCenter += frustumCorners[i];
+        radius = 0.0f;
+        for (uint32_t i = 0; i < 8; i++) {
+            float distance = glm::length(frustumCorners[i] - center);
+            radius = glm::max(radius, distance);
+        }
+    }
+
+    glm::mat4 CascadeShadowMapPass::getCascadeViewMatrix(const glm::vec3 &center, float radius,
+                                                         const glm::vec3 &lightDir) const {
+        return glm::lookAt(center - lightDir * radius, center, glm::vec3(0.0f, 1.0f, 0.0f));
+    }
+
+    void CascadeShadowMapPass::scheduleCascades() {
+        auto scene = engineGlobalContext.getScene();
+        const glm::vec3 lightDir = normalize(-renderResource->cameraObject.directionalLightPos);
+        const uint64_t staticVersion = scene->getStaticVersion();
+        const uint64_t dynamicVersion = scene->getDynamicVersion();
+
+        // 没有动态物体时depth本身就是静态缓存
+        const bool useStaticCache = enableStaticCache && scene->hasDynamicModels();
+        if (useStaticCache != depthPass->isStaticCacheEnabled()) {
+            depthPass->setStaticCacheEnabled(useStaticCache);
+            for (auto &state: cascadeStates) {
+                state.valid = false;
             }
-            frustumCenter /= 8.0f;
+        }
+        std::vector<glm::vec4> dynamicBounds;
+        scene->getDynamicBounds(dynamicBounds);
+
+        depthPass->updateGpuTime();
+        if (depthPass->getGpuTimePerLayer() >= 0.0f) {
+            cascadeCost = glm::mix(cascadeCost, depthPass->getGpuTimePerLayer(), 0.1f);
+        }
 
-            float radius = 0.0f;
-            for (uint32_t i = 0; i < 8; i++) {
-                float distance = glm::length(frustumCorners[i] - frustumCenter);
-                radius = glm::max(radius, distance);
+        struct Candidate {
+            uint32_t cascade;
+            bool refit;
+            bool required;
+            bool staticDirty;
+            bool dynamicOverlap;
+            glm::vec3 center;
+            float radius;
+            float cost;
+        };
+        std::vector<Candidate> candidates;
+        for (uint32_t i = 0; i < cascadeCount; ++i) {
+            CascadeState &state = cascadeStates[i];
+            glm::vec3 center;
+            float radius;
+            getCascadeSphere(i, center, radius);
+
+            Candidate candidate{i, false, false, false, false, state.center, state.radius, 0.0f};
+            // 光源方向不变且切片仍在上次拟合的范围内时沿用原来的矩阵，静态缓存保持有效。
+            // 切片超出了拟合范围时旧矩阵覆盖不到新的split，这一帧必须更新，不受预算限制；
+            // 切片明显缩小(SDSM收紧了深度范围)时也重新拟合，提高阴影的精度，可以推迟
+            candidate.required = !state.valid || glm::dot(state.lightDir, lightDir) < 0.99999f ||
+                                 glm::distance(center, state.center) + radius > state.radius;
+            candidate.refit = candidate.required || radius * (1.0f + 2.0f * cascadeRefitMargin) < state.radius;
+            if (candidate.refit) {
+                candidate.radius = std::ceil(radius * (1.0f + cascadeRefitMargin) * 16.0f) / 16.0f;
+                // 球心在光源空间按texel对齐，重新拟合后已经缓存的阴影边缘不会闪烁
+                const glm::mat4 lightRotation = glm::lookAt(glm::vec3(0.0f), lightDir, glm::vec3(0.0f, 1.0f, 0.0f));
+                const float texelSize = 2.0f * candidate.radius / static_cast<float>(depthPass->getLayerResolution(i));
+                glm::vec3 lightSpaceCenter = glm::vec3(lightRotation * glm::vec4(center, 1.0f));
+                lightSpaceCenter.x = std::floor(lightSpaceCenter.x / texelSize) * texelSize;
+                lightSpaceCenter.y = std::floor(lightSpaceCenter.y / texelSize) * texelSize;
+                candidate.center = glm::vec3(glm::inverse(lightRotation) * glm::vec4(lightSpaceCenter, 1.0f));
+            }
+            candidate.staticDirty = candidate.refit || state.staticVersion != staticVersion;
+
+            // 动态物体的包围球和cascade的正交包围盒相交。开启了depth clamp，光源和近平面之间的物体也投射阴影，
+            // 所以不检查近平面
+            const glm::mat4 lightView = getCascadeViewMatrix(candidate.center, candidate.radius, lightDir);
+            for (const glm::vec4 &bounds: dynamicBounds) {
+                const glm::vec3 position = glm::vec3(lightView * glm::vec4(glm::vec3(bounds), 1.0f));
+                const float extent = candidate.radius + bounds.w;
+                if (std::abs(position.x) <= extent && std::abs(position.y) <= extent &&
+                    -position.z <= 2.0f * candidate.radius + bounds.w) {
+                    candidate.dynamicOverlap = true;
+                    break;
+                }
+            }
+            // 动态物体移动后，进入或离开这个cascade都要重画
+            const bool dynamicDirty = state.dynamicVersion != dynamicVersion &&
+                                      (state.hasDynamic || candidate.dynamicOverlap);
+            if (!candidate.staticDirty && !dynamicDirty) {
+                state.dynamicVersion = dynamicVersion;
+                state.waitFrames = 0;
+                continue;
             }
-            radius = std::ceil(radius * 16.0f) / 16.0f;
+            candidate.cost = candidate.staticDirty || !useStaticCache ? cascadeCost
+                                                                      : cascadeCost * DepthPass::dynamicLayerCost;
+            if (useStaticCache && candidate.staticDirty) {
+                // 静态缓存更新后还要复制并叠加动态物体
+                candidate.cost += cascadeCost * DepthPass::dynamicLayerCost;
+            }
+            candidates.push_back(candidate);
+        }
 
-            glm::vec3 maxExtents = glm::vec3(radius);
-            glm::vec3 minExtents = -maxExtents;
+        // 没有有效内容或者切片超出拟合范围的cascade必须更新，其余的按等待帧数和远近排序，在预算内依次更新
+        std::sort(candidates.begin(), candidates.end(), [this](const Candidate &a, const Candidate &b) {
+            if (a.required != b.required) {
+                return a.required;
+            }
+            if (cascadeStates[a.cascade].waitFrames != cascadeStates[b.cascade].waitFrames) {
+                return cascadeStates[a.cascade].waitFrames > cascadeStates[b.cascade].waitFrames;
+            }
+            return a.cascade < b.cascade;
+        });
+        depthPass->needUpdate.clear();
+        depthPass->needStaticUpdate.clear();
+        float spent = 0.0f;
+        for (const Candidate &candidate: candidates) {
+            CascadeState &state = cascadeStates[candidate.cascade];
+            if (!candidate.required && !depthPass->needUpdate.empty() && spent + candidate.cost > shadowBudget) {
+                state.waitFrames++;
+                continue;
+            }
+            spent += candidate.cost;
+            depthPass->needUpdate.emplace_back(candidate.cascade);
+            if (useStaticCache && candidate.staticDirty) {
+                depthPass->needStaticUpdate.emplace_back(candidate.cascade);
+            }
+            state.center = candidate.center;
+            state.radius = candidate.radius;
+            state.lightDir = lightDir;
+            state.valid = true;
+            state.hasDynamic = candidate.dynamicOverlap;
+            state.staticVersion = staticVersion;
+            state.dynamicVersion = dynamicVersion;
+            state.waitFrames = 0;
+        }
+    }
 
-            glm::vec3 lightDir = normalize(-renderResource->cameraObject.directionalLightPos);
-            glm::mat4 lightViewMatrix = glm::lookAt(frustumCenter - lightDir * -minExtents.z, frustumCenter,
-                                                    glm::vec3(0.0f, 1.0f, 0.0f));
-            glm::mat4 lightOrthoMatrix = glm::ortho(minExtents.x, maxExtents.x, minExtents.y, maxExtents.y, 0.0f,
-                                                    maxExtents.z - minExtents.z);
+    void CascadeShadowMapPass::updateCascade() {
+        auto camera = engineGlobalContext.renderSystem->getRenderCamera();
+        for (uint32_t i = 0; i < cascadeCount; ++i) {
+            cascades[i].splitDepth =
+                    (camera->getNearClip() + cascadeSplits[i] * (camera->getFarClip() - camera->getNearClip())) * -1.0f;
+        }
 
-            cascades[cas].splitDepth =
-                    (camera->getNearClip() + splitDist * (camera->getFarClip() - camera->getNearClip())) * -1.0f;
+        for (auto &cas: depthPass->needUpdate) {
+            const CascadeState &state = cascadeStates[cas];
+            glm::mat4 lightViewMatrix = getCascadeViewMatrix(state.center, state.radius, state.lightDir);
+            glm::mat4 lightOrthoMatrix = glm::ortho(-state.radius, state.radius, -state.radius, state.radius, 0.0f,
+                                                    2.0f * state.radius);
             cascades[cas].lightProjViewMat = lightOrthoMatrix * lightViewMatrix;
         }
     }
 
+    void CascadeShadowMapPass::updateUIOverlay(UIOverlay *overlay) {
+        overlay->header("Shadow Settings");
+        overlay->checkBox("Cache Static Shadows", &enableStaticCache);
+        overlay->sliderFloat("Shadow Budget (ms)", &shadowBudget, 0.1f, 8.0f);
+        overlay->sliderFloat("Cascade Refit Margin", &cascadeRefitMargin, 0.0f, 0.5f);
+        overlay->checkBox("Fit Cascades To Visible Depth", &enableSDSM);
+        if (depthPass->supportsMeshlets()) {
+            overlay->checkBox("Meshlet Shadows", &depthPass->useMeshlets);
+            if (depthPass->useMeshlets) {
+                overlay->checkBox("Meshlet Cone Culling", &depthPass->meshletConeCulling);
+            }
+        }
+        overlay->text("Cascade depth range: %.2f - %.2f", splitMinZ, splitMaxZ);
+        overlay->comboBox("Shadow Filter", &shadowFilter, {"PCF 3x3", "Hardware PCF", "Poisson PCF", "PCSS"});
+        if (shadowFilter == ShadowFilterPoisson) {
+            overlay->sliderFloat("Filter Radius (texels)", &shadowFilterRadius, 0.5f, 8.0f);
+        } else if (shadowFilter == ShadowFilterPCSS) {
+            overlay->sliderFloat("Light Size", &shadowLightSize, 0.001f, 0.05f);
+        }
+        overlay->text("Shadow GPU time: %.3f ms (%d cascades)", depthPass->getGpuTime(),
+                      static_cast<int>(depthPass->needUpdate.size()));
+        const VkExtent2D atlasExtent = depthPass->getAtlasExtent();
+        overlay->text("Shadow atlas: %ux%u, %s", atlasExtent.width, atlasExtent.height,
+                      depthPass->getDepthFormat() == VK_FORMAT_D16_UNORM ? "16-bit" : "32-bit");
+    }
+
     void CascadeShadowMapPass::draw() {
         auto commandBuffer = device->getCurrentCommandBuffer();
         vkCmdBindDescriptorSets(device->getCurrentCommandBuffer(), VK_PIPELINE_BIND_POINT_GRAPHICS, pipelines[0].layout,
@@ -424,20 +606,49 @@ namespace MW {
                                              pipelines[0].layout, 1, &pushConstant, sizeof(pushConstant));
     }
 
-    void CascadeShadowMapPass::setCascadeSplits() {
+    void CascadeShadowMapPass::getVisibleDepthRange(float &minZ, float &maxZ) {
+        auto camera = engineGlobalContext.renderSystem->getRenderCamera();
+        const float nearClip = camera->getNearClip();
+        const float farClip = camera->getFarClip();
+        minZ = nearClip;
+        maxZ = farClip;
+        float minDepth, maxDepth;
+        if (!enableSDSM || !depthReductionPass->getDepthRange(minDepth, maxDepth)) {
+            return;
+        }
+        const glm::mat4 invProjection = glm::inverse(camera->matrices.perspective);
+        auto viewDistance = [&invProjection](float depth) {
+            const glm::vec4 position = invProjection * glm::vec4(0.0f, 0.0f, depth, 1.0f);
+            return -position.z / position.w;
+        };
+        const float nearest = std::min(viewDistance(minDepth), viewDistance(maxDepth));
+        const float farthest = std::max(viewDistance(minDepth), viewDistance(maxDepth));
+        // 结果落后几帧，两端各放宽1/16个倍频程再对齐到1/8个倍频程，相机移动时划分不会每帧变化
+        const float nearLog = std::floor((std::log2(std::max(nearest, nearClip)) - 0.0625f) * 8.0f) / 8.0f;
+        const float farLog = std::ceil((std::log2(std::max(farthest, nearClip)) + 0.0625f) * 8.0f) / 8.0f;
+        minZ = std::clamp(std::exp2(nearLog), nearClip, farClip);
+        maxZ = std::clamp(std::exp2(farLog), nearClip, farClip);
+        if (maxZ <= minZ) {
+            minZ = nearClip;
+            maxZ = farClip;
+        }
+    }
+
+    void CascadeShadowMapPass::setCascadeSplits(float minZ, float maxZ) {
         auto camera = engineGlobalContext.renderSystem->getRenderCamera();
         float nearClip = camera->getNearClip();
         float farClip = camera->getFarClip();
         float clipRange = farClip - nearClip;
 
-        float minZ = nearClip;
-        float maxZ = nearClip + clipRange;
+        splitMinZ = minZ;
+        splitMaxZ = maxZ;
+        cascadeStart = (minZ - nearClip) / clipRange;
 
         float range = maxZ - minZ;
         float ratio = maxZ / minZ;
 
-        for (uint32_t i = 0; i < CASCADE_COUNT; i++) {
-            float p = (i + 1) * 1.f / CASCADE_COUNT;
+        for (uint32_t i = 0; i < cascadeCount; i++) {
+            float p = (i + 1) * 1.f / cascadeCount;
             float log = minZ * std::pow(ratio, p);
             float uniform = minZ + range * p;
             float d = cascadeSplitLambda * (log - uniform) + uniform;
@@ -449,6 +660,12 @@ namespace MW {
         depthPass->drawLayer();
     }
 
+    void CascadeShadowMapPass::reduceDepth() {
+        if (enableSDSM) {
+            depthReductionPass->draw();
+        }
+    }
+
     void CascadeShadowMapPass::createCSMGlobalDescriptor() {
         std::vector<VkDescriptorSetLayoutBinding> binding = {
                 CreateDescriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_INPUT_ATTACHMENT, VK_SHADER_STAGE_FRAGMENT_BIT, 0),
@@ -479,5 +696,6 @@ namespace MW {
     void CascadeShadowMapPass::updateAfterFramebufferRecreate() {
         createDescriptorSets();
         createCSMGlobalDescriptor();
+        depthReductionPass->updateAfterFramebufferRecreate();
     }
 }
\ No newline at end of file
@@ -1,12 +1,22 @@
 #pragma once
 
 #include "depth_pass.h"
+#include "depth_reduction_pass.h"
 #include "runtime/function/render/pass/pass_base/pass_base.h"
 #include <array>
 
 namespace MW {
-    constexpr uint32_t CASCADE_COUNT = 8;
-    constexpr uint32_t MIN_CASCADE_COUNT = 4;
+    class UIOverlay;
+
+    // UBO和shader中数组的大小，实际的cascade数量由CSMPassInitInfo::cascadeCount决定
+    constexpr uint32_t MAX_CASCADE_COUNT = 8;
+    // 和deferred_csm.frag中的SHADOW_FILTER_*一致
+    enum ShadowFilter {
+        ShadowFilterPCF,          // 3x3手动比较
+        ShadowFilterHardwarePCF,  // 2x2次硬件比较的双线性采样
+        ShadowFilterPoisson,      // 旋转的Poisson disk，前几个tap一致时提前结束
+        ShadowFilterPCSS          // 按blocker距离调整Poisson半径的软阴影
+    };
     struct debugPushConstant {
         uint32_t cascadeIndex;
     };
@@ -20,18 +30,45 @@ namespace MW {
     };
     //todo:改名
     struct UniformBufferObjectFS {
-        float cascadeSplits[CASCADE_COUNT];
-        glm::mat4 cascadeProjViewMat[CASCADE_COUNT];
+        float cascadeSplits[MAX_CASCADE_COUNT];
+        glm::mat4 cascadeProjViewMat[MAX_CASCADE_COUNT];
         glm::mat4 projViewMatrix;
         glm::vec3 lightDir;
         float _padLightDir;
         glm::vec3 cameraPos;
         float _padCameraPos;
         int32_t colorCascades{0};
+        int32_t cascadeCount{0};
+        int32_t _padCascadeCount[2];
+        // 每个cascade在shadow atlas中的区域，xy为偏移，zw为大小
+        glm::vec4 cascadeAtlasRects[MAX_CASCADE_COUNT];
+        int32_t shadowFilter{ShadowFilterHardwarePCF};
+        float filterRadius{1.5f};
+        float lightSize{0.01f};
+        float _padLightSize;
+    };
+
+    /*
+        Fit and bookkeeping of one cascade, a cascade is only re-rendered when its content is out of date
+    */
+    struct CascadeState {
+        glm::vec3 center{0.0f};   // 拟合时的球心，已按texel对齐
+        float radius{0.0f};       // 包含余量的半径
+        glm::vec3 lightDir{0.0f};
+        bool valid{false};        // 矩阵和depth内容有效
+        bool hasDynamic{false};   // 上次绘制时覆盖了动态物体
+        uint64_t staticVersion{0};
+        uint64_t dynamicVersion{0};
+        uint32_t waitFrames{0};   // 超出预算被推迟的帧数
     };
 
     struct CSMPassInitInfo : public RenderPassInitInfo {
         PassBase::Framebuffer *frameBuffer;
+        uint32_t cascadeCount{MAX_CASCADE_COUNT};
+        // 每个cascade在atlas中的边长，为空时近处的cascade用DEFAULT_IMAGE_WIDTH，越远越小
+        std::vector<uint32_t> cascadeResolutions;
+        // 正交投影的深度是线性的，cascade的深度范围内16位精度足够，显存和带宽减半
+        bool use16BitDepth{true};
 
         explicit CSMPassInitInfo(const RenderPassInitInfo *info) : RenderPassInitInfo(*info) {};
     };
@@ -48,9 +85,41 @@ namespace MW {
 
         void drawDepth();
 
+        // 主render pass结束后统计可见深度范围，供后面的帧调整cascade划分
+        void reduceDepth();
+
         void updateAfterFramebufferRecreate();
+
+        void updateUIOverlay(UIOverlay *overlay);
+
+        // 有动态物体时把静态物体缓存起来，只重画动态物体
+        bool enableStaticCache{true};
+        // 每帧阴影绘制的GPU时间预算(毫秒)，没有有效内容的cascade不受预算限制
+        float shadowBudget{2.0f};
+        // 视锥切片的包围球超出上次拟合的范围时才重新拟合，拟合时半径放大这个比例
+        float cascadeRefitMargin{0.1f};
+        int32_t shadowFilter{ShadowFilterHardwarePCF};
+        // Poisson PCF的半径(texel)
+        float shadowFilterRadius{1.5f};
+        // PCSS中光源角半径的正切，决定半影随遮挡距离变宽的速度
+        float shadowLightSize{0.01f};
+        // 按上几帧可见像素的深度范围划分cascade(SDSM)，关闭时覆盖整个视锥
+        bool enableSDSM{true};
     protected:
-        void setCascadeSplits();
+        void createDepthPass(const CSMPassInitInfo *info);
+
+        void createDepthReductionPass(const RenderPassInitInfo *info);
+
+        // 可见深度范围换算到相机空间的距离并量化，没有结果时返回近远平面
+        void getVisibleDepthRange(float &minZ, float &maxZ);
+
+        void setCascadeSplits(float minZ, float maxZ);
+
+        void scheduleCascades();
+
+        void getCascadeSphere(uint32_t cascade, glm::vec3 &center, float &radius);
+
+        glm::mat4 getCascadeViewMatrix(const glm::vec3 &center, float radius, const glm::vec3 &lightDir) const;
 
         void updateCascade();
 
@@ -64,14 +133,24 @@ namespace MW {
 
         virtual void createPipelines();
 
-        std::array<Cascade, CASCADE_COUNT> cascades;
+        std::array<Cascade, MAX_CASCADE_COUNT> cascades;
         std::shared_ptr<DepthPass> depthPass;
+        std::shared_ptr<DepthReductionPass> depthReductionPass;
         CSMCameraProject csmCameraProject;
         UniformBufferObjectFS shadowMapFSUbo;
         VulkanBuffer cameraUboBuffer;
         VulkanBuffer shadowMapFSBuffer;
         Framebuffer *fatherFramebuffer;
+        uint32_t cascadeCount{MAX_CASCADE_COUNT};
         float cascadeSplitLambda{0.95f};
-        float cascadeSplits[CASCADE_COUNT];
+        float cascadeSplits[MAX_CASCADE_COUNT];
+        // 第一个cascade的起点，和cascadeSplits一样是[near, far]中的比例
+        float cascadeStart{0.0f};
+        // 当前划分使用的深度范围
+        float splitMinZ{-1.0f};
+        float splitMaxZ{-1.0f};
+        std::array<CascadeState, MAX_CASCADE_COUNT> cascadeStates;
+        // 没有timestamp结果之前按这个估计全量绘制一个cascade的耗时(毫秒)
+        float cascadeCost{0.5f};
     };
 }
\ No newline at end of file
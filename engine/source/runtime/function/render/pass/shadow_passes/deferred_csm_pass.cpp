@@ -12,12 +12,8 @@ namespace MW {
 
         const auto *_info = static_cast<const CSMPassInitInfo *>(info);
         fatherFramebuffer = _info->frameBuffer;
-        DepthPassInitInfo depthInfo{info};
-        depthInfo.depthArrayLayers = CASCADE_COUNT;
-        depthInfo.depthImageWidth = DEFAULT_IMAGE_WIDTH;
-        depthInfo.depthImageWidth = DEFAULT_IMAGE_HEIGHT;
-        depthPass = std::make_shared<DepthPass>();
-        depthPass->initialize(&depthInfo);
+        createDepthPass(_info);
+        createDepthReductionPass(info);
 
         skybox = engineGlobalContext.getScene()->getSkyBox();
 //        createRenderPass();
@@ -55,7 +51,9 @@ namespace MW {
                                                  VK_SHADER_STAGE_FRAGMENT_BIT, 1),
                 CreateDescriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, VK_SHADER_STAGE_FRAGMENT_BIT, 2),
                 CreateDescriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
-                                                 VK_SHADER_STAGE_FRAGMENT_BIT, 3)
+                                                 VK_SHADER_STAGE_FRAGMENT_BIT, 3),
+                CreateDescriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
+                                                 VK_SHADER_STAGE_FRAGMENT_BIT, 4)
         };
         VkDescriptorSetLayoutCreateInfo descriptorSetLayoutCreateInfo{};
         descriptorSetLayoutCreateInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
@@ -71,7 +69,9 @@ namespace MW {
                 CreateWriteDescriptorSet(descriptors[0].descriptorSet, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 2,
                                          &shadowMapFSBuffer.descriptor),
                 CreateWriteDescriptorSet(descriptors[0].descriptorSet, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 3,
-                                         &skybox->descriptor)
+                                         &skybox->descriptor),
+                CreateWriteDescriptorSet(descriptors[0].descriptorSet, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 4,
+                                         &depthPass->depth.compareDescriptor)
         };
         device->UpdateDescriptorSets(writeDescriptorSets.size(), writeDescriptorSets.data());
     }
@@ -2,51 +2,70 @@
 #include "function/render/render_model.h"
 #include "depthpass_vert.h"
 #include "depthpass_frag.h"
+#include "depthpass_layered_vert.h"
+#include "depthpass_ms_task.h"
+#include "depthpass_ms_mesh.h"
 #include "function/global/engine_global_context.h"
 #include "function/render/scene_manager.h"
+#include <algorithm>
 #include <array>
+#include <iostream>
+#include <numeric>
 
 namespace MW {
 
     extern VkDescriptorSetLayout descriptorSetLayoutImage;
+    // 在meshletCountPushConstantOffset之后写入是否做法线锥剔除
+    constexpr uint32_t meshletConeCullingPushConstantOffset = meshletCountPushConstantOffset + sizeof(uint32_t);
 
     void DepthPass::initialize(const RenderPassInitInfo *info) {
         PassBase::initialize(info);
         const auto *_info = static_cast<const DepthPassInitInfo *>(info);
-        depthImageWidth = _info->depthImageWidth;
-        depthImageHeight = _info->depthImageHeight;
-        depthArrayLayers = _info->depthArrayLayers;
-        uniformBufferObjects.resize(depthArrayLayers);
+        prefer16BitDepth = _info->prefer16BitDepth;
+        packAtlas(_info->layerResolutions);
+        const uint32_t layerCount = getLayerCount();
+        // layer序号按4位打包在push constant中，每个layer对应一个viewport
+        singlePass = device->supportsShaderOutputViewportIndex && layerCount > 1 &&
+                     layerCount <= LayerSelection::maxLayers && layerCount <= device->properties.limits.maxViewports;
+        uniformBufferObjects.resize(layerCount);
         createRenderPass();
         createUniformBuffer();
         createDescriptorSets();
         createPipelines();
         createFramebuffers();
+        createTimestampQueries();
     }
 
     void DepthPass::clean() {
-        for (size_t i = 0; i < framebuffer.attachments.size(); i++) {
-            device->DestroyImage(framebuffer.attachments[i].image);
-            device->DestroyImageView(framebuffer.attachments[i].view);
-            device->FreeMemory(framebuffer.attachments[i].mem);
-        }
-        for(auto&frameBuffer:depthFramebuffers)
-            device->DestroyFramebuffer(frameBuffer);
+        destroyAtlasTarget(depthTarget);
+        destroyAtlasTarget(staticTarget);
         for (auto &pipeline: pipelines) {
             device->DestroyPipeline(pipeline.pipeline);
             device->DestroyPipelineLayout(pipeline.layout);
         }
+        if (meshletPipeline.pipeline != VK_NULL_HANDLE) {
+            device->DestroyPipeline(meshletPipeline.pipeline);
+            device->DestroyPipelineLayout(meshletPipeline.layout);
+        }
         for (auto &descriptor: descriptors) {
             device->DestroyDescriptorSetLayout(descriptor.layout);
         }
         for (auto &buffer: uniformBuffers)
             device->DestroyVulkanBuffer(buffer);
         depth.destroy(device->device);
+        if (staticDepth.image != VK_NULL_HANDLE) {
+            staticDepth.destroy(device->device);
+        }
+        if (timestampPool != VK_NULL_HANDLE) {
+            vkDestroyQueryPool(device->device, timestampPool, nullptr);
+        }
         device->DestroyRenderPass(framebuffer.renderPass);
+        device->DestroyRenderPass(loadRenderPass);
         PassBase::clean();
     }
+
     void DepthPass::createRenderPass() {
-        VkFormat depthFormat = device->findDepthFormat(true);
+        depthFormat = device->findDepthFormat(true, prefer16BitDepth);
 
         VkAttachmentDescription attachmentDescription{};
         attachmentDescription.format = depthFormat;
@@ -95,65 +114,126 @@ namespace MW {
         renderPassCreateInfo.pDependencies = dependencies.data();
 
         device->CreateRenderPass(&renderPassCreateInfo, &framebuffer.renderPass);
+        // 保留atlas中本帧不更新的区域，需要更新的区域在pass开始后单独清除；动态物体叠加在静态缓存的拷贝上
+        attachmentDescription.loadOp = VK_ATTACHMENT_LOAD_OP_LOAD;
+        attachmentDescription.initialLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL;
+        device->CreateRenderPass(&renderPassCreateInfo, &loadRenderPass);
+
+        // 静态缓存要复制到depth中，提前加上transfer dst
+        createDepthImage(depth, VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT | VK_IMAGE_USAGE_SAMPLED_BIT |
+                                VK_IMAGE_USAGE_TRANSFER_DST_BIT);
+
+        VkSamplerCreateInfo sampler{};
+        sampler.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
+        sampler.magFilter = VK_FILTER_LINEAR;
+        sampler.minFilter = VK_FILTER_LINEAR;
+        sampler.mipmapMode = VK_SAMPLER_MIPMAP_MODE_LINEAR;
+        sampler.addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+        sampler.addressModeV = sampler.addressModeU;
+        sampler.addressModeW = sampler.addressModeU;
+        sampler.mipLodBias = 0.0f;
+        sampler.maxAnisotropy = 1.0f;
+        sampler.minLod = 0.0f;
+        sampler.maxLod = 1.0f;
+        sampler.borderColor = VK_BORDER_COLOR_FLOAT_OPAQUE_WHITE;
+        device->CreateSampler(&sampler, &depth.sampler);
+        // 参考深度不大于存储的深度时为1，即没有被遮挡
+        sampler.compareEnable = VK_TRUE;
+        sampler.compareOp = VK_COMPARE_OP_LESS_OR_EQUAL;
+        device->CreateSampler(&sampler, &depth.compareSampler);
+        depth.setDescriptor();
+    }
+
+    void DepthPass::packAtlas(const std::vector<uint32_t> &resolutions) {
+        std::vector<uint32_t> sizes = resolutions.empty() ? std::vector<uint32_t>{DEFAULT_IMAGE_WIDTH} : resolutions;
+        std::vector<uint32_t> order(sizes.size());
+        std::iota(order.begin(), order.end(), 0);
+        std::stable_sort(order.begin(), order.end(), [&sizes](uint32_t a, uint32_t b) { return sizes[a] > sizes[b]; });
+
+        // 按边长从大到小逐行摆放，atlas宽度取最大边长的两倍；放不下时所有区域减半再试
+        const uint32_t maxDimension = device->properties.limits.maxImageDimension2D;
+        uint32_t shift = 0;
+        while (true) {
+            layerRects.assign(sizes.size(), VkRect2D{});
+            const uint32_t largest = std::min(std::max(sizes[order[0]] >> shift, 1u), maxDimension);
+            atlasWidth = sizes.size() > 1 && largest * 2 <= maxDimension ? largest * 2 : largest;
+            uint32_t x = 0, y = 0, rowHeight = 0;
+            for (auto &i: order) {
+                const uint32_t size = std::min(std::max(sizes[i] >> shift, 1u), atlasWidth);
+                if (x + size > atlasWidth) {
+                    x = 0;
+                    y += rowHeight;
+                    rowHeight = 0;
+                }
+                layerRects[i].offset = {static_cast<int32_t>(x), static_cast<int32_t>(y)};
+                layerRects[i].extent = {size, size};
+                x += size;
+                rowHeight = std::max(rowHeight, size);
+            }
+            atlasHeight = y + rowHeight;
+            if (atlasHeight <= maxDimension) {
+                break;
+            }
+            shift++;
+        }
+        if (shift > 0) {
+            std::cerr << "Shadow atlas does not fit into " << maxDimension << " pixels, layer resolutions are divided by "
+                      << (1u << shift) << std::endl;
+        }
+    }
+
+    glm::vec4 DepthPass::getLayerAtlasRect(uint32_t layer) const {
+        const VkRect2D &rect = layerRects[layer];
+        return glm::vec4(static_cast<float>(rect.offset.x) / static_cast<float>(atlasWidth),
+                         static_cast<float>(rect.offset.y) / static_cast<float>(atlasHeight),
+                         static_cast<float>(rect.extent.width) / static_cast<float>(atlasWidth),
+                         static_cast<float>(rect.extent.height) / static_cast<float>(atlasHeight));
+    }
 
+    void DepthPass::createDepthImage(DepthImage &image, VkImageUsageFlags usage) {
         VkImageCreateInfo imageInfo{};
         imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
         imageInfo.imageType = VK_IMAGE_TYPE_2D;
-        imageInfo.extent.width = depthImageWidth;
-        imageInfo.extent.height = depthImageHeight;
+        imageInfo.extent.width = atlasWidth;
+        imageInfo.extent.height = atlasHeight;
         imageInfo.extent.depth = 1;
         imageInfo.mipLevels = 1;
-        imageInfo.arrayLayers = depthArrayLayers;
+        imageInfo.arrayLayers = 1;
         imageInfo.samples = VK_SAMPLE_COUNT_1_BIT;
         imageInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
         imageInfo.format = depthFormat;
-        imageInfo.usage = VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT | VK_IMAGE_USAGE_SAMPLED_BIT;
-        device->CreateImageWithInfo(imageInfo, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, depth.image, depth.mem);
+        imageInfo.usage = usage;
+        device->CreateImageWithInfo(imageInfo, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, image.image, image.mem);
 
         VkImageViewCreateInfo viewInfo{};
         viewInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
-        viewInfo.viewType = VK_IMAGE_VIEW_TYPE_2D_ARRAY;
+        viewInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
         viewInfo.format = depthFormat;
         viewInfo.subresourceRange = {};
         viewInfo.subresourceRange.aspectMask = VK_IMAGE_ASPECT_DEPTH_BIT;
         viewInfo.subresourceRange.baseMipLevel = 0;
         viewInfo.subresourceRange.levelCount = 1;
         viewInfo.subresourceRange.baseArrayLayer = 0;
-        viewInfo.subresourceRange.layerCount = depthArrayLayers;
-        viewInfo.image = depth.image;
-        device->CreateImageView(&viewInfo, &depth.view);
-
-        VkSamplerCreateInfo sampler{};
-        sampler.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
-        sampler.magFilter = VK_FILTER_LINEAR;
-        sampler.minFilter = VK_FILTER_LINEAR;
-        sampler.mipmapMode = VK_SAMPLER_MIPMAP_MODE_LINEAR;
-        sampler.addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
-        sampler.addressModeV = sampler.addressModeU;
-        sampler.addressModeW = sampler.addressModeU;
-        sampler.mipLodBias = 0.0f;
-        sampler.maxAnisotropy = 1.0f;
-        sampler.minLod = 0.0f;
-        sampler.maxLod = 1.0f;
-        sampler.borderColor = VK_BORDER_COLOR_FLOAT_OPAQUE_WHITE;
-        device->CreateSampler(&sampler, &depth.sampler);
-        depth.setDescriptor();
+        viewInfo.subresourceRange.layerCount = 1;
+        viewInfo.image = image.image;
+        device->CreateImageView(&viewInfo, &image.view);
     }
 
     void DepthPass::createUniformBuffer() {
-        uniformBuffers.resize(depthArrayLayers);
-        for (int i = 0; i < depthArrayLayers; ++i) {
+        const uint32_t layerCount = getLayerCount();
+        uniformBuffers.resize(layerCount + (singlePass ? 1 : 0));
+        for (int i = 0; i < uniformBuffers.size(); ++i) {
             device->CreateBuffer(
                     VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT,
                     VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
                     uniformBuffers[i],
-                    sizeof(UniformBufferObject));
+                    i < layerCount ? sizeof(UniformBufferObject) : sizeof(glm::mat4) * layerCount);
             device->MapMemory(uniformBuffers[i]);
         }
     }
 
     void DepthPass::createDescriptorSets() {
-        descriptors.resize(depthArrayLayers);
+        descriptors.resize(uniformBuffers.size());
         auto binding = CreateDescriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, VK_SHADER_STAGE_VERTEX_BIT,
                                                         0);
 
@@ -161,7 +241,7 @@ namespace MW {
         descriptorSetLayoutCreateInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
         descriptorSetLayoutCreateInfo.pBindings = &binding;
         descriptorSetLayoutCreateInfo.bindingCount = 1;
-        for (uint32_t i = 0; i < depthArrayLayers; i++) {
+        for (uint32_t i = 0; i < descriptors.size(); i++) {
             device->CreateDescriptorSetLayout(&descriptorSetLayoutCreateInfo, &descriptors[i].layout);
             device->CreateDescriptorSet(1, descriptors[i].layout, descriptors[i].descriptorSet);
 
@@ -173,7 +253,7 @@ namespace MW {
             VkDescriptorBufferInfo bufferInfo{};
             bufferInfo.buffer = uniformBuffers[i].buffer;
             bufferInfo.offset = 0;
-            bufferInfo.range = sizeof(UniformBufferObject);
+            bufferInfo.range = VK_WHOLE_SIZE;
 
             VkWriteDescriptorSet descriptorWrite{};
             descriptorWrite.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
@@ -189,37 +269,72 @@ namespace MW {
     }
 
     void DepthPass::createFramebuffers() {
-        VkFormat depthFormat = device->findDepthFormat(true);
-        framebuffer.attachments.resize(depthArrayLayers);
-        depthFramebuffers.resize(depthArrayLayers);
-        for (uint32_t i = 0; i < depthArrayLayers; i++) {
-            VkImageViewCreateInfo viewInfo{};
-            viewInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
-            viewInfo.viewType = VK_IMAGE_VIEW_TYPE_2D_ARRAY;
-            viewInfo.format = depthFormat;
-            viewInfo.subresourceRange = {};
-            viewInfo.subresourceRange.aspectMask = VK_IMAGE_ASPECT_DEPTH_BIT;
-            viewInfo.subresourceRange.baseMipLevel = 0;
-            viewInfo.subresourceRange.levelCount = 1;
-            viewInfo.subresourceRange.baseArrayLayer = i;
-            viewInfo.subresourceRange.layerCount = 1;
-            viewInfo.image = depth.image;
-            device->CreateImageView(&viewInfo, &framebuffer.attachments[i].view);
-            // Framebuffer
-            VkFramebufferCreateInfo framebufferInfo{};
-            framebufferInfo.sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO;
-            framebufferInfo.renderPass = framebuffer.renderPass;
-            framebufferInfo.attachmentCount = 1;
-            framebufferInfo.pAttachments = &framebuffer.attachments[i].view;
-            framebufferInfo.width = depthImageWidth;
-            framebufferInfo.height = depthImageHeight;
-            framebufferInfo.layers = 1;
-            device->CreateFramebuffer(&framebufferInfo, &depthFramebuffers[i]);
+        createAtlasTarget(depthTarget, depth);
+    }
+
+    void DepthPass::createAtlasTarget(AtlasTarget &target, const DepthImage &image) {
+        target.image = image.image;
+        // 清除和保留内容的render pass兼容，共用一个framebuffer
+        VkFramebufferCreateInfo framebufferInfo{};
+        framebufferInfo.sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO;
+        framebufferInfo.renderPass = framebuffer.renderPass;
+        framebufferInfo.attachmentCount = 1;
+        framebufferInfo.pAttachments = &image.view;
+        framebufferInfo.width = atlasWidth;
+        framebufferInfo.height = atlasHeight;
+        framebufferInfo.layers = 1;
+        device->CreateFramebuffer(&framebufferInfo, &target.framebuffer);
+    }
+
+    void DepthPass::destroyAtlasTarget(AtlasTarget &target) {
+        if (target.framebuffer != VK_NULL_HANDLE) {
+            device->DestroyFramebuffer(target.framebuffer);
+            target.framebuffer = VK_NULL_HANDLE;
+        }
+    }
+
+    void DepthPass::setStaticCacheEnabled(bool enabled) {
+        if (enabled && staticDepth.image == VK_NULL_HANDLE) {
+            createDepthImage(staticDepth, VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT);
+            createAtlasTarget(staticTarget, staticDepth);
+        }
+        useStaticCache = enabled;
+    }
+
+    void DepthPass::createTimestampQueries() {
+        if (!device->properties.limits.timestampComputeAndGraphics || device->properties.limits.timestampPeriod <= 0.0f) {
+            return;
+        }
+        VkQueryPoolCreateInfo queryPoolInfo{};
+        queryPoolInfo.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+        queryPoolInfo.queryType = VK_QUERY_TYPE_TIMESTAMP;
+        queryPoolInfo.queryCount = 2 * VulkanDevice::MAX_FRAMES_IN_FLIGHT;
+        if (vkCreateQueryPool(device->device, &queryPoolInfo, nullptr, &timestampPool) != VK_SUCCESS) {
+            std::cerr << "Could not create the shadow timestamp query pool" << std::endl;
+            timestampPool = VK_NULL_HANDLE;
         }
     }
 
+    void DepthPass::updateGpuTime() {
+        // 这一帧的fence已经等待过，上一次在这里写入的timestamp通常已经可读
+        const uint32_t frame = static_cast<uint32_t>(device->getFrameIndex());
+        if (timestampPool == VK_NULL_HANDLE || !timestampWritten[frame]) {
+            return;
+        }
+        uint64_t timestamps[2];
+        if (vkGetQueryPoolResults(device->device, timestampPool, frame * 2, 2, sizeof(timestamps), timestamps,
+                                  sizeof(uint64_t), VK_QUERY_RESULT_64_BIT) == VK_SUCCESS) {
+            gpuTime = static_cast<float>(static_cast<double>(timestamps[1] - timestamps[0]) *
+                                         device->properties.limits.timestampPeriod * 1e-6);
+            if (timestampLayers[frame] > 0.0f) {
+                gpuTimePerLayer = gpuTime / timestampLayers[frame];
+            }
+        }
+        timestampWritten[frame] = false;
+    }
+
     void DepthPass::createPipelines() {
-        pipelines.resize(1);
+        pipelines.resize(singlePass ? 2 : 1);
         VkPushConstantRange pushConstantRange = CreatePushConstantRange(VK_SHADER_STAGE_VERTEX_BIT,
                                                                         sizeof(PushConstBlock), 0);
         std::array<VkDescriptorSetLayout, 2> layouts = {descriptors[0].layout,
@@ -324,59 +439,339 @@ namespace MW {
 
         device->CreateGraphicsPipelines(&pipelineInfo, &pipelines[0].pipeline);
 
+        if (singlePass) {
+            // 和逐layer的pipeline只差vertex shader、layout和viewport数量，push constant多一个打包的layer
+            pushConstantRange.size = layerPushConstantOffset + sizeof(uint32_t);
+            layouts[0] = descriptors[getLayerCount()].layout;
+            device->CreatePipelineLayout(&pipelineLayoutInfo, &pipelines[1].layout);
+            auto layeredVertShaderModule = device->CreateShaderModule(DEPTHPASS_LAYERED_VERT);
+            shaderStages[0].module = layeredVertShaderModule;
+            pipelineInfo.layout = pipelines[1].layout;
+            viewportState.viewportCount = getLayerCount();
+            viewportState.scissorCount = getLayerCount();
+            device->CreateGraphicsPipelines(&pipelineInfo, &pipelines[1].pipeline);
+            device->DestroyShaderModule(layeredVertShaderModule);
+            viewportState.viewportCount = 1;
+            viewportState.scissorCount = 1;
+        }
+        pipelineInfo.layout = pipelines[0].layout;
+        createMeshletPipeline(pipelineInfo, fragShaderStageInfo);
+
         device->DestroyShaderModule(fragShaderModule);
         device->DestroyShaderModule(vertShaderModule);
     }
 
+    void DepthPass::createMeshletPipeline(VkGraphicsPipelineCreateInfo pipelineInfo,
+                                          const VkPipelineShaderStageCreateInfo &fragShaderStageInfo) {
+#if USE_MESH_SHADER && EXT_MESH_SHADER
+        // 模型的descriptor set layout在加载第一个模型时创建
+        if (descriptorSetLayoutVertexStorage == VK_NULL_HANDLE || descriptorSetLayoutMeshlet == VK_NULL_HANDLE) {
+            return;
+        }
+        const VkShaderStageFlags meshStages = VK_SHADER_STAGE_TASK_BIT_NV | VK_SHADER_STAGE_MESH_BIT_NV;
+        VkPushConstantRange pushConstantRange = CreatePushConstantRange(
+                meshStages, meshletConeCullingPushConstantOffset + sizeof(uint32_t), 0);
+        // set 3和4是SceneManager绑定的顶点和meshlet，set 2不使用，放一个占位的layout
+        std::array<VkDescriptorSetLayout, 5> layouts = {descriptors[0].layout, descriptorSetLayoutImage,
+                                                        descriptors[0].layout, descriptorSetLayoutVertexStorage,
+                                                        descriptorSetLayoutMeshlet};
+        VkPipelineLayoutCreateInfo pipelineLayoutInfo{};
+        pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+        pipelineLayoutInfo.setLayoutCount = layouts.size();
+        pipelineLayoutInfo.pSetLayouts = layouts.data();
+        pipelineLayoutInfo.pushConstantRangeCount = 1;
+        pipelineLayoutInfo.pPushConstantRanges = &pushConstantRange;
+        device->CreatePipelineLayout(&pipelineLayoutInfo, &meshletPipeline.layout);
+
+        auto taskShaderModule = device->CreateShaderModule(DEPTHPASS_MS_TASK);
+        auto meshShaderModule = device->CreateShaderModule(DEPTHPASS_MS_MESH);
+        VkPipelineShaderStageCreateInfo taskShaderStageInfo{};
+        taskShaderStageInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+        taskShaderStageInfo.stage = VK_SHADER_STAGE_TASK_BIT_NV;
+        taskShaderStageInfo.module = taskShaderModule;
+        taskShaderStageInfo.pName = "main";
+        VkPipelineShaderStageCreateInfo meshShaderStageInfo = taskShaderStageInfo;
+        meshShaderStageInfo.stage = VK_SHADER_STAGE_MESH_BIT_NV;
+        meshShaderStageInfo.module = meshShaderModule;
+        std::array<VkPipelineShaderStageCreateInfo, 3> shaderStages = {taskShaderStageInfo, meshShaderStageInfo,
+                                                                       fragShaderStageInfo};
+
+        // 其余状态和逐layer的pipeline相同
+        pipelineInfo.stageCount = shaderStages.size();
+        pipelineInfo.pStages = shaderStages.data();
+        pipelineInfo.pVertexInputState = nullptr;
+        pipelineInfo.pInputAssemblyState = nullptr;
+        pipelineInfo.layout = meshletPipeline.layout;
+        device->CreateGraphicsPipelines(&pipelineInfo, &meshletPipeline.pipeline);
+
+        device->DestroyShaderModule(meshShaderModule);
+        device->DestroyShaderModule(taskShaderModule);
+#endif
+    }
+
     void DepthPass::draw() {
+        if (!useStaticCache) {
+            renderLayers(depthTarget, needUpdate, 0, true);
+            return;
+        }
+        renderLayers(staticTarget, needStaticUpdate, RenderFlags::RenderStaticModels, true);
+        copyStaticLayers(needUpdate);
+        renderLayers(depthTarget, needUpdate, RenderFlags::RenderDynamicModels, false);
+    }
+
+    void DepthPass::renderLayers(AtlasTarget &target, const std::vector<int> &layers, uint32_t renderFlags,
+                                 bool clear) {
+        if (layers.empty()) {
+            return;
+        }
+        if (useMeshlets && supportsMeshlets()) {
+            drawMeshletLayers(target, layers, renderFlags, clear);
+            return;
+        }
+        if (singlePass) {
+            drawLayered(target, layers, renderFlags, clear);
+            return;
+        }
+        for (auto &i: layers) {
+            drawSingleLayer(target, i, renderFlags, clear);
+        }
+    }
+
+    void DepthPass::beginAtlasPass(AtlasTarget &target, const VkRect2D &renderArea, const std::vector<int> &layers,
+                                   bool clear) {
         auto commandBuffer = device->getCurrentCommandBuffer();
         VkClearValue clearValues[1];
         clearValues[0].depthStencil = {1.0f, 0};
 
+        // 第一次用会清除整个atlas的render pass，把image从undefined转换过来，之后只清除要更新的区域
+        const bool clearAll = clear && !target.initialized;
         VkRenderPassBeginInfo renderPassBeginInfo{};
         renderPassBeginInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
-        renderPassBeginInfo.renderPass = framebuffer.renderPass;
-        renderPassBeginInfo.renderArea.offset.x = 0;
-        renderPassBeginInfo.renderArea.offset.y = 0;
-        renderPassBeginInfo.renderArea.extent.width = depthImageWidth;
-        renderPassBeginInfo.renderArea.extent.height = depthImageHeight;
+        renderPassBeginInfo.renderPass = clearAll ? framebuffer.renderPass : loadRenderPass;
+        renderPassBeginInfo.renderArea = clearAll ? VkRect2D{{0, 0}, {atlasWidth, atlasHeight}} : renderArea;
         renderPassBeginInfo.clearValueCount = 1;
         renderPassBeginInfo.pClearValues = clearValues;
-        renderPassBeginInfo.framebuffer = depthFramebuffers[nowArrayLayer];
-
+        renderPassBeginInfo.framebuffer = target.framebuffer;
         vkCmdBeginRenderPass(commandBuffer, &renderPassBeginInfo, VK_SUBPASS_CONTENTS_INLINE);
+
+        if (clear && !clearAll) {
+            VkClearAttachment clearAttachment{};
+            clearAttachment.aspectMask = VK_IMAGE_ASPECT_DEPTH_BIT;
+            clearAttachment.clearValue = clearValues[0];
+            std::vector<VkClearRect> clearRects(layers.size());
+            for (size_t i = 0; i < layers.size(); ++i) {
+                clearRects[i].rect = layerRects[layers[i]];
+                clearRects[i].baseArrayLayer = 0;
+                clearRects[i].layerCount = 1;
+            }
+            vkCmdClearAttachments(commandBuffer, 1, &clearAttachment, static_cast<uint32_t>(clearRects.size()),
+                                  clearRects.data());
+        }
+        target.initialized = true;
+    }
+
+    void DepthPass::setLayerViewport(VkCommandBuffer commandBuffer, uint32_t layer) {
+        const VkRect2D &rect = layerRects[layer];
+        VkViewport viewport{};
+        viewport.x = static_cast<float>(rect.offset.x);
+        viewport.y = static_cast<float>(rect.offset.y);
+        viewport.width = static_cast<float>(rect.extent.width);
+        viewport.height = static_cast<float>(rect.extent.height);
+        viewport.minDepth = 0.0f;
+        viewport.maxDepth = 1.0f;
+        vkCmdSetViewport(commandBuffer, 0, 1, &viewport);
+        vkCmdSetScissor(commandBuffer, 0, 1, &rect);
+    }
+
+    void DepthPass::drawSingleLayer(AtlasTarget &target, uint32_t layer, uint32_t renderFlags, bool clear) {
+        auto commandBuffer = device->getCurrentCommandBuffer();
+        const VkRect2D &rect = layerRects[layer];
+        beginAtlasPass(target, rect, {static_cast<int>(layer)}, clear);
+        setLayerViewport(commandBuffer, layer);
+
         vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelines[0].pipeline);
-        vkCmdBindDescriptorSets(device->getCurrentCommandBuffer(), VK_PIPELINE_BIND_POINT_GRAPHICS, pipelines[0].layout,
-                                0, 1, &descriptors[nowArrayLayer].descriptorSet, 0, nullptr);
+        vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelines[0].layout,
+                                0, 1, &descriptors[layer].descriptorSet, 0, nullptr);
 
         PushConstBlock pushConstant;
-        engineGlobalContext.getScene()->draw(device->getCurrentCommandBuffer(), RenderFlags::BindImages,
-                                             pipelines[0].layout, 1, &pushConstant, sizeof(pushConstant));
+        LodSelection lodSelection = engineGlobalContext.getScene()->getShadowLodSelection(
+                uniformBufferObjects[layer].projViewMatrix, rect.extent.width);
+        engineGlobalContext.getScene()->draw(commandBuffer, RenderFlags::BindImages | renderFlags,
+                                             pipelines[0].layout, 1, &pushConstant, sizeof(pushConstant), false,
+                                             &lodSelection);
         vkCmdEndRenderPass(commandBuffer);
     }
 
     void DepthPass::drawLayer() {
         auto commandBuffer = device->getCurrentCommandBuffer();
-        VkViewport viewport{};
-        viewport.width = depthImageWidth;
-        viewport.height = depthImageHeight;
-        viewport.minDepth = 0.0f;
-        viewport.maxDepth = 1.0f;
-        vkCmdSetViewport(commandBuffer, 0, 1, &viewport);
+        const uint32_t frame = static_cast<uint32_t>(device->getFrameIndex());
+        if (timestampPool != VK_NULL_HANDLE) {
+            vkCmdResetQueryPool(commandBuffer, timestampPool, frame * 2, 2);
+            vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, timestampPool, frame * 2);
+        }
 
-        VkRect2D scissor{};
-        scissor.extent = {depthImageWidth, depthImageHeight};
-        scissor.offset = {0, 0};
-        vkCmdSetScissor(commandBuffer, 0, 1, &scissor);
+        draw();
 
-        for (auto &i: needUpdate) {
-            nowArrayLayer = i;
-            draw();
+        if (timestampPool != VK_NULL_HANDLE) {
+            vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, timestampPool, frame * 2 + 1);
+            timestampWritten[frame] = true;
+            timestampLayers[frame] = useStaticCache
+                                     ? static_cast<float>(needStaticUpdate.size()) +
+                                       dynamicLayerCost * static_cast<float>(needUpdate.size())
+                                     : static_cast<float>(needUpdate.size());
+        }
+    }
+
+    VkRect2D DepthPass::getLayersRect(const std::vector<int> &layers) const {
+        int32_t minX = INT32_MAX, minY = INT32_MAX, maxX = 0, maxY = 0;
+        for (auto &i: layers) {
+            const VkRect2D &rect = layerRects[i];
+            minX = std::min(minX, rect.offset.x);
+            minY = std::min(minY, rect.offset.y);
+            maxX = std::max(maxX, rect.offset.x + static_cast<int32_t>(rect.extent.width));
+            maxY = std::max(maxY, rect.offset.y + static_cast<int32_t>(rect.extent.height));
+        }
+        return {{minX, minY}, {static_cast<uint32_t>(maxX - minX), static_cast<uint32_t>(maxY - minY)}};
+    }
+
+    void DepthPass::drawLayered(AtlasTarget &target, const std::vector<int> &layers, uint32_t renderFlags,
+                                bool clear) {
+        auto commandBuffer = device->getCurrentCommandBuffer();
+        // render area取要更新的区域的并集
+        beginAtlasPass(target, getLayersRect(layers), layers, clear);
+
+        // pipeline的viewport数量固定为layer数，不更新的layer也要设置
+        std::vector<VkViewport> viewports(layerRects.size());
+        for (size_t i = 0; i < layerRects.size(); ++i) {
+            viewports[i].x = static_cast<float>(layerRects[i].offset.x);
+            viewports[i].y = static_cast<float>(layerRects[i].offset.y);
+            viewports[i].width = static_cast<float>(layerRects[i].extent.width);
+            viewports[i].height = static_cast<float>(layerRects[i].extent.height);
+            viewports[i].minDepth = 0.0f;
+            viewports[i].maxDepth = 1.0f;
+        }
+        vkCmdSetViewport(commandBuffer, 0, static_cast<uint32_t>(viewports.size()), viewports.data());
+        vkCmdSetScissor(commandBuffer, 0, static_cast<uint32_t>(layerRects.size()), layerRects.data());
+
+        vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelines[1].pipeline);
+        vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelines[1].layout,
+                                0, 1, &descriptors[getLayerCount()].descriptorSet, 0, nullptr);
+
+        // 每个primitive只实例化到它覆盖的cascade
+        auto scene = engineGlobalContext.getScene();
+        LayerSelection layerSelection;
+        for (auto &i: layers) {
+            const glm::mat4 &projViewMatrix = uniformBufferObjects[i].projViewMatrix;
+            layerSelection.addLayer(i, projViewMatrix,
+                                    scene->getShadowLodSelection(projViewMatrix, layerRects[i].extent.width));
         }
+        PushConstBlock pushConstant;
+        scene->draw(commandBuffer, RenderFlags::BindImages | renderFlags, pipelines[1].layout, 1, &pushConstant,
+                    sizeof(pushConstant.position), false, nullptr, &layerSelection);
+        vkCmdEndRenderPass(commandBuffer);
+    }
+
+    void DepthPass::drawMeshletLayers(AtlasTarget &target, const std::vector<int> &layers, uint32_t renderFlags,
+                                      bool clear) {
+        auto commandBuffer = device->getCurrentCommandBuffer();
+        beginAtlasPass(target, getLayersRect(layers), layers, clear);
+
+        vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, meshletPipeline.pipeline);
+        const uint32_t coneCulling = meshletConeCulling ? 1 : 0;
+        vkCmdPushConstants(commandBuffer, meshletPipeline.layout,
+                           VK_SHADER_STAGE_TASK_BIT_NV | VK_SHADER_STAGE_MESH_BIT_NV,
+                           meshletConeCullingPushConstantOffset, sizeof(coneCulling), &coneCulling);
+
+        // 每个layer各画一次，task shader按这个layer的矩阵裁剪meshlet
+        auto scene = engineGlobalContext.getScene();
+        for (auto &i: layers) {
+            setLayerViewport(commandBuffer, i);
+            vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, meshletPipeline.layout,
+                                    0, 1, &descriptors[i].descriptorSet, 0, nullptr);
+            PushConstBlock pushConstant;
+            LodSelection lodSelection = scene->getShadowLodSelection(uniformBufferObjects[i].projViewMatrix,
+                                                                     layerRects[i].extent.width);
+            scene->draw(commandBuffer, RenderFlags::BindImages | RenderFlags::CullMeshlets | renderFlags,
+                        meshletPipeline.layout, 1, &pushConstant, sizeof(pushConstant), true, &lodSelection);
+        }
+        vkCmdEndRenderPass(commandBuffer);
+    }
+
+    void DepthPass::copyStaticLayers(const std::vector<int> &layers) {
+        if (layers.empty()) {
+            return;
+        }
+        auto commandBuffer = device->getCurrentCommandBuffer();
+        VkImageAspectFlags aspect = VK_IMAGE_ASPECT_DEPTH_BIT;
+        if (depthFormat == VK_FORMAT_D32_SFLOAT_S8_UINT || depthFormat == VK_FORMAT_D24_UNORM_S8_UINT) {
+            aspect |= VK_IMAGE_ASPECT_STENCIL_BIT;
+        }
+
+        // layout按整个atlas转换，只复制要更新的区域，其余区域的内容要保留；第一次时depth还没有内容
+        auto createBarrier = [aspect](VkImage image, VkImageLayout oldLayout, VkImageLayout newLayout,
+                                      VkAccessFlags srcAccess, VkAccessFlags dstAccess) {
+            VkImageMemoryBarrier barrier{};
+            barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+            barrier.oldLayout = oldLayout;
+            barrier.newLayout = newLayout;
+            barrier.srcAccessMask = srcAccess;
+            barrier.dstAccessMask = dstAccess;
+            barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+            barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+            barrier.image = image;
+            barrier.subresourceRange = {aspect, 0, 1, 0, 1};
+            return barrier;
+        };
+        const bool firstCopy = !depthTarget.initialized;
+        std::array<VkImageMemoryBarrier, 2> barriers = {
+                createBarrier(staticDepth.image, VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL,
+                              VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT,
+                              VK_ACCESS_TRANSFER_READ_BIT),
+                createBarrier(depth.image, firstCopy ? VK_IMAGE_LAYOUT_UNDEFINED
+                                                     : VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL,
+                              VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, firstCopy ? 0 : VK_ACCESS_SHADER_READ_BIT,
+                              VK_ACCESS_TRANSFER_WRITE_BIT)
+        };
+        vkCmdPipelineBarrier(commandBuffer,
+                             VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
+                             VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 0, nullptr,
+                             static_cast<uint32_t>(barriers.size()), barriers.data());
+
+        std::vector<VkImageCopy> regions(layers.size());
+        for (size_t i = 0; i < layers.size(); ++i) {
+            const VkRect2D &rect = layerRects[layers[i]];
+            regions[i].srcSubresource = {aspect, 0, 0, 1};
+            regions[i].dstSubresource = regions[i].srcSubresource;
+            regions[i].srcOffset = {rect.offset.x, rect.offset.y, 0};
+            regions[i].dstOffset = regions[i].srcOffset;
+            regions[i].extent = {rect.extent.width, rect.extent.height, 1};
+        }
+        vkCmdCopyImage(commandBuffer, staticDepth.image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, depth.image,
+                       VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, static_cast<uint32_t>(regions.size()), regions.data());
+
+        barriers = {
+                createBarrier(staticDepth.image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+                              VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL, 0,
+                              VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT |
+                              VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT),
+                createBarrier(depth.image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+                              VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL, VK_ACCESS_TRANSFER_WRITE_BIT,
+                              VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT |
+                              VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT)
+        };
+        depthTarget.initialized = true;
+        vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT,
+                             VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT,
+                             0, 0, nullptr, 0, nullptr, static_cast<uint32_t>(barriers.size()), barriers.data());
     }
 
     void DepthPass::preparePassData() {
-        for (auto &i: needUpdate)
+        for (auto &i: needUpdate) {
             memcpy(uniformBuffers[i].mapped, &uniformBufferObjects[i], sizeof(UniformBufferObject));
+            if (singlePass) {
+                memcpy(static_cast<char *>(uniformBuffers[getLayerCount()].mapped) + sizeof(glm::mat4) * i,
+                       &uniformBufferObjects[i].projViewMatrix, sizeof(glm::mat4));
+            }
+        }
     }
 }
\ No newline at end of file
@@ -6,13 +6,15 @@
 #define GLM_FORCE_DEPTH_ZERO_TO_ONE
 
 #include "glm/glm.hpp"
+#include <array>
+#include <vector>
 
 namespace MW {
     struct DepthPassInitInfo : public RenderPassInitInfo {
-        // Maybe More
-        uint32_t depthImageWidth{DEFAULT_IMAGE_WIDTH};
-        uint32_t depthImageHeight{DEFAULT_IMAGE_HEIGHT};
-        uint32_t depthArrayLayers{1};
+        // 每个layer在atlas中的正方形区域边长
+        std::vector<uint32_t> layerResolutions{DEFAULT_IMAGE_WIDTH};
+        // 正交投影的深度是线性的，16位通常足够，设备不支持时退回32位
+        bool prefer16BitDepth{false};
 
         explicit DepthPassInitInfo(const RenderPassInitInfo *info) : RenderPassInitInfo(*info) {};
     };
@@ -27,11 +29,16 @@ namespace MW {
         VkImageView view;
         VkSampler sampler;
         VkDescriptorImageInfo descriptor;
+        // 开启深度比较的sampler，用于sampler2DShadow的硬件双线性PCF
+        VkSampler compareSampler{VK_NULL_HANDLE};
+        VkDescriptorImageInfo compareDescriptor;
 
         void setDescriptor() {
             descriptor.sampler = sampler;
             descriptor.imageLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL;
             descriptor.imageView = view;
+            compareDescriptor = descriptor;
+            compareDescriptor.sampler = compareSampler;
         }
 
         void destroy(VkDevice device) {
@@ -39,9 +46,19 @@ namespace MW {
             vkDestroyImage(device, image, nullptr);
             vkFreeMemory(device, mem, nullptr);
             vkDestroySampler(device, sampler, nullptr);
+            vkDestroySampler(device, compareSampler, nullptr);
         }
     };
 
+    /*
+        Renders the depth of every layer in needUpdate into its own region of a single atlas image, so each
+        layer can have a different resolution. When the device can write gl_ViewportIndex from the vertex
+        shader all layers are drawn in a single pass, otherwise each layer is drawn separately.
+        With the static cache enabled, static casters are kept in a second atlas and only the dynamic
+        casters are drawn on top of a copy of it.
+        With mesh shaders the layers are drawn from the models' meshlets instead, a task shader culls every
+        meshlet against the layer's frustum before it is rasterized
+    */
     class DepthPass : public PassBase {
     public:
         void drawLayer();
@@ -54,26 +71,120 @@ namespace MW {
 
         void preparePassData() override;
 
+        // 第一次开启时创建静态阴影缓存，关闭后needStaticUpdate不再使用
+        void setStaticCacheEnabled(bool enabled);
+
+        bool isStaticCacheEnabled() const { return useStaticCache; }
+
+        // 读回这一帧的slot上次写入的timestamp，需要在这一帧的fence等待之后调用
+        void updateGpuTime();
+
+        // 上一次读回的阴影绘制GPU耗时(毫秒)，还没有结果或不支持timestamp时为负数
+        float getGpuTime() const { return gpuTime; }
+
+        // 按全量绘制一个layer折算的平均耗时(毫秒)，没有测量结果时为负数
+        float getGpuTimePerLayer() const { return gpuTimePerLayer; }
+
+        // 复制静态缓存再叠加动态物体相对于全量绘制一个layer的耗时估计
+        static constexpr float dynamicLayerCost = 0.25f;
+
+        uint32_t getLayerCount() const { return static_cast<uint32_t>(layerRects.size()); }
+
+        // layer在atlas中的区域(像素)
+        const VkRect2D &getLayerRect(uint32_t layer) const { return layerRects[layer]; }
+
+        uint32_t getLayerResolution(uint32_t layer) const { return layerRects[layer].extent.width; }
+
+        // 采样用的区域，xy为偏移，zw为大小，都已除以atlas的尺寸
+        glm::vec4 getLayerAtlasRect(uint32_t layer) const;
+
+        VkExtent2D getAtlasExtent() const { return {atlasWidth, atlasHeight}; }
+
+        VkFormat getDepthFormat() const { return depthFormat; }
+
+        // 是否创建了task/mesh shader的pipeline
+        bool supportsMeshlets() const { return meshletPipeline.pipeline != VK_NULL_HANDLE; }
+
+        // 支持时按meshlet绘制，逐cascade裁剪
+        bool useMeshlets{true};
+        // 同时剔除法线锥整体背向光源的meshlet，只适用于封闭的网格
+        bool meshletConeCulling{false};
+
         std::vector<int> needUpdate;
+        // 开启静态缓存时，needUpdate中静态物体也需要重画的layer
+        std::vector<int> needStaticUpdate;
         DepthImage depth;
     private:
+        struct AtlasTarget {
+            VkImage image{VK_NULL_HANDLE};
+            VkFramebuffer framebuffer{VK_NULL_HANDLE};
+            bool initialized{false}; // 第一次绘制前image没有内容
+        };
+
         void draw() override;
 
         void createRenderPass();
 
+        void packAtlas(const std::vector<uint32_t> &resolutions);
+
+        void createDepthImage(DepthImage &image, VkImageUsageFlags usage);
+
         void createUniformBuffer();
 
         void createDescriptorSets();
 
         void createFramebuffers();
 
+        void createAtlasTarget(AtlasTarget &target, const DepthImage &image);
+
+        void destroyAtlasTarget(AtlasTarget &target);
+
         void createPipelines();
 
-        uint32_t nowArrayLayer;
-        uint32_t depthImageWidth;
-        uint32_t depthImageHeight;
-        uint32_t depthArrayLayers;
-        std::vector<VkFramebuffer> depthFramebuffers;
+        void createMeshletPipeline(VkGraphicsPipelineCreateInfo pipelineInfo,
+                                   const VkPipelineShaderStageCreateInfo &fragShaderStageInfo);
+
+        void createTimestampQueries();
+
+        void renderLayers(AtlasTarget &target, const std::vector<int> &layers, uint32_t renderFlags, bool clear);
+
+        void beginAtlasPass(AtlasTarget &target, const VkRect2D &renderArea, const std::vector<int> &layers,
+                            bool clear);
+
+        void setLayerViewport(VkCommandBuffer commandBuffer, uint32_t layer);
+
+        void drawSingleLayer(AtlasTarget &target, uint32_t layer, uint32_t renderFlags, bool clear);
+
+        void drawLayered(AtlasTarget &target, const std::vector<int> &layers, uint32_t renderFlags, bool clear);
+
+        void drawMeshletLayers(AtlasTarget &target, const std::vector<int> &layers, uint32_t renderFlags, bool clear);
+
+        // layers在atlas中区域的并集
+        VkRect2D getLayersRect(const std::vector<int> &layers) const;
+
+        void copyStaticLayers(const std::vector<int> &layers);
+
+        uint32_t atlasWidth;
+        uint32_t atlasHeight;
+        std::vector<VkRect2D> layerRects;
+        bool prefer16BitDepth{false};
+        VkFormat depthFormat;
+        // 单pass时uniformBuffers、descriptors的最后一项覆盖全部layer，pipelines[1]输出gl_ViewportIndex
+        bool singlePass{false};
+        // 不在pipelines中，pipelines[1]是单pass的pipeline
+        RenderPipelineBase meshletPipeline{VK_NULL_HANDLE, VK_NULL_HANDLE};
+        bool useStaticCache{false};
+        // 保留原有内容的render pass，framebuffer.renderPass则会清除整个atlas
+        VkRenderPass loadRenderPass{VK_NULL_HANDLE};
+        AtlasTarget depthTarget;
+        AtlasTarget staticTarget;
+        DepthImage staticDepth{};
         std::vector<VulkanBuffer> uniformBuffers;
+        VkQueryPool timestampPool{VK_NULL_HANDLE};
+        std::array<bool, VulkanDevice::MAX_FRAMES_IN_FLIGHT> timestampWritten{};
+        // 每个slot写入timestamp时绘制的工作量，按全量绘制的layer数折算
+        std::array<float, VulkanDevice::MAX_FRAMES_IN_FLIGHT> timestampLayers{};
+        float gpuTime{-1.0f};
+        float gpuTimePerLayer{-1.0f};
     };
-}
\ No newline at end of file
+}
@@ -0,0 +1,199 @@
+#include "depth_reduction_pass.h"
+#include "depth_reduction_comp.h"
+#include <cstring>
+#include <limits>
+
+namespace MW {
+    // depth_reduction.comp中每个workgroup覆盖的像素边长
+    constexpr uint32_t DEPTH_REDUCTION_TILE = 16 * 4;
+
+    void DepthReductionPass::initialize(const RenderPassInitInfo *info) {
+        PassBase::initialize(info);
+        createResultBuffers();
+        createDescriptorSets();
+        createPipelines();
+    }
+
+    void DepthReductionPass::clean() {
+        for (auto &pipeline: pipelines) {
+            device->DestroyPipeline(pipeline.pipeline);
+            device->DestroyPipelineLayout(pipeline.layout);
+        }
+        for (auto &descriptor: descriptors) {
+            device->DestroyDescriptorSetLayout(descriptor.layout);
+        }
+        for (auto &buffer: resultBuffers) {
+            device->unMapMemory(buffer);
+            device->DestroyVulkanBuffer(buffer);
+        }
+        device->DestroySampler(depthSampler);
+        PassBase::clean();
+    }
+
+    void DepthReductionPass::createResultBuffers() {
+        for (auto &buffer: resultBuffers) {
+            device->CreateBuffer(
+                    VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+                    VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+                    buffer,
+                    sizeof(ReductionResult));
+            device->MapMemory(buffer);
+        }
+    }
+
+    void DepthReductionPass::createDescriptorSets() {
+        VkSamplerCreateInfo sampler{};
+        sampler.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
+        sampler.magFilter = VK_FILTER_NEAREST;
+        sampler.minFilter = VK_FILTER_NEAREST;
+        sampler.mipmapMode = VK_SAMPLER_MIPMAP_MODE_NEAREST;
+        sampler.addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+        sampler.addressModeV = sampler.addressModeU;
+        sampler.addressModeW = sampler.addressModeU;
+        sampler.maxAnisotropy = 1.0f;
+        sampler.borderColor = VK_BORDER_COLOR_FLOAT_OPAQUE_WHITE;
+        device->CreateSampler(&sampler, &depthSampler);
+
+        std::vector<VkDescriptorSetLayoutBinding> bindings = {
+                CreateDescriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
+                                                 VK_SHADER_STAGE_COMPUTE_BIT, 0),
+                CreateDescriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT, 1),
+        };
+        VkDescriptorSetLayoutCreateInfo descriptorSetLayoutCreateInfo{};
+        descriptorSetLayoutCreateInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+        descriptorSetLayoutCreateInfo.pBindings = bindings.data();
+        descriptorSetLayoutCreateInfo.bindingCount = bindings.size();
+        // 每个slot写入自己的结果buffer
+        descriptors.resize(resultBuffers.size());
+        device->CreateDescriptorPool(bindings, static_cast<uint32_t>(descriptors.size()), descriptorPool);
+        for (auto &descriptor: descriptors) {
+            device->CreateDescriptorSetLayout(&descriptorSetLayoutCreateInfo, &descriptor.layout);
+            device->CreateDescriptorSet(descriptorPool, descriptor.layout, descriptor.descriptorSet);
+        }
+        updateDescriptorSets();
+    }
+
+    void DepthReductionPass::updateDescriptorSets() {
+        VkDescriptorImageInfo depthImageInfo{};
+        depthImageInfo.sampler = depthSampler;
+        depthImageInfo.imageView = device->getDepthImageInfo().depthImageView;
+        depthImageInfo.imageLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL;
+
+        for (size_t i = 0; i < descriptors.size(); i++) {
+            std::array<VkWriteDescriptorSet, 2> descriptorWrites = {
+                    CreateWriteDescriptorSet(descriptors[i].descriptorSet, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 0,
+                                             &depthImageInfo),
+                    CreateWriteDescriptorSet(descriptors[i].descriptorSet, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1,
+                                             &resultBuffers[i].descriptor),
+            };
+            device->UpdateDescriptorSets(descriptorWrites.size(), descriptorWrites.data());
+        }
+    }
+
+    void DepthReductionPass::createPipelines() {
+        pipelines.resize(1);
+        VkPipelineLayoutCreateInfo pipelineLayoutInfo{};
+        pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+        pipelineLayoutInfo.setLayoutCount = 1;
+        pipelineLayoutInfo.pSetLayouts = &descriptors[0].layout; //所有的descriptor的layout都一样
+        device->CreatePipelineLayout(&pipelineLayoutInfo, &pipelines[0].layout);
+
+        auto compShaderModule = device->CreateShaderModule(DEPTH_REDUCTION_COMP);
+        VkComputePipelineCreateInfo pipelineInfo{};
+        pipelineInfo.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+        pipelineInfo.stage.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+        pipelineInfo.stage.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+        pipelineInfo.stage.module = compShaderModule;
+        pipelineInfo.stage.pName = "main";
+        pipelineInfo.layout = pipelines[0].layout;
+        device->CreateComputePipelines(VK_NULL_HANDLE, 1, &pipelineInfo, &pipelines[0].pipeline);
+        device->DestroyShaderModule(compShaderModule);
+    }
+
+    void DepthReductionPass::preparePassData() {
+        const uint32_t frame = static_cast<uint32_t>(device->getFrameIndex());
+        auto *result = static_cast<ReductionResult *>(resultBuffers[frame].mapped);
+        if (resultWritten[frame]) {
+            // 全是天空时min仍是重置的值，大于max
+            float resultMin, resultMax;
+            std::memcpy(&resultMin, &result->minDepth, sizeof(float));
+            std::memcpy(&resultMax, &result->maxDepth, sizeof(float));
+            valid = resultMin <= resultMax;
+            if (valid) {
+                minDepth = resultMin;
+                maxDepth = resultMax;
+            }
+            resultWritten[frame] = false;
+        }
+        // coherent内存的写入在提交时对GPU可见
+        const float resetMin = std::numeric_limits<float>::max();
+        std::memcpy(&result->minDepth, &resetMin, sizeof(float));
+        result->maxDepth = 0;
+    }
+
+    void DepthReductionPass::draw() {
+        auto commandBuffer = device->getCurrentCommandBuffer();
+        const uint32_t frame = static_cast<uint32_t>(device->getFrameIndex());
+        const VulkanDepthImageDesc depthImage = device->getDepthImageInfo();
+        const VkExtent2D extent = device->getSwapChainExtent();
+
+        VkImageMemoryBarrier imageBarrier{};
+        imageBarrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+        imageBarrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        imageBarrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        imageBarrier.image = depthImage.depthImage;
+        imageBarrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_DEPTH_BIT;
+        if (depthImage.depthImageFormat == VK_FORMAT_D32_SFLOAT_S8_UINT ||
+            depthImage.depthImageFormat == VK_FORMAT_D24_UNORM_S8_UINT) {
+            imageBarrier.subresourceRange.aspectMask |= VK_IMAGE_ASPECT_STENCIL_BIT;
+        }
+        imageBarrier.subresourceRange.levelCount = 1;
+        imageBarrier.subresourceRange.layerCount = 1;
+        imageBarrier.oldLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+        imageBarrier.newLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL;
+        imageBarrier.srcAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+        imageBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+        vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT,
+                             VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 0, nullptr, 0, nullptr, 1, &imageBarrier);
+
+        vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipelines[0].pipeline);
+        vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipelines[0].layout, 0, 1,
+                                &descriptors[frame].descriptorSet, 0, nullptr);
+        vkCmdDispatch(commandBuffer, (extent.width + DEPTH_REDUCTION_TILE - 1) / DEPTH_REDUCTION_TILE,
+                      (extent.height + DEPTH_REDUCTION_TILE - 1) / DEPTH_REDUCTION_TILE, 1);
+
+        // 结果在fence之后由CPU读取；depth回到attachment layout，下一帧的深度测试等待这次读取结束
+        VkBufferMemoryBarrier bufferBarrier{};
+        bufferBarrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+        bufferBarrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+        bufferBarrier.dstAccessMask = VK_ACCESS_HOST_READ_BIT;
+        bufferBarrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        bufferBarrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        bufferBarrier.buffer = resultBuffers[frame].buffer;
+        bufferBarrier.size = VK_WHOLE_SIZE;
+        vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_HOST_BIT, 0, 0,
+                             nullptr, 1, &bufferBarrier, 0, nullptr);
+
+        imageBarrier.oldLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL;
+        imageBarrier.newLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+        imageBarrier.srcAccessMask = VK_ACCESS_SHADER_READ_BIT;
+        imageBarrier.dstAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT |
+                                     VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+        vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                             VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT, 0, 0, nullptr, 0, nullptr, 1, &imageBarrier);
+        resultWritten[frame] = true;
+    }
+
+    void DepthReductionPass::updateAfterFramebufferRecreate() {
+        updateDescriptorSets();
+    }
+
+    bool DepthReductionPass::getDepthRange(float &minDepth, float &maxDepth) const {
+        if (!valid) {
+            return false;
+        }
+        minDepth = this->minDepth;
+        maxDepth = this->maxDepth;
+        return true;
+    }
+}
@@ -0,0 +1,51 @@
+#pragma once
+
+#include "runtime/function/render/pass/pass_base/pass_base.h"
+#include <array>
+
+namespace MW {
+    /*
+        Reduces the scene depth buffer to the min/max depth of the visible surfaces in a compute pass.
+        Every frame slot has its own result buffer which is read back after the slot's fence, so the
+        range lags MAX_FRAMES_IN_FLIGHT frames behind the camera
+    */
+    class DepthReductionPass : public PassBase {
+    public:
+        void initialize(const RenderPassInitInfo *info) override;
+
+        void clean() override;
+
+        // 读回这一帧的slot上次的结果并重置，需要在这一帧的fence等待之后调用
+        void preparePassData() override;
+
+        // 在主render pass结束之后录制
+        void draw() override;
+
+        // depth image重建后更新descriptor
+        void updateAfterFramebufferRecreate();
+
+        // 最近一次读回的非天空像素的深度范围(深度缓冲中的原始值)，没有结果时返回false
+        bool getDepthRange(float &minDepth, float &maxDepth) const;
+
+    private:
+        struct ReductionResult {
+            uint32_t minDepth;
+            uint32_t maxDepth;
+        };
+
+        void createResultBuffers();
+
+        void createDescriptorSets();
+
+        void updateDescriptorSets();
+
+        void createPipelines();
+
+        std::array<VulkanBuffer, VulkanDevice::MAX_FRAMES_IN_FLIGHT> resultBuffers;
+        std::array<bool, VulkanDevice::MAX_FRAMES_IN_FLIGHT> resultWritten{};
+        VkSampler depthSampler{VK_NULL_HANDLE};
+        float minDepth{0.0f};
+        float maxDepth{1.0f};
+        bool valid{false};
+    };
+}
@@ -1,92 +1,271 @@
 #pragma once
 
 #include "core/base/hash.h"
-#include <unordered_map>
-#include <list>
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <iostream>
+#include <memory>
 #include <mutex>
+#include <unordered_map>
+#include <vector>
 
 namespace MW {
     static const size_t invalidGuid = 0;
 
+    /*
+        Generational slot map, a guid is (generation << 32) | slot index.
+        Slots live in fixed size chunks that are never moved or freed, so a lookup is two array accesses
+        and a stale guid is detected by comparing generations. Free slots are kept in a lock-free stack,
+        element to guid dedup uses a sharded hash map. All methods are thread safe
+    */
     template<typename T>
     class GuidAllocator {
     public:
+        GuidAllocator() {
+            for (auto &chunk: chunks) {
+                chunk.store(nullptr, std::memory_order_relaxed);
+            }
+        }
+
+        ~GuidAllocator() {
+            for (auto &chunk: chunks) {
+                delete[] chunk.load(std::memory_order_relaxed);
+            }
+        }
+
+        GuidAllocator(const GuidAllocator &) = delete;
+
+        GuidAllocator &operator=(const GuidAllocator &) = delete;
+
         static bool isValidGuid(size_t guid) { return guid != invalidGuid; }
 
+        // 相同元素返回已有的guid，slot用完时返回invalidGuid
         size_t allocGuid(const T &t) {
-            auto find_it = elementsToGuidMap.find(t);
-            if (find_it != elementsToGuidMap.end())
+            const size_t hash = std::hash<T>{}(t);
+            Shard &shard = getShard(hash);
+            std::lock_guard<std::mutex> lock(shard.mutex);
+            auto find_it = shard.elementsToGuidMap.find(t);
+            if (find_it != shard.elementsToGuidMap.end())
                 return find_it->second;
-            return allocateNewGuid();
+
+            uint32_t index;
+            if (!allocateSlot(index)) {
+                std::cerr << "GuidAllocator is full, " << kMaxChunks * kChunkSize << " slots in use" << std::endl;
+                return invalidGuid;
+            }
+            Slot &slot = getSlot(index);
+            {
+                SlotLock slotLock(slot);
+                slot.element = t;
+                slot.elementHash = hash;
+            }
+            const size_t guid = makeGuid(slot.generation.load(std::memory_order_acquire), index);
+            shard.elementsToGuidMap.emplace(t, guid);
+            return guid;
         }
 
         bool getGuidRelatedElement(size_t guid, T &t) {
-            auto find_it = guidToElementsMap.find(guid);
-            if (find_it != guidToElementsMap.end()) {
-                t = find_it->second;
-                return true;
-            }
-            return false;
+            Slot *slot = findSlot(guid);
+            if (slot == nullptr)
+                return false;
+            SlotLock slotLock(*slot);
+            // 加锁后再检查一次，释放和读取可能同时发生
+            if (slot->generation.load(std::memory_order_acquire) != getGeneration(guid))
+                return false;
+            t = slot->element;
+            return true;
         }
 
         bool getElementGuid(const T &t, size_t &guid) {
-            auto find_it = elementsToGuidMap.find(t);
-            if (find_it != elementsToGuidMap.end()) {
+            Shard &shard = getShard(std::hash<T>{}(t));
+            std::lock_guard<std::mutex> lock(shard.mutex);
+            auto find_it = shard.elementsToGuidMap.find(t);
+            if (find_it != shard.elementsToGuidMap.end()) {
                 guid = find_it->second;
                 return true;
             }
             return false;
         }
 
-        bool hasElement(const T &t) { return elementsToGuidMap.find(t) != elementsToGuidMap.end(); }
+        bool hasElement(const T &t) {
+            size_t guid;
+            return getElementGuid(t, guid);
+        }
 
         void freeGuid(size_t guid) {
-            auto find_it = guidToElementsMap.find(guid);
-            if (find_it != guidToElementsMap.end()) {
-                const auto &ele = find_it->second;
-                elementsToGuidMap.erase(ele);
-                guidToElementsMap.erase(guid);
-                restIdList.emplace_back(guid);
+            Slot *slot = findSlot(guid);
+            if (slot == nullptr)
+                return;
+            size_t hash;
+            {
+                SlotLock slotLock(*slot);
+                if (slot->generation.load(std::memory_order_acquire) != getGeneration(guid))
+                    return;
+                hash = slot->elementHash;
             }
+            Shard &shard = getShard(hash);
+            std::lock_guard<std::mutex> lock(shard.mutex);
+            releaseSlot(shard, guid);
         }
 
         void freeElement(const T &t) {
-            auto find_it = elementsToGuidMap.find(t);
-            if (find_it != elementsToGuidMap.end()) {
-                const auto &guid = find_it->second;
-                elementsToGuidMap.erase(t);
-                guidToElementsMap.erase(guid);
-                restIdList.emplace_back(guid);
-            }
+            Shard &shard = getShard(std::hash<T>{}(t));
+            std::lock_guard<std::mutex> lock(shard.mutex);
+            auto find_it = shard.elementsToGuidMap.find(t);
+            if (find_it != shard.elementsToGuidMap.end())
+                releaseSlot(shard, find_it->second);
         }
 
         std::vector<size_t> getAllocatedGuids() const {
             std::vector<size_t> allocated_guids;
-            for (const auto &ele: guidToElementsMap) {
-                allocated_guids.push_back(ele.first);
+            for (const Shard &shard: shards) {
+                std::lock_guard<std::mutex> lock(shard.mutex);
+                for (const auto &ele: shard.elementsToGuidMap) {
+                    allocated_guids.push_back(ele.second);
+                }
             }
             return allocated_guids;
         }
 
         void clear() {
-            elementsToGuidMap.clear();
-            guidToElementsMap.clear();
+            for (Shard &shard: shards) {
+                std::lock_guard<std::mutex> lock(shard.mutex);
+                while (!shard.elementsToGuidMap.empty()) {
+                    releaseSlot(shard, shard.elementsToGuidMap.begin()->second);
+                }
+            }
         }
 
     private:
-        int allocateNewGuid() {
-            std::lock_guard lock(mutex);
-            int Guid = restIdList.back();
-            restIdList.pop_back();
-            if (restIdList.empty())
-                restIdList.emplace_back(Guid + 1);
-            return Guid;
+        static constexpr uint32_t kChunkBits = 10;
+        static constexpr uint32_t kChunkSize = 1u << kChunkBits;
+        static constexpr uint32_t kMaxChunks = 4096;
+        static constexpr uint32_t kShardCount = 64;
+
+        struct Slot {
+            // 从1开始，保证guid不会等于invalidGuid
+            std::atomic<uint32_t> generation{1};
+            // 空闲链表中下一个slot的index+1，0表示链表结束
+            std::atomic<uint32_t> nextFree{0};
+            std::atomic_flag lock = ATOMIC_FLAG_INIT;
+            size_t elementHash{0};
+            T element{};
+        };
+
+        // 保护element的自旋锁，只在拷贝元素时持有
+        struct SlotLock {
+            explicit SlotLock(Slot &slot) : slot(slot) {
+                while (slot.lock.test_and_set(std::memory_order_acquire)) {
+                }
+            }
+
+            ~SlotLock() { slot.lock.clear(std::memory_order_release); }
+
+            Slot &slot;
+        };
+
+        struct Shard {
+            mutable std::mutex mutex;
+            std::unordered_map<T, size_t> elementsToGuidMap;
+        };
+
+        static size_t makeGuid(uint32_t generation, uint32_t index) {
+            return (static_cast<size_t>(generation) << 32) | index;
+        }
+
+        static uint32_t getGeneration(size_t guid) { return static_cast<uint32_t>(guid >> 32); }
+
+        static uint32_t getIndex(size_t guid) { return static_cast<uint32_t>(guid & 0xffffffffu); }
+
+        Shard &getShard(size_t hash) { return shards[(hash ^ (hash >> 17)) % kShardCount]; }
+
+        Slot &getSlot(uint32_t index) {
+            return chunks[index >> kChunkBits].load(std::memory_order_acquire)[index & (kChunkSize - 1)];
+        }
+
+        Slot *findSlot(size_t guid) {
+            if (!isValidGuid(guid))
+                return nullptr;
+            const uint32_t index = getIndex(guid);
+            if (index >= slotCount.load(std::memory_order_acquire))
+                return nullptr;
+            Slot *chunk = chunks[index >> kChunkBits].load(std::memory_order_acquire);
+            if (chunk == nullptr)
+                return nullptr;
+            Slot &slot = chunk[index & (kChunkSize - 1)];
+            if (slot.generation.load(std::memory_order_acquire) != getGeneration(guid))
+                return nullptr;
+            return &slot;
+        }
+
+        bool allocateSlot(uint32_t &index) {
+            // 先从空闲栈中取，head高32位是防ABA的计数
+            uint64_t head = freeHead.load(std::memory_order_acquire);
+            while (static_cast<uint32_t>(head) != 0) {
+                const uint32_t freeIndex = static_cast<uint32_t>(head) - 1;
+                const uint32_t next = getSlot(freeIndex).nextFree.load(std::memory_order_relaxed);
+                const uint64_t newHead = ((head >> 32) + 1) << 32 | next;
+                if (freeHead.compare_exchange_weak(head, newHead, std::memory_order_acq_rel,
+                                                   std::memory_order_acquire)) {
+                    index = freeIndex;
+                    return true;
+                }
+            }
+
+            // 先检查再递增，用完后nextSlot最多超出线程数，不会回绕
+            if (nextSlot.load(std::memory_order_relaxed) >= kMaxChunks * kChunkSize) {
+                return false;
+            }
+            index = nextSlot.fetch_add(1, std::memory_order_relaxed);
+            const uint32_t chunkIndex = index >> kChunkBits;
+            if (chunkIndex >= kMaxChunks) {
+                return false;
+            }
+            if (chunks[chunkIndex].load(std::memory_order_acquire) == nullptr) {
+                Slot *chunk = new Slot[kChunkSize];
+                Slot *expected = nullptr;
+                if (!chunks[chunkIndex].compare_exchange_strong(expected, chunk, std::memory_order_acq_rel)) {
+                    delete[] chunk;
+                }
+            }
+            // slotCount只用于拒绝越界的guid，单调增加
+            uint32_t count = slotCount.load(std::memory_order_relaxed);
+            while (count < index + 1 &&
+                   !slotCount.compare_exchange_weak(count, index + 1, std::memory_order_release,
+                                                    std::memory_order_relaxed)) {
+            }
+            return true;
+        }
+
+        // 调用时持有shard的锁
+        void releaseSlot(Shard &shard, size_t guid) {
+            const uint32_t index = getIndex(guid);
+            Slot &slot = getSlot(index);
+            T element;
+            {
+                SlotLock slotLock(slot);
+                if (slot.generation.load(std::memory_order_acquire) != getGeneration(guid))
+                    return;
+                uint32_t generation = slot.generation.load(std::memory_order_relaxed) + 1;
+                slot.generation.store(generation == 0 ? 1 : generation, std::memory_order_release);
+                element = std::move(slot.element);
+                slot.element = T{};
+            }
+            shard.elementsToGuidMap.erase(element);
+
+            uint64_t head = freeHead.load(std::memory_order_acquire);
+            do {
+                slot.nextFree.store(static_cast<uint32_t>(head), std::memory_order_relaxed);
+            } while (!freeHead.compare_exchange_weak(head, ((head >> 32) + 1) << 32 | (index + 1),
+                                                     std::memory_order_acq_rel, std::memory_order_acquire));
         }
 
-        std::unordered_map<T, size_t> elementsToGuidMap;
-        std::unordered_map<size_t, T> guidToElementsMap;
-        std::list<size_t> restIdList{1};
-        std::mutex mutex;
+        std::array<std::atomic<Slot *>, kMaxChunks> chunks;
+        std::atomic<uint32_t> nextSlot{0};
+        std::atomic<uint32_t> slotCount{0};
+        std::atomic<uint64_t> freeHead{0};
+        std::array<Shard, kShardCount> shards;
     };
 
 } // namespace MW
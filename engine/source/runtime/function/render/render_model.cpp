@@ -11,6 +11,19 @@
 #define TINYGLTF_NO_STB_IMAGE_WRITE
 
 #include "render_model.h"
+#include "function/render/gltf_accessor.h"
+#include "function/render/image_decoder.h"
+#include "function/render/render_resource.h"
+#include "function/render/texture_streamer.h"
+#include "function/render/virtual_texture.h"
+#include "core/base/thread_pool.h"
+#include "core/file/virtual_file_system.h"
+#include <unordered_map>
+#include <chrono>
+#include <cstring>
+#if defined(__linux__)
+#include <sys/resource.h>
+#endif
 
 namespace MW {
     VkDescriptorSetLayout descriptorSetLayoutImage = VK_NULL_HANDLE;
@@ -27,16 +40,174 @@ namespace MW {
 /*
 	We use a custom image loading function with tinyglTF, so we can do custom stuff loading ktx textures
 */
+    static bool isKtxImage(const tinygltf::Image &image) {
+        const size_t extension = image.uri.find_last_of('.');
+        return extension != std::string::npos && image.uri.substr(extension + 1) == "ktx";
+    }
+
     bool loadImageDataFunc(tinygltf::Image *image, const int imageIndex, std::string *error, std::string *warning,
                            int req_width, int req_height, const unsigned char *bytes, int size, void *userData) {
         // KTX files will be handled by our own code
-        if (image->uri.find_last_of(".") != std::string::npos) {
-            if (image->uri.substr(image->uri.find_last_of(".") + 1) == "ktx") {
-                return true;
+        if (isKtxImage(*image)) {
+            return true;
+        }
+        // Keep the encoded bytes, Model::loadImages decodes them on the thread pool
+        image->as_is = true;
+        image->image.assign(bytes, bytes + size);
+        return true;
+    }
+
+    // EXT_meshopt_compression的fallback buffer可以既没有uri也没有数据，tinygltf不接受这样的buffer，
+    // 解析前换成1字节的data uri占位，解析后再清空，引用它的bufferView由decodeMeshoptBufferViews解码
+    static const char *kMeshoptFallbackUri = "data:application/octet-stream;base64,AA==";
+
+    static bool patchMeshoptFallbackBuffers(std::string &text) {
+        if (text.find("EXT_meshopt_compression") == std::string::npos) {
+            return false;
+        }
+        nlohmann::json document = nlohmann::json::parse(text, nullptr, false);
+        if (document.is_discarded() || !document.is_object()) {
+            return false;
+        }
+        auto buffers = document.find("buffers");
+        if (buffers == document.end() || !buffers->is_array()) {
+            return false;
+        }
+        bool patched = false;
+        for (nlohmann::json &buffer: *buffers) {
+            if (!buffer.is_object() || buffer.find("uri") != buffer.end()) {
+                continue;
+            }
+            auto extensions = buffer.find("extensions");
+            if (extensions == buffer.end() || !extensions->is_object()) {
+                continue;
+            }
+            auto meshopt = extensions->find("EXT_meshopt_compression");
+            if (meshopt == extensions->end() || !meshopt->is_object()) {
+                continue;
+            }
+            auto fallback = meshopt->find("fallback");
+            if (fallback == meshopt->end() || !fallback->is_boolean() || !fallback->get<bool>()) {
+                continue;
+            }
+            buffer["uri"] = kMeshoptFallbackUri;
+            buffer["byteLength"] = 1;
+            patched = true;
+        }
+        if (patched) {
+            text = document.dump();
+        }
+        return patched;
+    }
+
+    static bool parseGltfMemory(tinygltf::TinyGLTF &context, tinygltf::Model &model, const unsigned char *data,
+                                size_t size, const std::string &baseDir, std::string &error, std::string &warning) {
+        const bool binary = size >= 4 && memcmp(data, "glTF", 4) == 0;
+        if (!binary) {
+            std::string text(reinterpret_cast<const char *>(data), size);
+            if (patchMeshoptFallbackBuffers(text)) {
+                return context.LoadASCIIFromString(&model, &error, &warning, text.data(),
+                                                   static_cast<unsigned int>(text.size()), baseDir);
+            }
+            return context.LoadASCIIFromString(&model, &error, &warning, reinterpret_cast<const char *>(data),
+                                               static_cast<unsigned int>(size), baseDir);
+        }
+        // GLB: 12字节文件头，之后是JSON chunk和可选的BIN chunk
+        uint32_t jsonLength = 0;
+        uint32_t jsonType = 0;
+        if (size >= 20) {
+            memcpy(&jsonLength, data + 12, sizeof(jsonLength));
+            memcpy(&jsonType, data + 16, sizeof(jsonType));
+        }
+        if (jsonType != 0x4E4F534Au || jsonLength > size - 20) {
+            return context.LoadBinaryFromMemory(&model, &error, &warning, data, static_cast<unsigned int>(size),
+                                                baseDir);
+        }
+        std::string text(reinterpret_cast<const char *>(data + 20), jsonLength);
+        if (!patchMeshoptFallbackBuffers(text)) {
+            return context.LoadBinaryFromMemory(&model, &error, &warning, data, static_cast<unsigned int>(size),
+                                                baseDir);
+        }
+        // 换掉JSON chunk后重新拼出GLB，JSON按4字节用空格补齐
+        text.resize((text.size() + 3) & ~size_t(3), ' ');
+        const size_t restOffset = 20 + jsonLength;
+        std::vector<unsigned char> glb(20 + text.size() + (size - restOffset));
+        const uint32_t totalLength = static_cast<uint32_t>(glb.size());
+        const uint32_t newJsonLength = static_cast<uint32_t>(text.size());
+        memcpy(glb.data(), data, 8);
+        memcpy(glb.data() + 8, &totalLength, sizeof(totalLength));
+        memcpy(glb.data() + 12, &newJsonLength, sizeof(newJsonLength));
+        memcpy(glb.data() + 16, &jsonType, sizeof(jsonType));
+        memcpy(glb.data() + 20, text.data(), text.size());
+        memcpy(glb.data() + 20 + text.size(), data + restOffset, size - restOffset);
+        return context.LoadBinaryFromMemory(&model, &error, &warning, glb.data(), totalLength, baseDir);
+    }
+
+    // 映射文件后直接解析，不先把整个文件读到堆上，按文件头区分GLB和JSON
+    static bool parseGltfFile(tinygltf::TinyGLTF &context, tinygltf::Model &model, const std::string &filename,
+                             std::string &error, std::string &warning) {
+        size_t pos = filename.find_last_of('/');
+        std::string baseDir = pos == std::string::npos ? std::string() : filename.substr(0, pos);
+#if defined(__ANDROID__)
+        std::vector<unsigned char> file;
+        if (!tinygltf::ReadWholeFile(&file, &error, filename, nullptr) || file.empty()) {
+            error = "File open error : " + filename;
+            return false;
+        }
+        return parseGltfMemory(context, model, file.data(), file.size(), baseDir, error, warning);
+#else
+        // 外部的.bin和图片也通过虚拟文件系统读取，可以来自归档
+        tinygltf::FsCallbacks callbacks{};
+        callbacks.FileExists = [](const std::string &path, void *) {
+            return VirtualFileSystem::global().exists(path);
+        };
+        callbacks.ExpandFilePath = tinygltf::ExpandFilePath;
+        callbacks.ReadWholeFile = [](std::vector<unsigned char> *out, std::string *err, const std::string &path,
+                                     void *) {
+            if (!VirtualFileSystem::global().readFile(path, *out)) {
+                if (err) {
+                    *err += "File read error : " + path + "\n";
+                }
+                return false;
+            }
+            return true;
+        };
+        callbacks.WriteWholeFile = tinygltf::WriteWholeFile;
+        context.SetFsCallbacks(callbacks);
+
+        VirtualFile file;
+        if (!VirtualFileSystem::global().open(filename, file) || file.size() == 0) {
+            error = "File open error : " + filename;
+            return false;
+        }
+        return parseGltfMemory(context, model, file.data(), file.size(), baseDir, error, warning);
+#endif
+    }
+
+    static bool loadGltfFile(tinygltf::TinyGLTF &context, tinygltf::Model &model, const std::string &filename,
+                             std::string &error, std::string &warning) {
+        if (!parseGltfFile(context, model, filename, error, warning)) {
+            return false;
+        }
+        for (tinygltf::Buffer &buffer: model.buffers) {
+            if (buffer.uri == kMeshoptFallbackUri) {
+                buffer.uri.clear();
+                buffer.data.clear();
             }
         }
+        // EXT_meshopt_compression的bufferView在读取accessor之前统一解码
+        return decodeMeshoptBufferViews(model, error);
+    }
 
-        return tinygltf::LoadImageData(image, imageIndex, error, warning, req_width, req_height, bytes, size, userData);
+    // 进程的峰值常驻内存，单位MiB，不支持的平台返回0
+    static size_t peakResidentMemory() {
+#if defined(__linux__)
+        struct rusage usage{};
+        getrusage(RUSAGE_SELF, &usage);
+        return static_cast<size_t>(usage.ru_maxrss) / 1024;
+#else
+        return 0;
+#endif
     }
 
     bool loadImageDataFuncEmpty(tinygltf::Image *image, const int imageIndex, std::string *error, std::string *warning,
@@ -80,187 +251,8 @@ namespace MW {
 
         if (!isKtx) {
             // Texture was loaded using STB_Image
-
-            unsigned char *buffer = nullptr;
-            VkDeviceSize bufferSize = 0;
-            bool deleteBuffer = false;
-            if (gltfimage.component == 3) {
-                // Most devices don't support RGB only on Vulkan so convert if necessary
-                // TODO: Check actual format support and transform only if required
-                bufferSize = gltfimage.width * gltfimage.height * 4;
-                buffer = new unsigned char[bufferSize];
-                unsigned char *rgba = buffer;
-                unsigned char *rgb = &gltfimage.image[0];
-                for (size_t i = 0; i < gltfimage.width * gltfimage.height; ++i) {
-                    for (int32_t j = 0; j < 3; ++j) {
-                        rgba[j] = rgb[j];
-                    }
-                    rgba += 4;
-                    rgb += 3;
-                }
-                deleteBuffer = true;
-            } else {
-                buffer = &gltfimage.image[0];
-                bufferSize = gltfimage.image.size();
-            }
-
-            format = VK_FORMAT_R8G8B8A8_UNORM;
-
-            VkFormatProperties formatProperties;
-
-            width = gltfimage.width;
-            height = gltfimage.height;
-            mipLevels = static_cast<uint32_t>(floor(log2(std::max(width, height))) + 1.0);
-
-            device->GetPhysicalDeviceFormatProperties(format, &formatProperties);
-            assert(formatProperties.optimalTilingFeatures & VK_FORMAT_FEATURE_BLIT_SRC_BIT);
-            assert(formatProperties.optimalTilingFeatures & VK_FORMAT_FEATURE_BLIT_DST_BIT);
-
-            VkMemoryAllocateInfo memAllocInfo{};
-            memAllocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-
-            VulkanBuffer stagingBuffer;
-            device->CreateBuffer(VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
-                                 VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
-                                 stagingBuffer, bufferSize);
-
-            device->MapMemory(stagingBuffer);
-            memcpy(stagingBuffer.mapped, buffer, bufferSize);
-            device->unMapMemory(stagingBuffer);
-
-            VkImageCreateInfo imageCreateInfo{};
-            imageCreateInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
-            imageCreateInfo.imageType = VK_IMAGE_TYPE_2D;
-            imageCreateInfo.format = format;
-            imageCreateInfo.mipLevels = mipLevels;
-            imageCreateInfo.arrayLayers = 1;
-            imageCreateInfo.samples = VK_SAMPLE_COUNT_1_BIT;
-            imageCreateInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
-            imageCreateInfo.usage = VK_IMAGE_USAGE_SAMPLED_BIT;
-            imageCreateInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
-            imageCreateInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-            imageCreateInfo.extent = {width, height, 1};
-            imageCreateInfo.usage =
-                    VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT | VK_IMAGE_USAGE_SAMPLED_BIT;
-            device->CreateImageWithInfo(imageCreateInfo, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, image, deviceMemory);
-
-            VkCommandBuffer copyCmd = device->beginSingleTimeCommands();
-
-            VkImageSubresourceRange subresourceRange = {};
-            subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-            subresourceRange.levelCount = 1;
-            subresourceRange.layerCount = 1;
-
-            VkImageMemoryBarrier imageMemoryBarrier{};
-
-            imageMemoryBarrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
-            imageMemoryBarrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-            imageMemoryBarrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
-            imageMemoryBarrier.srcAccessMask = 0;
-            imageMemoryBarrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
-            imageMemoryBarrier.image = image;
-            imageMemoryBarrier.subresourceRange = subresourceRange;
-            vkCmdPipelineBarrier(copyCmd, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0,
-                                 nullptr, 0, nullptr, 1, &imageMemoryBarrier);
-
-            VkBufferImageCopy bufferCopyRegion = {};
-            bufferCopyRegion.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-            bufferCopyRegion.imageSubresource.mipLevel = 0;
-            bufferCopyRegion.imageSubresource.baseArrayLayer = 0;
-            bufferCopyRegion.imageSubresource.layerCount = 1;
-            bufferCopyRegion.imageExtent.width = width;
-            bufferCopyRegion.imageExtent.height = height;
-            bufferCopyRegion.imageExtent.depth = 1;
-
-            vkCmdCopyBufferToImage(copyCmd, stagingBuffer.buffer, image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1,
-                                   &bufferCopyRegion);
-
-            imageMemoryBarrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
-            imageMemoryBarrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
-            imageMemoryBarrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
-            imageMemoryBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
-            imageMemoryBarrier.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
-            imageMemoryBarrier.image = image;
-            imageMemoryBarrier.subresourceRange = subresourceRange;
-            vkCmdPipelineBarrier(copyCmd, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr,
-                                 0, nullptr, 1, &imageMemoryBarrier);
-
-            device->endSingleTimeCommands(copyCmd);
-            device->DestroyVulkanBuffer(stagingBuffer);
-
-            // Generate the mip chain (glTF uses jpg and png, so we need to create this manually)
-            VkCommandBuffer blitCmd = device->beginSingleTimeCommands();
-            for (uint32_t i = 1; i < mipLevels; i++) {
-                VkImageBlit imageBlit{};
-
-                imageBlit.srcSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-                imageBlit.srcSubresource.layerCount = 1;
-                imageBlit.srcSubresource.mipLevel = i - 1;
-                imageBlit.srcOffsets[1].x = int32_t(width >> (i - 1));
-                imageBlit.srcOffsets[1].y = int32_t(height >> (i - 1));
-                imageBlit.srcOffsets[1].z = 1;
-
-                imageBlit.dstSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-                imageBlit.dstSubresource.layerCount = 1;
-                imageBlit.dstSubresource.mipLevel = i;
-                imageBlit.dstOffsets[1].x = int32_t(width >> i);
-                imageBlit.dstOffsets[1].y = int32_t(height >> i);
-                imageBlit.dstOffsets[1].z = 1;
-
-                VkImageSubresourceRange mipSubRange = {};
-                mipSubRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-                mipSubRange.baseMipLevel = i;
-                mipSubRange.levelCount = 1;
-                mipSubRange.layerCount = 1;
-
-                {
-                    VkImageMemoryBarrier imageMemoryBarrier{};
-                    imageMemoryBarrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
-                    imageMemoryBarrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-                    imageMemoryBarrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
-                    imageMemoryBarrier.srcAccessMask = 0;
-                    imageMemoryBarrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
-                    imageMemoryBarrier.image = image;
-                    imageMemoryBarrier.subresourceRange = mipSubRange;
-                    vkCmdPipelineBarrier(blitCmd, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0,
-                                         nullptr, 0, nullptr, 1, &imageMemoryBarrier);
-                }
-
-                vkCmdBlitImage(blitCmd, image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, image,
-                               VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &imageBlit, VK_FILTER_LINEAR);
-
-                {
-                    VkImageMemoryBarrier imageMemoryBarrier{};
-                    imageMemoryBarrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
-                    imageMemoryBarrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
-                    imageMemoryBarrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
-                    imageMemoryBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
-                    imageMemoryBarrier.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
-                    imageMemoryBarrier.image = image;
-                    imageMemoryBarrier.subresourceRange = mipSubRange;
-                    vkCmdPipelineBarrier(blitCmd, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0,
-                                         nullptr, 0, nullptr, 1, &imageMemoryBarrier);
-                }
-            }
-
-            subresourceRange.levelCount = mipLevels;
-            imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
-
-            imageMemoryBarrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
-            imageMemoryBarrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
-            imageMemoryBarrier.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
-            imageMemoryBarrier.srcAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
-            imageMemoryBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
-            imageMemoryBarrier.image = image;
-            imageMemoryBarrier.subresourceRange = subresourceRange;
-            vkCmdPipelineBarrier(blitCmd, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 0, 0,
-                                 nullptr, 0, nullptr, 1, &imageMemoryBarrier);
-
-            if (deleteBuffer) {
-                delete[] buffer;
-            }
-
-            device->endSingleTimeCommands(blitCmd);
+            fromPixels(gltfimage.image.data(), gltfimage.width, gltfimage.height, gltfimage.component, device);
+            return;
         } else {
             // Texture is stored in an external ktx file
             std::string filename = path + "/" + gltfimage.uri;
@@ -269,12 +261,13 @@ namespace MW {
 
             ktxResult result = KTX_SUCCESS;
 
-            if (!fileExists(filename)) {
+            // 只解析头部，图像数据从映射的文件直接读到staging buffer
+            VirtualFile file;
+            if (!VirtualFileSystem::global().open(filename, file)) {
                 exitFatal("Could not load texture from " + filename +
                           "\n\nMake sure the assets submodule has been checked out and is up-to-date.", -1);
             }
-            result = ktxTexture_CreateFromNamedFile(filename.c_str(), KTX_TEXTURE_CREATE_LOAD_IMAGE_DATA_BIT,
-                                                    &ktxTexture);
+            result = ktxTexture_CreateFromMemory(file.data(), file.size(), KTX_TEXTURE_CREATE_NO_FLAGS, &ktxTexture);
 
             assert(result == KTX_SUCCESS);
 
@@ -283,7 +276,6 @@ namespace MW {
             height = ktxTexture->baseHeight;
             mipLevels = ktxTexture->numLevels;
 
-            ktx_uint8_t *ktxTextureData = ktxTexture_GetData(ktxTexture);
             ktx_size_t ktxTextureSize = ktxTexture_GetSize(ktxTexture);
             // @todo: Use ktxTexture_GetVkFormat(ktxTexture)
             format = VK_FORMAT_R8G8B8A8_UNORM;
@@ -299,7 +291,9 @@ namespace MW {
                                  stagingBuffer, ktxTextureSize);
 
             device->MapMemory(stagingBuffer);
-            memcpy(stagingBuffer.mapped, ktxTextureData, ktxTextureSize);
+            result = ktxTexture_LoadImageData(ktxTexture, static_cast<ktx_uint8_t *>(stagingBuffer.mapped),
+                                              ktxTextureSize);
+            assert(result == KTX_SUCCESS);
             device->unMapMemory(stagingBuffer);
 
             std::vector<VkBufferImageCopy> bufferCopyRegions;
@@ -354,6 +348,280 @@ namespace MW {
             ktxTexture_Destroy(ktxTexture);
         }
 
+        createSamplerAndView(format);
+    }
+
+    void Texture::fromPixels(const unsigned char *pixels, uint32_t pixelWidth, uint32_t pixelHeight,
+                             uint32_t component, VulkanDevice *device) {
+        this->device = device;
+
+        VkDeviceSize bufferSize = static_cast<VkDeviceSize>(pixelWidth) * pixelHeight * 4;
+        VkFormat format = VK_FORMAT_R8G8B8A8_UNORM;
+
+        VkFormatProperties formatProperties;
+
+        width = pixelWidth;
+        height = pixelHeight;
+        mipLevels = static_cast<uint32_t>(floor(log2(std::max(width, height))) + 1.0);
+
+        device->GetPhysicalDeviceFormatProperties(format, &formatProperties);
+        assert(formatProperties.optimalTilingFeatures & VK_FORMAT_FEATURE_BLIT_SRC_BIT);
+        assert(formatProperties.optimalTilingFeatures & VK_FORMAT_FEATURE_BLIT_DST_BIT);
+
+        VkMemoryAllocateInfo memAllocInfo{};
+        memAllocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+
+        VulkanBuffer stagingBuffer;
+        device->CreateBuffer(VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+                             VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+                             stagingBuffer, bufferSize);
+
+        device->MapMemory(stagingBuffer);
+        if (component == 3) {
+            // Most devices don't support RGB only on Vulkan so convert if necessary
+            // TODO: Check actual format support and transform only if required
+            expandRgbToRgba(static_cast<unsigned char *>(stagingBuffer.mapped), pixels,
+                            static_cast<size_t>(pixelWidth) * pixelHeight);
+        } else {
+            assert(component == 4);
+            memcpy(stagingBuffer.mapped, pixels, bufferSize);
+        }
+        device->unMapMemory(stagingBuffer);
+
+        VkImageCreateInfo imageCreateInfo{};
+        imageCreateInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+        imageCreateInfo.imageType = VK_IMAGE_TYPE_2D;
+        imageCreateInfo.format = format;
+        imageCreateInfo.mipLevels = mipLevels;
+        imageCreateInfo.arrayLayers = 1;
+        imageCreateInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+        imageCreateInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+        imageCreateInfo.usage = VK_IMAGE_USAGE_SAMPLED_BIT;
+        imageCreateInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+        imageCreateInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+        imageCreateInfo.extent = {width, height, 1};
+        imageCreateInfo.usage =
+                VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT | VK_IMAGE_USAGE_SAMPLED_BIT;
+        device->CreateImageWithInfo(imageCreateInfo, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, image, deviceMemory);
+
+        VkCommandBuffer copyCmd = device->beginSingleTimeCommands();
+
+        VkImageSubresourceRange subresourceRange = {};
+        subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+        subresourceRange.levelCount = 1;
+        subresourceRange.layerCount = 1;
+
+        VkImageMemoryBarrier imageMemoryBarrier{};
+
+        imageMemoryBarrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+        imageMemoryBarrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+        imageMemoryBarrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+        imageMemoryBarrier.srcAccessMask = 0;
+        imageMemoryBarrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+        imageMemoryBarrier.image = image;
+        imageMemoryBarrier.subresourceRange = subresourceRange;
+        vkCmdPipelineBarrier(copyCmd, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0,
+                             nullptr, 0, nullptr, 1, &imageMemoryBarrier);
+
+        VkBufferImageCopy bufferCopyRegion = {};
+        bufferCopyRegion.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+        bufferCopyRegion.imageSubresource.mipLevel = 0;
+        bufferCopyRegion.imageSubresource.baseArrayLayer = 0;
+        bufferCopyRegion.imageSubresource.layerCount = 1;
+        bufferCopyRegion.imageExtent.width = width;
+        bufferCopyRegion.imageExtent.height = height;
+        bufferCopyRegion.imageExtent.depth = 1;
+
+        vkCmdCopyBufferToImage(copyCmd, stagingBuffer.buffer, image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1,
+                               &bufferCopyRegion);
+
+        imageMemoryBarrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+        imageMemoryBarrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+        imageMemoryBarrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+        imageMemoryBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+        imageMemoryBarrier.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+        imageMemoryBarrier.image = image;
+        imageMemoryBarrier.subresourceRange = subresourceRange;
+        vkCmdPipelineBarrier(copyCmd, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr,
+                             0, nullptr, 1, &imageMemoryBarrier);
+
+        device->endSingleTimeCommands(copyCmd);
+        device->DestroyVulkanBuffer(stagingBuffer);
+
+        // Generate the mip chain (glTF uses jpg and png, so we need to create this manually)
+        VkCommandBuffer blitCmd = device->beginSingleTimeCommands();
+        for (uint32_t i = 1; i < mipLevels; i++) {
+            VkImageBlit imageBlit{};
+
+            imageBlit.srcSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+            imageBlit.srcSubresource.layerCount = 1;
+            imageBlit.srcSubresource.mipLevel = i - 1;
+            imageBlit.srcOffsets[1].x = int32_t(width >> (i - 1));
+            imageBlit.srcOffsets[1].y = int32_t(height >> (i - 1));
+            imageBlit.srcOffsets[1].z = 1;
+
+            imageBlit.dstSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+            imageBlit.dstSubresource.layerCount = 1;
+            imageBlit.dstSubresource.mipLevel = i;
+            imageBlit.dstOffsets[1].x = int32_t(width >> i);
+            imageBlit.dstOffsets[1].y = int32_t(height >> i);
+            imageBlit.dstOffsets[1].z = 1;
+
+            VkImageSubresourceRange mipSubRange = {};
+            mipSubRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+            mipSubRange.baseMipLevel = i;
+            mipSubRange.levelCount = 1;
+            mipSubRange.layerCount = 1;
+
+            {
+                VkImageMemoryBarrier imageMemoryBarrier{};
+                imageMemoryBarrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+                imageMemoryBarrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+                imageMemoryBarrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+                imageMemoryBarrier.srcAccessMask = 0;
+                imageMemoryBarrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+                imageMemoryBarrier.image = image;
+                imageMemoryBarrier.subresourceRange = mipSubRange;
+                vkCmdPipelineBarrier(blitCmd, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0,
+                                     nullptr, 0, nullptr, 1, &imageMemoryBarrier);
+            }
+
+            vkCmdBlitImage(blitCmd, image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, image,
+                           VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &imageBlit, VK_FILTER_LINEAR);
+
+            {
+                VkImageMemoryBarrier imageMemoryBarrier{};
+                imageMemoryBarrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+                imageMemoryBarrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+                imageMemoryBarrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+                imageMemoryBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+                imageMemoryBarrier.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+                imageMemoryBarrier.image = image;
+                imageMemoryBarrier.subresourceRange = mipSubRange;
+                vkCmdPipelineBarrier(blitCmd, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0,
+                                     nullptr, 0, nullptr, 1, &imageMemoryBarrier);
+            }
+        }
+
+        subresourceRange.levelCount = mipLevels;
+        imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+
+        imageMemoryBarrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+        imageMemoryBarrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+        imageMemoryBarrier.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+        imageMemoryBarrier.srcAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+        imageMemoryBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+        imageMemoryBarrier.image = image;
+        imageMemoryBarrier.subresourceRange = subresourceRange;
+        vkCmdPipelineBarrier(blitCmd, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 0, 0,
+                             nullptr, 0, nullptr, 1, &imageMemoryBarrier);
+
+        device->endSingleTimeCommands(blitCmd);
+
+        createSamplerAndView(format);
+    }
+
+    void Texture::fromMipChain(const std::vector<std::vector<unsigned char>> &levels, uint32_t levelWidth,
+                               uint32_t levelHeight, VulkanDevice *device) {
+        fromLevels(VK_FORMAT_R8G8B8A8_UNORM, levels, levelWidth, levelHeight, {}, device);
+    }
+
+    void Texture::fromCompressedImage(const CompressedImage &compressedImage, VkComponentMapping components,
+                                      VulkanDevice *device) {
+        fromLevels(compressedImage.format, compressedImage.levels, compressedImage.width, compressedImage.height,
+                   components, device);
+    }
+
+    void Texture::fromLevels(VkFormat format, const std::vector<std::vector<unsigned char>> &levels,
+                             uint32_t levelWidth, uint32_t levelHeight, VkComponentMapping components,
+                             VulkanDevice *device) {
+        this->device = device;
+        assert(!levels.empty());
+
+        width = levelWidth;
+        height = levelHeight;
+        mipLevels = static_cast<uint32_t>(levels.size());
+
+        VkDeviceSize bufferSize = 0;
+        for (const auto &level: levels) {
+            bufferSize += level.size();
+        }
+
+        VulkanBuffer stagingBuffer;
+        device->CreateBuffer(VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+                             VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+                             stagingBuffer, bufferSize);
+
+        // 每级mip拷贝到staging buffer中的偏移，RGBA8和BC块的大小都满足对齐要求
+        std::vector<VkBufferImageCopy> bufferCopyRegions;
+        device->MapMemory(stagingBuffer);
+        VkDeviceSize offset = 0;
+        for (uint32_t i = 0; i < mipLevels; i++) {
+            memcpy(static_cast<unsigned char *>(stagingBuffer.mapped) + offset, levels[i].data(), levels[i].size());
+            VkBufferImageCopy bufferCopyRegion = {};
+            bufferCopyRegion.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+            bufferCopyRegion.imageSubresource.mipLevel = i;
+            bufferCopyRegion.imageSubresource.baseArrayLayer = 0;
+            bufferCopyRegion.imageSubresource.layerCount = 1;
+            bufferCopyRegion.imageExtent.width = std::max(1u, width >> i);
+            bufferCopyRegion.imageExtent.height = std::max(1u, height >> i);
+            bufferCopyRegion.imageExtent.depth = 1;
+            bufferCopyRegion.bufferOffset = offset;
+            bufferCopyRegions.push_back(bufferCopyRegion);
+            offset += levels[i].size();
+        }
+        device->unMapMemory(stagingBuffer);
+
+        VkImageCreateInfo imageCreateInfo{};
+        imageCreateInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+        imageCreateInfo.imageType = VK_IMAGE_TYPE_2D;
+        imageCreateInfo.format = format;
+        imageCreateInfo.mipLevels = mipLevels;
+        imageCreateInfo.arrayLayers = 1;
+        imageCreateInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+        imageCreateInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+        imageCreateInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+        imageCreateInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+        imageCreateInfo.extent = {width, height, 1};
+        imageCreateInfo.usage = VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT;
+        device->CreateImageWithInfo(imageCreateInfo, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, image, deviceMemory);
+
+        VkCommandBuffer copyCmd = device->beginSingleTimeCommands();
+
+        VkImageSubresourceRange subresourceRange = {};
+        subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+        subresourceRange.levelCount = mipLevels;
+        subresourceRange.layerCount = 1;
+
+        VkImageMemoryBarrier imageMemoryBarrier{};
+        imageMemoryBarrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+        imageMemoryBarrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+        imageMemoryBarrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+        imageMemoryBarrier.srcAccessMask = 0;
+        imageMemoryBarrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+        imageMemoryBarrier.image = image;
+        imageMemoryBarrier.subresourceRange = subresourceRange;
+        vkCmdPipelineBarrier(copyCmd, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0,
+                             nullptr, 0, nullptr, 1, &imageMemoryBarrier);
+
+        vkCmdCopyBufferToImage(copyCmd, stagingBuffer.buffer, image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+                               static_cast<uint32_t>(bufferCopyRegions.size()), bufferCopyRegions.data());
+
+        imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+        imageMemoryBarrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+        imageMemoryBarrier.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+        imageMemoryBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+        imageMemoryBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+        vkCmdPipelineBarrier(copyCmd, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 0, 0,
+                             nullptr, 0, nullptr, 1, &imageMemoryBarrier);
+
+        device->endSingleTimeCommands(copyCmd);
+        device->DestroyVulkanBuffer(stagingBuffer);
+
+        createSamplerAndView(format, components);
+    }
+
+    void Texture::createSamplerAndView(VkFormat format, VkComponentMapping components) {
         VkSamplerCreateInfo samplerInfo{};
         samplerInfo.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
         samplerInfo.magFilter = VK_FILTER_LINEAR;
@@ -375,6 +643,7 @@ namespace MW {
         viewInfo.image = image;
         viewInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
         viewInfo.format = format;
+        viewInfo.components = components;
         viewInfo.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
         viewInfo.subresourceRange.layerCount = 1;
         viewInfo.subresourceRange.levelCount = mipLevels;
@@ -430,12 +699,130 @@ namespace MW {
         dimensions.radius = glm::distance(min, max) / 2.0f;
     }
 
+    const Primitive::Lod &Primitive::selectLod(const LodSelection *selection, const glm::mat4 *matrix) const {
+        if (selection == nullptr || lods.size() == 1) {
+            return lods[0];
+        }
+        glm::vec3 center = boundsCenter;
+        float radius = boundsRadius;
+        float errorScale = 1.0f;
+        if (matrix) {
+            center = glm::vec3(*matrix * glm::vec4(boundsCenter, 1.0f));
+            errorScale = std::max(glm::length(glm::vec3((*matrix)[0])),
+                                  std::max(glm::length(glm::vec3((*matrix)[1])), glm::length(glm::vec3((*matrix)[2]))));
+            radius *= errorScale;
+        }
+        // 误差单调递增，取投影误差仍在阈值内的最粗一级
+        size_t selected = 0;
+        for (size_t i = 1; i < lods.size(); ++i) {
+            if (selection->projectedError(lods[i].error * errorScale, center, radius) > selection->errorThreshold) {
+                break;
+            }
+            selected = i;
+        }
+        return lods[selected];
+    }
+
+    LodSelection LodSelection::fromPerspective(const glm::mat4 &view, const glm::mat4 &projection,
+                                               float viewportHeight, float errorThreshold) {
+        LodSelection selection{};
+        selection.viewPosition = glm::vec3(glm::inverse(view)[3]);
+        selection.projectionScale = std::abs(projection[1][1]) * viewportHeight * 0.5f;
+        selection.errorThreshold = errorThreshold;
+        selection.orthographic = false;
+        return selection;
+    }
+
+    LodSelection LodSelection::fromOrthographic(const glm::mat4 &viewProjection, float viewportWidth,
+                                                float errorThreshold) {
+        LodSelection selection{};
+        // 正交投影的第一行长度为2/(right-left)
+        glm::vec3 row0(viewProjection[0][0], viewProjection[1][0], viewProjection[2][0]);
+        selection.projectionScale = glm::length(row0) * viewportWidth * 0.5f;
+        selection.errorThreshold = errorThreshold;
+        selection.orthographic = true;
+        return selection;
+    }
+
+    float LodSelection::projectedError(float error, const glm::vec3 &center, float radius) const {
+        if (orthographic) {
+            return error * projectionScale;
+        }
+        float distance = glm::distance(viewPosition, center) - radius;
+        return error * projectionScale / std::max(distance, 1e-3f);
+    }
+
+    void LayerSelection::addLayer(uint32_t layer, const glm::mat4 &viewProjection, const LodSelection &lodSelection) {
+        if (layerCount >= maxLayers) {
+            return;
+        }
+        // 从投影矩阵的行提取平面，深度范围为[0,1]
+        // 不裁近平面：光源和近平面之间的物体仍然会投射阴影(开启depth clamp时)
+        const glm::vec4 row0(viewProjection[0][0], viewProjection[1][0], viewProjection[2][0], viewProjection[3][0]);
+        const glm::vec4 row1(viewProjection[0][1], viewProjection[1][1], viewProjection[2][1], viewProjection[3][1]);
+        const glm::vec4 row2(viewProjection[0][2], viewProjection[1][2], viewProjection[2][2], viewProjection[3][2]);
+        const glm::vec4 row3(viewProjection[0][3], viewProjection[1][3], viewProjection[2][3], viewProjection[3][3]);
+        glm::vec4 *layerPlanes = planes[layerCount];
+        layerPlanes[0] = row3 + row0;
+        layerPlanes[1] = row3 - row0;
+        layerPlanes[2] = row3 + row1;
+        layerPlanes[3] = row3 - row1;
+        layerPlanes[4] = row3 - row2;
+        for (uint32_t i = 0; i < 5; ++i) {
+            const float length = glm::length(glm::vec3(layerPlanes[i]));
+            if (length > 0.0f) {
+                layerPlanes[i] /= length;
+            }
+        }
+        layers[layerCount] = layer;
+        lodSelections[layerCount] = lodSelection;
+        layerCount++;
+    }
+
+    void LayerSelection::translate(const glm::vec3 &offset) {
+        for (uint32_t i = 0; i < layerCount; ++i) {
+            for (glm::vec4 &plane: planes[i]) {
+                plane.w += glm::dot(glm::vec3(plane), offset);
+            }
+            lodSelections[i].viewPosition -= offset;
+        }
+    }
+
+    uint32_t LayerSelection::overlappedLayers(const glm::vec3 &center, float radius, uint32_t &count,
+                                              uint32_t &first) const {
+        uint32_t packed = 0;
+        count = 0;
+        first = 0;
+        for (uint32_t i = 0; i < layerCount; ++i) {
+            bool inside = true;
+            for (const glm::vec4 &plane: planes[i]) {
+                if (glm::dot(glm::vec3(plane), center) + plane.w < -radius) {
+                    inside = false;
+                    break;
+                }
+            }
+            if (!inside) {
+                continue;
+            }
+            if (count == 0) {
+                first = i;
+            }
+            packed |= layers[i] << (count * 4);
+            count++;
+        }
+        return packed;
+    }
+
 /*
 	glTF mesh
 */
     Mesh::Mesh(VulkanDevice *device, glm::mat4 matrix) {
         this->device = device;
         this->uniformBlock.matrix = matrix;
+        // 离线烘焙时没有device
+        if (!device) {
+            return;
+        }
         device->CreateBuffer(
                 VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT,
                 VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
@@ -447,7 +834,9 @@ namespace MW {
     };
 
     Mesh::~Mesh() {
-        device->DestroyVulkanBuffer(uniformBuffer.buffer);
+        if (device) {
+            device->DestroyVulkanBuffer(uniformBuffer.buffer);
+        }
         for (auto primitive: primitives) {
             delete primitive;
         }
@@ -593,6 +982,13 @@ namespace MW {
     }
 
     void Model::createEmptyTexture() {
+        if (resourceManager) {
+            // 所有模型共用同一个空贴图
+            const unsigned char empty[4] = {0, 0, 0, 0};
+            emptyTextureGuid = resourceManager->loadTexture("empty", empty, 1, 1, 4);
+            resourceManager->getTexture(emptyTextureGuid, emptyTexture);
+            return;
+        }
         emptyTexture.device = device;
         emptyTexture.width = 1;
         emptyTexture.height = 1;
@@ -707,14 +1103,27 @@ namespace MW {
     }
 
     void Model::clean() {
-        device->DestroyVulkanBuffer(vertices.buffer);
-        device->DestroyVulkanBuffer(indices.buffer);
+        if (meshGuid != invalidGuid) {
+            resourceManager->release(RenderResourceType::Mesh, meshGuid);
+        } else {
+            device->DestroyVulkanBuffer(vertices.buffer);
+            device->DestroyVulkanBuffer(indices.buffer);
 #if USE_MESH_SHADER
-        device->DestroyVulkanBuffer(meshBuffer.buffer);
-        device->DestroyVulkanBuffer(vertexBuffer.buffer);
+            device->DestroyVulkanBuffer(meshBuffer.buffer);
+            device->DestroyVulkanBuffer(vertexBuffer.buffer);
 #endif
-        for (auto texture: textures) {
-            texture.destroy();
+        }
+        for (auto &material: materials) {
+            if (material.resourceGuid != invalidGuid) {
+                resourceManager->release(RenderResourceType::Material, material.resourceGuid);
+            }
+        }
+        for (size_t i = 0; i < textures.size(); i++) {
+            if (i < textureGuids.size() && textureGuids[i] != invalidGuid) {
+                resourceManager->release(RenderResourceType::Texture, textureGuids[i]);
+            } else {
+                textures[i].destroy();
+            }
         }
         for (auto node: nodes) {
             delete node;
@@ -740,12 +1149,67 @@ namespace MW {
             descriptorSetLayoutMeshlet = VK_NULL_HANDLE;
         }
 #endif
-        emptyTexture.destroy();
+        if (emptyTextureGuid != invalidGuid) {
+            resourceManager->release(RenderResourceType::Texture, emptyTextureGuid);
+        } else {
+            emptyTexture.destroy();
+        }
+        if (placeholderBaseColorTexture.device) {
+            placeholderBaseColorTexture.destroy();
+            placeholderNormalTexture.destroy();
+        }
+    }
+
+    static void accumulateStatistics(VertexCacheStatistics &total, const VertexCacheStatistics &statistics) {
+        total.vertexTransforms += statistics.vertexTransforms;
+        total.triangleCount += statistics.triangleCount;
+        total.vertexCount += statistics.vertexCount;
+        total.acmr = total.triangleCount ? float(total.vertexTransforms) / total.triangleCount : 0.0f;
+        total.atvr = total.vertexCount ? float(total.vertexTransforms) / total.vertexCount : 0.0f;
+    }
+
+    // 量化的纹理坐标通过KHR_texture_transform还原，变换直接应用到顶点上，材质的所有贴图使用第一个找到的变换
+    static bool getTextureTransform(const tinygltf::Model &model, int materialIndex, glm::mat3 &transform) {
+        if (materialIndex < 0 || materialIndex >= static_cast<int>(model.materials.size())) {
+            return false;
+        }
+        const tinygltf::Material &material = model.materials[materialIndex];
+        const tinygltf::ExtensionMap *textureExtensions[] = {
+                &material.pbrMetallicRoughness.baseColorTexture.extensions,
+                &material.normalTexture.extensions,
+                &material.pbrMetallicRoughness.metallicRoughnessTexture.extensions,
+                &material.occlusionTexture.extensions,
+                &material.emissiveTexture.extensions};
+        for (const tinygltf::ExtensionMap *extensions: textureExtensions) {
+            auto it = extensions->find("KHR_texture_transform");
+            if (it == extensions->end()) {
+                continue;
+            }
+            const tinygltf::Value &value = it->second;
+            auto getVec2 = [&value](const char *name, glm::vec2 fallback) {
+                if (value.Has(name) && value.Get(name).IsArray() && value.Get(name).ArrayLen() == 2) {
+                    return glm::vec2(value.Get(name).Get(0).GetNumberAsDouble(),
+                                     value.Get(name).Get(1).GetNumberAsDouble());
+                }
+                return fallback;
+            };
+            const glm::vec2 offset = getVec2("offset", glm::vec2(0.0f));
+            const glm::vec2 scale = getVec2("scale", glm::vec2(1.0f));
+            const float rotation = value.Has("rotation") && value.Get("rotation").IsNumber()
+                                   ? static_cast<float>(value.Get("rotation").GetNumberAsDouble()) : 0.0f;
+            // translation * rotation * scale
+            const float c = std::cos(rotation), s = std::sin(rotation);
+            transform = glm::mat3(glm::vec3(scale.x * c, -scale.x * s, 0.0f),
+                                  glm::vec3(scale.y * s, scale.y * c, 0.0f),
+                                  glm::vec3(offset, 1.0f));
+            return true;
+        }
+        return false;
     }
 
     void Model::loadNode(Node *parent, const tinygltf::Node &node, uint32_t nodeIndex,
-                         const tinygltf::Model &model, std::vector<uint32_t> &indexBuffer,
-                         std::vector<gltfVertex> &vertexBuffer, float globalscale) {
+                         const tinygltf::Model &model, std::vector<PrimitiveLoadJob> &primitiveJobs,
+                         uint32_t &vertexCount, float globalscale) {
         Node *newNode = new Node{};
         newNode->index = nodeIndex;
         newNode->parent = parent;
@@ -779,14 +1243,15 @@ namespace MW {
         // Node with children
         if (node.children.size() > 0) {
             for (auto i = 0; i < node.children.size(); i++) {
-                loadNode(newNode, model.nodes[node.children[i]], node.children[i], model, indexBuffer, vertexBuffer,
-                         globalscale);
+                loadNode(newNode, model.nodes[node.children[i]], node.children[i], model, primitiveJobs,
+                         vertexCount, globalscale);
             }
         }
 
         // Node contains mesh data
+        // 这里只统计每个primitive的顶点/索引数量并分配顶点区间，数据在loadPrimitives中并行读取
         if (node.mesh > -1) {
-            const tinygltf::Mesh mesh = model.meshes[node.mesh];
+            const tinygltf::Mesh &mesh = model.meshes[node.mesh];
             Mesh *newMesh = new Mesh(device, newNode->matrix);
             newMesh->name = mesh.name;
             for (size_t j = 0; j < mesh.primitives.size(); j++) {
@@ -794,174 +1259,29 @@ namespace MW {
                 if (primitive.indices < 0) {
                     continue;
                 }
-                uint32_t indexStart = static_cast<uint32_t>(indexBuffer.size());
-                uint32_t vertexStart = static_cast<uint32_t>(vertexBuffer.size());
-                uint32_t indexCount = 0;
-                uint32_t vertexCount = 0;
-                glm::vec3 posMin{};
-                glm::vec3 posMax{};
-                bool hasSkin = false;
-                // Vertices
-                {
-                    const float *bufferPos = nullptr;
-                    const float *bufferNormals = nullptr;
-                    const float *bufferTexCoords = nullptr;
-                    const float *bufferColors = nullptr;
-                    const float *bufferTangents = nullptr;
-                    uint32_t numColorComponents;
-                    const uint16_t *bufferJoints = nullptr;
-                    const float *bufferWeights = nullptr;
-
-                    // Position attribute is required
-                    assert(primitive.attributes.find("POSITION") != primitive.attributes.end());
-
-                    const tinygltf::Accessor &posAccessor = model.accessors[primitive.attributes.find(
-                            "POSITION")->second];
-                    const tinygltf::BufferView &posView = model.bufferViews[posAccessor.bufferView];
-                    bufferPos = reinterpret_cast<const float *>(&(model.buffers[posView.buffer].data[
-                            posAccessor.byteOffset + posView.byteOffset]));
-                    posMin = glm::vec3(posAccessor.minValues[0], posAccessor.minValues[1], posAccessor.minValues[2]);
-                    posMax = glm::vec3(posAccessor.maxValues[0], posAccessor.maxValues[1], posAccessor.maxValues[2]);
-
-                    if (primitive.attributes.find("NORMAL") != primitive.attributes.end()) {
-                        const tinygltf::Accessor &normAccessor = model.accessors[primitive.attributes.find(
-                                "NORMAL")->second];
-                        const tinygltf::BufferView &normView = model.bufferViews[normAccessor.bufferView];
-                        bufferNormals = reinterpret_cast<const float *>(&(model.buffers[normView.buffer].data[
-                                normAccessor.byteOffset + normView.byteOffset]));
-                    }
-
-                    if (primitive.attributes.find("TEXCOORD_0") != primitive.attributes.end()) {
-                        const tinygltf::Accessor &uvAccessor = model.accessors[primitive.attributes.find(
-                                "TEXCOORD_0")->second];
-                        const tinygltf::BufferView &uvView = model.bufferViews[uvAccessor.bufferView];
-                        bufferTexCoords = reinterpret_cast<const float *>(&(model.buffers[uvView.buffer].data[
-                                uvAccessor.byteOffset + uvView.byteOffset]));
-                    }
-
-                    if (primitive.attributes.find("COLOR_0") != primitive.attributes.end()) {
-                        const tinygltf::Accessor &colorAccessor = model.accessors[primitive.attributes.find(
-                                "COLOR_0")->second];
-                        const tinygltf::BufferView &colorView = model.bufferViews[colorAccessor.bufferView];
-                        // Color buffer are either of type vec3 or vec4
-                        numColorComponents = colorAccessor.type == TINYGLTF_PARAMETER_TYPE_FLOAT_VEC3 ? 3 : 4;
-                        bufferColors = reinterpret_cast<const float *>(&(model.buffers[colorView.buffer].data[
-                                colorAccessor.byteOffset + colorView.byteOffset]));
-                    }
-
-                    if (primitive.attributes.find("TANGENT") != primitive.attributes.end()) {
-                        const tinygltf::Accessor &tangentAccessor = model.accessors[primitive.attributes.find(
-                                "TANGENT")->second];
-                        const tinygltf::BufferView &tangentView = model.bufferViews[tangentAccessor.bufferView];
-                        bufferTangents = reinterpret_cast<const float *>(&(model.buffers[tangentView.buffer].data[
-                                tangentAccessor.byteOffset + tangentView.byteOffset]));
-                    }
-
-                    // Skinning
-                    // Joints
-                    if (primitive.attributes.find("JOINTS_0") != primitive.attributes.end()) {
-                        const tinygltf::Accessor &jointAccessor = model.accessors[primitive.attributes.find(
-                                "JOINTS_0")->second];
-                        const tinygltf::BufferView &jointView = model.bufferViews[jointAccessor.bufferView];
-                        bufferJoints = reinterpret_cast<const uint16_t *>(&(model.buffers[jointView.buffer].data[
-                                jointAccessor.byteOffset + jointView.byteOffset]));
-                    }
+                // Position attribute is required
+                assert(primitive.attributes.find("POSITION") != primitive.attributes.end());
+                const tinygltf::Accessor &posAccessor = model.accessors[primitive.attributes.find("POSITION")->second];
+                const tinygltf::Accessor &indexAccessor = model.accessors[primitive.indices];
 
-                    if (primitive.attributes.find("WEIGHTS_0") != primitive.attributes.end()) {
-                        const tinygltf::Accessor &uvAccessor = model.accessors[primitive.attributes.find(
-                                "WEIGHTS_0")->second];
-                        const tinygltf::BufferView &uvView = model.bufferViews[uvAccessor.bufferView];
-                        bufferWeights = reinterpret_cast<const float *>(&(model.buffers[uvView.buffer].data[
-                                uvAccessor.byteOffset + uvView.byteOffset]));
-                    }
-
-                    hasSkin = (bufferJoints && bufferWeights);
-
-                    vertexCount = static_cast<uint32_t>(posAccessor.count);
-
-                    for (size_t v = 0; v < posAccessor.count; v++) {
-                        gltfVertex vert{};
-                        vert.pos = glm::vec4(glm::make_vec3(&bufferPos[v * 3]), 1.0f);
-                        vert.normal = glm::normalize(
-                                glm::vec3(bufferNormals ? glm::make_vec3(&bufferNormals[v * 3]) : glm::vec3(0.0f)));
-                        vert.uv = bufferTexCoords ? glm::make_vec2(&bufferTexCoords[v * 2]) : glm::vec3(0.0f);
-                        if (bufferColors) {
-                            switch (numColorComponents) {
-                                case 3:
-                                    vert.color = glm::vec4(glm::make_vec3(&bufferColors[v * 3]), 1.0f);
-                                case 4:
-                                    vert.color = glm::make_vec4(&bufferColors[v * 4]);
-                            }
-                        } else {
-                            vert.color = glm::vec4(1.0f);
-                        }
-                        vert.tangent = bufferTangents ? glm::vec4(glm::make_vec4(&bufferTangents[v * 4])) : glm::vec4(
-                                0.0f);
-                        vert.joint0 = hasSkin ? glm::vec4(glm::make_vec4(&bufferJoints[v * 4])) : glm::vec4(0.0f);
-                        vert.weight0 = hasSkin ? glm::make_vec4(&bufferWeights[v * 4]) : glm::vec4(0.0f);
-                        vertexBuffer.push_back(vert);
-                    }
-                }
-                // Indices
-                {
-                    const tinygltf::Accessor &accessor = model.accessors[primitive.indices];
-                    const tinygltf::BufferView &bufferView = model.bufferViews[accessor.bufferView];
-                    const tinygltf::Buffer &buffer = model.buffers[bufferView.buffer];
-
-                    indexCount = static_cast<uint32_t>(accessor.count);
-
-                    switch (accessor.componentType) {
-                        case TINYGLTF_PARAMETER_TYPE_UNSIGNED_INT: {
-                            uint32_t *buf = new uint32_t[accessor.count];
-                            memcpy(buf, &buffer.data[accessor.byteOffset + bufferView.byteOffset],
-                                   accessor.count * sizeof(uint32_t));
-                            for (size_t index = 0; index < accessor.count; index++) {
-                                indexBuffer.push_back(buf[index] + vertexStart);
-                            }
-                            delete[] buf;
-                            break;
-                        }
-                        case TINYGLTF_PARAMETER_TYPE_UNSIGNED_SHORT: {
-                            uint16_t *buf = new uint16_t[accessor.count];
-                            memcpy(buf, &buffer.data[accessor.byteOffset + bufferView.byteOffset],
-                                   accessor.count * sizeof(uint16_t));
-                            for (size_t index = 0; index < accessor.count; index++) {
-                                indexBuffer.push_back(buf[index] + vertexStart);
-                            }
-                            delete[] buf;
-                            break;
-                        }
-                        case TINYGLTF_PARAMETER_TYPE_UNSIGNED_BYTE: {
-                            uint8_t *buf = new uint8_t[accessor.count];
-                            memcpy(buf, &buffer.data[accessor.byteOffset + bufferView.byteOffset],
-                                   accessor.count * sizeof(uint8_t));
-                            for (size_t index = 0; index < accessor.count; index++) {
-                                indexBuffer.push_back(buf[index] + vertexStart);
-                            }
-                            delete[] buf;
-                            break;
-                        }
-                        default:
-                            std::cerr << "Index component type " << accessor.componentType << " not supported!"
-                                      << std::endl;
-                            return;
-                    }
-                }
-                Primitive *newPrimitive = new Primitive(indexStart, indexCount,
+                Primitive *newPrimitive = new Primitive(0, static_cast<uint32_t>(indexAccessor.count),
                                                         primitive.material > -1 ? materials[primitive.material]
                                                                                 : materials.back());
-                newPrimitive->firstVertex = vertexStart;
-                newPrimitive->vertexCount = vertexCount;
-                newPrimitive->setDimensions(posMin, posMax);
-#if USE_MESH_SHADER
-                if(bUseMeshShader) {
-#if EXT_MESH_SHADER
-                    newPrimitive->pushConstantBlock.offsetIndex = this->meshlets.size();
-#endif
-                    newPrimitive->addMeshlets(this->meshlets, indexBuffer);
+                newPrimitive->firstVertex = vertexCount;
+                newPrimitive->vertexCount = static_cast<uint32_t>(posAccessor.count);
+                if (posAccessor.minValues.size() >= 3 && posAccessor.maxValues.size() >= 3) {
+                    newPrimitive->setDimensions(
+                            glm::vec3(posAccessor.minValues[0], posAccessor.minValues[1], posAccessor.minValues[2]),
+                            glm::vec3(posAccessor.maxValues[0], posAccessor.maxValues[1], posAccessor.maxValues[2]));
                 }
-#endif
+                vertexCount += newPrimitive->vertexCount;
                 newMesh->primitives.push_back(newPrimitive);
+
+                PrimitiveLoadJob job;
+                job.primitive = newPrimitive;
+                job.node = newNode;
+                job.source = &primitive;
+                primitiveJobs.push_back(std::move(job));
             }
             newNode->mesh = newMesh;
         }
@@ -973,6 +1293,257 @@ namespace MW {
         linearNodes.push_back(newNode);
     }
 
+    void Model::loadPrimitive(PrimitiveLoadJob &job, const tinygltf::Model &model,
+                              gltfVertex *vertexBuffer) {
+        const tinygltf::Primitive &primitive = *job.source;
+        Primitive *newPrimitive = job.primitive;
+        const uint32_t vertexStart = newPrimitive->firstVertex;
+        const uint32_t vertexCount = newPrimitive->vertexCount;
+        bool hasSkin = false;
+        // Vertices
+        {
+            // 按accessor的分量类型读取，KHR_mesh_quantization的量化数据直接转换到最终的顶点中
+            auto attribute = [&](const char *name) {
+                auto it = primitive.attributes.find(name);
+                return GltfAccessor(model, it != primitive.attributes.end() ? it->second : -1);
+            };
+            // Position attribute is required
+            assert(primitive.attributes.find("POSITION") != primitive.attributes.end());
+            const GltfAccessor positions = attribute("POSITION");
+            const GltfAccessor normals = attribute("NORMAL");
+            const GltfAccessor texCoords = attribute("TEXCOORD_0");
+            // Color buffer are either of type vec3 or vec4
+            const GltfAccessor colors = attribute("COLOR_0");
+            const GltfAccessor tangents = attribute("TANGENT");
+            // Skinning
+            const GltfAccessor joints = attribute("JOINTS_0");
+            const GltfAccessor weights = attribute("WEIGHTS_0");
+            hasSkin = joints.isValid() && weights.isValid();
+
+            glm::mat3 uvTransform(1.0f);
+            const bool transformUV = getTextureTransform(model, primitive.material, uvTransform);
+            const size_t count = std::min<size_t>(positions.getCount(), vertexCount);
+            for (size_t v = 0; v < count; v++) {
+                gltfVertex vert{};
+                vert.pos = glm::vec3(positions.read(v));
+                vert.normal = normals.isValid() ? glm::normalize(glm::vec3(normals.read(v))) : glm::vec3(0.0f);
+                vert.uv = texCoords.isValid() ? glm::vec2(texCoords.read(v)) : glm::vec2(0.0f);
+                if (transformUV) {
+                    vert.uv = glm::vec2(uvTransform * glm::vec3(vert.uv, 1.0f));
+                }
+                vert.color = colors.isValid() ? colors.read(v, glm::vec4(1.0f)) : glm::vec4(1.0f);
+                vert.tangent = tangents.isValid() ? tangents.read(v) : glm::vec4(0.0f);
+                vert.joint0 = hasSkin ? joints.read(v) : glm::vec4(0.0f);
+                vert.weight0 = hasSkin ? weights.read(v) : glm::vec4(0.0f);
+                vertexBuffer[vertexStart + v] = vert;
+            }
+            for (size_t v = count; v < vertexCount; v++) {
+                vertexBuffer[vertexStart + v] = gltfVertex{};
+            }
+        }
+        // Indices
+        std::vector<uint32_t> primitiveIndices;
+        {
+            const GltfAccessor accessor(model, primitive.indices);
+            switch (accessor.getComponentType()) {
+                case TINYGLTF_PARAMETER_TYPE_UNSIGNED_INT:
+                case TINYGLTF_PARAMETER_TYPE_UNSIGNED_SHORT:
+                case TINYGLTF_PARAMETER_TYPE_UNSIGNED_BYTE:
+                    primitiveIndices.resize(accessor.getCount());
+                    for (size_t index = 0; index < accessor.getCount(); index++) {
+                        primitiveIndices[index] = accessor.readIndex(index);
+                    }
+                    break;
+                default:
+                    std::cerr << "Index component type " << accessor.getComponentType() << " not supported!"
+                              << std::endl;
+                    break;
+            }
+            // 越界的索引会读到其他primitive的顶点，和越界的accessor一样报错并丢弃这个primitive的索引
+            for (uint32_t index: primitiveIndices) {
+                if (index >= vertexCount) {
+                    std::cerr << "Primitive index " << index << " is out of range of its " << vertexCount
+                              << " vertices" << std::endl;
+                    primitiveIndices.clear();
+                    break;
+                }
+            }
+            if (fileLoadingFlags & FileLoadingFlags::OptimizeMeshes) {
+                optimizePrimitive(primitiveIndices, &vertexBuffer[vertexStart], vertexCount,
+                                  job.statistics);
+            }
+            job.indices.reserve(primitiveIndices.size());
+            for (uint32_t index: primitiveIndices) {
+                job.indices.push_back(index + vertexStart);
+            }
+        }
+        newPrimitive->indexCount = static_cast<uint32_t>(primitiveIndices.size());
+        newPrimitive->lods[0].indexCount = newPrimitive->indexCount;
+        if (fileLoadingFlags & FileLoadingFlags::GenerateLods) {
+            generateLods(newPrimitive, primitiveIndices, job.indices, &vertexBuffer[vertexStart]);
+        }
+
+        // Pre-Calculations for requested features
+        if ((fileLoadingFlags & FileLoadingFlags::PreTransformVertices) ||
+            (fileLoadingFlags & FileLoadingFlags::PreMultiplyVertexColors) ||
+            (fileLoadingFlags & FileLoadingFlags::FlipY)) {
+            const bool preTransform = fileLoadingFlags & FileLoadingFlags::PreTransformVertices;
+            const bool preMultiplyColor = fileLoadingFlags & FileLoadingFlags::PreMultiplyVertexColors;
+            const bool flipY = fileLoadingFlags & FileLoadingFlags::FlipY;
+            const glm::mat4 localMatrix = job.node->getMatrix();
+            if (preTransform) {
+                const float maxScale = std::max(glm::length(glm::vec3(localMatrix[0])),
+                                                std::max(glm::length(glm::vec3(localMatrix[1])),
+                                                         glm::length(glm::vec3(localMatrix[2]))));
+                for (Primitive::Lod &lod: newPrimitive->lods) {
+                    lod.error *= maxScale;
+                }
+            }
+            for (uint32_t i = 0; i < vertexCount; i++) {
+                gltfVertex &vertex = vertexBuffer[vertexStart + i];
+                // Pre-transform vertex positions by node-hierarchy
+                if (preTransform) {
+                    vertex.pos = glm::vec3(localMatrix * glm::vec4(vertex.pos, 1.0f));
+                    vertex.normal = glm::normalize(glm::mat3(localMatrix) * vertex.normal);
+                }
+                // Flip Y-Axis of vertex positions
+                if (flipY) {
+                    vertex.pos.y *= -1.0f;
+                    vertex.normal.y *= -1.0f;
+                }
+                // Pre-Multiply vertex colors with material base color
+                if (preMultiplyColor) {
+                    vertex.color = newPrimitive->material.baseColorFactor * vertex.color;
+                }
+                vertex.metallicFactor = newPrimitive->material.metallicFactor;
+                vertex.roughnessFactor = newPrimitive->material.roughnessFactor;
+            }
+        }
+
+        glm::vec3 boundsMin(FLT_MAX);
+        glm::vec3 boundsMax(-FLT_MAX);
+        for (uint32_t i = 0; i < vertexCount; i++) {
+            boundsMin = glm::min(boundsMin, vertexBuffer[vertexStart + i].pos);
+            boundsMax = glm::max(boundsMax, vertexBuffer[vertexStart + i].pos);
+        }
+        newPrimitive->boundsCenter = (boundsMin + boundsMax) * 0.5f;
+        newPrimitive->boundsRadius = glm::length(boundsMax - boundsMin) * 0.5f;
+#if USE_MESH_SHADER
+        if (bUseMeshShader) {
+            newPrimitive->addMeshlets(job.meshlets, job.indices, vertexBuffer);
+        }
+#endif
+    }
+
+    void Model::loadPrimitives(const tinygltf::Model &model, std::vector<PrimitiveLoadJob> &primitiveJobs,
+                               std::vector<uint32_t> &indexBuffer, gltfVertex *vertexBuffer) {
+        // 每个primitive的顶点区间已经在loadNode中确定，可以直接并行写入vertexBuffer
+        ThreadPool::global().parallelFor(static_cast<uint32_t>(primitiveJobs.size()), [&](uint32_t i) {
+            loadPrimitive(primitiveJobs[i], model, vertexBuffer);
+        });
+
+        // 按原顺序拼接index与meshlet，结果与串行加载一致
+        size_t indexCount = 0;
+        size_t meshletCount = meshlets.size();
+        std::vector<size_t> indexOffsets(primitiveJobs.size());
+        for (size_t i = 0; i < primitiveJobs.size(); i++) {
+            PrimitiveLoadJob &job = primitiveJobs[i];
+            indexOffsets[i] = indexCount;
+            indexCount += job.indices.size();
+            for (Primitive::Lod &lod: job.primitive->lods) {
+                lod.firstIndex += static_cast<uint32_t>(indexOffsets[i]);
+            }
+            job.primitive->firstIndex = job.primitive->lods[0].firstIndex;
+#if USE_MESH_SHADER
+            if (bUseMeshShader) {
+                for (Primitive::Lod &lod: job.primitive->lods) {
+                    lod.firstMeshlet += static_cast<uint32_t>(meshletCount);
+                }
+                job.primitive->firstMeshlet = job.primitive->lods[0].firstMeshlet;
+#if EXT_MESH_SHADER
+                job.primitive->pushConstantBlock.offsetIndex = job.primitive->firstMeshlet;
+#endif
+                meshletCount += job.meshlets.size();
+            }
+#endif
+            accumulateStatistics(meshOptimizationStatistics.before, job.statistics.before);
+            accumulateStatistics(meshOptimizationStatistics.after, job.statistics.after);
+        }
+
+        indexBuffer.resize(indexCount);
+#if USE_MESH_SHADER
+        meshlets.reserve(meshletCount);
+        for (PrimitiveLoadJob &job: primitiveJobs) {
+            meshlets.insert(meshlets.end(), job.meshlets.begin(), job.meshlets.end());
+        }
+#endif
+        ThreadPool::global().parallelFor(static_cast<uint32_t>(primitiveJobs.size()), [&](uint32_t i) {
+            std::copy(primitiveJobs[i].indices.begin(), primitiveJobs[i].indices.end(),
+                      indexBuffer.begin() + indexOffsets[i]);
+        });
+    }
+
+    void Model::optimizePrimitive(std::vector<uint32_t> &primitiveIndices, gltfVertex *primitiveVertices,
+                                  uint32_t vertexCount, MeshOptimizationStatistics &statistics) {
+        if (primitiveIndices.size() < 3 || primitiveIndices.size() % 3 != 0) {
+            return;
+        }
+        uint32_t *indices = primitiveIndices.data();
+        const size_t indexCount = primitiveIndices.size();
+        accumulateStatistics(statistics.before, MeshOptimizer::analyzeVertexCache(indices, indexCount, vertexCount));
+
+        MeshOptimizer::optimizeVertexCache(indices, indices, indexCount, vertexCount);
+        MeshOptimizer::optimizeOverdraw(indices, indices, indexCount, &primitiveVertices[0].pos.x, vertexCount,
+                                        sizeof(gltfVertex));
+
+        // 顶点按首次使用的顺序重排，提高vertex fetch的局部性
+        std::vector<uint32_t> remap(vertexCount);
+        MeshOptimizer::optimizeVertexFetchRemap(remap.data(), indices, indexCount, vertexCount);
+        std::vector<gltfVertex> sourceVertices(primitiveVertices, primitiveVertices + vertexCount);
+        MeshOptimizer::remapVertexBuffer(primitiveVertices, sourceVertices.data(), vertexCount, sizeof(gltfVertex),
+                                         remap.data());
+        MeshOptimizer::remapIndexBuffer(indices, indexCount, remap.data());
+
+        accumulateStatistics(statistics.after, MeshOptimizer::analyzeVertexCache(indices, indexCount, vertexCount));
+    }
+
+    void Model::generateLods(Primitive *primitive, const std::vector<uint32_t> &primitiveIndices,
+                             std::vector<uint32_t> &indexBuffer, const gltfVertex *primitiveVertices) {
+        constexpr uint32_t maxLodCount = 5;
+        constexpr size_t minLodTriangles = 32;
+        // 误差超过包围盒尺寸的1/4后再简化已经没有意义
+        const float maxError = glm::length(primitive->dimensions.size) * 0.25f;
+        const size_t sourceIndexCount = primitiveIndices.size();
+        std::vector<uint32_t> lodIndices(sourceIndexCount);
+        size_t previousIndexCount = sourceIndexCount;
+        for (uint32_t level = 1; level < maxLodCount; ++level) {
+            size_t targetIndexCount = (sourceIndexCount >> level) / 3 * 3;
+            if (targetIndexCount < minLodTriangles * 3) {
+                break;
+            }
+            float error = 0.0f;
+            size_t lodIndexCount = MeshOptimizer::simplify(lodIndices.data(), primitiveIndices.data(), sourceIndexCount,
+                                                           &primitiveVertices[0].pos.x, primitive->vertexCount,
+                                                           sizeof(gltfVertex), targetIndexCount, maxError, &error);
+            // 被接缝或误差上限卡住、三角形数降不下来时不再生成更粗的LOD
+            if (lodIndexCount == 0 || lodIndexCount > previousIndexCount * 85 / 100) {
+                break;
+            }
+            MeshOptimizer::optimizeVertexCache(lodIndices.data(), lodIndices.data(), lodIndexCount,
+                                               primitive->vertexCount);
+
+            Primitive::Lod lod{};
+            lod.firstIndex = static_cast<uint32_t>(indexBuffer.size());
+            lod.indexCount = static_cast<uint32_t>(lodIndexCount);
+            lod.error = std::max(error, primitive->lods.back().error);
+            for (size_t i = 0; i < lodIndexCount; ++i) {
+                indexBuffer.push_back(lodIndices[i] + primitive->firstVertex);
+            }
+            primitive->lods.push_back(lod);
+            previousIndexCount = lodIndexCount;
+        }
+    }
+
     void Model::loadSkins(tinygltf::Model &gltfModel) {
         for (tinygltf::Skin &source: gltfModel.skins) {
             Skin *newSkin = new Skin{};
@@ -1006,14 +1577,219 @@ namespace MW {
     }
 
     void Model::loadImages(tinygltf::Model &gltfModel, VulkanDevice *device) {
-        for (tinygltf::Image &image: gltfModel.images) {
-            Texture texture;
-            texture.fromglTfImage(image, path, device);
-            texture.index = static_cast<uint32_t>(textures.size());
-            textures.push_back(texture);
-        }
+        loadImages(gltfModel.images, device);
+    }
+
+    void Model::loadImages(std::vector<tinygltf::Image> &images, VulkanDevice *device) {
         // Create an empty texture to be used for empty material images
         createEmptyTexture();
+        textures.resize(images.size());
+        if (!deferImageLoading) {
+            uploadImages(images, device);
+            return;
+        }
+        // 先只确定textures的数量，材质中的贴图指针保持有效，解码上传留给loadPendingImages
+        pendingImages.resize(images.size());
+        for (size_t i = 0; i < images.size(); i++) {
+            pendingImages[i] = std::move(images[i]);
+            images[i].uri = pendingImages[i].uri;
+        }
+        imagesPending = true;
+        const unsigned char baseColor[4] = {0x80, 0x80, 0x80, 0xff};
+        const unsigned char normal[4] = {0x80, 0x80, 0xff, 0xff};
+        placeholderBaseColorTexture.fromPixels(baseColor, 1, 1, 4, device);
+        placeholderNormalTexture.fromPixels(normal, 1, 1, 4, device);
+    }
+
+    void Model::collectImageUsages(const tinygltf::Model &gltfModel) {
+        // 记录每张图片的所有用途，最后统一决定压缩格式
+        baseColorImages.assign(gltfModel.images.size(), 0);
+        std::vector<uint32_t> usageMasks(gltfModel.images.size(), 0);
+        auto assign = [&](int textureIndex, TextureUsage usage) {
+            if (textureIndex < 0 || textureIndex >= static_cast<int>(gltfModel.textures.size())) {
+                return;
+            }
+            const int source = gltfModel.textures[textureIndex].source;
+            if (source >= 0 && source < static_cast<int>(usageMasks.size())) {
+                usageMasks[source] |= 1u << static_cast<uint32_t>(usage);
+            }
+        };
+        for (const tinygltf::Material &material: gltfModel.materials) {
+            const int baseColor = material.pbrMetallicRoughness.baseColorTexture.index;
+            if (baseColor >= 0 && baseColor < static_cast<int>(gltfModel.textures.size()) &&
+                gltfModel.textures[baseColor].source >= 0 &&
+                gltfModel.textures[baseColor].source < static_cast<int>(baseColorImages.size())) {
+                baseColorImages[gltfModel.textures[baseColor].source] = 1;
+            }
+            assign(baseColor, TextureUsage::Color);
+            assign(material.normalTexture.index, TextureUsage::Normal);
+            assign(material.pbrMetallicRoughness.metallicRoughnessTexture.index, TextureUsage::MetallicRoughness);
+            assign(material.occlusionTexture.index, TextureUsage::Occlusion);
+            assign(material.emissiveTexture.index, TextureUsage::Color);
+        }
+        imageUsages.resize(usageMasks.size());
+        for (size_t i = 0; i < usageMasks.size(); i++) {
+            imageUsages[i] = resolveTextureUsage(usageMasks[i]);
+        }
+    }
+
+    std::string Model::getCompressedCachePath(const tinygltf::Image &image, uint32_t index,
+                                              uint64_t contentHash) const {
+        // 文件名带上内容hash，源图片修改后自动失效
+        char suffix[32];
+        snprintf(suffix, sizeof(suffix), ".%016llx.ktx2", static_cast<unsigned long long>(contentHash));
+        const std::string name = image.uri.empty() || image.uri.compare(0, 5, "data:") == 0
+                                 ? "image" + std::to_string(index) : image.uri;
+        return path + "/" + name + suffix;
+    }
+
+    void Model::loadPendingImages() {
+        if (!imagesPending) {
+            return;
+        }
+        uploadImages(pendingImages, device);
+        std::vector<tinygltf::Image>().swap(pendingImages);
+        imagesPending = false;
+    }
+
+    void Model::uploadImages(std::vector<tinygltf::Image> &images, VulkanDevice *device) {
+        // 编码数据交给线程池解码，调用线程按完成顺序逐个上传，未上传的解码数据不超过maxInFlightImageBytes
+        textureGuids.assign(images.size(), invalidGuid);
+        std::vector<TextureSource> textureSources(images.size());
+        // 压缩的图片按用途选格式，设备不支持时退回RGBA8
+        std::vector<char> compressImages(images.size(), 0);
+        bool anyCompressed = false;
+        if (fileLoadingFlags & FileLoadingFlags::CompressTextures) {
+            imageUsages.resize(images.size(), TextureUsage::Color);
+            for (uint32_t i = 0; i < images.size(); i++) {
+                const tinygltf::Image &image = images[i];
+                compressImages[i] = !isKtxImage(image) && (image.as_is || image.image.empty()) &&
+                                    isCompressedFormatSupported(device, getCompressedFormat(imageUsages[i]));
+                anyCompressed = anyCompressed || compressImages[i];
+            }
+        }
+        if (resourceManager || anyCompressed) {
+            // 按文件内容去重，已经驻留的贴图不再解码
+            ThreadPool::global().parallelFor(static_cast<uint32_t>(images.size()), [&](uint32_t i) {
+                const tinygltf::Image &image = images[i];
+                // 压缩后的贴图和原图不能共用，用途也参与hash
+                const uint64_t seed = compressImages[i] ? static_cast<uint64_t>(imageUsages[i]) + 1 : 0;
+                textureSources[i].textureFile = image.uri;
+                if (!image.image.empty()) {
+                    textureSources[i].contentHash = hash_bytes(image.image.data(), image.image.size(), seed);
+                } else {
+                    VirtualFile file;
+                    if (VirtualFileSystem::global().open(path + "/" + image.uri, file)) {
+                        textureSources[i].contentHash = hash_bytes(file.data(), file.size(), seed);
+                    }
+                }
+            });
+        }
+        if (resourceManager) {
+            for (uint32_t i = 0; i < images.size(); i++) {
+                textures[i].index = i;
+                if (textureSources[i].contentHash &&
+                    resourceManager->acquireTexture(textureSources[i], textures[i], textureGuids[i])) {
+                    std::vector<unsigned char>().swap(images[i].image);
+                }
+            }
+        }
+        auto registerTexture = [&](uint32_t i) {
+            if (resourceManager && textureSources[i].contentHash) {
+                textureGuids[i] = resourceManager->addTexture(textureSources[i], textures[i]);
+            }
+        };
+
+        // 有KTX2缓存的压缩贴图直接上传，不再解码
+        std::vector<char> uploaded(images.size(), 0);
+        for (uint32_t i = 0; i < images.size(); i++) {
+            if (!compressImages[i] || textureGuids[i] != invalidGuid || !textureSources[i].contentHash) {
+                continue;
+            }
+            CompressedImage compressedImage;
+            if (readKtx2(getCompressedCachePath(images[i], i, textureSources[i].contentHash), compressedImage) &&
+                compressedImage.format == getCompressedFormat(imageUsages[i])) {
+                textures[i].fromCompressedImage(compressedImage, getCompressedComponentMapping(imageUsages[i]),
+                                                device);
+                registerTexture(i);
+                uploaded[i] = 1;
+                std::vector<unsigned char>().swap(images[i].image);
+            }
+        }
+
+        std::vector<ImageDecodeQueue::Request> requests;
+        std::vector<uint32_t> requestImages;
+        for (uint32_t i = 0; i < images.size(); i++) {
+            const tinygltf::Image &image = images[i];
+            textures[i].index = i;
+            if (textureGuids[i] != invalidGuid || uploaded[i] || isKtxImage(image) ||
+                (!image.as_is && !image.image.empty())) {
+                continue;
+            }
+            ImageDecodeQueue::Request request;
+            if (image.image.empty()) {
+                request.filename = path + "/" + image.uri;
+            } else {
+                request.data = image.image.data();
+                request.size = image.image.size();
+            }
+            requests.push_back(request);
+            requestImages.push_back(i);
+        }
+        ImageDecodeQueue decodeQueue(std::move(requests), maxInFlightImageBytes);
+
+        // KTX以及已经解码好的图片在解码进行的同时直接上传
+        for (uint32_t i = 0; i < images.size(); i++) {
+            if (textureGuids[i] == invalidGuid &&
+                (isKtxImage(images[i]) || (!images[i].as_is && !images[i].image.empty()))) {
+                textures[i].fromglTfImage(images[i], path, device);
+                registerTexture(i);
+            }
+        }
+
+        ImageDecodeQueue::Result result;
+        while (decodeQueue.pop(result)) {
+            const uint32_t imageIndex = requestImages[result.index];
+            std::shared_ptr<TextureStreamer::StreamedImage> streamedImage;
+            if (result.pixels && compressImages[imageIndex]) {
+                // 压缩贴图一次上传完整的mip链，不参与流送
+                CompressedImage compressedImage;
+                compressImage(result.pixels, result.width, result.height, result.component, imageUsages[imageIndex],
+                              compressedImage);
+                if (textureSources[imageIndex].contentHash) {
+                    writeKtx2(getCompressedCachePath(images[imageIndex], imageIndex,
+                                                     textureSources[imageIndex].contentHash), compressedImage);
+                }
+                textures[imageIndex].fromCompressedImage(compressedImage,
+                                                         getCompressedComponentMapping(imageUsages[imageIndex]),
+                                                         device);
+            } else if (result.pixels && textureStreamer && resourceManager && textureSources[imageIndex].contentHash) {
+                streamedImage = textureStreamer->createTexture(textures[imageIndex], result.pixels, result.width,
+                                                               result.height, result.component, device);
+            } else if (result.pixels) {
+                textures[imageIndex].fromPixels(result.pixels, result.width, result.height, result.component, device);
+            } else {
+                const unsigned char white[4] = {0xff, 0xff, 0xff, 0xff};
+                textures[imageIndex].fromPixels(white, 1, 1, 4, device);
+            }
+            registerTexture(imageIndex);
+            decodeQueue.release(result);
+            if (streamedImage) {
+                // 高分辨率mip之后从原始的编码数据重新解码
+                if (images[imageIndex].image.empty()) {
+                    streamedImage->filename = path + "/" + images[imageIndex].uri;
+                } else {
+                    streamedImage->data = std::move(images[imageIndex].image);
+                }
+                if (virtualTexture && virtualTexture->isEnabled() && imageIndex < baseColorImages.size() &&
+                    baseColorImages[imageIndex]) {
+                    virtualTexture->track(textureGuids[imageIndex], std::move(streamedImage));
+                } else {
+                    textureStreamer->track(textureGuids[imageIndex], std::move(streamedImage));
+                }
+            }
+            std::vector<unsigned char>().swap(images[imageIndex].image);
+        }
     }
 
     void Model::loadMaterials(tinygltf::Model &gltfModel) {
@@ -1094,19 +1870,10 @@ namespace MW {
 
                 // Read sampler input time values
                 {
-                    const tinygltf::Accessor &accessor = gltfModel.accessors[samp.input];
-                    const tinygltf::BufferView &bufferView = gltfModel.bufferViews[accessor.bufferView];
-                    const tinygltf::Buffer &buffer = gltfModel.buffers[bufferView.buffer];
-
-                    assert(accessor.componentType == TINYGLTF_COMPONENT_TYPE_FLOAT);
-
-                    float *buf = new float[accessor.count];
-                    memcpy(buf, &buffer.data[accessor.byteOffset + bufferView.byteOffset],
-                           accessor.count * sizeof(float));
-                    for (size_t index = 0; index < accessor.count; index++) {
-                        sampler.inputs.push_back(buf[index]);
+                    const GltfAccessor accessor(gltfModel, samp.input);
+                    for (size_t index = 0; index < accessor.getCount(); index++) {
+                        sampler.inputs.push_back(accessor.read(index).x);
                     }
-                    delete[] buf;
                     for (auto input: sampler.inputs) {
                         if (input < animation.start) {
                             animation.start = input;
@@ -1119,31 +1886,14 @@ namespace MW {
 
                 // Read sampler output T/R/S values
                 {
-                    const tinygltf::Accessor &accessor = gltfModel.accessors[samp.output];
-                    const tinygltf::BufferView &bufferView = gltfModel.bufferViews[accessor.bufferView];
-                    const tinygltf::Buffer &buffer = gltfModel.buffers[bufferView.buffer];
-
-                    assert(accessor.componentType == TINYGLTF_COMPONENT_TYPE_FLOAT);
-
-                    switch (accessor.type) {
-                        case TINYGLTF_TYPE_VEC3: {
-                            glm::vec3 *buf = new glm::vec3[accessor.count];
-                            memcpy(buf, &buffer.data[accessor.byteOffset + bufferView.byteOffset],
-                                   accessor.count * sizeof(glm::vec3));
-                            for (size_t index = 0; index < accessor.count; index++) {
-                                sampler.outputsVec4.push_back(glm::vec4(buf[index], 0.0f));
-                            }
-                            delete[] buf;
-                            break;
-                        }
-                        case TINYGLTF_TYPE_VEC4: {
-                            glm::vec4 *buf = new glm::vec4[accessor.count];
-                            memcpy(buf, &buffer.data[accessor.byteOffset + bufferView.byteOffset],
-                                   accessor.count * sizeof(glm::vec4));
-                            for (size_t index = 0; index < accessor.count; index++) {
-                                sampler.outputsVec4.push_back(buf[index]);
+                    // KHR_mesh_quantization允许用normalized整数存储旋转
+                    const GltfAccessor accessor(gltfModel, samp.output);
+                    switch (accessor.getComponentCount()) {
+                        case 3:
+                        case 4: {
+                            for (size_t index = 0; index < accessor.getCount(); index++) {
+                                sampler.outputsVec4.push_back(accessor.read(index));
                             }
-                            delete[] buf;
                             break;
                         }
                         default: {
@@ -1186,7 +1936,313 @@ namespace MW {
         }
     }
 
+    bool Model::loadFromCache(ModelCache &cache, const std::string &cachePath, const std::string &filename,
+                              uint32_t cacheKey) {
+#if USE_MESH_SHADER
+        const uint32_t meshVertexStride = bUseMeshShader ? sizeof(MeshVertex) : 0;
+        const uint32_t meshletStride = bUseMeshShader ? sizeof(Meshlet) : 0;
+#else
+        const uint32_t meshVertexStride = 0;
+        const uint32_t meshletStride = 0;
+#endif
+        if (!cache.open(cachePath, filename, cacheKey, sizeof(gltfVertex), meshVertexStride, meshletStride)) {
+            return false;
+        }
+
+        size_t imageCount = 0, materialCount = 0, nodeCount = 0, primitiveCount = 0, lodCount = 0;
+        const CachedImage *cachedImages = cache.getSection<CachedImage>(ModelCacheSection::Images, imageCount);
+        const CachedMaterial *cachedMaterials = cache.getSection<CachedMaterial>(ModelCacheSection::Materials,
+                                                                                 materialCount);
+        const CachedNode *cachedNodes = cache.getSection<CachedNode>(ModelCacheSection::Nodes, nodeCount);
+        const CachedPrimitive *cachedPrimitives = cache.getSection<CachedPrimitive>(ModelCacheSection::Primitives,
+                                                                                    primitiveCount);
+        const CachedLod *cachedLods = cache.getSection<CachedLod>(ModelCacheSection::Lods, lodCount);
+
+        // Images
+        if (!(fileLoadingFlags & FileLoadingFlags::DontLoadImages)) {
+            std::vector<tinygltf::Image> images(imageCount);
+            for (size_t i = 0; i < imageCount; i++) {
+                images[i].uri = cache.getString(cachedImages[i].uri);
+            }
+            baseColorImages.assign(imageCount, 0);
+            std::vector<uint32_t> usageMasks(imageCount, 0);
+            auto assign = [&](int32_t index, TextureUsage usage) {
+                if (index >= 0 && static_cast<size_t>(index) < imageCount) {
+                    usageMasks[index] |= 1u << static_cast<uint32_t>(usage);
+                }
+            };
+            for (size_t i = 0; i < materialCount; i++) {
+                const int32_t baseColor = cachedMaterials[i].baseColorTexture;
+                if (baseColor >= 0 && static_cast<size_t>(baseColor) < imageCount) {
+                    baseColorImages[baseColor] = 1;
+                }
+                assign(baseColor, TextureUsage::Color);
+                assign(cachedMaterials[i].normalTexture, TextureUsage::Normal);
+                assign(cachedMaterials[i].metallicRoughnessTexture, TextureUsage::MetallicRoughness);
+                assign(cachedMaterials[i].occlusionTexture, TextureUsage::Occlusion);
+                assign(cachedMaterials[i].emissiveTexture, TextureUsage::Color);
+            }
+            imageUsages.resize(imageCount);
+            for (size_t i = 0; i < imageCount; i++) {
+                imageUsages[i] = resolveTextureUsage(usageMasks[i]);
+            }
+            loadImages(images, device);
+        }
+
+        // Materials
+        auto cachedTexture = [this](int32_t index) -> Texture * {
+            if (index == -2) {
+                return &emptyTexture;
+            }
+            return index >= 0 ? getTexture(static_cast<uint32_t>(index)) : nullptr;
+        };
+        materials.reserve(materialCount);
+        for (size_t i = 0; i < materialCount; i++) {
+            const CachedMaterial &cached = cachedMaterials[i];
+            Material material(device);
+            material.alphaMode = static_cast<Material::AlphaMode>(cached.alphaMode);
+            material.alphaCutoff = cached.alphaCutoff;
+            material.metallicFactor = cached.metallicFactor;
+            material.roughnessFactor = cached.roughnessFactor;
+            material.baseColorFactor = glm::make_vec4(cached.baseColorFactor);
+            material.baseColorTexture = cachedTexture(cached.baseColorTexture);
+            material.metallicRoughnessTexture = cachedTexture(cached.metallicRoughnessTexture);
+            material.normalTexture = cachedTexture(cached.normalTexture);
+            material.occlusionTexture = cachedTexture(cached.occlusionTexture);
+            material.emissiveTexture = cachedTexture(cached.emissiveTexture);
+            materials.push_back(material);
+        }
+
+        // Nodes按linearNodes顺序存储，子节点总在父节点之前
+        linearNodes.resize(nodeCount);
+        for (size_t i = 0; i < nodeCount; i++) {
+            const CachedNode &cached = cachedNodes[i];
+            Node *node = new Node{};
+            node->index = cached.index;
+            node->name = cache.getString(cached.name);
+            node->skinIndex = cached.skinIndex;
+            node->matrix = glm::make_mat4x4(cached.matrix);
+            node->translation = glm::make_vec3(cached.translation);
+            node->rotation = glm::quat(cached.rotation[3], cached.rotation[0], cached.rotation[1], cached.rotation[2]);
+            node->scale = glm::make_vec3(cached.scale);
+            if (cached.hasMesh) {
+                Mesh *mesh = new Mesh(device, node->matrix);
+                mesh->name = cache.getString(cached.meshName);
+                for (uint32_t j = 0; j < cached.primitiveCount; j++) {
+                    const CachedPrimitive &cachedPrimitive = cachedPrimitives[cached.firstPrimitive + j];
+                    Primitive *primitive = new Primitive(cachedPrimitive.firstIndex, cachedPrimitive.indexCount,
+                                                         materials[cachedPrimitive.material]);
+                    primitive->firstVertex = cachedPrimitive.firstVertex;
+                    primitive->vertexCount = cachedPrimitive.vertexCount;
+                    primitive->setDimensions(glm::make_vec3(cachedPrimitive.dimensionsMin),
+                                             glm::make_vec3(cachedPrimitive.dimensionsMax));
+                    primitive->boundsCenter = glm::make_vec3(cachedPrimitive.boundsCenter);
+                    primitive->boundsRadius = cachedPrimitive.boundsRadius;
+                    primitive->lods.clear();
+                    for (uint32_t k = 0; k < cachedPrimitive.lodCount; k++) {
+                        const CachedLod &cachedLod = cachedLods[cachedPrimitive.firstLod + k];
+                        Primitive::Lod lod{cachedLod.firstIndex, cachedLod.indexCount, cachedLod.error};
+#if USE_MESH_SHADER
+                        lod.firstMeshlet = cachedLod.firstMeshlet;
+                        lod.meshletsCount = cachedLod.meshletsCount;
+#endif
+                        primitive->lods.push_back(lod);
+                    }
+#if USE_MESH_SHADER
+                    primitive->firstMeshlet = cachedPrimitive.firstMeshlet;
+                    primitive->meshletsCount = cachedPrimitive.meshletsCount;
+#if EXT_MESH_SHADER
+                    primitive->pushConstantBlock.offsetIndex = cachedPrimitive.firstMeshlet;
+#endif
+#endif
+                    mesh->primitives.push_back(primitive);
+                }
+                node->mesh = mesh;
+            }
+            linearNodes[i] = node;
+        }
+        for (size_t i = 0; i < nodeCount; i++) {
+            Node *node = linearNodes[i];
+            if (cachedNodes[i].parent >= 0) {
+                node->parent = linearNodes[cachedNodes[i].parent];
+                node->parent->children.push_back(node);
+            } else {
+                nodes.push_back(node);
+            }
+        }
+        for (Node *node: linearNodes) {
+            if (node->mesh) {
+                node->update();
+            }
+        }
+
+#if USE_MESH_SHADER
+        if (bUseMeshShader) {
+            size_t meshletCount = 0;
+            const Meshlet *cachedMeshlets = cache.getSection<Meshlet>(ModelCacheSection::Meshlets, meshletCount);
+            meshlets.assign(cachedMeshlets, cachedMeshlets + meshletCount);
+        }
+#endif
+        metallicRoughnessWorkflow = cache.getHeader().modelFlags & ModelCache::MetallicRoughnessWorkflow;
+        return true;
+    }
+
+    void Model::writeCache(const std::string &cachePath, const std::string &filename, uint32_t cacheKey,
+                           const tinygltf::Model &gltfModel, const gltfVertex *vertexData, size_t vertexCount,
+                           const std::vector<uint32_t> &indexBuffer, const void *meshVertexData,
+                           size_t meshVertexBufferSize) {
+        // 蒙皮、动画以及内嵌资源不进缓存，每次都从glTF加载
+        if (!skins.empty() || !animations.empty()) {
+            return;
+        }
+        ModelCache cache;
+        for (const tinygltf::Buffer &buffer: gltfModel.buffers) {
+            // EXT_meshopt_compression的fallback buffer和解码得到的buffer都来自其他buffer
+            if (buffer.uri.empty() && buffer.extensions.count("EXT_meshopt_compression")) {
+                continue;
+            }
+            if (buffer.uri.empty() || buffer.uri.compare(0, 5, "data:") == 0) {
+                return;
+            }
+            cache.getDependencies().push_back(buffer.uri);
+        }
+        std::vector<CachedImage> cachedImages;
+        for (const tinygltf::Image &image: gltfModel.images) {
+            if (image.uri.empty() || image.uri.compare(0, 5, "data:") == 0) {
+                return;
+            }
+            cachedImages.push_back({cache.addString(image.uri)});
+        }
+
+        auto textureIndex = [this](const Texture *texture) -> int32_t {
+            if (texture == nullptr) {
+                return -1;
+            }
+            return texture == &emptyTexture ? -2 : static_cast<int32_t>(texture - textures.data());
+        };
+        std::vector<CachedMaterial> cachedMaterials;
+        for (const Material &material: materials) {
+            CachedMaterial cached{};
+            cached.alphaMode = material.alphaMode;
+            cached.alphaCutoff = material.alphaCutoff;
+            cached.metallicFactor = material.metallicFactor;
+            cached.roughnessFactor = material.roughnessFactor;
+            memcpy(cached.baseColorFactor, glm::value_ptr(material.baseColorFactor), sizeof(cached.baseColorFactor));
+            cached.baseColorTexture = textureIndex(material.baseColorTexture);
+            cached.metallicRoughnessTexture = textureIndex(material.metallicRoughnessTexture);
+            cached.normalTexture = textureIndex(material.normalTexture);
+            cached.occlusionTexture = textureIndex(material.occlusionTexture);
+            cached.emissiveTexture = textureIndex(material.emissiveTexture);
+            cachedMaterials.push_back(cached);
+        }
+
+        std::unordered_map<const Node *, int32_t> linearIndices;
+        for (size_t i = 0; i < linearNodes.size(); i++) {
+            linearIndices[linearNodes[i]] = static_cast<int32_t>(i);
+        }
+        std::vector<CachedNode> cachedNodes;
+        std::vector<CachedPrimitive> cachedPrimitives;
+        std::vector<CachedLod> cachedLods;
+        for (const Node *node: linearNodes) {
+            CachedNode cached{};
+            cached.parent = node->parent ? linearIndices[node->parent] : -1;
+            cached.index = node->index;
+            cached.skinIndex = node->skinIndex;
+            cached.name = cache.addString(node->name);
+            memcpy(cached.matrix, glm::value_ptr(node->matrix), sizeof(cached.matrix));
+            memcpy(cached.translation, glm::value_ptr(node->translation), sizeof(cached.translation));
+            const float rotation[4] = {node->rotation.x, node->rotation.y, node->rotation.z, node->rotation.w};
+            memcpy(cached.rotation, rotation, sizeof(cached.rotation));
+            memcpy(cached.scale, glm::value_ptr(node->scale), sizeof(cached.scale));
+            cached.hasMesh = node->mesh != nullptr;
+            cached.firstPrimitive = static_cast<uint32_t>(cachedPrimitives.size());
+            if (node->mesh) {
+                cached.meshName = cache.addString(node->mesh->name);
+                cached.primitiveCount = static_cast<uint32_t>(node->mesh->primitives.size());
+                for (const Primitive *primitive: node->mesh->primitives) {
+                    CachedPrimitive cachedPrimitive{};
+                    cachedPrimitive.firstIndex = primitive->firstIndex;
+                    cachedPrimitive.indexCount = primitive->indexCount;
+                    cachedPrimitive.firstVertex = primitive->firstVertex;
+                    cachedPrimitive.vertexCount = primitive->vertexCount;
+                    cachedPrimitive.material = static_cast<uint32_t>(&primitive->material - materials.data());
+                    memcpy(cachedPrimitive.dimensionsMin, glm::value_ptr(primitive->dimensions.min),
+                           sizeof(cachedPrimitive.dimensionsMin));
+                    memcpy(cachedPrimitive.dimensionsMax, glm::value_ptr(primitive->dimensions.max),
+                           sizeof(cachedPrimitive.dimensionsMax));
+                    memcpy(cachedPrimitive.boundsCenter, glm::value_ptr(primitive->boundsCenter),
+                           sizeof(cachedPrimitive.boundsCenter));
+                    cachedPrimitive.boundsRadius = primitive->boundsRadius;
+                    cachedPrimitive.firstLod = static_cast<uint32_t>(cachedLods.size());
+                    cachedPrimitive.lodCount = static_cast<uint32_t>(primitive->lods.size());
+#if USE_MESH_SHADER
+                    cachedPrimitive.firstMeshlet = primitive->firstMeshlet;
+                    cachedPrimitive.meshletsCount = primitive->meshletsCount;
+#endif
+                    for (const Primitive::Lod &lod: primitive->lods) {
+                        CachedLod cachedLod{lod.firstIndex, lod.indexCount, lod.error, 0, 0};
+#if USE_MESH_SHADER
+                        cachedLod.firstMeshlet = lod.firstMeshlet;
+                        cachedLod.meshletsCount = lod.meshletsCount;
+#endif
+                        cachedLods.push_back(cachedLod);
+                    }
+                    cachedPrimitives.push_back(cachedPrimitive);
+                }
+            }
+            cachedNodes.push_back(cached);
+        }
+
+        uint32_t modelFlags = metallicRoughnessWorkflow ? ModelCache::MetallicRoughnessWorkflow : 0;
+        uint32_t meshVertexStride = 0;
+        uint32_t meshletStride = 0;
+        cache.addSection(ModelCacheSection::Vertices, vertexData, vertexCount * sizeof(gltfVertex), vertexCount);
+        cache.addSection(ModelCacheSection::Indices, indexBuffer);
+#if USE_MESH_SHADER
+        if (bUseMeshShader) {
+            modelFlags |= ModelCache::HasMeshVertices;
+            meshVertexStride = sizeof(MeshVertex);
+            meshletStride = sizeof(Meshlet);
+            cache.addSection(ModelCacheSection::MeshVertices, meshVertexData, meshVertexBufferSize,
+                             meshVertexBufferSize / sizeof(MeshVertex));
+            cache.addSection(ModelCacheSection::Meshlets, meshlets);
+        }
+#endif
+        cache.addSection(ModelCacheSection::Nodes, cachedNodes);
+        cache.addSection(ModelCacheSection::Primitives, cachedPrimitives);
+        cache.addSection(ModelCacheSection::Lods, cachedLods);
+        cache.addSection(ModelCacheSection::Materials, cachedMaterials);
+        cache.addSection(ModelCacheSection::Images, cachedImages);
+        if (!cache.write(cachePath, filename, cacheKey, sizeof(gltfVertex), meshVertexStride, meshletStride,
+                         modelFlags)) {
+            std::cerr << "Could not write model cache for \"" << filename << "\"" << std::endl;
+        }
+    }
+
+#if USE_MESH_SHADER
+    static void buildMeshVertices(const gltfVertex *vertexBuffer, uint32_t vertexCount,
+                                  std::vector<MeshVertex> &meshVertices) {
+        meshVertices.resize(vertexCount);
+        for (uint32_t i = 0; i < vertexCount; ++i) {
+            meshVertices[i].inPos = vertexBuffer[i].pos;
+            meshVertices[i].inUV = vertexBuffer[i].uv;
+            meshVertices[i].inColor = vertexBuffer[i].color;
+            meshVertices[i].inNormal = vertexBuffer[i].normal;
+            meshVertices[i].inTangent = vertexBuffer[i].tangent;
+            meshVertices[i].inMetallic = vertexBuffer[i].metallicFactor;
+            meshVertices[i].inRoughness = vertexBuffer[i].roughnessFactor;
+        }
+    }
+#endif
+
     void Model::loadFromFile(std::string filename, VulkanDevice *device, uint32_t fileLoadingFlags, float scale) {
+        if (loadResources(filename, device, fileLoadingFlags, scale)) {
+            loadPendingImages();
+            setupDescriptors();
+        }
+    }
+
+    bool Model::loadResources(std::string filename, VulkanDevice *device, uint32_t fileLoadingFlags, float scale) {
         tinygltf::Model gltfModel;
         tinygltf::TinyGLTF gltfContext;
         if (fileLoadingFlags & FileLoadingFlags::DontLoadImages) {
@@ -1205,31 +2261,81 @@ namespace MW {
         std::string error, warning;
 
         this->device = device;
+        this->fileLoadingFlags = fileLoadingFlags;
+        meshOptimizationStatistics = {};
+
+        // 缓存的内容还取决于是否生成了mesh shader数据
+        std::string cachePath;
+        const uint32_t cacheKey = fileLoadingFlags | (bUseMeshShader ? 0x80000000u : 0u);
+        if (fileLoadingFlags & FileLoadingFlags::UseModelCache) {
+            cachePath = ModelCache::getCachePath(filename, cacheKey);
+            ModelCache cache;
+            if (loadFromCache(cache, cachePath, filename, cacheKey)) {
+                size_t vertexCount = 0, indexCount = 0;
+                const gltfVertex *vertexData = cache.getSection<gltfVertex>(ModelCacheSection::Vertices, vertexCount);
+                const uint32_t *indexData = cache.getSection<uint32_t>(ModelCacheSection::Indices, indexCount);
+                size_t meshVertexBufferSize = 0;
+                const void *meshVertexData = cache.getSectionData(ModelCacheSection::MeshVertices,
+                                                                  meshVertexBufferSize);
+                createBuffers(vertexData, vertexCount, indexData, indexCount, meshVertexData, meshVertexBufferSize);
+                return true;
+            }
+        }
 
 #if defined(__ANDROID__)
         // On Android all assets are packed with the apk in a compressed form, so we need to open them using the asset manager
         // We let tinygltf handle this, by passing the asset manager of our app
         tinygltf::asset_manager = androidApp->activity->assetManager;
 #endif
-        bool fileLoaded = gltfContext.LoadASCIIFromFile(&gltfModel, &error, &warning, filename);
+        const auto loadStart = std::chrono::steady_clock::now();
+        bool fileLoaded = loadGltfFile(gltfContext, gltfModel, filename, error, warning);
 
         std::vector<uint32_t> indexBuffer;
-        std::vector<gltfVertex> vertexBuffer;
+        // 顶点直接解码到staging buffer的映射内存，省去堆上的副本
+        // 优化和生成LOD时会反复读写顶点，有带缓存的host内存时优先使用
+        VulkanBuffer vertexStaging{};
+        gltfVertex *vertexBuffer = nullptr;
+        uint32_t vertexCount = 0;
 
         if (fileLoaded) {
             if (!(fileLoadingFlags & FileLoadingFlags::DontLoadImages)) {
+                collectImageUsages(gltfModel);
                 loadImages(gltfModel, device);
             }
             loadMaterials(gltfModel);
             const tinygltf::Scene &scene = gltfModel.scenes[gltfModel.defaultScene > -1 ? gltfModel.defaultScene : 0];
+            std::vector<PrimitiveLoadJob> primitiveJobs;
             for (size_t i = 0; i < scene.nodes.size(); i++) {
-                const tinygltf::Node node = gltfModel.nodes[scene.nodes[i]];
-                loadNode(nullptr, node, scene.nodes[i], gltfModel, indexBuffer, vertexBuffer, scale);
+                const tinygltf::Node &node = gltfModel.nodes[scene.nodes[i]];
+                loadNode(nullptr, node, scene.nodes[i], gltfModel, primitiveJobs, vertexCount, scale);
             }
+            if (vertexCount > 0) {
+                VkMemoryPropertyFlags stagingProperties =
+                        VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+                if (device->supportsMemoryProperties(stagingProperties | VK_MEMORY_PROPERTY_HOST_CACHED_BIT)) {
+                    stagingProperties |= VK_MEMORY_PROPERTY_HOST_CACHED_BIT;
+                }
+                device->CreateBuffer(VK_BUFFER_USAGE_TRANSFER_SRC_BIT, stagingProperties, vertexStaging,
+                                     vertexCount * sizeof(gltfVertex));
+                device->MapMemory(vertexStaging);
+                vertexBuffer = static_cast<gltfVertex *>(vertexStaging.mapped);
+            }
+            loadPrimitives(gltfModel, primitiveJobs, indexBuffer, vertexBuffer);
             if (gltfModel.animations.size() > 0) {
                 loadAnimations(gltfModel);
             }
             loadSkins(gltfModel);
+            // 所有accessor都已读完，提前释放buffer数据以降低峰值内存
+            for (tinygltf::Buffer &buffer: gltfModel.buffers) {
+                std::vector<unsigned char>().swap(buffer.data);
+            }
+
+            if (fileLoadingFlags & FileLoadingFlags::OptimizeMeshes) {
+                const VertexCacheStatistics &before = meshOptimizationStatistics.before;
+                const VertexCacheStatistics &after = meshOptimizationStatistics.after;
+                std::cout << "Optimized \"" << filename << "\": ACMR " << before.acmr << " -> " << after.acmr
+                          << ", ATVR " << before.atvr << " -> " << after.atvr << std::endl;
+            }
 
             for (auto node: linearNodes) {
                 // Assign skins
@@ -1244,42 +2350,7 @@ namespace MW {
         } else {
             // TODO: throw
             std::cerr << ("Could not load glTF file \"" + filename + "\": " + error) << std::endl;
-            return;
-        }
-
-        // Pre-Calculations for requested features
-        if ((fileLoadingFlags & FileLoadingFlags::PreTransformVertices) ||
-            (fileLoadingFlags & FileLoadingFlags::PreMultiplyVertexColors) ||
-            (fileLoadingFlags & FileLoadingFlags::FlipY)) {
-            const bool preTransform = fileLoadingFlags & FileLoadingFlags::PreTransformVertices;
-            const bool preMultiplyColor = fileLoadingFlags & FileLoadingFlags::PreMultiplyVertexColors;
-            const bool flipY = fileLoadingFlags & FileLoadingFlags::FlipY;
-            for (Node *node: linearNodes) {
-                if (node->mesh) {
-                    const glm::mat4 localMatrix = node->getMatrix();
-                    for (Primitive *primitive: node->mesh->primitives) {
-                        for (uint32_t i = 0; i < primitive->vertexCount; i++) {
-                            gltfVertex &vertex = vertexBuffer[primitive->firstVertex + i];
-                            // Pre-transform vertex positions by node-hierarchy
-                            if (preTransform) {
-                                vertex.pos = glm::vec3(localMatrix * glm::vec4(vertex.pos, 1.0f));
-                                vertex.normal = glm::normalize(glm::mat3(localMatrix) * vertex.normal);
-                            }
-                            // Flip Y-Axis of vertex positions
-                            if (flipY) {
-                                vertex.pos.y *= -1.0f;
-                                vertex.normal.y *= -1.0f;
-                            }
-                            // Pre-Multiply vertex colors with material base color
-                            if (preMultiplyColor) {
-                                vertex.color = primitive->material.baseColorFactor * vertex.color;
-                            }
-                            vertex.metallicFactor = primitive->material.metallicFactor;
-                            vertex.roughnessFactor = primitive->material.roughnessFactor;
-                        }
-                    }
-                }
-            }
+            return false;
         }
 
         for (auto extension: gltfModel.extensionsUsed) {
@@ -1288,54 +2359,244 @@ namespace MW {
                 metallicRoughnessWorkflow = false;
             }
         }
-#if USE_MESH_SHADER
+        const void *meshVertexData = nullptr;
         size_t meshVertexBufferSize = 0;
-        VulkanBuffer meshVertexStaging;
+#if USE_MESH_SHADER
+        std::vector<MeshVertex> meshVertices;
         if(bUseMeshShader) {
+            buildMeshVertices(vertexBuffer, vertexCount, meshVertices);
+            meshVertexData = meshVertices.data();
+            meshVertexBufferSize = meshVertices.size() * sizeof(MeshVertex);
+        }
+#endif
+        if (!cachePath.empty()) {
+            writeCache(cachePath, filename, cacheKey, gltfModel, vertexBuffer, vertexCount, indexBuffer, meshVertexData,
+                       meshVertexBufferSize);
+        }
+        createBuffers(vertexBuffer, vertexCount, indexBuffer.data(), indexBuffer.size(), meshVertexData,
+                      meshVertexBufferSize, vertexCount > 0 ? &vertexStaging : nullptr);
+        const auto loadTime = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - loadStart);
+        std::cout << "Loaded \"" << filename << "\" in " << loadTime.count() << " ms, peak RSS "
+                  << peakResidentMemory() << " MiB" << std::endl;
+        return true;
+    }
+
+    bool Model::cook(const std::string &filename, uint32_t fileLoadingFlags, float scale,
+                     std::vector<std::string> &dependencies, std::vector<std::string> &outputs) {
+        tinygltf::Model gltfModel;
+        tinygltf::TinyGLTF gltfContext;
+        if (fileLoadingFlags & FileLoadingFlags::DontLoadImages) {
+            gltfContext.SetImageLoader(loadImageDataFuncEmpty, nullptr);
+        } else {
+            gltfContext.SetImageLoader(loadImageDataFunc, nullptr);
+        }
+        size_t pos = filename.find_last_of('/');
+        path = filename.substr(0, pos);
+        this->device = nullptr;
+        this->fileLoadingFlags = fileLoadingFlags;
+        meshOptimizationStatistics = {};
+
+        std::string error, warning;
+        if (!loadGltfFile(gltfContext, gltfModel, filename, error, warning)) {
+            std::cerr << ("Could not load glTF file \"" + filename + "\": " + error) << std::endl;
+            return false;
+        }
+        for (const tinygltf::Buffer &buffer: gltfModel.buffers) {
+            if (!buffer.uri.empty() && buffer.uri.compare(0, 5, "data:") != 0) {
+                dependencies.push_back(buffer.uri);
+            }
+        }
+        for (const tinygltf::Image &image: gltfModel.images) {
+            if (!image.uri.empty() && image.uri.compare(0, 5, "data:") != 0) {
+                dependencies.push_back(image.uri);
+            }
+        }
+
+        if (!(fileLoadingFlags & FileLoadingFlags::DontLoadImages)) {
+            collectImageUsages(gltfModel);
+            cookImages(gltfModel.images, outputs);
+            textures.resize(gltfModel.images.size());
+            for (uint32_t i = 0; i < textures.size(); i++) {
+                textures[i].index = i;
+            }
+        }
+        loadMaterials(gltfModel);
+
+        const tinygltf::Scene &scene = gltfModel.scenes[gltfModel.defaultScene > -1 ? gltfModel.defaultScene : 0];
+        std::vector<PrimitiveLoadJob> primitiveJobs;
+        uint32_t vertexCount = 0;
+        for (size_t i = 0; i < scene.nodes.size(); i++) {
+            const tinygltf::Node &node = gltfModel.nodes[scene.nodes[i]];
+            loadNode(nullptr, node, scene.nodes[i], gltfModel, primitiveJobs, vertexCount, scale);
+        }
+        // 蒙皮和动画不进模型缓存，运行时总是从glTF加载
+        if (gltfModel.skins.empty() && gltfModel.animations.empty() &&
+            (fileLoadingFlags & FileLoadingFlags::UseModelCache)) {
+            std::vector<gltfVertex> vertexBuffer(vertexCount);
+            std::vector<uint32_t> indexBuffer;
+            loadPrimitives(gltfModel, primitiveJobs, indexBuffer, vertexBuffer.data());
+            for (auto extension: gltfModel.extensionsUsed) {
+                if (extension == "KHR_materials_pbrSpecularGlossiness") {
+                    metallicRoughnessWorkflow = false;
+                }
+            }
+            const void *meshVertexData = nullptr;
+            size_t meshVertexBufferSize = 0;
+#if USE_MESH_SHADER
             std::vector<MeshVertex> meshVertices;
-            meshVertices.resize(vertexBuffer.size());
-            for (int i = 0; i < vertexBuffer.size(); ++i) {
-                meshVertices[i].inPos = vertexBuffer[i].pos;
-                meshVertices[i].inUV = vertexBuffer[i].uv;
-                meshVertices[i].inColor = vertexBuffer[i].color;
-                meshVertices[i].inNormal = vertexBuffer[i].normal;
-                meshVertices[i].inTangent = vertexBuffer[i].tangent;
-                meshVertices[i].inMetallic = vertexBuffer[i].metallicFactor;
-                meshVertices[i].inRoughness = vertexBuffer[i].roughnessFactor;
+            if (bUseMeshShader) {
+                buildMeshVertices(vertexBuffer.data(), vertexCount, meshVertices);
+                meshVertexData = meshVertices.data();
+                meshVertexBufferSize = meshVertices.size() * sizeof(MeshVertex);
             }
-            meshVertexBufferSize = meshVertices.size() * sizeof(MeshVertex);
+#endif
+            const uint32_t cacheKey = fileLoadingFlags | (bUseMeshShader ? 0x80000000u : 0u);
+            const std::string cachePath = ModelCache::getCachePath(filename, cacheKey);
+            writeCache(cachePath, filename, cacheKey, gltfModel, vertexBuffer.data(), vertexCount, indexBuffer,
+                       meshVertexData, meshVertexBufferSize);
+            if (fileExists(cachePath)) {
+                outputs.push_back(cachePath);
+            }
+        }
+
+        for (auto node: nodes) {
+            delete node;
+        }
+        nodes.clear();
+        linearNodes.clear();
+        return true;
+    }
+
+    void Model::cookImages(std::vector<tinygltf::Image> &images, std::vector<std::string> &outputs) {
+        // 和uploadImages使用相同的hash和缓存路径，运行时开启CompressTextures时直接读取
+        imageUsages.resize(images.size(), TextureUsage::Color);
+        std::vector<uint64_t> contentHashes(images.size(), 0);
+        ThreadPool::global().parallelFor(static_cast<uint32_t>(images.size()), [&](uint32_t i) {
+            const tinygltf::Image &image = images[i];
+            if (isKtxImage(image) || (!image.as_is && !image.image.empty())) {
+                return;
+            }
+            const uint64_t seed = static_cast<uint64_t>(imageUsages[i]) + 1;
+            if (!image.image.empty()) {
+                contentHashes[i] = hash_bytes(image.image.data(), image.image.size(), seed);
+            } else {
+                VirtualFile file;
+                if (VirtualFileSystem::global().open(path + "/" + image.uri, file)) {
+                    contentHashes[i] = hash_bytes(file.data(), file.size(), seed);
+                }
+            }
+        });
+
+        std::vector<ImageDecodeQueue::Request> requests;
+        std::vector<uint32_t> requestImages;
+        for (uint32_t i = 0; i < images.size(); i++) {
+            if (!contentHashes[i]) {
+                continue;
+            }
+            const std::string cachePath = getCompressedCachePath(images[i], i, contentHashes[i]);
+            if (fileExists(cachePath)) {
+                outputs.push_back(cachePath);
+                continue;
+            }
+            ImageDecodeQueue::Request request;
+            if (images[i].image.empty()) {
+                request.filename = path + "/" + images[i].uri;
+            } else {
+                request.data = images[i].image.data();
+                request.size = images[i].image.size();
+            }
+            requests.push_back(request);
+            requestImages.push_back(i);
+        }
+        ImageDecodeQueue decodeQueue(std::move(requests), maxInFlightImageBytes);
+        ImageDecodeQueue::Result result;
+        while (decodeQueue.pop(result)) {
+            const uint32_t imageIndex = requestImages[result.index];
+            if (result.pixels) {
+                CompressedImage compressedImage;
+                compressImage(result.pixels, result.width, result.height, result.component, imageUsages[imageIndex],
+                              compressedImage);
+                const std::string cachePath = getCompressedCachePath(images[imageIndex], imageIndex,
+                                                                     contentHashes[imageIndex]);
+                if (writeKtx2(cachePath, compressedImage)) {
+                    outputs.push_back(cachePath);
+                }
+            } else {
+                std::cerr << "Could not decode image \"" << images[imageIndex].uri << "\"" << std::endl;
+            }
+            decodeQueue.release(result);
+            std::vector<unsigned char>().swap(images[imageIndex].image);
+        }
+    }
+
+    void Model::createBuffers(const gltfVertex *vertexData, size_t vertexCount, const uint32_t *indexData,
+                              size_t indexCount, const void *meshVertexData, size_t meshVertexBufferSize,
+                              VulkanBuffer *vertexStaging) {
+        this->meshVertexBufferSize = meshVertexBufferSize;
+        vertices.count = static_cast<uint32_t>(vertexCount);
+        indices.count = static_cast<uint32_t>(indexCount);
+        // 内容完全相同的模型共用顶点和索引buffer
+        MeshSource meshSource;
+        if (resourceManager) {
+            uint64_t hash = hash_bytes(vertexData, vertexCount * sizeof(gltfVertex));
+            hash = hash_bytes(indexData, indexCount * sizeof(uint32_t), hash);
+#if USE_MESH_SHADER
+            if (bUseMeshShader) {
+                hash = hash_bytes(meshVertexData, meshVertexBufferSize, hash);
+                hash = hash_bytes(meshlets.data(), meshlets.size() * sizeof(Meshlet), hash);
+            }
+#endif
+            meshSource.contentHash = hash;
+            std::vector<VulkanBuffer> buffers;
+            if (resourceManager->acquireMesh(meshSource, buffers, meshGuid)) {
+                if (vertexStaging) {
+                    device->unMapMemory(*vertexStaging);
+                    device->DestroyVulkanBuffer(*vertexStaging);
+                }
+                setMeshBuffers(buffers);
+                getSceneDimensions();
+                return;
+            }
+        }
+#if USE_MESH_SHADER
+        VulkanBuffer meshVertexStaging;
+        if(bUseMeshShader) {
             device->CreateBuffer(
                     VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
                     VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
                     meshVertexStaging,
                     meshVertexBufferSize,
-                    meshVertices.data());
+                    const_cast<void *>(meshVertexData));
         }
 #endif
-        size_t vertexBufferSize = vertexBuffer.size() * sizeof(gltfVertex);
-        vertices.count = static_cast<uint32_t>(vertexBuffer.size());
-        indices.count = static_cast<uint32_t>(indexBuffer.size());
-        size_t indexBufferSize = indexBuffer.size() * sizeof(uint32_t);
+        size_t vertexBufferSize = vertexCount * sizeof(gltfVertex);
+        size_t indexBufferSize = indexCount * sizeof(uint32_t);
 
         assert((vertexBufferSize > 0) && (indexBufferSize > 0));
 
-        VulkanBuffer vertexStaging, indexStaging;
+        VulkanBuffer stagingVertices, indexStaging;
 
         // Create staging buffers
         // gltfVertex data
-        device->CreateBuffer(
-                VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
-                VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
-                vertexStaging,
-                vertexBufferSize,
-                vertexBuffer.data());
+        if (vertexStaging) {
+            // 申请时要求了HOST_COHERENT，不需要flush
+            stagingVertices = *vertexStaging;
+            device->unMapMemory(stagingVertices);
+        } else {
+            device->CreateBuffer(
+                    VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+                    VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+                    stagingVertices,
+                    vertexBufferSize,
+                    const_cast<gltfVertex *>(vertexData));
+        }
         // Index data
         device->CreateBuffer(
                 VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
                 VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
                 indexStaging,
                 indexBufferSize,
-                indexBuffer.data());
+                const_cast<uint32_t *>(indexData));
 
         // Create device local buffers
         // gltfVertex buffer
@@ -1365,7 +2626,7 @@ namespace MW {
         VkBufferCopy copyRegion = {};
 
         copyRegion.size = vertexBufferSize;
-        vkCmdCopyBuffer(copyCmd, vertexStaging.buffer, vertices.buffer.buffer, 1, &copyRegion);
+        vkCmdCopyBuffer(copyCmd, stagingVertices.buffer, vertices.buffer.buffer, 1, &copyRegion);
 #if USE_MESH_SHADER
         if (bUseMeshShader) {
             copyRegion.size = meshVertexBufferSize;
@@ -1376,137 +2637,270 @@ namespace MW {
         vkCmdCopyBuffer(copyCmd, indexStaging.buffer, indices.buffer.buffer, 1, &copyRegion);
 
         device->endSingleTimeCommands(copyCmd);
-        device->DestroyVulkanBuffer(vertexStaging);
+        device->DestroyVulkanBuffer(stagingVertices);
         device->DestroyVulkanBuffer(indexStaging);
 #if USE_MESH_SHADER
         if (bUseMeshShader) {
             device->DestroyVulkanBuffer(meshVertexStaging);
+            createMeshletBuffer();
         }
 #endif
+        if (resourceManager) {
+            std::vector<VulkanBuffer> buffers = getMeshBuffers();
+            meshGuid = resourceManager->addMesh(meshSource, buffers);
+            setMeshBuffers(buffers);
+        }
         getSceneDimensions();
+    }
 
-        // Setup descriptors
-        uint32_t uboCount{0};
-        uint32_t imageCount{0};
-        for (auto node: linearNodes) {
-            if (node->mesh) {
-                uboCount++;
-            }
+    std::vector<VulkanBuffer> Model::getMeshBuffers() {
+        std::vector<VulkanBuffer> buffers = {vertices.buffer, indices.buffer};
+#if USE_MESH_SHADER
+        if (bUseMeshShader) {
+            buffers.push_back(vertexBuffer.buffer);
+            buffers.push_back(meshBuffer.buffer);
         }
-        for (auto material: materials) {
-            if (material.baseColorTexture != nullptr) {
-                imageCount++;
+#endif
+        return buffers;
+    }
+
+    void Model::setMeshBuffers(const std::vector<VulkanBuffer> &buffers) {
+        vertices.buffer = buffers[0];
+        indices.buffer = buffers[1];
+#if USE_MESH_SHADER
+        if (bUseMeshShader && buffers.size() >= 4) {
+            vertexBuffer.buffer = buffers[2];
+            meshBuffer.buffer = buffers[3];
+        }
+#endif
+    }
+
+    void Model::createDescriptorSetLayouts(VulkanDevice *device) {
+        // Layouts are global, so only create if they haven't already been created before
+        // 渲染pass初始化时就需要这些layout，异步加载模型时要提前创建
+        if (descriptorSetLayoutUbo == VK_NULL_HANDLE) {
+            std::vector<VkDescriptorSetLayoutBinding> setLayoutBindings = {
+                    CreateDescriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER,
+                                                     VK_SHADER_STAGE_VERTEX_BIT, 0),
+            };
+            VkDescriptorSetLayoutCreateInfo descriptorLayoutCI{};
+            descriptorLayoutCI.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+            descriptorLayoutCI.bindingCount = static_cast<uint32_t>(setLayoutBindings.size());
+            descriptorLayoutCI.pBindings = setLayoutBindings.data();
+            device->CreateDescriptorSetLayout(&descriptorLayoutCI, &descriptorSetLayoutUbo);
+        }
+        if (descriptorSetLayoutImage == VK_NULL_HANDLE) {
+            std::vector<VkDescriptorSetLayoutBinding> setLayoutBindings{};
+            if (descriptorBindingFlags & DescriptorBindingFlags::ImageBaseColor) {
+                setLayoutBindings.push_back(
+                        CreateDescriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
+                                                         VK_SHADER_STAGE_FRAGMENT_BIT,
+                                                         static_cast<uint32_t>(setLayoutBindings.size())));
+            }
+            if (descriptorBindingFlags & DescriptorBindingFlags::ImageNormalMap) {
+                setLayoutBindings.push_back(
+                        CreateDescriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
+                                                         VK_SHADER_STAGE_FRAGMENT_BIT,
+                                                         static_cast<uint32_t>(setLayoutBindings.size())));
             }
+            VkDescriptorSetLayoutCreateInfo descriptorLayoutCI{};
+            descriptorLayoutCI.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+            descriptorLayoutCI.bindingCount = static_cast<uint32_t>(setLayoutBindings.size());
+            descriptorLayoutCI.pBindings = setLayoutBindings.data();
+            device->CreateDescriptorSetLayout(&descriptorLayoutCI, &descriptorSetLayoutImage);
         }
+#if USE_MESH_SHADER
+        if (descriptorSetLayoutMeshlet == VK_NULL_HANDLE) {
+            std::vector<VkDescriptorSetLayoutBinding> setLayoutBindings{};
+            // task shader按meshlet的包围球和法线锥剔除
+            setLayoutBindings.push_back(
+                    CreateDescriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+                                                     VK_SHADER_STAGE_TASK_BIT_NV | VK_SHADER_STAGE_MESH_BIT_NV, 0));
+            VkDescriptorSetLayoutCreateInfo descriptorLayoutCI{};
+            descriptorLayoutCI.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+            descriptorLayoutCI.bindingCount = static_cast<uint32_t>(setLayoutBindings.size());
+            descriptorLayoutCI.pBindings = setLayoutBindings.data();
+            device->CreateDescriptorSetLayout(&descriptorLayoutCI, &descriptorSetLayoutMeshlet);
+        }
+        if (descriptorSetLayoutVertexStorage == VK_NULL_HANDLE) {
+            std::vector<VkDescriptorSetLayoutBinding> setLayoutBindings{};
+            setLayoutBindings.push_back(
+                    CreateDescriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_MESH_BIT_NV, 0));
+            VkDescriptorSetLayoutCreateInfo descriptorLayoutCI{};
+            descriptorLayoutCI.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+            descriptorLayoutCI.bindingCount = static_cast<uint32_t>(setLayoutBindings.size());
+            descriptorLayoutCI.pBindings = setLayoutBindings.data();
+            device->CreateDescriptorSetLayout(&descriptorLayoutCI, &descriptorSetLayoutVertexStorage);
+        }
+#endif
+    }
+
+    void Model::setupDescriptors() {
+        createDescriptorSetLayouts(device);
         // Descriptors for per-node uniform buffers
-        {
-            // Layout is global, so only create if it hasn't already been created before
-            if (descriptorSetLayoutUbo == VK_NULL_HANDLE) {
-                std::vector<VkDescriptorSetLayoutBinding> setLayoutBindings = {
-                        CreateDescriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER,
-                                                         VK_SHADER_STAGE_VERTEX_BIT, 0),
-                };
-                VkDescriptorSetLayoutCreateInfo descriptorLayoutCI{};
-                descriptorLayoutCI.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
-                descriptorLayoutCI.bindingCount = static_cast<uint32_t>(setLayoutBindings.size());
-                descriptorLayoutCI.pBindings = setLayoutBindings.data();
-                device->CreateDescriptorSetLayout(&descriptorLayoutCI, &descriptorSetLayoutUbo);
+        for (auto node: nodes) {
+            prepareNodeDescriptor(node, descriptorSetLayoutUbo);
+        }
+
+        // Descriptors for per-material images
+        setupMaterialDescriptors();
+#if USE_MESH_SHADER
+        if (bUseMeshShader && meshBuffer.descriptorSet == VK_NULL_HANDLE) {
+            device->CreateDescriptorSet(1, descriptorSetLayoutMeshlet, meshBuffer.descriptorSet);
+
+            VkDescriptorBufferInfo MeshletBufferInfo{};
+            MeshletBufferInfo.buffer = meshBuffer.buffer.buffer;
+            MeshletBufferInfo.offset = 0;
+            MeshletBufferInfo.range = sizeof(Meshlet) * meshlets.size();
+            std::array<VkWriteDescriptorSet, 1> descriptorWrites{};
+            descriptorWrites[0].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+            descriptorWrites[0].dstSet = meshBuffer.descriptorSet;
+            descriptorWrites[0].dstBinding = 0;
+            descriptorWrites[0].dstArrayElement = 0;
+            descriptorWrites[0].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+            descriptorWrites[0].descriptorCount = 1;
+            descriptorWrites[0].pBufferInfo = &MeshletBufferInfo;
+
+            device->UpdateDescriptorSets(descriptorWrites.size(), descriptorWrites.data());
+        }
+
+        if (bUseMeshShader && this->vertexBuffer.descriptorSet == VK_NULL_HANDLE) {
+            device->CreateDescriptorSet(1, descriptorSetLayoutVertexStorage, this->vertexBuffer.descriptorSet);
+
+            VkDescriptorBufferInfo VertexBufferInfo{};
+            VertexBufferInfo.buffer = this->vertexBuffer.buffer.buffer;
+            VertexBufferInfo.offset = 0;
+            VertexBufferInfo.range = meshVertexBufferSize;
+            std::array<VkWriteDescriptorSet, 1> descriptorWrites{};
+            descriptorWrites[0].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+            descriptorWrites[0].dstSet = this->vertexBuffer.descriptorSet;
+            descriptorWrites[0].dstBinding = 0;
+            descriptorWrites[0].dstArrayElement = 0;
+            descriptorWrites[0].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+            descriptorWrites[0].descriptorCount = 1;
+            descriptorWrites[0].pBufferInfo = &VertexBufferInfo;
+
+            device->UpdateDescriptorSets(descriptorWrites.size(), descriptorWrites.data());
+        }
+#endif
+    }
+
+    void Model::setupMaterialDescriptors() {
+        if (imagesPending) {
+            // 贴图还没上传完时所有材质共用一个占位descriptor set
+            if (placeholderDescriptorSet == VK_NULL_HANDLE) {
+                Material placeholder(device);
+                placeholder.baseColorTexture = &placeholderBaseColorTexture;
+                placeholder.normalTexture = &placeholderNormalTexture;
+                placeholder.createDescriptorSet(descriptorSetLayoutImage, descriptorBindingFlags);
+                placeholderDescriptorSet = placeholder.descriptorSet;
             }
-            for (auto node: nodes) {
-                prepareNodeDescriptor(node, descriptorSetLayoutUbo);
+            return;
+        }
+        for (auto &material: materials) {
+            if (material.baseColorTexture == nullptr || material.descriptorSet != VK_NULL_HANDLE) {
+                continue;
+            }
+            MaterialSource materialSource;
+            if (resourceManager && getMaterialSource(material, materialSource)) {
+                // 参数和贴图都相同的材质共用一个descriptor set
+                material.resourceGuid = resourceManager->loadMaterial(materialSource);
+                material.descriptorSet = resourceManager->getMaterialDescriptorSet(material.resourceGuid);
+            }
+            if (material.descriptorSet == VK_NULL_HANDLE) {
+                material.createDescriptorSet(descriptorSetLayoutImage, descriptorBindingFlags);
             }
         }
+    }
 
-        // Descriptors for per-material images
-        {
-            // Layout is global, so only create if it hasn't already been created before
-            if (descriptorSetLayoutImage == VK_NULL_HANDLE) {
-                std::vector<VkDescriptorSetLayoutBinding> setLayoutBindings{};
-                if (descriptorBindingFlags & DescriptorBindingFlags::ImageBaseColor) {
-                    setLayoutBindings.push_back(
-                            CreateDescriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
-                                                             VK_SHADER_STAGE_FRAGMENT_BIT,
-                                                             static_cast<uint32_t>(setLayoutBindings.size())));
+    size_t Model::getTextureGuid(const Texture *texture) {
+        if (texture == &emptyTexture) {
+            return emptyTextureGuid;
+        }
+        if (texture != nullptr && texture >= textures.data() && texture < textures.data() + textures.size() &&
+            static_cast<size_t>(texture - textures.data()) < textureGuids.size()) {
+            return textureGuids[texture - textures.data()];
+        }
+        return invalidGuid;
+    }
+
+    void Model::refreshMaterialDescriptors() {
+        for (auto &material: materials) {
+            if (material.resourceGuid != invalidGuid) {
+                material.descriptorSet = resourceManager->getMaterialDescriptorSet(material.resourceGuid);
+            }
+        }
+    }
+
+    void Model::requestTextureResolution(TextureStreamer &streamer, const TextureStreamingView &view,
+                                         const glm::vec3 &offset) {
+        for (Node *node: linearNodes) {
+            if (!node->mesh) {
+                continue;
+            }
+            // 和LOD选择一样，没有预变换时先把包围球变换到模型空间
+            const bool transform = !(fileLoadingFlags & FileLoadingFlags::PreTransformVertices);
+            glm::mat4 nodeMatrix(1.0f);
+            float radiusScale = 1.0f;
+            if (transform) {
+                nodeMatrix = node->getMatrix();
+                radiusScale = std::max(glm::length(glm::vec3(nodeMatrix[0])),
+                                       std::max(glm::length(glm::vec3(nodeMatrix[1])),
+                                                glm::length(glm::vec3(nodeMatrix[2]))));
+            }
+            for (Primitive *primitive: node->mesh->primitives) {
+                glm::vec3 center = primitive->boundsCenter;
+                if (transform) {
+                    center = glm::vec3(nodeMatrix * glm::vec4(center, 1.0f));
                 }
-                if (descriptorBindingFlags & DescriptorBindingFlags::ImageNormalMap) {
-                    setLayoutBindings.push_back(
-                            CreateDescriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
-                                                             VK_SHADER_STAGE_FRAGMENT_BIT,
-                                                             static_cast<uint32_t>(setLayoutBindings.size())));
+                center += offset;
+                const float radius = primitive->boundsRadius * radiusScale;
+                if (!view.isVisible(center, radius)) {
+                    continue;
                 }
-                VkDescriptorSetLayoutCreateInfo descriptorLayoutCI{};
-                descriptorLayoutCI.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
-                descriptorLayoutCI.bindingCount = static_cast<uint32_t>(setLayoutBindings.size());
-                descriptorLayoutCI.pBindings = setLayoutBindings.data();
-                device->CreateDescriptorSetLayout(&descriptorLayoutCI, &descriptorSetLayoutImage);
-            }
-            for (auto &material: materials) {
-                if (material.baseColorTexture != nullptr) {
-                    material.createDescriptorSet(descriptorSetLayoutImage, descriptorBindingFlags);
+                const float pixels = view.projectedDiameter(center, radius);
+                const Material &material = primitive->material;
+                for (const Texture *texture: {material.baseColorTexture, material.normalTexture,
+                                              material.metallicRoughnessTexture, material.occlusionTexture,
+                                              material.emissiveTexture}) {
+                    const size_t guid = getTextureGuid(texture);
+                    if (guid != invalidGuid) {
+                        streamer.requestResolution(guid, pixels);
+                    }
                 }
             }
         }
-#if USE_MESH_SHADER
-        {
-            if (descriptorSetLayoutMeshlet == VK_NULL_HANDLE && bUseMeshShader) {
-                createMeshletBuffer();
-                std::vector<VkDescriptorSetLayoutBinding> setLayoutBindings{};
-                    setLayoutBindings.push_back(
-                            CreateDescriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_MESH_BIT_NV, 0));
-                VkDescriptorSetLayoutCreateInfo descriptorLayoutCI{};
-                descriptorLayoutCI.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
-                descriptorLayoutCI.bindingCount = static_cast<uint32_t>(setLayoutBindings.size());
-                descriptorLayoutCI.pBindings = setLayoutBindings.data();
-                device->CreateDescriptorSetLayout(&descriptorLayoutCI, &descriptorSetLayoutMeshlet);
-                device->CreateDescriptorSet(1, descriptorSetLayoutMeshlet, meshBuffer.descriptorSet);
-
-                VkDescriptorBufferInfo MeshletBufferInfo{};
-                MeshletBufferInfo.buffer = meshBuffer.buffer.buffer;
-                MeshletBufferInfo.offset = 0;
-                MeshletBufferInfo.range = sizeof(Meshlet) * meshlets.size();
-                std::array<VkWriteDescriptorSet, 1> descriptorWrites{};
-                descriptorWrites[0].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-                descriptorWrites[0].dstSet = meshBuffer.descriptorSet;
-                descriptorWrites[0].dstBinding = 0;
-                descriptorWrites[0].dstArrayElement = 0;
-                descriptorWrites[0].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
-                descriptorWrites[0].descriptorCount = 1;
-                descriptorWrites[0].pBufferInfo = &MeshletBufferInfo;
-
-                device->UpdateDescriptorSets(descriptorWrites.size(), descriptorWrites.data());
-            }
-        }
+    }
 
-        {
-            if (descriptorSetLayoutVertexStorage == VK_NULL_HANDLE && bUseMeshShader) {
-                std::vector<VkDescriptorSetLayoutBinding> setLayoutBindings{};
-                setLayoutBindings.push_back(
-                        CreateDescriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_MESH_BIT_NV, 0));
-                VkDescriptorSetLayoutCreateInfo descriptorLayoutCI{};
-                descriptorLayoutCI.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
-                descriptorLayoutCI.bindingCount = static_cast<uint32_t>(setLayoutBindings.size());
-                descriptorLayoutCI.pBindings = setLayoutBindings.data();
-                device->CreateDescriptorSetLayout(&descriptorLayoutCI, &descriptorSetLayoutVertexStorage);
-                device->CreateDescriptorSet(1, descriptorSetLayoutMeshlet, this->vertexBuffer.descriptorSet);
-
-                VkDescriptorBufferInfo VertexBufferInfo{};
-                VertexBufferInfo.buffer = this->vertexBuffer.buffer.buffer;
-                VertexBufferInfo.offset = 0;
-                VertexBufferInfo.range = meshVertexBufferSize;
-                std::array<VkWriteDescriptorSet, 1> descriptorWrites{};
-                descriptorWrites[0].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-                descriptorWrites[0].dstSet = this->vertexBuffer.descriptorSet;
-                descriptorWrites[0].dstBinding = 0;
-                descriptorWrites[0].dstArrayElement = 0;
-                descriptorWrites[0].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
-                descriptorWrites[0].descriptorCount = 1;
-                descriptorWrites[0].pBufferInfo = &VertexBufferInfo;
-
-                device->UpdateDescriptorSets(descriptorWrites.size(), descriptorWrites.data());
+    void Model::updateVirtualTextureIndices(const VirtualTexture &virtualTexture) {
+        for (auto &material: materials) {
+            const size_t guid = getTextureGuid(material.baseColorTexture);
+            material.virtualTexture = guid != invalidGuid ? virtualTexture.getTextureIndex(guid)
+                                                          : VirtualTexture::invalidIndex;
+        }
+    }
 
+    bool Model::getMaterialSource(const Material &material, MaterialSource &materialSource) {
+        bool managed = true;
+        auto textureGuid = [&](const Texture *texture) -> size_t {
+            if (texture == nullptr) {
+                return invalidGuid;
             }
-        }
-#endif
+            const size_t guid = getTextureGuid(texture);
+            managed = managed && guid != invalidGuid;
+            return guid;
+        };
+        materialSource.baseColorTexture = textureGuid(material.baseColorTexture);
+        materialSource.metallicRoughnessTexture = textureGuid(material.metallicRoughnessTexture);
+        materialSource.normalTexture = textureGuid(material.normalTexture);
+        materialSource.occlusionTexture = textureGuid(material.occlusionTexture);
+        materialSource.emissiveTexture = textureGuid(material.emissiveTexture);
+        materialSource.baseColorFactor = material.baseColorFactor;
+        materialSource.metallicFactor = material.metallicFactor;
+        materialSource.roughnessFactor = material.roughnessFactor;
+        materialSource.alphaCutoff = material.alphaCutoff;
+        materialSource.alphaMode = static_cast<uint32_t>(material.alphaMode);
+        return managed;
     }
 
     void Model::bindBuffers(VkCommandBuffer commandBuffer) {
@@ -1517,8 +2911,16 @@ namespace MW {
     }
 
     void Model::drawNode(Node *node, VkCommandBuffer commandBuffer, uint32_t renderFlags,
-                         VkPipelineLayout pipelineLayout, uint32_t bindImageSet) {
+                         VkPipelineLayout pipelineLayout, uint32_t bindImageSet, const LodSelection *lodSelection,
+                         const LayerSelection *layerSelection) {
         if (node->mesh) {
+            // 没有预变换时顶点还在节点空间，选LOD前要先变换包围球
+            glm::mat4 nodeMatrix;
+            const glm::mat4 *lodMatrix = nullptr;
+            if (lodSelection && !(fileLoadingFlags & FileLoadingFlags::PreTransformVertices)) {
+                nodeMatrix = node->getMatrix();
+                lodMatrix = &nodeMatrix;
+            }
             for (Primitive *primitive: node->mesh->primitives) {
                 bool skip = false;
                 const Material &material = primitive->material;
@@ -1531,38 +2933,79 @@ namespace MW {
                 if (renderFlags & RenderFlags::RenderAlphaBlendedNodes) {
                     skip = (material.alphaMode != Material::ALPHAMODE_BLEND);
                 }
+                // 分层绘制时只实例化到包围球覆盖的层，LOD按其中最靠前的一层选择
+                uint32_t layerInstances = 1;
+                uint32_t packedLayers = 0;
+                const LodSelection *primitiveLodSelection = lodSelection;
+                if (!skip && layerSelection) {
+                    uint32_t firstLayer;
+                    packedLayers = layerSelection->overlappedLayers(primitive->boundsCenter, primitive->boundsRadius,
+                                                                    layerInstances, firstLayer);
+                    skip = layerInstances == 0;
+                    if (!skip) {
+                        primitiveLodSelection = &layerSelection->lodSelections[firstLayer];
+                    }
+                }
                 if (!skip) {
+                    if (layerSelection) {
+                        vkCmdPushConstants(commandBuffer, pipelineLayout, VK_SHADER_STAGE_VERTEX_BIT,
+                                           layerPushConstantOffset, sizeof(packedLayers), &packedLayers);
+                    }
                     if (renderFlags & RenderFlags::BindImages) {
+                        const VkDescriptorSet imageSet = material.descriptorSet != VK_NULL_HANDLE
+                                                         ? material.descriptorSet : placeholderDescriptorSet;
                         vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout,
-                                                bindImageSet, 1, &material.descriptorSet, 0, nullptr);
+                                                bindImageSet, 1, &imageSet, 0, nullptr);
+                    }
+                    if (renderFlags & RenderFlags::PushVirtualTexture) {
+                        vkCmdPushConstants(commandBuffer, pipelineLayout, VK_SHADER_STAGE_FRAGMENT_BIT,
+                                           virtualTexturePushConstantOffset, sizeof(material.virtualTexture),
+                                           &material.virtualTexture);
                     }
+                    const Primitive::Lod &lod = primitive->selectLod(primitiveLodSelection, lodMatrix);
+                    const bool cullMeshlets = renderFlags & RenderFlags::CullMeshlets;
+                    const VkShaderStageFlags meshStages = cullMeshlets ? VK_SHADER_STAGE_TASK_BIT_NV |
+                                                                         VK_SHADER_STAGE_MESH_BIT_NV
+                                                                       : VK_SHADER_STAGE_MESH_BIT_NV;
                     if(bUseMeshShader) { // 使用Mesh Shader情况下用自身的push constant
-                        vkCmdPushConstants(commandBuffer, pipelineLayout,
-                                           bUseMeshShader ? VK_SHADER_STAGE_MESH_BIT_NV : VK_SHADER_STAGE_VERTEX_BIT, 0,
-                                           sizeof(primitive->pushConstantBlock),
-                                           &primitive->pushConstantBlock);
+                        Primitive::PushConstantBlock pushConstantBlock = primitive->pushConstantBlock;
+#if USE_MESH_SHADER && EXT_MESH_SHADER
+                        pushConstantBlock.offsetIndex = lod.firstMeshlet;
+#endif
+                        vkCmdPushConstants(commandBuffer, pipelineLayout, meshStages, 0,
+                                           sizeof(pushConstantBlock),
+                                           &pushConstantBlock);
                     }
 #if USE_MESH_SHADER
-                    if (bUseMeshShader && primitive->meshletsCount > 0) {
+                    if (bUseMeshShader && lod.meshletsCount > 0) {
+                        if (cullMeshlets) {
+                            vkCmdPushConstants(commandBuffer, pipelineLayout, meshStages,
+                                               meshletCountPushConstantOffset, sizeof(lod.meshletsCount),
+                                               &lod.meshletsCount);
+                        }
+                        // 裁剪时一个task workgroup负责meshletsPerTask个meshlet
+                        const uint32_t taskCount = cullMeshlets ? (lod.meshletsCount + meshletsPerTask - 1) /
+                                                                  meshletsPerTask
+                                                                : lod.meshletsCount;
 #if NV_MESH_SHADER
-                        device->vkCmdDrawMeshTasksNV(commandBuffer, primitive->meshletsCount, primitive->firstMeshlet);
+                        device->vkCmdDrawMeshTasksNV(commandBuffer, taskCount, lod.firstMeshlet);
 #elif EXT_MESH_SHADER
-                        device->vkCmdDrawMeshTasksEXT(commandBuffer, primitive->meshletsCount, 1, 1);
+                        device->vkCmdDrawMeshTasksEXT(commandBuffer, taskCount, 1, 1);
 #endif
                     }
 #endif
                     if(!bUseMeshShader)
-                        vkCmdDrawIndexed(commandBuffer, primitive->indexCount, 1, primitive->firstIndex, 0, 0);
+                        vkCmdDrawIndexed(commandBuffer, lod.indexCount, layerInstances, lod.firstIndex, 0, 0);
                 }
             }
         }
         for (auto &child: node->children) {
-            drawNode(child, commandBuffer, renderFlags, pipelineLayout, bindImageSet);
+            drawNode(child, commandBuffer, renderFlags, pipelineLayout, bindImageSet, lodSelection, layerSelection);
         }
     }
 
     void Model::draw(VkCommandBuffer commandBuffer, uint32_t renderFlags, VkPipelineLayout pipelineLayout,
-                     uint32_t bindImageSet) {
+                     uint32_t bindImageSet, const LodSelection *lodSelection, const LayerSelection *layerSelection) {
         if (!buffersBound) {
             const VkDeviceSize offsets[1] = {0};
             if(!bUseMeshShader) {
@@ -1579,7 +3022,7 @@ namespace MW {
 #endif
         }
         for (auto &node: nodes) {
-            drawNode(node, commandBuffer, renderFlags, pipelineLayout, bindImageSet);
+            drawNode(node, commandBuffer, renderFlags, pipelineLayout, bindImageSet, lodSelection, layerSelection);
         }
     }
 
@@ -1717,53 +3160,112 @@ namespace MW {
 
 #if USE_MESH_SHADER
     // https://zhuanlan.zhihu.com/p/110404763
-    void Primitive::addMeshlets(std::vector<Meshlet> &meshlets, const std::vector<uint32_t> &indexBuffer) {
-        firstMeshlet = meshlets.size();
-//        for (auto &primitive: primitives) {
-        Meshlet meshlet = {};
-        std::vector<uint8_t> meshletVertices(indexCount, 0xff);
-        // 离散化
-        std::map<int, int> meshIndex2LocalIndex;
-        std::map<int, int> localIndex2MeshIndex;
-        std::vector<int> localIndices;
-        for (int i = firstIndex; i < firstIndex + indexCount; ++i) {
-            int id = indexBuffer[i];
-            if (meshIndex2LocalIndex.find(id) == meshIndex2LocalIndex.end()) {
-                meshIndex2LocalIndex[id] = localIndices.size();
-                localIndex2MeshIndex[localIndices.size()] = id;
-                localIndices.emplace_back(id);
-            }
-        }
-        for (size_t i = firstIndex; i < firstIndex + indexCount; i += 3) {
-            unsigned int triangleIndices[3];
-            for (int j = 0; j < 3; ++j)
-                triangleIndices[j] = meshIndex2LocalIndex[indexBuffer[i + j]];
-            uint8_t *meshletLocalIndex[3];
-            for (int j = 0; j < 3; ++j)
-                meshletLocalIndex[j] = &meshletVertices[triangleIndices[j]];
-            uint32_t nowVertexCount = meshlet.vertexCount;
-            for (int j = 0; j < 3; ++j)
-                nowVertexCount += (*meshletLocalIndex[j] == 0xff);
-            if (nowVertexCount > Meshlet::MAX_VERTICES ||
-                meshlet.indexCount + 3 > Meshlet::MAX_INDICES) {
-                meshlets.push_back(meshlet);
-                for (size_t j = 0; j < meshlet.vertexCount; ++j)
-                    meshletVertices[meshIndex2LocalIndex[meshlet.vertices[j]]] = 0xff;
-                meshlet = {};
-            }
-            for (int j = 0; j < 3; ++j) {
-                if (*meshletLocalIndex[j] == 0xff) {
-                    *meshletLocalIndex[j] = meshlet.vertexCount;
-                    meshlet.vertices[meshlet.vertexCount++] = localIndex2MeshIndex[triangleIndices[j]];
-                }
-                meshlet.indices[meshlet.indexCount++] = *meshletLocalIndex[j];
+    static void computeMeshletBounds(Meshlet &meshlet, const gltfVertex *vertexBuffer) {
+        glm::vec3 boundsMin(FLT_MAX);
+        glm::vec3 boundsMax(-FLT_MAX);
+        for (uint32_t i = 0; i < meshlet.vertexCount; ++i) {
+            boundsMin = glm::min(boundsMin, vertexBuffer[meshlet.vertices[i]].pos);
+            boundsMax = glm::max(boundsMax, vertexBuffer[meshlet.vertices[i]].pos);
+        }
+        const glm::vec3 center = (boundsMin + boundsMax) * 0.5f;
+        float radius = 0.0f;
+        for (uint32_t i = 0; i < meshlet.vertexCount; ++i) {
+            radius = std::max(radius, glm::distance(center, vertexBuffer[meshlet.vertices[i]].pos));
+        }
+        meshlet.bounds = glm::vec4(center, radius);
+
+        // 法线取三角形的几何法线，方向和顶点法线一致，FlipY等改变了绕序时也成立
+        std::vector<glm::vec3> normals;
+        normals.reserve(meshlet.indexCount / 3);
+        glm::vec3 axis(0.0f);
+        for (uint32_t i = 0; i + 2 < meshlet.indexCount; i += 3) {
+            const gltfVertex &v0 = vertexBuffer[meshlet.vertices[meshlet.indices[i]]];
+            const gltfVertex &v1 = vertexBuffer[meshlet.vertices[meshlet.indices[i + 1]]];
+            const gltfVertex &v2 = vertexBuffer[meshlet.vertices[meshlet.indices[i + 2]]];
+            glm::vec3 normal = glm::cross(v1.pos - v0.pos, v2.pos - v0.pos);
+            const float length = glm::length(normal);
+            if (length <= 1e-12f) {
+                continue;
+            }
+            normal /= length;
+            if (glm::dot(normal, v0.normal + v1.normal + v2.normal) < 0.0f) {
+                normal = -normal;
             }
+            normals.push_back(normal);
+            axis += normal;
         }
-        if (meshlet.indexCount) {
-            meshlets.push_back(meshlet);
+        meshlet.cone = glm::vec4(0.0f, 0.0f, 1.0f, 1.0f);
+        const float axisLength = glm::length(axis);
+        if (normals.empty() || axisLength <= 1e-6f) {
+            return;
         }
-//        }
-        meshletsCount = meshlets.size() - firstMeshlet;
+        axis /= axisLength;
+        float minDot = 1.0f;
+        for (const glm::vec3 &normal: normals) {
+            minDot = std::min(minDot, glm::dot(axis, normal));
+        }
+        // 法线张开接近半球时几乎不可能整体背向，不做剔除
+        if (minDot > 0.1f) {
+            meshlet.cone = glm::vec4(axis, std::sqrt(1.0f - minDot * minDot));
+        }
+    }
+
+    void Primitive::addMeshlets(std::vector<Meshlet> &meshlets, const std::vector<uint32_t> &indexBuffer,
+                                const gltfVertex *vertexBuffer) {
+        // 每一级LOD各自生成一段连续的meshlet
+        for (Lod &lod: lods) {
+            lod.firstMeshlet = meshlets.size();
+            const uint32_t lodFirstIndex = lod.firstIndex;
+            const uint32_t lodIndexCount = lod.indexCount;
+            Meshlet meshlet = {};
+            std::vector<uint8_t> meshletVertices(lodIndexCount, 0xff);
+            // 离散化
+            std::map<int, int> meshIndex2LocalIndex;
+            std::map<int, int> localIndex2MeshIndex;
+            std::vector<int> localIndices;
+            for (int i = lodFirstIndex; i < lodFirstIndex + lodIndexCount; ++i) {
+                int id = indexBuffer[i];
+                if (meshIndex2LocalIndex.find(id) == meshIndex2LocalIndex.end()) {
+                    meshIndex2LocalIndex[id] = localIndices.size();
+                    localIndex2MeshIndex[localIndices.size()] = id;
+                    localIndices.emplace_back(id);
+                }
+            }
+            for (size_t i = lodFirstIndex; i < lodFirstIndex + lodIndexCount; i += 3) {
+                unsigned int triangleIndices[3];
+                for (int j = 0; j < 3; ++j)
+                    triangleIndices[j] = meshIndex2LocalIndex[indexBuffer[i + j]];
+                uint8_t *meshletLocalIndex[3];
+                for (int j = 0; j < 3; ++j)
+                    meshletLocalIndex[j] = &meshletVertices[triangleIndices[j]];
+                uint32_t nowVertexCount = meshlet.vertexCount;
+                for (int j = 0; j < 3; ++j)
+                    nowVertexCount += (*meshletLocalIndex[j] == 0xff);
+                if (nowVertexCount > Meshlet::MAX_VERTICES ||
+                    meshlet.indexCount + 3 > Meshlet::MAX_INDICES) {
+                    meshlets.push_back(meshlet);
+                    for (size_t j = 0; j < meshlet.vertexCount; ++j)
+                        meshletVertices[meshIndex2LocalIndex[meshlet.vertices[j]]] = 0xff;
+                    meshlet = {};
+                }
+                for (int j = 0; j < 3; ++j) {
+                    if (*meshletLocalIndex[j] == 0xff) {
+                        *meshletLocalIndex[j] = meshlet.vertexCount;
+                        meshlet.vertices[meshlet.vertexCount++] = localIndex2MeshIndex[triangleIndices[j]];
+                    }
+                    meshlet.indices[meshlet.indexCount++] = *meshletLocalIndex[j];
+                }
+            }
+            if (meshlet.indexCount) {
+                meshlets.push_back(meshlet);
+            }
+            lod.meshletsCount = meshlets.size() - lod.firstMeshlet;
+            for (size_t i = lod.firstMeshlet; i < meshlets.size(); ++i) {
+                computeMeshletBounds(meshlets[i], vertexBuffer);
+            }
+        }
+        firstMeshlet = lods[0].firstMeshlet;
+        meshletsCount = lods[0].meshletsCount;
     }
 
     void Model::createMeshletBuffer()
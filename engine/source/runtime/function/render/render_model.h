@@ -8,6 +8,7 @@
 
 #pragma once
 
+#include <atomic>
 #include <cstdlib>
 #include <string>
 #include <fstream>
@@ -15,6 +16,10 @@
 
 #include "vulkan/vulkan.h"
 #include "function/render/rhi/vulkan_device.h"
+#include "function/render/mesh_optimizer.h"
+#include "function/render/model_cache.h"
+#include "function/render/render_type.h"
+#include "function/render/texture_compressor.h"
 #include <ktx.h>
 #include <ktxvulkan.h>
 #define GLM_FORCE_RADIANS
@@ -48,6 +53,10 @@ namespace MW
     extern uint32_t descriptorBindingFlags;
 
     struct Node;
+    class RenderResource;
+    class TextureStreamer;
+    struct TextureStreamingView;
+    class VirtualTexture;
 
     /*
         glTF texture loading class
@@ -67,6 +76,15 @@ namespace MW
         void updateDescriptor();
         void destroy();
         void fromglTfImage(tinygltf::Image& gltfimage, std::string path, VulkanDevice* device);
+        // component为3时上传前展开为RGBA
+        void fromPixels(const unsigned char* pixels, uint32_t pixelWidth, uint32_t pixelHeight, uint32_t component, VulkanDevice* device);
+        // 上传CPU上已经生成好的RGBA8 mip链，levels[0]的尺寸为levelWidth x levelHeight
+        void fromMipChain(const std::vector<std::vector<unsigned char>>& levels, uint32_t levelWidth, uint32_t levelHeight, VulkanDevice* device);
+        // 上传块压缩的mip链，components把压缩格式的通道映射回shader期望的通道
+        void fromCompressedImage(const CompressedImage& compressedImage, VkComponentMapping components, VulkanDevice* device);
+        void fromLevels(VkFormat format, const std::vector<std::vector<unsigned char>>& levels, uint32_t levelWidth, uint32_t levelHeight,
+                        VkComponentMapping components, VulkanDevice* device);
+        void createSamplerAndView(VkFormat format, VkComponentMapping components = {});
     };
 #if USE_MESH_SHADER
     struct Meshlet
@@ -78,6 +96,9 @@ namespace MW
         uint32_t indices[MAX_INDICES]; // 局部IndexBuffer
         uint32_t indexCount;
         uint32_t vertexCount;
+        glm::vec4 bounds; // 顶点buffer空间下的包围球，w为半径
+        // 三角形法线的锥，w为cutoff，视线方向和轴的点积不小于cutoff时所有三角形都是背面；为1时不做背面剔除
+        glm::vec4 cone;
     };
     struct MeshVertex
     {
@@ -117,11 +138,51 @@ namespace MW
         Texture* diffuseTexture;
 
         VkDescriptorSet descriptorSet = VK_NULL_HANDLE;
+        // 基础色在虚拟贴图中的序号，~0u表示使用baseColorTexture
+        uint32_t virtualTexture = ~0u;
+        // 由RenderResource共享时descriptorSet属于RenderResource
+        size_t resourceGuid = 0;
 
         Material(VulkanDevice* device) : device(device) {};
         void createDescriptorSet(VkDescriptorSetLayout descriptorSetLayout, uint32_t descriptorBindingFlags);
     };
 
+    /*
+        Per-view LOD selection parameters, projected errors are compared against errorThreshold
+    */
+    struct LodSelection {
+        glm::vec3 viewPosition{0.0f};
+        // 透视投影: 视口高度/(2*tan(fovy/2))；正交投影: 每单位长度对应的像素数
+        float projectionScale{0.0f};
+        float errorThreshold{1.0f};
+        bool orthographic{false};
+
+        static LodSelection fromPerspective(const glm::mat4& view, const glm::mat4& projection, float viewportHeight, float errorThreshold);
+        static LodSelection fromOrthographic(const glm::mat4& viewProjection, float viewportWidth, float errorThreshold);
+        float projectedError(float error, const glm::vec3& center, float radius) const;
+    };
+
+    /*
+        Per-layer culling for layered rendering, a primitive is instanced once for every layer its bounds overlap
+    */
+    struct LayerSelection {
+        static constexpr uint32_t maxLayers = 8;
+
+        uint32_t layerCount{0};
+        uint32_t layers[maxLayers]{};
+        // 每层的左右上下和远平面，法线指向内侧
+        glm::vec4 planes[maxLayers][5];
+        LodSelection lodSelections[maxLayers];
+
+        void addLayer(uint32_t layer, const glm::mat4& viewProjection, const LodSelection& lodSelection);
+        // 场景中模型通过push constant平移，把平面和LOD视点变换到模型空间
+        void translate(const glm::vec3& offset);
+        // 返回包围球覆盖的层，按实例序号每4位打包一个layer，count为层数，first为第一个覆盖层在layers中的序号
+        uint32_t overlappedLayers(const glm::vec3& center, float radius, uint32_t& count, uint32_t& first) const;
+    };
+
+    struct gltfVertex;
+
     /*
         glTF primitive
     */
@@ -140,8 +201,26 @@ namespace MW
 #if USE_MESH_SHADER
         uint32_t firstMeshlet{0};
         uint32_t meshletsCount{0};
-        void addMeshlets(std::vector<Meshlet>&meshlets,const std::vector<uint32_t>&indexBuffer);
+        void addMeshlets(std::vector<Meshlet>&meshlets,const std::vector<uint32_t>&indexBuffer,
+                         const gltfVertex *vertexBuffer);
 #endif
+        struct Lod {
+            uint32_t firstIndex;
+            uint32_t indexCount;
+            float error{0.0f}; // 顶点空间下的几何误差
+#if USE_MESH_SHADER
+            uint32_t firstMeshlet{0};
+            uint32_t meshletsCount{0};
+#endif
+        };
+        std::vector<Lod> lods; // lods[0]为原始网格，误差逐级增大
+
+        // 顶点buffer空间下的包围球，用于LOD选择
+        glm::vec3 boundsCenter{0.0f};
+        float boundsRadius{0.0f};
+
+        const Lod& selectLod(const LodSelection* selection, const glm::mat4* matrix = nullptr) const;
+
         struct Dimensions {
             glm::vec3 min = glm::vec3(FLT_MAX);
             glm::vec3 max = glm::vec3(-FLT_MAX);
@@ -151,7 +230,9 @@ namespace MW
         } dimensions;
 
         void setDimensions(glm::vec3 min, glm::vec3 max);
-        Primitive(uint32_t firstIndex, uint32_t indexCount, Material& material) : firstIndex(firstIndex), indexCount(indexCount), material(material) {};
+        Primitive(uint32_t firstIndex, uint32_t indexCount, Material& material) : firstIndex(firstIndex), indexCount(indexCount), material(material) {
+            lods.push_back({firstIndex, indexCount, 0.0f});
+        };
     };
 
     /*
@@ -271,16 +352,35 @@ namespace MW
         PreTransformVertices = 0x00000001,
         PreMultiplyVertexColors = 0x00000002,
         FlipY = 0x00000004,
-        DontLoadImages = 0x00000008
+        DontLoadImages = 0x00000008,
+        OptimizeMeshes = 0x00000010,
+        GenerateLods = 0x00000020,
+        UseModelCache = 0x00000040,
+        // png/jpg按材质中的用途压缩为BC7/BC5/BC4，结果缓存为KTX2
+        CompressTextures = 0x00000080
     };
 
     enum RenderFlags {
         BindImages = 0x00000001,
         RenderOpaqueNodes = 0x00000002,
         RenderAlphaMaskedNodes = 0x00000004,
-        RenderAlphaBlendedNodes = 0x00000008
+        RenderAlphaBlendedNodes = 0x00000008,
+        // 在fragment stage的virtualTexturePushConstantOffset写入材质的虚拟贴图序号
+        PushVirtualTexture = 0x00000010,
+        // 由SceneManager按模型是否为动态物体筛选，都不设置时绘制全部模型
+        RenderStaticModels = 0x00000020,
+        RenderDynamicModels = 0x00000040,
+        // mesh shader绘制时由task shader逐meshlet裁剪(只支持EXT_MESH_SHADER)，每个task workgroup处理
+        // meshletsPerTask个meshlet，并在task和mesh stage的meshletCountPushConstantOffset写入这一级LOD的meshlet数量
+        CullMeshlets = 0x00000080
     };
 
+    static const uint32_t virtualTexturePushConstantOffset = 16;
+    // 分层绘制时在vertex stage的layerPushConstantOffset写入打包后的layer
+    static const uint32_t layerPushConstantOffset = 12;
+    static const uint32_t meshletCountPushConstantOffset = 16;
+    static const uint32_t meshletsPerTask = 32;
+
     /*
         glTF model loading and rendering class
     */
@@ -289,8 +389,38 @@ namespace MW
         Texture* getTexture(uint32_t index);
         Texture emptyTexture;
         void createEmptyTexture();
+        // 延迟加载贴图期间材质使用的占位贴图
+        Texture placeholderBaseColorTexture;
+        Texture placeholderNormalTexture;
+        VkDescriptorSet placeholderDescriptorSet{VK_NULL_HANDLE};
+        std::atomic<bool> imagesPending{false};
+        std::vector<tinygltf::Image> pendingImages;
+        size_t meshVertexBufferSize{0};
+        void uploadImages(std::vector<tinygltf::Image>& images, VulkanDevice* device);
+        // 按用途把图片压缩成KTX2缓存，已有的跳过，outputs加入缓存文件的路径
+        void cookImages(std::vector<tinygltf::Image>& images, std::vector<std::string>& outputs);
+        // 从RenderResource获得的资源guid，0表示由模型自己持有
+        std::vector<size_t> textureGuids;
+        // 每张图片在材质中的用途，CompressTextures时决定压缩格式
+        std::vector<TextureUsage> imageUsages;
+        // 被材质用作基础色的图片，可以交给虚拟贴图
+        std::vector<char> baseColorImages;
+        void collectImageUsages(const tinygltf::Model& gltfModel);
+        std::string getCompressedCachePath(const tinygltf::Image& image, uint32_t index, uint64_t contentHash) const;
+        size_t emptyTextureGuid{0};
+        size_t meshGuid{0};
+        size_t getTextureGuid(const Texture* texture);
+        bool getMaterialSource(const Material& material, MaterialSource& materialSource);
+        std::vector<VulkanBuffer> getMeshBuffers();
+        void setMeshBuffers(const std::vector<VulkanBuffer>& buffers);
     public:
         VulkanDevice* device;
+        // 不为空时贴图、材质和顶点数据通过RenderResource按内容去重
+        RenderResource* resourceManager{nullptr};
+        // 不为空时大贴图只先上传低分辨率mip，高分辨率mip之后按屏幕尺寸流送，需要resourceManager
+        TextureStreamer* textureStreamer{nullptr};
+        // 不为空时流送的基础色贴图改由虚拟贴图按页驻留，需要textureStreamer
+        VirtualTexture* virtualTexture{nullptr};
 
         struct Vertices {
             int count;
@@ -329,6 +459,17 @@ namespace MW
         bool metallicRoughnessWorkflow = true;
         bool buffersBound = false;
         std::string path;
+        uint32_t fileLoadingFlags{FileLoadingFlags::None};
+        // 已解码但尚未上传的图片数据上限
+        size_t maxInFlightImageBytes{256ull * 1024 * 1024};
+        // 为true时loadResources只记录图片，由loadPendingImages稍后解码上传
+        bool deferImageLoading{false};
+
+        // OptimizeMeshes前后所有primitive的post-transform cache统计
+        struct MeshOptimizationStatistics {
+            VertexCacheStatistics before;
+            VertexCacheStatistics after;
+        } meshOptimizationStatistics;
 
         Model() {};
 #if USE_MESH_SHADER
@@ -336,15 +477,56 @@ namespace MW
 #endif
         ~Model();
         void clean();
-        void loadNode(Node* parent, const tinygltf::Node& node, uint32_t nodeIndex, const tinygltf::Model& model, std::vector<uint32_t>& indexBuffer, std::vector<gltfVertex>& vertexBuffer, float globalscale);
+        // 单个primitive的读取任务，indices中的firstIndex相对于本任务
+        struct PrimitiveLoadJob {
+            Primitive* primitive = nullptr;
+            Node* node = nullptr;
+            const tinygltf::Primitive* source = nullptr;
+            std::vector<uint32_t> indices;
+#if USE_MESH_SHADER
+            std::vector<Meshlet> meshlets;
+#endif
+            MeshOptimizationStatistics statistics;
+        };
+
+        void loadNode(Node* parent, const tinygltf::Node& node, uint32_t nodeIndex, const tinygltf::Model& model, std::vector<PrimitiveLoadJob>& primitiveJobs, uint32_t& vertexCount, float globalscale);
+        void loadPrimitive(PrimitiveLoadJob& job, const tinygltf::Model& model, gltfVertex* vertexBuffer);
+        void loadPrimitives(const tinygltf::Model& model, std::vector<PrimitiveLoadJob>& primitiveJobs, std::vector<uint32_t>& indexBuffer, gltfVertex* vertexBuffer);
+        void optimizePrimitive(std::vector<uint32_t>& primitiveIndices, gltfVertex* primitiveVertices, uint32_t vertexCount, MeshOptimizationStatistics& statistics);
+        void generateLods(Primitive* primitive, const std::vector<uint32_t>& primitiveIndices, std::vector<uint32_t>& indexBuffer, const gltfVertex* primitiveVertices);
         void loadSkins(tinygltf::Model& gltfModel);
         void loadImages(tinygltf::Model& gltfModel, VulkanDevice* device);
+        void loadImages(std::vector<tinygltf::Image>& images, VulkanDevice* device);
         void loadMaterials(tinygltf::Model& gltfModel);
         void loadAnimations(tinygltf::Model& gltfModel);
         void loadFromFile(std::string filename, VulkanDevice* device, uint32_t fileLoadingFlags = FileLoadingFlags::None, float scale = 1.0f);
+        // 读取文件并上传顶点、索引和贴图，不创建descriptor，可以在后台线程调用
+        bool loadResources(std::string filename, VulkanDevice* device, uint32_t fileLoadingFlags = FileLoadingFlags::None, float scale = 1.0f);
+        // 离线烘焙(MWCooker)：生成和loadResources相同的模型缓存并压缩贴图，不创建任何GPU资源。
+        // dependencies为源文件引用的其他文件(相对源文件目录)，outputs为生成的文件
+        bool cook(const std::string& filename, uint32_t fileLoadingFlags, float scale,
+                  std::vector<std::string>& dependencies, std::vector<std::string>& outputs);
+        void loadPendingImages();
+        bool hasPendingImages() const { return imagesPending.load(); }
+        // descriptor pool不是线程安全的，只能在主线程调用
+        static void createDescriptorSetLayouts(VulkanDevice* device);
+        void setupDescriptors();
+        void setupMaterialDescriptors();
+        // 材质的descriptor set被RenderResource替换后重新获取
+        void refreshMaterialDescriptors();
+        // 按可见primitive在屏幕上的尺寸请求贴图分辨率，offset为模型的平移
+        void requestTextureResolution(TextureStreamer& streamer, const TextureStreamingView& view, const glm::vec3& offset);
+        // 虚拟贴图登记了新的贴图后重新获取材质的序号
+        void updateVirtualTextureIndices(const VirtualTexture& virtualTexture);
+        bool loadFromCache(ModelCache& cache, const std::string& cachePath, const std::string& filename, uint32_t cacheKey);
+        void writeCache(const std::string& cachePath, const std::string& filename, uint32_t cacheKey, const tinygltf::Model& gltfModel,
+                        const gltfVertex* vertexData, size_t vertexCount, const std::vector<uint32_t>& indexBuffer, const void* meshVertexData, size_t meshVertexBufferSize);
+        // vertexStaging不为空时vertexData就是它映射的内存，顶点已经解码在staging中，不再拷贝
+        void createBuffers(const gltfVertex* vertexData, size_t vertexCount, const uint32_t* indexData, size_t indexCount,
+                           const void* meshVertexData, size_t meshVertexBufferSize, VulkanBuffer* vertexStaging = nullptr);
         void bindBuffers(VkCommandBuffer commandBuffer);
-        void drawNode(Node* node, VkCommandBuffer commandBuffer, uint32_t renderFlags = 0, VkPipelineLayout pipelineLayout = VK_NULL_HANDLE, uint32_t bindImageSet = 1);
-        void draw(VkCommandBuffer commandBuffer, uint32_t renderFlags = 0, VkPipelineLayout pipelineLayout = VK_NULL_HANDLE, uint32_t bindImageSet = 1);
+        void drawNode(Node* node, VkCommandBuffer commandBuffer, uint32_t renderFlags = 0, VkPipelineLayout pipelineLayout = VK_NULL_HANDLE, uint32_t bindImageSet = 1, const LodSelection* lodSelection = nullptr, const LayerSelection* layerSelection = nullptr);
+        void draw(VkCommandBuffer commandBuffer, uint32_t renderFlags = 0, VkPipelineLayout pipelineLayout = VK_NULL_HANDLE, uint32_t bindImageSet = 1, const LodSelection* lodSelection = nullptr, const LayerSelection* layerSelection = nullptr);
         void getNodeDimensions(Node* node, glm::vec3& min, glm::vec3& max);
         void getSceneDimensions();
         void updateAnimation(uint32_t index, float time);
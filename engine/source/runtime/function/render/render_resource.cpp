@@ -1,23 +1,386 @@
 #include "render_resource.h"
+
+#include <iostream>
+
+#include "stb_image.h"
+#include "core/file/virtual_file_system.h"
+
 namespace MW {
+    extern VkDescriptorSetLayout descriptorSetLayoutImage;
+    extern uint32_t descriptorBindingFlags;
+
+    void RenderResource::initialize(std::shared_ptr<VulkanDevice> device) {
+        this->device = device;
+    }
+
+    void RenderResource::clean() {
+        std::lock_guard<std::mutex> lock(mutex);
+        for (auto &material: materials) {
+            device->FreeDescriptorSets(1, &material.second.descriptorSet);
+        }
+        for (auto &texture: textures) {
+            texture.second.texture.destroy();
+        }
+        for (auto &mesh: meshes) {
+            for (VulkanBuffer &buffer: mesh.second.buffers) {
+                device->DestroyVulkanBuffer(buffer);
+            }
+        }
+        materials.clear();
+        textures.clear();
+        meshes.clear();
+        materialResources.clear();
+        textureResources.clear();
+        meshResources.clear();
+        for (size_t &bytes: residentBytes) {
+            bytes = 0;
+        }
+    }
+
     size_t RenderResource::loadTexture(std::string filePath, bool isSrgb) {
-        TextureSource textureSource{filePath};
+        VirtualFile file;
+        if (!VirtualFileSystem::global().open(filePath, file)) {
+            std::cerr << "Could not load texture \"" << filePath << "\"" << std::endl;
+            return invalidGuid;
+        }
+        TextureSource textureSource{filePath, hash_bytes(file.data(), file.size())};
+        Texture texture{};
+        size_t guid;
+        if (acquireTexture(textureSource, texture, guid)) {
+            return guid;
+        }
+
+        const size_t extension = filePath.find_last_of('.');
+        if (extension != std::string::npos && filePath.substr(extension + 1) == "ktx") {
+            const size_t pos = filePath.find_last_of("/\\");
+            tinygltf::Image image;
+            image.uri = pos == std::string::npos ? filePath : filePath.substr(pos + 1);
+            texture.fromglTfImage(image, pos == std::string::npos ? std::string(".") : filePath.substr(0, pos),
+                                  device.get());
+        } else {
+            int width = 0, height = 0, component = 0;
+            const int size = static_cast<int>(file.size());
+            if (!stbi_info_from_memory(file.data(), size, &width, &height, &component)) {
+                std::cerr << "Could not decode texture \"" << filePath << "\": " << stbi_failure_reason()
+                          << std::endl;
+                return invalidGuid;
+            }
+            const int requestedComponent = component == 3 ? 3 : 4;
+            unsigned char *pixels = stbi_load_from_memory(file.data(), size, &width, &height, &component,
+                                                          requestedComponent);
+            if (pixels == nullptr) {
+                std::cerr << "Could not decode texture \"" << filePath << "\": " << stbi_failure_reason()
+                          << std::endl;
+                return invalidGuid;
+            }
+            texture.fromPixels(pixels, width, height, requestedComponent, device.get());
+            stbi_image_free(pixels);
+        }
+        return addTexture(textureSource, texture);
+    }
+
+    size_t RenderResource::loadTexture(const std::string &name, const unsigned char *pixels, uint32_t width,
+                                       uint32_t height, uint32_t component) {
+        const uint32_t size[3] = {width, height, component};
+        TextureSource textureSource{name, hash_bytes(pixels, static_cast<size_t>(width) * height * component,
+                                                     hash_bytes(size, sizeof(size)))};
+        Texture texture{};
         size_t guid;
-        if(textureResources.getElementGuid(textureSource,guid))
+        if (acquireTexture(textureSource, texture, guid)) {
             return guid;
-        return textureResources.allocGuid(textureSource);
+        }
+        texture.fromPixels(pixels, width, height, component, device.get());
+        return addTexture(textureSource, texture);
     }
 
     size_t RenderResource::loadMaterial(MaterialSource materialSource) {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            size_t guid;
+            if (materialResources.getElementGuid(materialSource, guid)) {
+                ++materials[guid].referenceCount;
+                return guid;
+            }
+        }
+
+        Texture baseColorTexture{}, normalTexture{};
+        if (!getTexture(materialSource.baseColorTexture, baseColorTexture)) {
+            std::cerr << "Material has no resident base color texture" << std::endl;
+            return invalidGuid;
+        }
+        // 没有法线贴图时和Model一样使用全0的空贴图
+        size_t normalGuid = materialSource.normalTexture;
+        if (!GuidAllocator<TextureSource>::isValidGuid(normalGuid)) {
+            const unsigned char empty[4] = {0, 0, 0, 0};
+            normalGuid = loadTexture("empty", empty, 1, 1, 4);
+        } else {
+            addReference(RenderResourceType::Texture, normalGuid);
+        }
+        getTexture(normalGuid, normalTexture);
+
+        MaterialEntry entry;
+        entry.baseColorTexture = materialSource.baseColorTexture;
+        entry.normalTexture = normalGuid;
+        entry.textures.push_back(normalGuid);
+        for (size_t textureGuid: {materialSource.baseColorTexture, materialSource.metallicRoughnessTexture,
+                                  materialSource.occlusionTexture, materialSource.emissiveTexture}) {
+            if (GuidAllocator<TextureSource>::isValidGuid(textureGuid)) {
+                addReference(RenderResourceType::Texture, textureGuid);
+                entry.textures.push_back(textureGuid);
+            }
+        }
+
+        entry.descriptorSet = createMaterialDescriptorSet(baseColorTexture, normalTexture);
+        entry.referenceCount = 1;
+
+        // 创建期间其他线程可能已登记了相同的材质，和addTexture一样在同一个锁内再查一次
+        std::lock_guard<std::mutex> lock(mutex);
+        size_t guid;
+        const bool existing = materialResources.getElementGuid(materialSource, guid);
+        if (!existing) {
+            guid = materialResources.allocGuid(materialSource);
+        }
+        if (existing || !GuidAllocator<MaterialSource>::isValidGuid(guid)) {
+            device->FreeDescriptorSets(1, &entry.descriptorSet);
+            for (size_t textureGuid: entry.textures) {
+                releaseLocked(RenderResourceType::Texture, textureGuid);
+            }
+            if (existing) {
+                ++materials[guid].referenceCount;
+            }
+            return guid;
+        }
+        materials[guid] = std::move(entry);
+        return guid;
+    }
+
+    bool RenderResource::acquireTexture(const TextureSource &source, Texture &texture, size_t &guid) {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (!textureResources.getElementGuid(source, guid)) {
+            return false;
+        }
+        TextureEntry &entry = textures[guid];
+        const uint32_t index = texture.index;
+        texture = entry.texture;
+        texture.index = index;
+        ++entry.referenceCount;
+        return true;
+    }
+
+    size_t RenderResource::addTexture(const TextureSource &source, Texture &texture) {
+        std::lock_guard<std::mutex> lock(mutex);
+        size_t guid;
+        if (textureResources.getElementGuid(source, guid)) {
+            TextureEntry &entry = textures[guid];
+            const uint32_t index = texture.index;
+            texture.destroy();
+            texture = entry.texture;
+            texture.index = index;
+            ++entry.referenceCount;
+            return guid;
+        }
+        guid = textureResources.allocGuid(source);
+        if (!GuidAllocator<TextureSource>::isValidGuid(guid)) {
+            texture.destroy();
+            return invalidGuid;
+        }
+        TextureEntry &entry = textures[guid];
+        entry.texture = texture;
+        entry.bytes = getTextureBytes(texture);
+        entry.referenceCount = 1;
+        residentBytes[static_cast<uint32_t>(RenderResourceType::Texture)] += entry.bytes;
+        return guid;
+    }
+
+    bool RenderResource::acquireMesh(const MeshSource &source, std::vector<VulkanBuffer> &buffers, size_t &guid) {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (!meshResources.getElementGuid(source, guid)) {
+            return false;
+        }
+        MeshEntry &entry = meshes[guid];
+        buffers = entry.buffers;
+        ++entry.referenceCount;
+        return true;
+    }
+
+    size_t RenderResource::addMesh(const MeshSource &source, std::vector<VulkanBuffer> &buffers) {
+        std::lock_guard<std::mutex> lock(mutex);
+        size_t guid;
+        if (meshResources.getElementGuid(source, guid)) {
+            MeshEntry &entry = meshes[guid];
+            for (VulkanBuffer &buffer: buffers) {
+                device->DestroyVulkanBuffer(buffer);
+            }
+            buffers = entry.buffers;
+            ++entry.referenceCount;
+            return guid;
+        }
+        guid = meshResources.allocGuid(source);
+        if (!GuidAllocator<MeshSource>::isValidGuid(guid)) {
+            for (VulkanBuffer &buffer: buffers) {
+                device->DestroyVulkanBuffer(buffer);
+            }
+            return invalidGuid;
+        }
+        MeshEntry &entry = meshes[guid];
+        entry.buffers = buffers;
+        for (const VulkanBuffer &buffer: buffers) {
+            entry.bytes += buffer.bufferSize;
+        }
+        entry.referenceCount = 1;
+        residentBytes[static_cast<uint32_t>(RenderResourceType::Mesh)] += entry.bytes;
+        return guid;
+    }
 
-        return 0;
+    bool RenderResource::getTexture(size_t guid, Texture &texture) {
+        std::lock_guard<std::mutex> lock(mutex);
+        auto it = textures.find(guid);
+        if (it == textures.end()) {
+            return false;
+        }
+        texture = it->second.texture;
+        return true;
     }
 
-//    RenderTexture RenderResource::getTexture(size_t id) {
-//        return RenderTexture();
-//    }
-//
-//    RenderMaterial RenderResource::getMaterial(size_t id) {
-//        return RenderMaterial();
-//    }
-}
\ No newline at end of file
+    VkDescriptorSet RenderResource::getMaterialDescriptorSet(size_t guid) {
+        std::lock_guard<std::mutex> lock(mutex);
+        auto it = materials.find(guid);
+        return it == materials.end() ? VK_NULL_HANDLE : it->second.descriptorSet;
+    }
+
+    bool RenderResource::replaceTexture(size_t guid, Texture &texture, std::vector<VkDescriptorSet> &retiredSets) {
+        std::lock_guard<std::mutex> lock(mutex);
+        auto it = textures.find(guid);
+        if (it == textures.end()) {
+            return false;
+        }
+        TextureEntry &entry = it->second;
+        texture.index = entry.texture.index;
+        std::swap(entry.texture, texture);
+        residentBytes[static_cast<uint32_t>(RenderResourceType::Texture)] -= entry.bytes;
+        entry.bytes = getTextureBytes(entry.texture);
+        residentBytes[static_cast<uint32_t>(RenderResourceType::Texture)] += entry.bytes;
+
+        // 正在录制或执行的命令可能还在使用旧的set，不能原地更新
+        bool changed = false;
+        for (auto &material: materials) {
+            MaterialEntry &materialEntry = material.second;
+            if (materialEntry.baseColorTexture != guid && materialEntry.normalTexture != guid) {
+                continue;
+            }
+            retiredSets.push_back(materialEntry.descriptorSet);
+            materialEntry.descriptorSet = createMaterialDescriptorSet(
+                    textures.at(materialEntry.baseColorTexture).texture,
+                    textures.at(materialEntry.normalTexture).texture);
+            changed = true;
+        }
+        if (changed) {
+            ++materialVersion;
+        }
+        return true;
+    }
+
+    void RenderResource::addReference(RenderResourceType type, size_t guid) {
+        std::lock_guard<std::mutex> lock(mutex);
+        switch (type) {
+            case RenderResourceType::Texture:
+                ++textures.at(guid).referenceCount;
+                break;
+            case RenderResourceType::Material:
+                ++materials.at(guid).referenceCount;
+                break;
+            case RenderResourceType::Mesh:
+                ++meshes.at(guid).referenceCount;
+                break;
+            default:
+                break;
+        }
+    }
+
+    void RenderResource::release(RenderResourceType type, size_t guid) {
+        std::lock_guard<std::mutex> lock(mutex);
+        releaseLocked(type, guid);
+    }
+
+    void RenderResource::releaseLocked(RenderResourceType type, size_t guid) {
+        switch (type) {
+            case RenderResourceType::Texture: {
+                auto it = textures.find(guid);
+                if (it == textures.end() || --it->second.referenceCount > 0) {
+                    return;
+                }
+                it->second.texture.destroy();
+                residentBytes[static_cast<uint32_t>(type)] -= it->second.bytes;
+                textures.erase(it);
+                textureResources.freeGuid(guid);
+                break;
+            }
+            case RenderResourceType::Material: {
+                auto it = materials.find(guid);
+                if (it == materials.end() || --it->second.referenceCount > 0) {
+                    return;
+                }
+                device->FreeDescriptorSets(1, &it->second.descriptorSet);
+                const std::vector<size_t> materialTextures = std::move(it->second.textures);
+                materials.erase(it);
+                materialResources.freeGuid(guid);
+                for (size_t textureGuid: materialTextures) {
+                    releaseLocked(RenderResourceType::Texture, textureGuid);
+                }
+                break;
+            }
+            case RenderResourceType::Mesh: {
+                auto it = meshes.find(guid);
+                if (it == meshes.end() || --it->second.referenceCount > 0) {
+                    return;
+                }
+                for (VulkanBuffer &buffer: it->second.buffers) {
+                    device->DestroyVulkanBuffer(buffer);
+                }
+                residentBytes[static_cast<uint32_t>(type)] -= it->second.bytes;
+                meshes.erase(it);
+                meshResources.freeGuid(guid);
+                break;
+            }
+            default:
+                break;
+        }
+    }
+
+    size_t RenderResource::getResidentBytes(RenderResourceType type) {
+        std::lock_guard<std::mutex> lock(mutex);
+        return residentBytes[static_cast<uint32_t>(type)];
+    }
+
+    uint32_t RenderResource::getResidentCount(RenderResourceType type) {
+        std::lock_guard<std::mutex> lock(mutex);
+        switch (type) {
+            case RenderResourceType::Texture:
+                return static_cast<uint32_t>(textures.size());
+            case RenderResourceType::Material:
+                return static_cast<uint32_t>(materials.size());
+            case RenderResourceType::Mesh:
+                return static_cast<uint32_t>(meshes.size());
+            default:
+                return 0;
+        }
+    }
+
+    VkDescriptorSet RenderResource::createMaterialDescriptorSet(Texture &baseColorTexture, Texture &normalTexture) {
+        Model::createDescriptorSetLayouts(device.get());
+        Material material(device.get());
+        material.baseColorTexture = &baseColorTexture;
+        material.normalTexture = &normalTexture;
+        material.createDescriptorSet(descriptorSetLayoutImage, descriptorBindingFlags);
+        return material.descriptorSet;
+    }
+
+    size_t RenderResource::getTextureBytes(const Texture &texture) {
+        if (texture.image == VK_NULL_HANDLE) {
+            return 0;
+        }
+        VkMemoryRequirements memoryRequirements;
+        vkGetImageMemoryRequirements(device->device, texture.image, &memoryRequirements);
+        return static_cast<size_t>(memoryRequirements.size);
+    }
+}
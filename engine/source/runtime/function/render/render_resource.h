@@ -3,16 +3,32 @@
 #include "core/math/math_headers.h"
 #include "runtime/function/render/render_guid_allocator.h"
 #include "runtime/function/render/render_type.h"
+#include "runtime/function/render/render_model.h"
 #include "render_entity.h"
 #include <vulkan/vulkan.h>
 #include <array>
+#include <atomic>
 #include <cstdint>
 #include <map>
+#include <memory>
+#include <mutex>
 #include <vector>
 #include <cmath>
 #include <string>
 
 namespace MW {
+    enum class RenderResourceType : uint32_t {
+        Texture = 0,
+        Material,
+        Mesh,
+        Count
+    };
+
+    /*
+        Reference counted GPU resources shared between models, deduplicated by content hash.
+        Every load/acquire/add adds a reference that has to be given back with release,
+        the resource is destroyed when its last reference is released
+    */
     class RenderResource {
     public:
         CameraObject cameraObject;
@@ -21,13 +37,86 @@ namespace MW {
 
         GuidAllocator<MaterialSource> materialResources;
         GuidAllocator<TextureSource> textureResources;
+        GuidAllocator<MeshSource> meshResources;
+
+        void initialize(std::shared_ptr<VulkanDevice> device);
+
+        // 销毁所有仍然驻留的资源
+        void clean();
 
         size_t loadTexture(std::string filePath, bool isSrgb = false);
 
+        // 从内存中的像素创建贴图，component为3或4
+        size_t loadTexture(const std::string &name, const unsigned char *pixels, uint32_t width, uint32_t height,
+                           uint32_t component);
+
+        // 创建材质的descriptor set，材质持有其贴图的引用
         size_t loadMaterial(MaterialSource materialSource);
 
-//        RenderTexture getTexture(size_t id);
-//
-//        RenderMaterial getMaterial(size_t id);
+        // 内容已驻留时返回true并填充texture
+        bool acquireTexture(const TextureSource &source, Texture &texture, size_t &guid);
+
+        // 登记新上传的贴图，相同内容已被其他线程登记时销毁传入的贴图并换成已驻留的
+        size_t addTexture(const TextureSource &source, Texture &texture);
+
+        bool acquireMesh(const MeshSource &source, std::vector<VulkanBuffer> &buffers, size_t &guid);
+
+        size_t addMesh(const MeshSource &source, std::vector<VulkanBuffer> &buffers);
+
+        bool getTexture(size_t guid, Texture &texture);
+
+        VkDescriptorSet getMaterialDescriptorSet(size_t guid);
+
+        // 替换贴图的GPU数据(mip流送)，引用它的材质重新分配descriptor set，
+        // 旧的贴图通过texture返回，旧的set放入retiredSets，都要等GPU用完后再销毁。只能在主线程调用
+        bool replaceTexture(size_t guid, Texture &texture, std::vector<VkDescriptorSet> &retiredSets);
+
+        // 材质的descriptor set被替换时递增
+        uint64_t getMaterialVersion() const { return materialVersion.load(); }
+
+        void addReference(RenderResourceType type, size_t guid);
+
+        // 调用前需保证GPU不再使用该资源
+        void release(RenderResourceType type, size_t guid);
+
+        size_t getResidentBytes(RenderResourceType type);
+
+        uint32_t getResidentCount(RenderResourceType type);
+
+    private:
+        struct TextureEntry {
+            Texture texture;
+            size_t bytes{0};
+            uint32_t referenceCount{0};
+        };
+
+        struct MaterialEntry {
+            VkDescriptorSet descriptorSet{VK_NULL_HANDLE};
+            size_t baseColorTexture{invalidGuid};
+            size_t normalTexture{invalidGuid};
+            // 材质持有引用的贴图
+            std::vector<size_t> textures;
+            uint32_t referenceCount{0};
+        };
+
+        struct MeshEntry {
+            std::vector<VulkanBuffer> buffers;
+            size_t bytes{0};
+            uint32_t referenceCount{0};
+        };
+
+        size_t getTextureBytes(const Texture &texture);
+
+        VkDescriptorSet createMaterialDescriptorSet(Texture &baseColorTexture, Texture &normalTexture);
+
+        void releaseLocked(RenderResourceType type, size_t guid);
+
+        std::shared_ptr<VulkanDevice> device;
+        std::unordered_map<size_t, TextureEntry> textures;
+        std::unordered_map<size_t, MaterialEntry> materials;
+        std::unordered_map<size_t, MeshEntry> meshes;
+        size_t residentBytes[static_cast<uint32_t>(RenderResourceType::Count)]{};
+        std::atomic<uint64_t> materialVersion{0};
+        std::mutex mutex;
     };
 } // namespace MW
@@ -26,9 +26,11 @@ namespace MW {
         deviceInfo.windowSystem = info.window;
         device = std::make_shared<VulkanDevice>();
         device->initialize(deviceInfo);
+        renderResource->initialize(device);
         sceneManager = std::make_shared<SceneManager>();
         SceneManagerInitInfo sceneInfo;
         sceneInfo.device = device;
+        sceneInfo.renderResource = renderResource;
         sceneManager->initialize(&sceneInfo);
         renderCamera = std::make_shared<RenderCamera>();
         renderCamera->initialize();
@@ -51,6 +53,8 @@ namespace MW {
     }
 
     void RenderSystem::clean() {
+        // 加载线程会提交上传命令，先停下来再等待设备空闲和销毁资源
+        sceneManager->stopLoading();
         if (device) {
             vkDeviceWaitIdle(device->device);
         }
@@ -60,6 +64,7 @@ namespace MW {
         mainCameraPass.reset();
         sceneManager->clean();
         sceneManager.reset();
+        renderResource->clean();
         if (device) {
             vkDeviceWaitIdle(device->device);
             device->clean();
@@ -77,6 +82,7 @@ namespace MW {
         float radius = 20.0f;
         glm::vec4 lightPos = glm::vec4(cos(angle) * radius + 1, -radius, sin(angle) * radius, 0.0f);
         renderCamera->update(delta_time);
+        sceneManager->update();
         renderResource->rtData.projInverse = glm::inverse(renderCamera->matrices.perspective);
         renderResource->rtData.viewInverse = glm::inverse(renderCamera->matrices.view);
         renderResource->rtData.lightPos = lightPos;
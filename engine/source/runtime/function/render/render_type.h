@@ -37,39 +37,69 @@ namespace MW {
 //        int32_t vertexSize;
 //    };
 
+    // 材质按贴图guid和参数去重，贴图的guid为0表示没有
     struct MaterialSource {
-        std::string baseColorFile;
-        std::string metallicRoughnessFile;
-        std::string normalFile;
-        std::string occlusionFile;
-        std::string emissiveFile;
+        size_t baseColorTexture{0};
+        size_t metallicRoughnessTexture{0};
+        size_t normalTexture{0};
+        size_t occlusionTexture{0};
+        size_t emissiveTexture{0};
+        glm::vec4 baseColorFactor{1.0f};
+        float metallicFactor{1.0f};
+        float roughnessFactor{1.0f};
+        float alphaCutoff{1.0f};
+        uint32_t alphaMode{0};
 
         bool operator==(const MaterialSource &rhs) const {
-            return baseColorFile == rhs.baseColorFile &&
-                   metallicRoughnessFile == rhs.metallicRoughnessFile &&
-                   normalFile == rhs.normalFile &&
-                   occlusionFile == rhs.occlusionFile &&
-                   emissiveFile == rhs.emissiveFile;
+            return baseColorTexture == rhs.baseColorTexture &&
+                   metallicRoughnessTexture == rhs.metallicRoughnessTexture &&
+                   normalTexture == rhs.normalTexture &&
+                   occlusionTexture == rhs.occlusionTexture &&
+                   emissiveTexture == rhs.emissiveTexture &&
+                   baseColorFactor == rhs.baseColorFactor &&
+                   metallicFactor == rhs.metallicFactor &&
+                   roughnessFactor == rhs.roughnessFactor &&
+                   alphaCutoff == rhs.alphaCutoff &&
+                   alphaMode == rhs.alphaMode;
         }
 
         size_t getHashValue() const {
             size_t hash = 0;
             hash_combine(hash,
-                         baseColorFile,
-                         metallicRoughnessFile,
-                         normalFile,
-                         occlusionFile,
-                         emissiveFile);
+                         baseColorTexture,
+                         metallicRoughnessTexture,
+                         normalTexture,
+                         occlusionTexture,
+                         emissiveTexture,
+                         baseColorFactor.x,
+                         baseColorFactor.y,
+                         baseColorFactor.z,
+                         baseColorFactor.w,
+                         metallicFactor,
+                         roughnessFactor,
+                         alphaCutoff,
+                         alphaMode);
             return hash;
         }
     };
 
+    // 贴图按文件内容去重，textureFile只用于输出信息
     struct TextureSource {
         std::string textureFile;
+        uint64_t contentHash{0};
 
-        bool operator==(const TextureSource &rhs) const { return textureFile == rhs.textureFile; }
+        bool operator==(const TextureSource &rhs) const { return contentHash == rhs.contentHash; }
 
-        size_t getHashValue() const { return std::hash<std::string>{}(textureFile); }
+        size_t getHashValue() const { return static_cast<size_t>(contentHash); }
+    };
+
+    // 模型的顶点、索引以及meshlet数据的内容hash
+    struct MeshSource {
+        uint64_t contentHash{0};
+
+        bool operator==(const MeshSource &rhs) const { return contentHash == rhs.contentHash; }
+
+        size_t getHashValue() const { return static_cast<size_t>(contentHash); }
     };
 }
 
@@ -81,4 +111,9 @@ struct std::hash<MW::MaterialSource> {
 template<>
 struct std::hash<MW::TextureSource> {
     size_t operator()(const MW::TextureSource &rhs) const noexcept { return rhs.getHashValue(); }
+};
+
+template<>
+struct std::hash<MW::MeshSource> {
+    size_t operator()(const MW::MeshSource &rhs) const noexcept { return rhs.getHashValue(); }
 };
\ No newline at end of file
@@ -11,6 +11,7 @@
 #include <set>
 #include <unordered_set>
 #include <array>
+#include <algorithm>
 
 namespace MW {
     std::string errorString(VkResult errorCode) {
@@ -99,6 +100,7 @@ namespace MW {
 
     void VulkanDevice::initialize(VulkanDeviceInitInfo info) {
         window = info.windowSystem->getGLFWwindow();
+        mainThreadId = std::this_thread::get_id();
         CreateInstance();
         setupDebugMessenger();
         CreateSurface();
@@ -154,6 +156,10 @@ namespace MW {
             vkDestroyCommandPool(device, swapChainCommandPools[i], nullptr);
         }
         vkDestroyCommandPool(device, commandPool, nullptr);
+        for (auto &threadCommandPool: threadCommandPools) {
+            vkDestroyCommandPool(device, threadCommandPool.second, nullptr);
+        }
+        threadCommandPools.clear();
         vkDestroyDevice(device, nullptr);
 
         if (enableValidationLayers) {
@@ -620,6 +626,17 @@ namespace MW {
         throw std::runtime_error("failed to find suitable memory type!");
     }
 
+    bool VulkanDevice::supportsMemoryProperties(VkMemoryPropertyFlags properties) {
+        VkPhysicalDeviceMemoryProperties memProperties;
+        vkGetPhysicalDeviceMemoryProperties(physicalDevice, &memProperties);
+        for (uint32_t i = 0; i < memProperties.memoryTypeCount; i++) {
+            if ((memProperties.memoryTypes[i].propertyFlags & properties) == properties) {
+                return true;
+            }
+        }
+        return false;
+    }
+
     void VulkanDevice::CreateBuffer(
             VkDeviceSize size,
             VkBufferUsageFlags usage,
@@ -684,6 +701,25 @@ namespace MW {
         enabledMeshShaderFeatures.taskShader = VK_TRUE;
 #endif
         deviceCreatepNextChain = &enabledBufferDeviceAddresFeatures;
+
+        // shaderOutputLayer和shaderOutputViewportIndex只在VkPhysicalDeviceVulkan12Features中，它不能和单独的bufferDeviceAddress结构同时出现在链上
+        VkPhysicalDeviceVulkan12Features vulkan12Features{};
+        vulkan12Features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES;
+        VkPhysicalDeviceFeatures2 deviceFeatures2{};
+        deviceFeatures2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+        deviceFeatures2.pNext = &vulkan12Features;
+        vkGetPhysicalDeviceFeatures2(physicalDevice, &deviceFeatures2);
+        supportsShaderOutputLayer = vulkan12Features.shaderOutputLayer == VK_TRUE;
+        supportsShaderOutputViewportIndex = vulkan12Features.shaderOutputViewportIndex == VK_TRUE &&
+                                            enabledFeatures.multiViewport == VK_TRUE;
+        if (supportsShaderOutputLayer || supportsShaderOutputViewportIndex) {
+            enabledVulkan12Features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES;
+            enabledVulkan12Features.bufferDeviceAddress = VK_TRUE;
+            enabledVulkan12Features.shaderOutputLayer = vulkan12Features.shaderOutputLayer;
+            enabledVulkan12Features.shaderOutputViewportIndex = vulkan12Features.shaderOutputViewportIndex;
+            enabledVulkan12Features.pNext = enabledBufferDeviceAddresFeatures.pNext;
+            deviceCreatepNextChain = &enabledVulkan12Features;
+        }
     }
 
     void VulkanDevice::CreateDeviceBuffer(VkBufferUsageFlags usageFlags,
@@ -778,11 +814,31 @@ namespace MW {
         }
     }
 
+    VkCommandPool VulkanDevice::getThreadCommandPool() {
+        const std::thread::id threadId = std::this_thread::get_id();
+        if (threadId == mainThreadId) {
+            return commandPool;
+        }
+        std::lock_guard<std::mutex> lock(threadCommandPoolMutex);
+        auto it = threadCommandPools.find(threadId);
+        if (it != threadCommandPools.end()) {
+            return it->second;
+        }
+        VkCommandPoolCreateInfo poolInfo = {};
+        poolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+        poolInfo.queueFamilyIndex = queueIndices.graphicsFamily.value();
+        poolInfo.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT | VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
+        VkCommandPool pool;
+        VK_CHECK_RESULT(vkCreateCommandPool(device, &poolInfo, nullptr, &pool));
+        threadCommandPools.emplace(threadId, pool);
+        return pool;
+    }
+
     VkCommandBuffer VulkanDevice::beginSingleTimeCommands() {
         VkCommandBufferAllocateInfo allocInfo{};
         allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
         allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
-        allocInfo.commandPool = commandPool;
+        allocInfo.commandPool = getThreadCommandPool();
         allocInfo.commandBufferCount = 1;
 
         VkCommandBuffer commandBuffer;
@@ -808,10 +864,18 @@ namespace MW {
         submitInfo.commandBufferCount = 1;
         submitInfo.pCommandBuffers = &commandBuffer;
 
-        vkQueueSubmit(queue, 1, &submitInfo, VK_NULL_HANDLE);
-        vkQueueWaitIdle(queue);
+        // 只等待这次提交，不阻塞正在渲染的帧
+        VkFenceCreateInfo fenceInfo = CreateFenceCreateInfo();
+        VkFence fence;
+        CreateFence(&fenceInfo, &fence);
+        {
+            std::lock_guard<std::mutex> lock(queueMutex);
+            VK_CHECK_RESULT(vkQueueSubmit(queue, 1, &submitInfo, fence));
+        }
+        WaitForFences(1, &fence);
+        DestroyFence(fence);
 
-        vkFreeCommandBuffers(device, commandPool, 1, &commandBuffer);
+        vkFreeCommandBuffers(device, getThreadCommandPool(), 1, &commandBuffer);
     }
 
     void VulkanDevice::copyBuffer(VkBuffer srcBuffer, VkBuffer dstBuffer, VkDeviceSize size) {
@@ -941,6 +1005,7 @@ namespace MW {
     }
 
     void VulkanDevice::QueueSubmit(VkQueue queue, uint32_t submitCount, const VkSubmitInfo *pSubmits, VkFence fence) {
+        std::lock_guard<std::mutex> lock(queueMutex);
         VK_CHECK_RESULT(vkQueueSubmit(queue, submitCount, pSubmits, fence));
     }
 
@@ -1007,6 +1072,10 @@ namespace MW {
         vkDestroyDescriptorSetLayout(device, descriptorSetLayout, pAllocator);
     }
 
+    void VulkanDevice::DestroyDescriptorPool(VkDescriptorPool pool, const VkAllocationCallbacks *pAllocator) {
+        vkDestroyDescriptorPool(device, pool, pAllocator);
+    }
+
     void VulkanDevice::DestroySwapchainKHR(VkSwapchainKHR swapChain, const VkAllocationCallbacks *pAllocator) {
         vkDestroySwapchainKHR(device, swapChain, pAllocator);
     }
@@ -1046,6 +1115,13 @@ namespace MW {
         CreateGraphicsPipelines(VK_NULL_HANDLE, 1, pCreateInfos, pPipelines, nullptr);
     }
 
+    void VulkanDevice::CreateComputePipelines(VkPipelineCache pipelineCache, uint32_t CreateInfoCount,
+                                              const VkComputePipelineCreateInfo *pCreateInfos,
+                                              VkPipeline *pPipelines, const VkAllocationCallbacks *pAllocator) {
+        VK_CHECK_RESULT(vkCreateComputePipelines(device, pipelineCache, CreateInfoCount, pCreateInfos, pAllocator,
+                                                 pPipelines));
+    }
+
     void VulkanDevice::CreateRayTracingPipelinesKHR(const VkRayTracingPipelineCreateInfoKHR *pCreateInfos,
                                                     VkPipeline *pPipelines,
                                                     uint32_t createInfoCount,
@@ -1072,6 +1148,41 @@ namespace MW {
         AllocateDescriptorSets(&descriptorSetAllocateInfo, &set);
     }
 
+    void VulkanDevice::CreateDescriptorPool(const std::vector<VkDescriptorSetLayoutBinding> &bindings,
+                                            uint32_t setCount, VkDescriptorPool &pool) {
+        std::vector<VkDescriptorPoolSize> poolSizes;
+        for (const VkDescriptorSetLayoutBinding &binding: bindings) {
+            auto it = std::find_if(poolSizes.begin(), poolSizes.end(), [&](const VkDescriptorPoolSize &size) {
+                return size.type == binding.descriptorType;
+            });
+            if (it == poolSizes.end()) {
+                poolSizes.push_back({binding.descriptorType, 0});
+                it = poolSizes.end() - 1;
+            }
+            it->descriptorCount += binding.descriptorCount * setCount;
+        }
+        VkDescriptorPoolCreateInfo poolInfo{};
+        poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+        poolInfo.poolSizeCount = static_cast<uint32_t>(poolSizes.size());
+        poolInfo.pPoolSizes = poolSizes.data();
+        poolInfo.maxSets = setCount;
+        CreateDescriptorPool(&poolInfo, &pool);
+    }
+
+    void VulkanDevice::CreateDescriptorSet(VkDescriptorPool pool, const VkDescriptorSetLayout &setLayout,
+                                           VkDescriptorSet &set) {
+        VkDescriptorSetAllocateInfo descriptorSetAllocateInfo{};
+        descriptorSetAllocateInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+        descriptorSetAllocateInfo.descriptorPool = pool;
+        descriptorSetAllocateInfo.pSetLayouts = &setLayout;
+        descriptorSetAllocateInfo.descriptorSetCount = 1;
+        AllocateDescriptorSets(&descriptorSetAllocateInfo, &set);
+    }
+
+    void VulkanDevice::FreeDescriptorSets(uint32_t descriptorSetCount, const VkDescriptorSet *pDescriptorSets) {
+        VK_CHECK_RESULT(vkFreeDescriptorSets(device, descriptorPool, descriptorSetCount, pDescriptorSets));
+    }
+
     void VulkanDevice::AllocateDescriptorSets(const VkDescriptorSetAllocateInfo *pAllocateInfo,
                                               VkDescriptorSet *pDescriptorSets) {
         VK_CHECK_RESULT(vkAllocateDescriptorSets(device, pAllocateInfo, pDescriptorSets));
@@ -1152,7 +1263,11 @@ namespace MW {
 
         presentInfo.pImageIndices = &currentImageIndex;
 
-        auto result = vkQueuePresentKHR(presentQueue, &presentInfo);
+        VkResult result;
+        {
+            std::lock_guard<std::mutex> lock(queueMutex);
+            result = vkQueuePresentKHR(presentQueue, &presentInfo);
+        }
         if (VK_ERROR_OUT_OF_DATE_KHR == result || VK_SUBOPTIMAL_KHR == result) {
             recreateSwapChain();
             passUpdateAfterRecreateSwapchain();
@@ -1208,8 +1323,11 @@ namespace MW {
 
             VK_CHECK_RESULT(vkResetFences(device, 1, &inFlightFences[currentFrameIndex]));
 
-            VkResult res_queue_submit =
-                    vkQueueSubmit(graphicsQueue, 1, &submit_info, inFlightFences[currentFrameIndex]);
+            VkResult res_queue_submit;
+            {
+                std::lock_guard<std::mutex> lock(queueMutex);
+                res_queue_submit = vkQueueSubmit(graphicsQueue, 1, &submit_info, inFlightFences[currentFrameIndex]);
+            }
             if (VK_SUCCESS != res_queue_submit) {
                 std::cerr << ("vkQueueSubmit failed!") << std::endl;;
                 return false;
@@ -1458,7 +1576,8 @@ namespace MW {
 #endif
 
     void VulkanDevice::createDepthResources() {
-        VkFormat depthFormat = findDepthFormat();
+        // SDSM的compute pass要采样场景深度
+        VkFormat depthFormat = findDepthFormat(true);
         swapChainDepthFormat = depthFormat;
         VkExtent2D swapChainExtent = getSwapChainExtent();
 
@@ -1473,7 +1592,8 @@ namespace MW {
         imageInfo.format = depthFormat;
         imageInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
         imageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-        imageInfo.usage = VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT | VK_IMAGE_USAGE_INPUT_ATTACHMENT_BIT;
+        imageInfo.usage = VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT | VK_IMAGE_USAGE_INPUT_ATTACHMENT_BIT |
+                          VK_IMAGE_USAGE_SAMPLED_BIT;
         imageInfo.samples = VK_SAMPLE_COUNT_1_BIT;
         imageInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
         imageInfo.flags = 0;
@@ -1614,7 +1734,18 @@ namespace MW {
         }
     }
 
-    VkFormat VulkanDevice::findDepthFormat(bool checkSamplingSupport) {
+    VkFormat VulkanDevice::findDepthFormat(bool checkSamplingSupport, bool prefer16Bit) {
+        if (prefer16Bit) {
+            VkFormatProperties props;
+            vkGetPhysicalDeviceFormatProperties(physicalDevice, VK_FORMAT_D16_UNORM, &props);
+            VkFormatFeatureFlags features = VK_FORMAT_FEATURE_DEPTH_STENCIL_ATTACHMENT_BIT;
+            if (checkSamplingSupport) {
+                features |= VK_FORMAT_FEATURE_SAMPLED_IMAGE_BIT;
+            }
+            if ((props.optimalTilingFeatures & features) == features) {
+                return VK_FORMAT_D16_UNORM;
+            }
+        }
         return findSupportedFormat(
                 {VK_FORMAT_D32_SFLOAT, VK_FORMAT_D32_SFLOAT_S8_UINT, VK_FORMAT_D24_UNORM_S8_UINT},
                 VK_IMAGE_TILING_OPTIMAL,
@@ -1652,8 +1783,11 @@ namespace MW {
         pool_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
         pool_info.poolSizeCount = pool_sizes.size();
         pool_info.pPoolSizes = pool_sizes.data();
-        pool_info.maxSets = 1 + 1 + 1 + maxMaterialCount + 1 + 1 + 1; // +skybox + axis descriptor set
-        pool_info.flags = 0U;
+        // +skybox + axis descriptor set + 每帧的虚拟贴图set
+        // compute pass独占的set从pass自己的pool分配，不计入这里
+        pool_info.maxSets = 1 + 1 + 1 + maxMaterialCount + 1 + 1 + 1 + MAX_FRAMES_IN_FLIGHT;
+        // 共享材质的descriptor set在最后一个引用释放时归还
+        pool_info.flags = VK_DESCRIPTOR_POOL_CREATE_FREE_DESCRIPTOR_SET_BIT;
 
         VK_CHECK_RESULT(vkCreateDescriptorPool(device, &pool_info, nullptr, &descriptorPool));
     }
@@ -1979,7 +2113,10 @@ namespace MW {
         VkFence fence;
         CreateFence(&fenceInfo, &fence);
         // Submit to the queue
-        VK_CHECK_RESULT(vkQueueSubmit(queue, 1, &submitInfo, fence));
+        {
+            std::lock_guard<std::mutex> lock(queueMutex);
+            VK_CHECK_RESULT(vkQueueSubmit(queue, 1, &submitInfo, fence));
+        }
         // Wait for the fence to signal that command buffer has finished executing
         WaitForFences(1, &fence);
         DestroyFence(fence);
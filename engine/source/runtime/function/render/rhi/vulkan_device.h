@@ -9,6 +9,9 @@
 #include <functional>
 #include <map>
 #include <memory>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
 #include <vector>
 #include <optional>
 #include "vulkan_resources.h"
@@ -69,6 +72,9 @@ namespace MW {
 
         uint32_t findMemoryType(uint32_t typeFilter, VkMemoryPropertyFlags properties);
 
+        // 是否存在同时具有这些属性的内存类型
+        bool supportsMemoryProperties(VkMemoryPropertyFlags properties);
+
         QueueFamilyIndices findPhysicalQueueFamilies() { return findQueueFamilies(physicalDevice); }
 
         VkFormat findSupportedFormat(
@@ -120,9 +126,17 @@ namespace MW {
         void CreateDescriptorSet(uint32_t descriptorSetCount, const VkDescriptorSetLayout &pSetLayouts,
                                  VkDescriptorSet &set);
 
+        // 按一个set的binding乘以set数量创建独立的pool，pass自己分配的set不占用全局pool
+        void CreateDescriptorPool(const std::vector<VkDescriptorSetLayoutBinding> &bindings, uint32_t setCount,
+                                  VkDescriptorPool &pool);
+
+        void CreateDescriptorSet(VkDescriptorPool pool, const VkDescriptorSetLayout &setLayout, VkDescriptorSet &set);
+
         void AllocateDescriptorSets(const VkDescriptorSetAllocateInfo *pAllocateInfo,
                                     VkDescriptorSet *pDescriptorSets);
 
+        void FreeDescriptorSets(uint32_t descriptorSetCount, const VkDescriptorSet *pDescriptorSets);
+
         void UpdateDescriptorSets(uint32_t descriptorWriteCount,
                                   const VkWriteDescriptorSet *pDescriptorWrites,
                                   uint32_t descriptorCopyCount = 0,
@@ -159,6 +173,7 @@ namespace MW {
         void CreateSampler(const VkSamplerCreateInfo *pCreateInfo, VkSampler *pSampler,
                            const VkAllocationCallbacks *pAllocator = nullptr);
 
+        // 可以在任意线程调用，非主线程使用各自的command pool
         VkCommandBuffer beginSingleTimeCommands();
 
         VkShaderModule CreateShaderModule(const std::vector<unsigned char> &shader_code);
@@ -274,6 +289,8 @@ namespace MW {
         void DestroyDescriptorSetLayout(VkDescriptorSetLayout descriptorSetLayout,
                                         const VkAllocationCallbacks *pAllocator = nullptr);
 
+        void DestroyDescriptorPool(VkDescriptorPool pool, const VkAllocationCallbacks *pAllocator = nullptr);
+
         void recreateSwapChain();
 
         bool prepareBeforePass(std::function<void()> passUpdateAfterRecreateSwapchain);
@@ -333,7 +350,8 @@ namespace MW {
 
         void resetCommandPool();
 
-        VkFormat findDepthFormat(bool checkSamplingSupport = false);
+        // prefer16Bit时优先D16_UNORM，不支持时和默认一样选32位格式
+        VkFormat findDepthFormat(bool checkSamplingSupport = false, bool prefer16Bit = false);
 
         VkResult acquireNextImage(uint32_t *imageIndex);
 
@@ -462,6 +480,14 @@ namespace MW {
         GLFWwindow *window{nullptr};
         VkCommandPool commandPool;
         VkCommandPool swapChainCommandPools[MAX_FRAMES_IN_FLIGHT];
+        // 后台加载线程的command pool，主线程仍使用commandPool
+        std::thread::id mainThreadId;
+        std::unordered_map<std::thread::id, VkCommandPool> threadCommandPools;
+        std::mutex threadCommandPoolMutex;
+        // graphicsQueue/presentQueue的提交需要外部同步
+        std::mutex queueMutex;
+
+        VkCommandPool getThreadCommandPool();
 
         VkDevice device;
         VkSurfaceKHR surface;
@@ -533,6 +559,8 @@ namespace MW {
 #endif
 #endif
         VkPhysicalDeviceBufferDeviceAddressFeatures enabledBufferDeviceAddresFeatures{};
+        // 支持shaderOutputLayer或shaderOutputViewportIndex时用它代替enabledBufferDeviceAddresFeatures放在pNext链的开头
+        VkPhysicalDeviceVulkan12Features enabledVulkan12Features{};
         VkPhysicalDeviceRayTracingPipelineFeaturesKHR enabledRayTracingPipelineFeatures{};
         VkPhysicalDeviceAccelerationStructureFeaturesKHR enabledAccelerationStructureFeatures{};
         VkPhysicalDeviceRayTracingPipelinePropertiesKHR rayTracingPipelineProperties{};
@@ -562,6 +590,10 @@ namespace MW {
 #endif
         void *deviceCreatepNextChain = nullptr;
         VkPhysicalDeviceFeatures enabledFeatures{};
+        // vertex shader可以写gl_Layer，用于单pass渲染多层shadow map
+        bool supportsShaderOutputLayer{false};
+        // vertex shader可以写gl_ViewportIndex且支持多个viewport，用于单pass渲染shadow atlas的多个区域
+        bool supportsShaderOutputViewportIndex{false};
     };
 
 }
\ No newline at end of file
@@ -1,6 +1,8 @@
 #include "vulkan_resources.h"
 #include "vulkan_device.h"
+#include "core/file/virtual_file_system.h"
 #include <cassert>
+#include <cstring>
 
 namespace MW {
 
@@ -19,7 +21,7 @@ namespace MW {
         device->FreeMemory(deviceMemory);
     }
 
-    ktxResult VulkanTexture::loadKTXFile(std::string filename, ktxTexture **target) {
+    ktxResult VulkanTexture::loadKTXFile(std::string filename, VirtualFile &file, ktxTexture **target) {
         ktxResult result = KTX_SUCCESS;
 #if defined(__ANDROID__)
         AAsset* asset = AAssetManager_open(androidApp->activity->assetManager, filename.c_str(), AASSET_MODE_STREAMING);
@@ -34,11 +36,11 @@ namespace MW {
         result = ktxTexture_CreateFromMemory(textureData, size, KTX_TEXTURE_CREATE_LOAD_IMAGE_DATA_BIT, target);
         delete[] textureData;
 #else
-        if (!fileExists(filename)) {
+        if (!VirtualFileSystem::global().open(filename, file)) {
             exitFatal("Could not load texture from " + filename +
                       "\n\nMake sure the assets submodule has been checked out and is up-to-date.", -1);
         }
-        result = ktxTexture_CreateFromNamedFile(filename.c_str(), KTX_TEXTURE_CREATE_LOAD_IMAGE_DATA_BIT, target);
+        result = ktxTexture_CreateFromMemory(file.data(), file.size(), KTX_TEXTURE_CREATE_NO_FLAGS, target);
 #endif
         return result;
     }
@@ -154,25 +156,31 @@ namespace MW {
     void VulkanTextureCubeMap::loadFromFile(std::string filename, VkFormat format, std::shared_ptr<VulkanDevice> device,
                                             VkImageUsageFlags imageUsageFlags, VkImageLayout imageLayout) {
         ktxTexture *ktxTexture;
-        ktxResult result = loadKTXFile(filename, &ktxTexture);
+        VirtualFile file;
+        ktxResult result = loadKTXFile(filename, file, &ktxTexture);
         assert(result == KTX_SUCCESS);
 
         width = ktxTexture->baseWidth;
         height = ktxTexture->baseHeight;
         mipLevels = ktxTexture->numLevels;
 
-        ktx_uint8_t *ktxTextureData = ktxTexture_GetData(ktxTexture);
         ktx_size_t ktxTextureSize = ktxTexture_GetSize(ktxTexture);
 
         // Create a host-visible staging buffer that contains the raw image data
         VulkanBuffer stagingBuffer;
         device->CreateBuffer(VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
                              VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
-                             stagingBuffer, ktxTextureSize, ktxTextureData);
-
-//        device->MapMemory(stagingBuffer);
-//        memcpy(stagingBuffer.mapped, ktxTextureData, ktxTextureSize);
-//        device->unMapMemory(stagingBuffer);
+                             stagingBuffer, ktxTextureSize);
+        device->MapMemory(stagingBuffer);
+        if (ktxTexture->pData) {
+            memcpy(stagingBuffer.mapped, ktxTexture->pData, ktxTextureSize);
+        } else {
+            // 从映射的文件直接读到staging，不经过堆上的副本
+            result = ktxTexture_LoadImageData(ktxTexture, static_cast<ktx_uint8_t *>(stagingBuffer.mapped),
+                                              ktxTextureSize);
+            assert(result == KTX_SUCCESS);
+        }
+        device->unMapMemory(stagingBuffer);
 
         // Setup buffer copy regions for each face including all of its mip levels
         std::vector<VkBufferImageCopy> bufferCopyRegions;
@@ -21,6 +21,7 @@
 
 namespace MW {
     class VulkanDevice;
+    class VirtualFile;
 
     struct VulkanBuffer {
         VkDescriptorBufferInfo descriptor;
@@ -50,7 +51,9 @@ namespace MW {
 
         void destroy(std::shared_ptr<VulkanDevice> device);
 
-        ktxResult loadKTXFile(std::string filename, ktxTexture **target);
+        // 桌面平台上通过虚拟文件系统打开并只解析头部，图像数据之后用ktxTexture_LoadImageData直接读到staging buffer，
+        // file需要保持打开直到数据读完
+        ktxResult loadKTXFile(std::string filename, VirtualFile &file, ktxTexture **target);
     };
 
     struct VulkanTexture2D : public VulkanTexture {
@@ -1,11 +1,32 @@
 #include "scene_manager.h"
+#include <algorithm>
+#include "function/global/engine_global_context.h"
+#include "function/render/render_system.h"
+#include "function/render/render_camera.h"
 
 namespace MW {
 
     void SceneManager::draw(VkCommandBuffer commandBuffer, uint32_t renderFlags, VkPipelineLayout pipelineLayout,
-                            uint32_t bindImageSet, PushConstBlock *pushConstant, uint32_t pushSize, bool bUseMeshShader) {
+                            uint32_t bindImageSet, PushConstBlock *pushConstant, uint32_t pushSize, bool bUseMeshShader,
+                            const LodSelection *lodSelection, const LayerSelection *layerSelection) {
+        const uint32_t modelFilter = renderFlags & (RenderFlags::RenderStaticModels | RenderFlags::RenderDynamicModels);
         for (int i = 0; i < models.size(); ++i) {
             auto &model = models[i];
+            if (modelFilter &&
+                !(modelFilter & (modelDynamic[i] ? RenderFlags::RenderDynamicModels : RenderFlags::RenderStaticModels))) {
+                continue;
+            }
+            // 模型通过push constant平移，LOD选择和分层裁剪在模型空间中进行
+            LodSelection modelLodSelection;
+            if (lodSelection) {
+                modelLodSelection = *lodSelection;
+                modelLodSelection.viewPosition -= modelPoss[i];
+            }
+            LayerSelection modelLayerSelection;
+            if (layerSelection) {
+                modelLayerSelection = *layerSelection;
+                modelLayerSelection.translate(modelPoss[i]);
+            }
             if (!bUseMeshShader) { // 不使用mesh shader情况下直接这里绑定
                 pushConstant->position = modelPoss[i];
                 vkCmdPushConstants(commandBuffer, pipelineLayout,
@@ -15,40 +36,215 @@ namespace MW {
             }
 #if USE_MESH_SHADER
             model->bUseMeshShader = bUseMeshShader;
-            model->setVertexDescriptorFirstSet(2);
-            model->setMeshletDescriptorFirstSet(3);
+            model->setVertexDescriptorFirstSet(3);
+            model->setMeshletDescriptorFirstSet(4);
 #endif
-            model->draw(commandBuffer, renderFlags, pipelineLayout, bindImageSet);
+            model->draw(commandBuffer, renderFlags, pipelineLayout, bindImageSet,
+                        lodSelection ? &modelLodSelection : nullptr,
+                        layerSelection ? &modelLayerSelection : nullptr);
         }
     }
 
+    LodSelection SceneManager::getMainViewLodSelection() {
+        auto camera = engineGlobalContext.renderSystem->getRenderCamera();
+        return LodSelection::fromPerspective(camera->matrices.view, camera->matrices.perspective,
+                                             static_cast<float>(device->height()),
+                                             enableLod ? lodErrorThreshold : -1.0f);
+    }
+
+    LodSelection SceneManager::getShadowLodSelection(const glm::mat4 &lightViewProjection, uint32_t shadowMapWidth) {
+        return LodSelection::fromOrthographic(lightViewProjection, static_cast<float>(shadowMapWidth),
+                                              enableLod ? shadowLodErrorThreshold : -1.0f);
+    }
+
     void
     SceneManager::loadModel(const std::string &filename, uint32_t fileLoadingFlags,
                             glm::vec3 modelPos, float scale
     ) {
 #if USE_MESH_SHADER
-        models.emplace_back(std::make_shared<Model>(true));
+        auto model = std::make_shared<Model>(true);
 #else
-        models.emplace_back(std::make_shared<Model>());
+        auto model = std::make_shared<Model>();
 #endif
-        auto&model =models.back();
+        model->resourceManager = renderResource.get();
+        model->textureStreamer = textureStreamer.get();
+        model->virtualTexture = virtualTexture.get();
         model->loadFromFile(filename, device.get(), fileLoadingFlags, scale);
-        for(auto&node:model->nodes){
-            for(auto&primitive:node->mesh->primitives){
+        addModel(model, modelPos);
+    }
+
+    ModelLoadHandle
+    SceneManager::loadModelAsync(const std::string &filename, uint32_t fileLoadingFlags, glm::vec3 modelPos,
+                                 float scale, bool usePlaceholderMaterials) {
+        auto task = std::make_shared<ModelLoadTask>();
+#if USE_MESH_SHADER
+        task->model = std::make_shared<Model>(true);
+#else
+        task->model = std::make_shared<Model>();
+#endif
+        task->model->resourceManager = renderResource.get();
+        task->model->textureStreamer = textureStreamer.get();
+        task->model->virtualTexture = virtualTexture.get();
+        task->model->deferImageLoading = usePlaceholderMaterials;
+        task->filename = filename;
+        task->fileLoadingFlags = fileLoadingFlags;
+        task->position = modelPos;
+        task->scale = scale;
+        pendingLoads.push_back(task);
+
+        if (!loaderThread) {
+            loaderThread = std::make_unique<ThreadPool>(1);
+        }
+        VulkanDevice *vulkanDevice = device.get();
+        loaderThread->submit([this, task, vulkanDevice]() {
+            if (loadCancelled) {
+                task->state = ModelLoadState::Failed;
+                return;
+            }
+            Model &model = *task->model;
+            if (!model.loadResources(task->filename, vulkanDevice, task->fileLoadingFlags, task->scale)) {
+                task->state = ModelLoadState::Failed;
+                return;
+            }
+            if (!model.hasPendingImages()) {
+                task->texturesUploaded = true;
+            }
+            task->state = ModelLoadState::Uploaded;
+            if (model.hasPendingImages() && !loadCancelled) {
+                model.loadPendingImages();
+                task->texturesUploaded = true;
+            }
+        });
+        return task;
+    }
+
+    void SceneManager::update() {
+        for (auto it = pendingLoads.begin(); it != pendingLoads.end();) {
+            ModelLoadTask &task = **it;
+            const ModelLoadState state = task.getState();
+            if (state == ModelLoadState::Uploaded) {
+                task.model->setupDescriptors();
+                addModel(task.model, task.position);
+                task.state = ModelLoadState::Resident;
+            }
+            if (task.isResident() && !task.texturesBound && task.texturesUploaded) {
+                // 新分配材质的descriptor set，正在使用的占位set不需要修改
+                task.model->setupMaterialDescriptors();
+                task.texturesBound = true;
+                virtualTextureVersion = ~0ull;
+            }
+            if (state == ModelLoadState::Failed || task.texturesBound) {
+                it = pendingLoads.erase(it);
+            } else {
+                ++it;
+            }
+        }
+        updateTextureStreaming();
+    }
+
+    void SceneManager::updateTextureStreaming() {
+        auto camera = engineGlobalContext.renderSystem->getRenderCamera();
+        const TextureStreamingView view = TextureStreamingView::fromPerspective(
+                camera->matrices.view, camera->matrices.perspective, static_cast<float>(device->height()));
+        for (size_t i = 0; i < models.size(); ++i) {
+            // 贴图还在后台上传时textureGuids还没有写完
+            if (!models[i]->hasPendingImages()) {
+                models[i]->requestTextureResolution(*textureStreamer, view, modelPoss[i]);
+            }
+        }
+        textureStreamer->update();
+        if (renderResource->getMaterialVersion() != materialVersion) {
+            materialVersion = renderResource->getMaterialVersion();
+            for (auto &model: models) {
+                model->refreshMaterialDescriptors();
+            }
+        }
+        virtualTexture->update();
+        if (virtualTexture->isEnabled() && virtualTexture->getVersion() != virtualTextureVersion) {
+            virtualTextureVersion = virtualTexture->getVersion();
+            for (auto &model: models) {
+                if (!model->hasPendingImages()) {
+                    model->updateVirtualTextureIndices(*virtualTexture);
+                }
+            }
+        }
+    }
+
+    void SceneManager::addModel(const std::shared_ptr<Model> &model, glm::vec3 modelPos) {
+        for (auto &node: model->nodes) {
+            if (!node->mesh) {
+                continue;
+            }
+            for (auto &primitive: node->mesh->primitives) {
                 primitive->pushConstantBlock.position = modelPos; // todo: 改成model矩阵
             }
         }
+        models.emplace_back(model);
         modelPoss.emplace_back(modelPos);
+        modelDynamic.emplace_back(0);
+        staticVersion++;
+        virtualTextureVersion = ~0ull;
+    }
+
+    void SceneManager::setModelDynamic(uint32_t index, bool dynamic) {
+        if (index >= models.size() || static_cast<bool>(modelDynamic[index]) == dynamic) {
+            return;
+        }
+        modelDynamic[index] = dynamic;
+        // 从一种缓存移到另一种，两边都要重画
+        staticVersion++;
+        dynamicVersion++;
+    }
+
+    void SceneManager::setModelPosition(uint32_t index, glm::vec3 modelPos) {
+        if (index >= models.size()) {
+            return;
+        }
+        for (auto &node: models[index]->nodes) {
+            if (!node->mesh) {
+                continue;
+            }
+            for (auto &primitive: node->mesh->primitives) {
+                primitive->pushConstantBlock.position = modelPos;
+            }
+        }
+        modelPoss[index] = modelPos;
+        if (modelDynamic[index]) {
+            dynamicVersion++;
+        } else {
+            staticVersion++;
+        }
+    }
+
+    bool SceneManager::hasDynamicModels() const {
+        return std::find(modelDynamic.begin(), modelDynamic.end(), 1) != modelDynamic.end();
+    }
+
+    void SceneManager::getDynamicBounds(std::vector<glm::vec4> &bounds) const {
+        bounds.clear();
+        for (size_t i = 0; i < models.size(); ++i) {
+            if (modelDynamic[i]) {
+                const auto &dimensions = models[i]->dimensions;
+                bounds.emplace_back(dimensions.center + modelPoss[i], dimensions.radius);
+            }
+        }
     }
 
     void SceneManager::initialize(SceneManagerInitInfo *initInfo) {
         device = initInfo->device;
-        uint32_t glTFLoadingFlags = FileLoadingFlags::PreTransformVertices | FileLoadingFlags::FlipY;
-        loadModel(getAssetPath() + "models/sponza/sponza.gltf", glTFLoadingFlags);
+        renderResource = initInfo->renderResource;
+        textureStreamer = std::make_unique<TextureStreamer>();
+        textureStreamer->initialize(device, renderResource);
+        virtualTexture = std::make_unique<VirtualTexture>();
+        virtualTexture->initialize(device, textureStreamer.get(), enableVirtualTexture);
+        uint32_t glTFLoadingFlags = modelLoadingFlags;
+        // pass初始化时需要模型的descriptor set layout，模型本身在后台加载
+        Model::createDescriptorSetLayouts(device.get());
+        loadModelAsync(getAssetPath() + "models/sponza/sponza.gltf", glTFLoadingFlags);
 //        loadModel(getAssetPath() + "models/cube.gltf", glTFLoadingFlags);
         skybox = std::make_shared<VulkanTextureCubeMap>();
-        skybox->loadFromFile(getAssetPath() + "textures/hdr/pisa_cube.ktx",
-                             VK_FORMAT_R16G16B16A16_SFLOAT, device);
+        skyboxFile = getAssetPath() + "textures/hdr/pisa_cube.ktx";
+        skybox->loadFromFile(skyboxFile, VK_FORMAT_R16G16B16A16_SFLOAT, device);
 //        const std::vector<glm::vec3> positions = {
 //                glm::vec3(0.0f, 0.0f, 0.0f),
 //                glm::vec3(1.25f, 0.25f, 1.25f),
@@ -59,7 +255,23 @@ namespace MW {
 //        for (auto &position: positions)
 //            loadModel(getAssetPath() + "models/oaktree.gltf", device.get(), glTFLoadingFlags, position);
     }
+    void SceneManager::stopLoading() {
+        // 等待正在进行的加载结束，还没开始的直接取消
+        loadCancelled = true;
+        loaderThread.reset();
+        textureStreamer->stop();
+    }
+
     void SceneManager::clean(){
+        stopLoading();
+        textureStreamer->clean();
+        virtualTexture->clean();
+        for (auto &task: pendingLoads) {
+            if (task->getState() == ModelLoadState::Uploaded) {
+                task->model->clean();
+            }
+        }
+        pendingLoads.clear();
         skybox->destroy(device);
         for(auto&model:models)
             model->clean();
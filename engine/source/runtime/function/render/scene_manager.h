@@ -1,11 +1,18 @@
 #pragma once
 
 #include "render_model.h"
+#include "render_resource.h"
+#include "texture_streamer.h"
+#include "virtual_texture.h"
+#include "core/base/thread_pool.h"
+#include <atomic>
+#include <memory>
 #include <vector>
 
 namespace MW {
     struct SceneManagerInitInfo {
         std::shared_ptr<VulkanDevice> device;
+        std::shared_ptr<RenderResource> renderResource;
     };
 
     struct PushConstBlock {
@@ -15,26 +22,138 @@ namespace MW {
 #endif
     };
 
+    enum class ModelLoadState : uint32_t {
+        Loading,  // 后台读取、解码、上传中
+        Uploaded, // 几何数据已在GPU上，等待主线程创建descriptor
+        Resident, // 已加入绘制列表
+        Failed
+    };
+
+    /*
+        Handle returned by SceneManager::loadModelAsync
+    */
+    class ModelLoadTask {
+    public:
+        ModelLoadState getState() const { return state.load(); }
+
+        bool isResident() const { return getState() == ModelLoadState::Resident; }
+
+        // 使用占位材质时，贴图是否已经替换为真正的贴图，只在主线程查询
+        bool isTexturesResident() const { return texturesBound; }
+
+        std::shared_ptr<Model> getModel() const { return model; }
+
+    private:
+        friend class SceneManager;
+
+        std::shared_ptr<Model> model;
+        std::string filename;
+        uint32_t fileLoadingFlags{FileLoadingFlags::None};
+        glm::vec3 position{0.0f};
+        float scale{1.0f};
+        std::atomic<ModelLoadState> state{ModelLoadState::Loading};
+        std::atomic<bool> texturesUploaded{false};
+        bool texturesBound{false};
+    };
+
+    using ModelLoadHandle = std::shared_ptr<ModelLoadTask>;
+
     class SceneManager {
     public:
+        // 场景模型的加载flags，MWCooker按相同的flags离线生成模型缓存
+        static constexpr uint32_t modelLoadingFlags =
+                FileLoadingFlags::PreTransformVertices | FileLoadingFlags::FlipY | FileLoadingFlags::OptimizeMeshes |
+                FileLoadingFlags::GenerateLods | FileLoadingFlags::UseModelCache;
+
         void
         loadModel(const std::string &filename,uint32_t fileLoadingFlags = FileLoadingFlags::None,
                   glm::vec3 modelPos = glm::vec3(0.0f), float scale = 1.0);
 
+        // 在后台线程读取、解码并上传模型，完成后由update()在主线程加入绘制列表
+        // usePlaceholderMaterials为true时几何数据上传完就开始绘制，贴图上传完之前使用占位材质
+        ModelLoadHandle
+        loadModelAsync(const std::string &filename, uint32_t fileLoadingFlags = FileLoadingFlags::None,
+                       glm::vec3 modelPos = glm::vec3(0.0f), float scale = 1.0, bool usePlaceholderMaterials = true);
+
+        // 每帧录制命令之前调用，把后台加载完成的模型加入绘制列表
+        void update();
+
+        size_t getModelCount() const { return models.size(); }
+
+        // 动态物体的阴影叠加在缓存的静态阴影之上，移动时只需要重画它们覆盖的cascade
+        void setModelDynamic(uint32_t index, bool dynamic);
+
+        void setModelPosition(uint32_t index, glm::vec3 modelPos);
+
+        bool hasDynamicModels() const;
+
+        // 动态物体在世界空间的包围球，xyz为球心，w为半径
+        void getDynamicBounds(std::vector<glm::vec4> &bounds) const;
+
+        // 静态几何变化(加入模型、移动静态模型)时递增，阴影缓存据此失效
+        uint64_t getStaticVersion() const { return staticVersion; }
+
+        // 动态物体移动时递增
+        uint64_t getDynamicVersion() const { return dynamicVersion; }
+
         void
         draw(VkCommandBuffer commandBuffer, uint32_t renderFlags = 0, VkPipelineLayout pipelineLayout = VK_NULL_HANDLE,
-             uint32_t bindImageSet = 1, PushConstBlock *pushConstant = nullptr, uint32_t pushSize = 0, bool bUseMeshShader = false);
+             uint32_t bindImageSet = 1, PushConstBlock *pushConstant = nullptr, uint32_t pushSize = 0, bool bUseMeshShader = false,
+             const LodSelection *lodSelection = nullptr, const LayerSelection *layerSelection = nullptr);
+
+        // 主相机视角的LOD选择参数，阈值单位为像素
+        LodSelection getMainViewLodSelection();
+
+        // 阴影视角的LOD选择参数，阈值单位为shadow map texel
+        LodSelection getShadowLodSelection(const glm::mat4 &lightViewProjection, uint32_t shadowMapWidth);
 
         void initialize(SceneManagerInitInfo *initInfo);
 
+        // 停止后台加载和贴图流送线程，之后不会再有提交到队列的上传，必须在vkDeviceWaitIdle和销毁pass之前调用
+        void stopLoading();
+
         void clean();
 
         std::shared_ptr<VulkanTextureCubeMap> getSkyBox() { return skybox; }
 
+        // IBL预计算用它查找离线烘焙的结果
+        const std::string &getSkyBoxFile() const { return skyboxFile; }
+
+        // 贴图mip流送，显存预算等参数在这里调整
+        TextureStreamer *getTextureStreamer() { return textureStreamer.get(); }
+
+        // G-buffer pass使用的虚拟贴图，pass初始化时需要它的descriptor set layout
+        VirtualTexture *getVirtualTexture() { return virtualTexture.get(); }
+
+        bool enableLod{true};
+        float lodErrorThreshold{1.0f};
+        // 阴影允许更大的误差，cascade使用更粗的LOD
+        float shadowLodErrorThreshold{4.0f};
+        // 在initialize之前设置，流送的基础色贴图改为按页驻留在固定大小的atlas中
+        bool enableVirtualTexture{false};
+
     private:
+        void addModel(const std::shared_ptr<Model> &model, glm::vec3 modelPos);
+
+        void updateTextureStreaming();
+
         std::shared_ptr<VulkanDevice> device;
+        std::shared_ptr<RenderResource> renderResource;
         std::vector<std::shared_ptr<Model>> models; /* 存指针！！！不然扩容时会全析构 */
         std::vector<glm::vec3> modelPoss;
+        std::vector<char> modelDynamic;
+        uint64_t staticVersion{0};
+        uint64_t dynamicVersion{0};
         std::shared_ptr<VulkanTextureCubeMap> skybox;
+        std::string skyboxFile;
+        // 单独的加载线程，模型加载内部还会使用全局线程池解码图片
+        std::unique_ptr<ThreadPool> loaderThread;
+        std::vector<ModelLoadHandle> pendingLoads;
+        std::atomic<bool> loadCancelled{false};
+        std::unique_ptr<TextureStreamer> textureStreamer;
+        uint64_t materialVersion{0};
+        std::unique_ptr<VirtualTexture> virtualTexture;
+        // 新模型的贴图就绪时置为invalid，强制重新获取材质的虚拟贴图序号
+        uint64_t virtualTextureVersion{0};
     };
 }
\ No newline at end of file
@@ -0,0 +1,507 @@
+#include "texture_compressor.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+
+#include "core/base/thread_pool.h"
+#include "core/file/virtual_file_system.h"
+#include "function/render/image_decoder.h"
+#include "function/render/rhi/vulkan_device.h"
+
+namespace MW {
+    TextureUsage resolveTextureUsage(uint32_t usageMask) {
+        for (uint32_t usage = 0; usage < static_cast<uint32_t>(TextureUsage::Count); ++usage) {
+            if (usageMask == (1u << usage)) {
+                return static_cast<TextureUsage>(usage);
+            }
+        }
+        return TextureUsage::Color;
+    }
+
+    VkFormat getCompressedFormat(TextureUsage usage) {
+        switch (usage) {
+            case TextureUsage::Color:
+                // 现有的shader把base color当作UNORM读取，保持一致
+                return VK_FORMAT_BC7_UNORM_BLOCK;
+            case TextureUsage::Normal:
+            case TextureUsage::MetallicRoughness:
+                return VK_FORMAT_BC5_UNORM_BLOCK;
+            case TextureUsage::Occlusion:
+                return VK_FORMAT_BC4_UNORM_BLOCK;
+            default:
+                return VK_FORMAT_UNDEFINED;
+        }
+    }
+
+    bool isCompressedFormatSupported(VulkanDevice *device, VkFormat format) {
+        if (format == VK_FORMAT_UNDEFINED || !device->enabledFeatures.textureCompressionBC) {
+            return false;
+        }
+        VkFormatProperties formatProperties;
+        device->GetPhysicalDeviceFormatProperties(format, &formatProperties);
+        return (formatProperties.optimalTilingFeatures & VK_FORMAT_FEATURE_SAMPLED_IMAGE_BIT) &&
+               (formatProperties.optimalTilingFeatures & VK_FORMAT_FEATURE_TRANSFER_DST_BIT);
+    }
+
+    VkComponentMapping getCompressedComponentMapping(TextureUsage usage) {
+        switch (usage) {
+            case TextureUsage::MetallicRoughness:
+                // BC5的RG存roughness和metallic，映射回glTF的G和B
+                return {VK_COMPONENT_SWIZZLE_ONE, VK_COMPONENT_SWIZZLE_R, VK_COMPONENT_SWIZZLE_G,
+                        VK_COMPONENT_SWIZZLE_ONE};
+            case TextureUsage::Occlusion:
+                return {VK_COMPONENT_SWIZZLE_R, VK_COMPONENT_SWIZZLE_R, VK_COMPONENT_SWIZZLE_R,
+                        VK_COMPONENT_SWIZZLE_ONE};
+            case TextureUsage::Normal:
+                return {VK_COMPONENT_SWIZZLE_R, VK_COMPONENT_SWIZZLE_G, VK_COMPONENT_SWIZZLE_ONE,
+                        VK_COMPONENT_SWIZZLE_ONE};
+            default:
+                return {VK_COMPONENT_SWIZZLE_IDENTITY, VK_COMPONENT_SWIZZLE_IDENTITY, VK_COMPONENT_SWIZZLE_IDENTITY,
+                        VK_COMPONENT_SWIZZLE_IDENTITY};
+        }
+    }
+
+    namespace {
+        // 小端序按位写入128位的块
+        struct BlockWriter {
+            unsigned char *block;
+            uint32_t bit{0};
+
+            void write(uint32_t value, uint32_t bitCount) {
+                for (uint32_t i = 0; i < bitCount; ++i, ++bit) {
+                    if (value & (1u << i)) {
+                        block[bit >> 3] |= static_cast<unsigned char>(1u << (bit & 7));
+                    }
+                }
+            }
+        };
+
+        const uint32_t bc7Weights4[16] = {0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47, 51, 55, 60, 64};
+
+        // 按p位量化到7位，返回量化后的8位值
+        uint32_t quantizeEndpoint(const float endpoint[4], uint32_t quantized[4]) {
+            uint32_t bestP = 0;
+            float bestError = 1e30f;
+            for (uint32_t p = 0; p < 2; ++p) {
+                float error = 0.0f;
+                for (uint32_t c = 0; c < 4; ++c) {
+                    const float q = std::round((endpoint[c] - static_cast<float>(p)) * 0.5f);
+                    const float clamped = std::min(127.0f, std::max(0.0f, q));
+                    const float value = clamped * 2.0f + static_cast<float>(p);
+                    error += (value - endpoint[c]) * (value - endpoint[c]);
+                }
+                if (error < bestError) {
+                    bestError = error;
+                    bestP = p;
+                }
+            }
+            for (uint32_t c = 0; c < 4; ++c) {
+                const float q = std::round((endpoint[c] - static_cast<float>(bestP)) * 0.5f);
+                quantized[c] = static_cast<uint32_t>(std::min(127.0f, std::max(0.0f, q)));
+            }
+            return bestP;
+        }
+
+        // 返回所有像素选最近调色板颜色时的误差
+        float selectBC7Indices(const unsigned char *rgba, const uint32_t q0[4], uint32_t p0, const uint32_t q1[4],
+                               uint32_t p1, uint32_t indices[16]) {
+            int32_t palette[16][4];
+            for (uint32_t i = 0; i < 16; ++i) {
+                for (uint32_t c = 0; c < 4; ++c) {
+                    const int32_t e0 = static_cast<int32_t>(q0[c] << 1 | p0);
+                    const int32_t e1 = static_cast<int32_t>(q1[c] << 1 | p1);
+                    palette[i][c] = ((64 - static_cast<int32_t>(bc7Weights4[i])) * e0 +
+                                     static_cast<int32_t>(bc7Weights4[i]) * e1 + 32) >> 6;
+                }
+            }
+            float totalError = 0.0f;
+            for (uint32_t p = 0; p < 16; ++p) {
+                int32_t bestError = INT32_MAX;
+                for (uint32_t i = 0; i < 16; ++i) {
+                    int32_t error = 0;
+                    for (uint32_t c = 0; c < 4; ++c) {
+                        const int32_t d = static_cast<int32_t>(rgba[p * 4 + c]) - palette[i][c];
+                        error += d * d;
+                    }
+                    if (error < bestError) {
+                        bestError = error;
+                        indices[p] = i;
+                    }
+                }
+                totalError += static_cast<float>(bestError);
+            }
+            return totalError;
+        }
+    }
+
+    void encodeBC4Block(const unsigned char *rgba, uint32_t channel, unsigned char *block) {
+        uint32_t minValue = 255, maxValue = 0;
+        for (uint32_t p = 0; p < 16; ++p) {
+            minValue = std::min<uint32_t>(minValue, rgba[p * 4 + channel]);
+            maxValue = std::max<uint32_t>(maxValue, rgba[p * 4 + channel]);
+        }
+        // 端点0大于端点1时使用8级插值，相等时所有索引为0
+        block[0] = static_cast<unsigned char>(maxValue);
+        block[1] = static_cast<unsigned char>(minValue);
+        uint64_t bits = 0;
+        if (maxValue > minValue) {
+            uint32_t palette[8];
+            palette[0] = maxValue;
+            palette[1] = minValue;
+            for (uint32_t i = 2; i < 8; ++i) {
+                palette[i] = ((8 - i) * maxValue + (i - 1) * minValue) / 7;
+            }
+            for (uint32_t p = 0; p < 16; ++p) {
+                const int32_t value = rgba[p * 4 + channel];
+                uint32_t bestIndex = 0;
+                int32_t bestError = INT32_MAX;
+                for (uint32_t i = 0; i < 8; ++i) {
+                    const int32_t error = std::abs(value - static_cast<int32_t>(palette[i]));
+                    if (error < bestError) {
+                        bestError = error;
+                        bestIndex = i;
+                    }
+                }
+                bits |= static_cast<uint64_t>(bestIndex) << (p * 3);
+            }
+        }
+        for (uint32_t i = 0; i < 6; ++i) {
+            block[2 + i] = static_cast<unsigned char>(bits >> (i * 8));
+        }
+    }
+
+    void encodeBC5Block(const unsigned char *rgba, uint32_t channel0, uint32_t channel1, unsigned char *block) {
+        encodeBC4Block(rgba, channel0, block);
+        encodeBC4Block(rgba, channel1, block + 8);
+    }
+
+    void encodeBC7Block(const unsigned char *rgba, unsigned char *block) {
+        // 沿主轴方向取投影的两端作为端点
+        float mean[4] = {};
+        for (uint32_t p = 0; p < 16; ++p) {
+            for (uint32_t c = 0; c < 4; ++c) {
+                mean[c] += static_cast<float>(rgba[p * 4 + c]) / 16.0f;
+            }
+        }
+        float covariance[4][4] = {};
+        for (uint32_t p = 0; p < 16; ++p) {
+            float d[4];
+            for (uint32_t c = 0; c < 4; ++c) {
+                d[c] = static_cast<float>(rgba[p * 4 + c]) - mean[c];
+            }
+            for (uint32_t i = 0; i < 4; ++i) {
+                for (uint32_t j = 0; j < 4; ++j) {
+                    covariance[i][j] += d[i] * d[j];
+                }
+            }
+        }
+        float axis[4] = {1.0f, 1.0f, 1.0f, 1.0f};
+        for (uint32_t iteration = 0; iteration < 8; ++iteration) {
+            float next[4] = {};
+            for (uint32_t i = 0; i < 4; ++i) {
+                for (uint32_t j = 0; j < 4; ++j) {
+                    next[i] += covariance[i][j] * axis[j];
+                }
+            }
+            const float length = std::sqrt(next[0] * next[0] + next[1] * next[1] + next[2] * next[2] +
+                                           next[3] * next[3]);
+            if (length < 1e-6f) {
+                break;
+            }
+            for (uint32_t c = 0; c < 4; ++c) {
+                axis[c] = next[c] / length;
+            }
+        }
+        float minProjection = 1e30f, maxProjection = -1e30f;
+        for (uint32_t p = 0; p < 16; ++p) {
+            float projection = 0.0f;
+            for (uint32_t c = 0; c < 4; ++c) {
+                projection += (static_cast<float>(rgba[p * 4 + c]) - mean[c]) * axis[c];
+            }
+            minProjection = std::min(minProjection, projection);
+            maxProjection = std::max(maxProjection, projection);
+        }
+        float endpoints[2][4];
+        for (uint32_t c = 0; c < 4; ++c) {
+            endpoints[0][c] = std::min(255.0f, std::max(0.0f, mean[c] + axis[c] * minProjection));
+            endpoints[1][c] = std::min(255.0f, std::max(0.0f, mean[c] + axis[c] * maxProjection));
+        }
+
+        uint32_t q0[4], q1[4], indices[16];
+        uint32_t p0 = quantizeEndpoint(endpoints[0], q0);
+        uint32_t p1 = quantizeEndpoint(endpoints[1], q1);
+        float error = selectBC7Indices(rgba, q0, p0, q1, p1, indices);
+
+        // 用选出的索引做一次最小二乘优化端点
+        float a = 0.0f, b = 0.0f, c2 = 0.0f, x0[4] = {}, x1[4] = {};
+        for (uint32_t p = 0; p < 16; ++p) {
+            const float w = static_cast<float>(bc7Weights4[indices[p]]) / 64.0f;
+            a += (1.0f - w) * (1.0f - w);
+            b += (1.0f - w) * w;
+            c2 += w * w;
+            for (uint32_t c = 0; c < 4; ++c) {
+                x0[c] += (1.0f - w) * static_cast<float>(rgba[p * 4 + c]);
+                x1[c] += w * static_cast<float>(rgba[p * 4 + c]);
+            }
+        }
+        const float determinant = a * c2 - b * b;
+        if (std::abs(determinant) > 1e-6f) {
+            float refined[2][4];
+            for (uint32_t c = 0; c < 4; ++c) {
+                refined[0][c] = std::min(255.0f, std::max(0.0f, (c2 * x0[c] - b * x1[c]) / determinant));
+                refined[1][c] = std::min(255.0f, std::max(0.0f, (a * x1[c] - b * x0[c]) / determinant));
+            }
+            uint32_t r0[4], r1[4], refinedIndices[16];
+            const uint32_t rp0 = quantizeEndpoint(refined[0], r0);
+            const uint32_t rp1 = quantizeEndpoint(refined[1], r1);
+            const float refinedError = selectBC7Indices(rgba, r0, rp0, r1, rp1, refinedIndices);
+            if (refinedError < error) {
+                std::copy(r0, r0 + 4, q0);
+                std::copy(r1, r1 + 4, q1);
+                std::copy(refinedIndices, refinedIndices + 16, indices);
+                p0 = rp0;
+                p1 = rp1;
+            }
+        }
+
+        // 第一个像素的索引最高位隐含为0，需要时交换端点
+        if (indices[0] & 8) {
+            std::swap(q0, q1);
+            std::swap(p0, p1);
+            for (uint32_t &index: indices) {
+                index = 15 - index;
+            }
+        }
+
+        memset(block, 0, 16);
+        BlockWriter writer{block};
+        writer.write(1u << 6, 7);
+        for (uint32_t c = 0; c < 4; ++c) {
+            writer.write(q0[c], 7);
+            writer.write(q1[c], 7);
+        }
+        writer.write(p0, 1);
+        writer.write(p1, 1);
+        writer.write(indices[0], 3);
+        for (uint32_t p = 1; p < 16; ++p) {
+            writer.write(indices[p], 4);
+        }
+    }
+
+    void compressImage(const unsigned char *pixels, uint32_t width, uint32_t height, uint32_t component,
+                       TextureUsage usage, CompressedImage &image) {
+        image.format = getCompressedFormat(usage);
+        image.width = width;
+        image.height = height;
+        const uint32_t blockBytes = usage == TextureUsage::Occlusion ? 8 : 16;
+
+        std::vector<std::vector<unsigned char>> mipChain = generateMipChain(pixels, width, height, component, 0);
+        image.levels.resize(mipChain.size());
+        for (uint32_t level = 0; level < mipChain.size(); ++level) {
+            const uint32_t levelWidth = std::max(1u, width >> level);
+            const uint32_t levelHeight = std::max(1u, height >> level);
+            const uint32_t blocksX = (levelWidth + 3) / 4;
+            const uint32_t blocksY = (levelHeight + 3) / 4;
+            const unsigned char *source = mipChain[level].data();
+            std::vector<unsigned char> &blocks = image.levels[level];
+            blocks.resize(static_cast<size_t>(blocksX) * blocksY * blockBytes);
+
+            ThreadPool::global().parallelFor(blocksY, [&](uint32_t by) {
+                unsigned char texels[64];
+                for (uint32_t bx = 0; bx < blocksX; ++bx) {
+                    // 边缘不足4x4的块重复最后一行/列
+                    for (uint32_t y = 0; y < 4; ++y) {
+                        const uint32_t sy = std::min(by * 4 + y, levelHeight - 1);
+                        for (uint32_t x = 0; x < 4; ++x) {
+                            const uint32_t sx = std::min(bx * 4 + x, levelWidth - 1);
+                            memcpy(texels + (y * 4 + x) * 4, source + (static_cast<size_t>(sy) * levelWidth + sx) * 4,
+                                   4);
+                        }
+                    }
+                    unsigned char *block = blocks.data() + (static_cast<size_t>(by) * blocksX + bx) * blockBytes;
+                    switch (usage) {
+                        case TextureUsage::Color:
+                            encodeBC7Block(texels, block);
+                            break;
+                        case TextureUsage::Normal:
+                            encodeBC5Block(texels, 0, 1, block);
+                            break;
+                        case TextureUsage::MetallicRoughness:
+                            encodeBC5Block(texels, 1, 2, block);
+                            break;
+                        default:
+                            encodeBC4Block(texels, 0, block);
+                            break;
+                    }
+                }
+            });
+            std::vector<unsigned char>().swap(mipChain[level]);
+        }
+    }
+
+    namespace {
+        const unsigned char ktx2Identifier[12] = {0xAB, 0x4B, 0x54, 0x58, 0x20, 0x32, 0x30, 0xBB, 0x0D, 0x0A, 0x1A,
+                                                  0x0A};
+
+        // 头部紧跟在12字节的identifier之后，64位字段不是8字节对齐的
+#pragma pack(push, 4)
+        struct Ktx2Header {
+            uint32_t vkFormat;
+            uint32_t typeSize;
+            uint32_t pixelWidth;
+            uint32_t pixelHeight;
+            uint32_t pixelDepth;
+            uint32_t layerCount;
+            uint32_t faceCount;
+            uint32_t levelCount;
+            uint32_t supercompressionScheme;
+            uint32_t dfdByteOffset;
+            uint32_t dfdByteLength;
+            uint32_t kvdByteOffset;
+            uint32_t kvdByteLength;
+            uint64_t sgdByteOffset;
+            uint64_t sgdByteLength;
+        };
+#pragma pack(pop)
+        static_assert(sizeof(Ktx2Header) == 68, "KTX2 header layout");
+
+        struct Ktx2Level {
+            uint64_t byteOffset;
+            uint64_t byteLength;
+            uint64_t uncompressedByteLength;
+        };
+
+        // Khronos Data Format的颜色模型
+        const uint32_t KHR_DF_MODEL_BC4 = 131;
+        const uint32_t KHR_DF_MODEL_BC5 = 132;
+        const uint32_t KHR_DF_MODEL_BC7 = 134;
+
+        std::vector<uint32_t> createDataFormatDescriptor(VkFormat format) {
+            uint32_t colorModel = KHR_DF_MODEL_BC7, bytesPerBlock = 16, sampleCount = 1;
+            if (format == VK_FORMAT_BC4_UNORM_BLOCK) {
+                colorModel = KHR_DF_MODEL_BC4;
+                bytesPerBlock = 8;
+            } else if (format == VK_FORMAT_BC5_UNORM_BLOCK) {
+                colorModel = KHR_DF_MODEL_BC5;
+                sampleCount = 2;
+            }
+            const uint32_t transferFunction = format == VK_FORMAT_BC7_SRGB_BLOCK ? 2 : 1;
+            const uint32_t blockSize = 24 + 16 * sampleCount;
+            std::vector<uint32_t> dfd;
+            dfd.push_back(4 + blockSize);
+            dfd.push_back(0);                       // vendorId, descriptorType
+            dfd.push_back(2 | blockSize << 16);     // versionNumber, descriptorBlockSize
+            dfd.push_back(colorModel | 1u << 8 | transferFunction << 16);
+            dfd.push_back(3 | 3u << 8);             // 4x4块
+            dfd.push_back(bytesPerBlock);
+            dfd.push_back(0);
+            for (uint32_t i = 0; i < sampleCount; ++i) {
+                const uint32_t bitLength = (bytesPerBlock / sampleCount) * 8 - 1;
+                dfd.push_back(i * 64 | bitLength << 16 | i << 24);
+                dfd.push_back(0);
+                dfd.push_back(0);
+                dfd.push_back(0xFFFFFFFFu);
+            }
+            return dfd;
+        }
+
+        uint64_t alignUp(uint64_t value, uint64_t alignment) {
+            return (value + alignment - 1) / alignment * alignment;
+        }
+    }
+
+    bool writeKtx2(const std::string &filename, const CompressedImage &image) {
+        const std::vector<uint32_t> dfd = createDataFormatDescriptor(image.format);
+        const uint32_t levelCount = static_cast<uint32_t>(image.levels.size());
+
+        Ktx2Header header{};
+        header.vkFormat = image.format;
+        header.typeSize = 1;
+        header.pixelWidth = image.width;
+        header.pixelHeight = image.height;
+        header.faceCount = 1;
+        header.levelCount = levelCount;
+        header.dfdByteOffset = static_cast<uint32_t>(sizeof(ktx2Identifier) + sizeof(Ktx2Header) +
+                                                     sizeof(Ktx2Level) * levelCount);
+        header.dfdByteLength = static_cast<uint32_t>(dfd.size() * sizeof(uint32_t));
+
+        // 按规范小的mip在前，每级按16字节对齐
+        std::vector<Ktx2Level> levelIndex(levelCount);
+        uint64_t offset = header.dfdByteOffset + header.dfdByteLength;
+        for (uint32_t i = levelCount; i-- > 0;) {
+            offset = alignUp(offset, 16);
+            levelIndex[i].byteOffset = offset;
+            levelIndex[i].byteLength = image.levels[i].size();
+            levelIndex[i].uncompressedByteLength = image.levels[i].size();
+            offset += image.levels[i].size();
+        }
+
+        const std::string tempPath = filename + ".tmp";
+        {
+            std::ofstream out(tempPath, std::ios::binary | std::ios::trunc);
+            if (!out) {
+                std::cerr << "Could not write texture cache \"" << tempPath << "\"" << std::endl;
+                return false;
+            }
+            out.write(reinterpret_cast<const char *>(ktx2Identifier), sizeof(ktx2Identifier));
+            out.write(reinterpret_cast<const char *>(&header), sizeof(header));
+            out.write(reinterpret_cast<const char *>(levelIndex.data()),
+                      static_cast<std::streamsize>(levelIndex.size() * sizeof(Ktx2Level)));
+            out.write(reinterpret_cast<const char *>(dfd.data()), header.dfdByteLength);
+            uint64_t written = header.dfdByteOffset + header.dfdByteLength;
+            static const char padding[16] = {};
+            for (uint32_t i = levelCount; i-- > 0;) {
+                out.write(padding, static_cast<std::streamsize>(levelIndex[i].byteOffset - written));
+                out.write(reinterpret_cast<const char *>(image.levels[i].data()),
+                          static_cast<std::streamsize>(image.levels[i].size()));
+                written = levelIndex[i].byteOffset + levelIndex[i].byteLength;
+            }
+            if (!out) {
+                out.close();
+                std::remove(tempPath.c_str());
+                return false;
+            }
+        }
+        std::remove(filename.c_str());
+        if (std::rename(tempPath.c_str(), filename.c_str()) != 0) {
+            std::remove(tempPath.c_str());
+            return false;
+        }
+        return true;
+    }
+
+    bool readKtx2(const std::string &filename, CompressedImage &image) {
+        VirtualFile file;
+        if (!VirtualFileSystem::global().open(filename, file) || file.size() < sizeof(ktx2Identifier) + sizeof(Ktx2Header) ||
+            memcmp(file.data(), ktx2Identifier, sizeof(ktx2Identifier)) != 0) {
+            return false;
+        }
+        Ktx2Header header;
+        memcpy(&header, file.data() + sizeof(ktx2Identifier), sizeof(header));
+        if (header.supercompressionScheme != 0 || header.pixelDepth != 0 || header.layerCount > 1 ||
+            header.faceCount != 1 || header.levelCount == 0) {
+            std::cerr << "Unsupported KTX2 texture \"" << filename << "\"" << std::endl;
+            return false;
+        }
+        const size_t levelIndexOffset = sizeof(ktx2Identifier) + sizeof(Ktx2Header);
+        if (levelIndexOffset + sizeof(Ktx2Level) * header.levelCount > file.size()) {
+            return false;
+        }
+        image.format = static_cast<VkFormat>(header.vkFormat);
+        image.width = header.pixelWidth;
+        image.height = header.pixelHeight;
+        image.levels.resize(header.levelCount);
+        for (uint32_t i = 0; i < header.levelCount; ++i) {
+            Ktx2Level level;
+            memcpy(&level, file.data() + levelIndexOffset + sizeof(Ktx2Level) * i, sizeof(level));
+            if (level.byteOffset + level.byteLength > file.size()) {
+                return false;
+            }
+            image.levels[i].assign(file.data() + level.byteOffset, file.data() + level.byteOffset + level.byteLength);
+        }
+        return true;
+    }
+}
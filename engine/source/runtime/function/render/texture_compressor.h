@@ -0,0 +1,57 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "vulkan/vulkan.h"
+
+namespace MW {
+    // 贴图在材质中的用途，决定压缩格式和采样时的通道映射
+    enum class TextureUsage : uint32_t {
+        Color = 0,         // BC7，保留alpha
+        Normal,            // BC5，只存xy，shader中重建z
+        MetallicRoughness, // BC5，存glTF的G(roughness)和B(metallic)
+        Occlusion,         // BC4，存R
+        Count
+    };
+
+    struct CompressedImage {
+        VkFormat format{VK_FORMAT_UNDEFINED};
+        uint32_t width{0};
+        uint32_t height{0};
+        // levels[0]为最大的一级
+        std::vector<std::vector<unsigned char>> levels;
+    };
+
+    class VulkanDevice;
+
+    // usageMask的第i位表示图片被用作TextureUsage(i)，多种用途时(如打包的ORM贴图)退回Color，
+    // 按单一用途压缩会丢掉其他用途需要的通道
+    TextureUsage resolveTextureUsage(uint32_t usageMask);
+
+    VkFormat getCompressedFormat(TextureUsage usage);
+
+    // 设备需要开启textureCompressionBC且格式支持optimal tiling采样
+    bool isCompressedFormatSupported(VulkanDevice *device, VkFormat format);
+
+    // 采样压缩贴图时的通道映射，使shader读到和未压缩RGBA8相同的通道
+    VkComponentMapping getCompressedComponentMapping(TextureUsage usage);
+
+    // 每个4x4块的输入为16个RGBA8像素(按行存放)
+    void encodeBC4Block(const unsigned char *rgba, uint32_t channel, unsigned char *block);
+
+    void encodeBC5Block(const unsigned char *rgba, uint32_t channel0, uint32_t channel1, unsigned char *block);
+
+    // BC7 mode 6：单个子集，RGBA端点7位+p位，4位索引
+    void encodeBC7Block(const unsigned char *rgba, unsigned char *block);
+
+    // 在CPU上生成完整mip链并按用途块压缩，块在全局线程池上并行编码
+    void compressImage(const unsigned char *pixels, uint32_t width, uint32_t height, uint32_t component,
+                       TextureUsage usage, CompressedImage &image);
+
+    // 不带supercompression的KTX2文件，只支持2D、单层的块压缩格式
+    bool writeKtx2(const std::string &filename, const CompressedImage &image);
+
+    bool readKtx2(const std::string &filename, CompressedImage &image);
+}
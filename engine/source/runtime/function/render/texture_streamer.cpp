@@ -0,0 +1,366 @@
+#include "texture_streamer.h"
+
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+
+#include "stb_image.h"
+#include "core/file/virtual_file_system.h"
+#include "function/render/image_decoder.h"
+
+namespace MW {
+    TextureStreamingView TextureStreamingView::fromPerspective(const glm::mat4 &view, const glm::mat4 &projection,
+                                                               float viewportHeight) {
+        TextureStreamingView streamingView{};
+        streamingView.viewPosition = glm::vec3(glm::inverse(view)[3]);
+        streamingView.projectionScale = std::abs(projection[1][1]) * viewportHeight * 0.5f;
+
+        // 从裁剪矩阵的行提取视锥平面，深度范围为[0, 1]
+        const glm::mat4 viewProjection = projection * view;
+        const glm::vec4 row0(viewProjection[0][0], viewProjection[1][0], viewProjection[2][0], viewProjection[3][0]);
+        const glm::vec4 row1(viewProjection[0][1], viewProjection[1][1], viewProjection[2][1], viewProjection[3][1]);
+        const glm::vec4 row2(viewProjection[0][2], viewProjection[1][2], viewProjection[2][2], viewProjection[3][2]);
+        const glm::vec4 row3(viewProjection[0][3], viewProjection[1][3], viewProjection[2][3], viewProjection[3][3]);
+        streamingView.planes[0] = row3 + row0;
+        streamingView.planes[1] = row3 - row0;
+        streamingView.planes[2] = row3 + row1;
+        streamingView.planes[3] = row3 - row1;
+        streamingView.planes[4] = row2;
+        streamingView.planes[5] = row3 - row2;
+        for (glm::vec4 &plane: streamingView.planes) {
+            plane /= glm::length(glm::vec3(plane));
+        }
+        return streamingView;
+    }
+
+    bool TextureStreamingView::isVisible(const glm::vec3 &center, float radius) const {
+        for (const glm::vec4 &plane: planes) {
+            if (glm::dot(glm::vec3(plane), center) + plane.w < -radius) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    float TextureStreamingView::projectedDiameter(const glm::vec3 &center, float radius) const {
+        // 相机在包围球内时按贴着球面计算
+        const float distance = std::max(glm::distance(viewPosition, center), radius);
+        return distance > 0.0f ? 2.0f * radius * projectionScale / distance : 0.0f;
+    }
+
+    void TextureStreamer::initialize(std::shared_ptr<VulkanDevice> device,
+                                     std::shared_ptr<RenderResource> renderResource) {
+        this->device = device;
+        this->renderResource = renderResource;
+        cancelled = false;
+        worker = std::make_unique<ThreadPool>(1);
+    }
+
+    void TextureStreamer::stop() {
+        // 正在进行的流送做完，排队中的直接返回
+        cancelled = true;
+        std::vector<AsyncFileReader::RequestId> reads;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            reads.assign(pendingReads.begin(), pendingReads.end());
+        }
+        for (AsyncFileReader::RequestId id: reads) {
+            AsyncFileReader::global().cancel(id);
+        }
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            readCondition.wait(lock, [this]() { return pendingReadCount == 0; });
+            pendingReads.clear();
+        }
+        worker.reset();
+    }
+
+    void TextureStreamer::clean() {
+        stop();
+        for (CompletedJob &job: completedJobs) {
+            if (job.success) {
+                job.texture.destroy();
+            }
+        }
+        completedJobs.clear();
+        destroyRetired(true);
+        trackedTextures.clear();
+        inFlightJobs = 0;
+        pendingBytes = 0;
+    }
+
+    std::shared_ptr<TextureStreamer::StreamedImage>
+    TextureStreamer::createTexture(Texture &texture, const unsigned char *pixels, uint32_t width, uint32_t height,
+                                   uint32_t component, VulkanDevice *device) {
+        const uint32_t mipLevels = static_cast<uint32_t>(std::floor(std::log2(std::max(width, height)))) + 1;
+        uint32_t tailFirstLevel = 0;
+        while (tailFirstLevel + 1 < mipLevels && std::max(width, height) >> tailFirstLevel > tailSize) {
+            ++tailFirstLevel;
+        }
+        if (tailFirstLevel == 0) {
+            texture.fromPixels(pixels, width, height, component, device);
+            return nullptr;
+        }
+
+        auto image = std::make_shared<StreamedImage>();
+        image->width = width;
+        image->height = height;
+        image->mipLevels = mipLevels;
+        image->tailFirstLevel = tailFirstLevel;
+        image->tailLevels = generateMipChain(pixels, width, height, component, tailFirstLevel);
+        texture.fromMipChain(image->tailLevels, std::max(1u, width >> tailFirstLevel),
+                             std::max(1u, height >> tailFirstLevel), device);
+        return image;
+    }
+
+    void TextureStreamer::track(size_t guid, std::shared_ptr<StreamedImage> image) {
+        if (guid == invalidGuid || !image) {
+            return;
+        }
+        std::lock_guard<std::mutex> lock(mutex);
+        // 相同内容的贴图只登记一次
+        if (trackedTextures.count(guid)) {
+            return;
+        }
+        TrackedTexture &tracked = trackedTextures[guid];
+        tracked.residentLevel = image->tailFirstLevel;
+        tracked.desiredLevel = image->tailFirstLevel;
+        tracked.lastVisibleFrame = frameIndex;
+        tracked.image = std::move(image);
+    }
+
+    void TextureStreamer::requestResolution(size_t guid, float pixels) {
+        std::lock_guard<std::mutex> lock(mutex);
+        auto it = trackedTextures.find(guid);
+        if (it != trackedTextures.end()) {
+            it->second.requestedPixels = std::max(it->second.requestedPixels, pixels);
+        }
+    }
+
+    size_t TextureStreamer::getTrackedCount() {
+        std::lock_guard<std::mutex> lock(mutex);
+        return trackedTextures.size();
+    }
+
+    void TextureStreamer::update() {
+        ++frameIndex;
+        applyCompletedJobs();
+        destroyRetired(false);
+
+        std::lock_guard<std::mutex> lock(mutex);
+        std::vector<size_t> upgrades;
+        for (auto &it: trackedTextures) {
+            TrackedTexture &tracked = it.second;
+            if (tracked.requestedPixels > 0.0f) {
+                // 屏幕上需要的texel数对应的mip层级
+                const StreamedImage &image = *tracked.image;
+                const float texels = static_cast<float>(std::max(image.width, image.height)) * texelDensityScale;
+                const float level = std::floor(std::log2(std::max(texels / tracked.requestedPixels, 1.0f)));
+                tracked.desiredLevel = std::min(static_cast<uint32_t>(level), image.tailFirstLevel);
+                tracked.lastVisibleFrame = frameIndex;
+                tracked.screenPixels = tracked.requestedPixels;
+                tracked.requestedPixels = 0.0f;
+            }
+            if (!tracked.jobPending && !tracked.failed && tracked.desiredLevel < tracked.residentLevel) {
+                upgrades.push_back(it.first);
+            }
+        }
+
+        // 缺的mip越多越先流送，相同时屏幕上越大越先
+        std::sort(upgrades.begin(), upgrades.end(), [this](size_t a, size_t b) {
+            const TrackedTexture &ta = trackedTextures[a], &tb = trackedTextures[b];
+            const uint32_t da = ta.residentLevel - ta.desiredLevel, db = tb.residentLevel - tb.desiredLevel;
+            if (da != db) {
+                return da > db;
+            }
+            return ta.screenPixels > tb.screenPixels;
+        });
+
+        int64_t projectedBytes =
+                static_cast<int64_t>(renderResource->getResidentBytes(RenderResourceType::Texture)) + pendingBytes;
+        const int64_t budget = static_cast<int64_t>(memoryBudget);
+        bool evicted = false;
+        auto evict = [&]() {
+            // 很久没看到的贴图回退到尾部mip，最久没看到的先回退
+            evicted = true;
+            std::vector<size_t> candidates;
+            for (auto &it: trackedTextures) {
+                const TrackedTexture &tracked = it.second;
+                if (!tracked.jobPending && tracked.residentLevel < tracked.image->tailFirstLevel &&
+                    tracked.lastVisibleFrame + evictAfterFrames < frameIndex) {
+                    candidates.push_back(it.first);
+                }
+            }
+            std::sort(candidates.begin(), candidates.end(), [this](size_t a, size_t b) {
+                return trackedTextures[a].lastVisibleFrame < trackedTextures[b].lastVisibleFrame;
+            });
+            for (size_t guid: candidates) {
+                if (projectedBytes <= budget) {
+                    break;
+                }
+                TrackedTexture &tracked = trackedTextures[guid];
+                projectedBytes += static_cast<int64_t>(getChainBytes(*tracked.image, tracked.image->tailFirstLevel)) -
+                                  static_cast<int64_t>(getChainBytes(*tracked.image, tracked.residentLevel));
+                submitJob(guid, tracked, tracked.image->tailFirstLevel);
+            }
+        };
+        if (projectedBytes > budget) {
+            evict();
+        }
+
+        for (size_t guid: upgrades) {
+            if (inFlightJobs >= maxInFlightJobs) {
+                break;
+            }
+            TrackedTexture &tracked = trackedTextures[guid];
+            if (tracked.jobPending) {
+                continue;
+            }
+            const int64_t extraBytes = static_cast<int64_t>(getChainBytes(*tracked.image, tracked.desiredLevel)) -
+                                       static_cast<int64_t>(getChainBytes(*tracked.image, tracked.residentLevel));
+            if (projectedBytes + extraBytes > budget && !evicted) {
+                evict();
+            }
+            if (projectedBytes + extraBytes > budget) {
+                break;
+            }
+            projectedBytes += extraBytes;
+            submitJob(guid, tracked, tracked.desiredLevel);
+        }
+    }
+
+    size_t TextureStreamer::getChainBytes(const StreamedImage &image, uint32_t firstLevel) {
+        size_t bytes = 0;
+        for (uint32_t level = firstLevel; level < image.mipLevels; ++level) {
+            bytes += static_cast<size_t>(std::max(1u, image.width >> level)) * std::max(1u, image.height >> level) * 4;
+        }
+        return bytes;
+    }
+
+    void TextureStreamer::submitJob(size_t guid, TrackedTexture &tracked, uint32_t level) {
+        tracked.jobPending = true;
+        ++inFlightJobs;
+        pendingBytes += static_cast<int64_t>(getChainBytes(*tracked.image, level)) -
+                        static_cast<int64_t>(getChainBytes(*tracked.image, tracked.residentLevel));
+        std::shared_ptr<StreamedImage> image = tracked.image;
+        if (level >= image->tailFirstLevel || image->filename.empty() ||
+            VirtualFileSystem::global().isArchived(image->filename)) {
+            worker->submit([this, guid, image, level]() { runJob(guid, image, level, nullptr); });
+            return;
+        }
+        // 调用时已经持有mutex，回调在I/O线程上执行，需要等这里登记完才能拿到锁
+        ++pendingReadCount;
+        auto id = std::make_shared<AsyncFileReader::RequestId>(0);
+        *id = AsyncFileReader::global().read(
+                image->filename, AsyncFileReader::Priority::Normal,
+                [this, guid, image, level, id](AsyncFileReader::Result &result) {
+                    auto data = std::make_shared<std::vector<unsigned char>>(std::move(result.data));
+                    std::lock_guard<std::mutex> lock(mutex);
+                    // clean等待所有回调结束后才销毁worker
+                    worker->submit([this, guid, image, level, data]() { runJob(guid, image, level, data.get()); });
+                    pendingReads.erase(*id);
+                    --pendingReadCount;
+                    readCondition.notify_all();
+                });
+        pendingReads.insert(*id);
+    }
+
+    void TextureStreamer::runJob(size_t guid, const std::shared_ptr<StreamedImage> &image, uint32_t level,
+                                 const std::vector<unsigned char> *fileData) {
+        CompletedJob job;
+        job.guid = guid;
+        job.level = level;
+        if (!cancelled) {
+            const uint32_t levelWidth = std::max(1u, image->width >> level);
+            const uint32_t levelHeight = std::max(1u, image->height >> level);
+            if (level >= image->tailFirstLevel) {
+                // 回退只需要常驻的尾部mip
+                std::vector<std::vector<unsigned char>> levels(
+                        image->tailLevels.begin() + (level - image->tailFirstLevel), image->tailLevels.end());
+                job.texture.fromMipChain(levels, levelWidth, levelHeight, device.get());
+                job.success = true;
+            } else {
+                const unsigned char *data = image->data.data();
+                size_t size = image->data.size();
+                VirtualFile file;
+                if (fileData != nullptr) {
+                    data = fileData->data();
+                    size = fileData->size();
+                } else if (!image->filename.empty() && VirtualFileSystem::global().open(image->filename, file)) {
+                    data = file.data();
+                    size = file.size();
+                }
+                int width = 0, height = 0, component = 0;
+                unsigned char *pixels = size > 0 ? stbi_load_from_memory(data, static_cast<int>(size), &width,
+                                                                         &height, &component, 4) : nullptr;
+                if (pixels && static_cast<uint32_t>(width) == image->width &&
+                    static_cast<uint32_t>(height) == image->height) {
+                    std::vector<std::vector<unsigned char>> levels = generateMipChain(pixels, image->width,
+                                                                                      image->height, 4, level);
+                    job.texture.fromMipChain(levels, levelWidth, levelHeight, device.get());
+                    job.success = true;
+                } else {
+                    std::cerr << "Could not stream texture \"" << image->filename << "\"" << std::endl;
+                }
+                stbi_image_free(pixels);
+            }
+        }
+        std::lock_guard<std::mutex> lock(mutex);
+        completedJobs.push_back(std::move(job));
+    }
+
+    void TextureStreamer::applyCompletedJobs() {
+        std::vector<CompletedJob> jobs;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            jobs.swap(completedJobs);
+        }
+        for (CompletedJob &job: jobs) {
+            RetiredResources resources;
+            resources.frame = frameIndex;
+            bool replaced = false;
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                auto it = trackedTextures.find(job.guid);
+                if (it != trackedTextures.end()) {
+                    TrackedTexture &tracked = it->second;
+                    tracked.jobPending = false;
+                    --inFlightJobs;
+                    pendingBytes -= static_cast<int64_t>(getChainBytes(*tracked.image, job.level)) -
+                                    static_cast<int64_t>(getChainBytes(*tracked.image, tracked.residentLevel));
+                    if (!job.success) {
+                        tracked.failed = true;
+                        continue;
+                    }
+                    // 贴图已经被释放时不再流送
+                    replaced = renderResource->replaceTexture(job.guid, job.texture, resources.descriptorSets);
+                    if (replaced) {
+                        tracked.residentLevel = job.level;
+                    } else {
+                        trackedTextures.erase(it);
+                    }
+                }
+            }
+            if (!job.success) {
+                continue;
+            }
+            // 替换成功时job.texture是旧贴图，否则是没用上的新贴图
+            resources.texture = job.texture;
+            retired.push_back(std::move(resources));
+        }
+    }
+
+    void TextureStreamer::destroyRetired(bool all) {
+        // 录制过旧descriptor set的帧都执行完后才能销毁
+        while (!retired.empty() &&
+               (all || retired.front().frame + VulkanDevice::MAX_FRAMES_IN_FLIGHT + 1 <= frameIndex)) {
+            RetiredResources &resources = retired.front();
+            if (!resources.descriptorSets.empty()) {
+                device->FreeDescriptorSets(static_cast<uint32_t>(resources.descriptorSets.size()),
+                                           resources.descriptorSets.data());
+            }
+            resources.texture.destroy();
+            retired.pop_front();
+        }
+    }
+}
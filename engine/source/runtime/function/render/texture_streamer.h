@@ -0,0 +1,142 @@
+#pragma once
+
+#include "render_model.h"
+#include "render_resource.h"
+#include "core/base/thread_pool.h"
+#include "core/file/async_file_reader.h"
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+namespace MW {
+    /*
+        Main view used to estimate the on-screen size of primitives for texture streaming
+    */
+    struct TextureStreamingView {
+        glm::vec3 viewPosition{0.0f};
+        // 视口高度/(2*tan(fovy/2))
+        float projectionScale{0.0f};
+        glm::vec4 planes[6];
+
+        static TextureStreamingView fromPerspective(const glm::mat4& view, const glm::mat4& projection, float viewportHeight);
+        bool isVisible(const glm::vec3& center, float radius) const;
+        // 包围球投影到屏幕上的直径，单位像素
+        float projectedDiameter(const glm::vec3& center, float radius) const;
+    };
+
+    /*
+        Streams the high resolution mips of RenderResource textures in the background.
+        Textures are created with only their low resolution tail resident, each frame the visible primitives
+        request the resolution they cover on screen and the largest deficits are streamed first.
+        When over memoryBudget, textures that have not been visible for evictAfterFrames drop back to their tail
+    */
+    class TextureStreamer {
+    public:
+        // 流送贴图的来源和常驻CPU内存的尾部mip
+        struct StreamedImage {
+            // 外部图片文件，为空时使用data中的编码数据
+            std::string filename;
+            std::vector<unsigned char> data;
+            uint32_t width{0};
+            uint32_t height{0};
+            uint32_t mipLevels{0};
+            uint32_t tailFirstLevel{0};
+            std::vector<std::vector<unsigned char>> tailLevels;
+        };
+
+        void initialize(std::shared_ptr<VulkanDevice> device, std::shared_ptr<RenderResource> renderResource);
+
+        // 取消未完成的读取并等待流送线程结束，之后不会再提交上传，可以重复调用
+        void stop();
+
+        void clean();
+
+        // 尺寸大于tailSize时只上传尾部mip并返回流送信息，否则上传完整贴图并返回nullptr，可以在后台线程调用
+        std::shared_ptr<StreamedImage> createTexture(Texture& texture, const unsigned char* pixels, uint32_t width,
+                                                     uint32_t height, uint32_t component, VulkanDevice* device);
+
+        // 登记已加入RenderResource的贴图，可以在后台线程调用
+        void track(size_t guid, std::shared_ptr<StreamedImage> image);
+
+        // 记录本帧贴图覆盖的屏幕尺寸，只在主线程调用
+        void requestResolution(size_t guid, float pixels);
+
+        // 每帧在录制命令前调用一次：替换完成流送的贴图、回收旧资源、调度新的流送和丢弃
+        void update();
+
+        size_t getTrackedCount();
+
+        // 贴图显存预算，包括不参与流送的贴图
+        size_t memoryBudget{512ull * 1024 * 1024};
+        // 最大边不超过tailSize的mip常驻
+        uint32_t tailSize{128};
+        // uv在包围球上平铺次数的估计，越大需要的分辨率越高
+        float texelDensityScale{2.0f};
+        uint32_t evictAfterFrames{300};
+        // 文件读取是异步的，多个流送可以同时读，解码和上传在流送线程上依次进行
+        uint32_t maxInFlightJobs{4};
+
+    private:
+        struct TrackedTexture {
+            std::shared_ptr<StreamedImage> image;
+            // 当前驻留的最高分辨率mip在完整mip链中的层级
+            uint32_t residentLevel{0};
+            uint32_t desiredLevel{0};
+            // 本帧请求的屏幕尺寸，以及最近一次看到时的屏幕尺寸
+            float requestedPixels{0.0f};
+            float screenPixels{0.0f};
+            uint64_t lastVisibleFrame{0};
+            bool jobPending{false};
+            bool failed{false};
+        };
+
+        struct CompletedJob {
+            size_t guid{invalidGuid};
+            uint32_t level{0};
+            bool success{false};
+            Texture texture{};
+        };
+
+        struct RetiredResources {
+            uint64_t frame{0};
+            Texture texture{};
+            std::vector<VkDescriptorSet> descriptorSets;
+        };
+
+        static size_t getChainBytes(const StreamedImage& image, uint32_t firstLevel);
+
+        void submitJob(size_t guid, TrackedTexture& tracked, uint32_t level);
+
+        // fileData为异步读到的图片文件，使用内存中的数据时为nullptr
+        void runJob(size_t guid, const std::shared_ptr<StreamedImage>& image, uint32_t level,
+                    const std::vector<unsigned char>* fileData);
+
+        void applyCompletedJobs();
+
+        void destroyRetired(bool all);
+
+        std::shared_ptr<VulkanDevice> device;
+        std::shared_ptr<RenderResource> renderResource;
+        std::unordered_map<size_t, TrackedTexture> trackedTextures;
+        std::vector<CompletedJob> completedJobs;
+        std::deque<RetiredResources> retired;
+        // 单独的流送线程，不和模型加载抢全局线程池
+        std::unique_ptr<ThreadPool> worker;
+        std::atomic<bool> cancelled{false};
+        // 还没有回调的异步读，clean时取消并等待回调结束
+        std::unordered_set<AsyncFileReader::RequestId> pendingReads;
+        uint32_t pendingReadCount{0};
+        std::condition_variable readCondition;
+        uint32_t inFlightJobs{0};
+        // 正在进行的流送完成后显存的变化量
+        int64_t pendingBytes{0};
+        std::atomic<uint64_t> frameIndex{0};
+        std::mutex mutex;
+    };
+}
@@ -0,0 +1,645 @@
+#include "virtual_texture.h"
+
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+
+#include "stb_image.h"
+#include "core/file/virtual_file_system.h"
+#include "function/render/image_decoder.h"
+
+namespace MW {
+    namespace {
+        constexpr uint32_t pageBytes = VirtualTexture::pageSize * VirtualTexture::pageSize * 4;
+        // 反馈buffer开头的uvec4：宽、高、本帧写反馈的像素在feedbackScale块内的位置
+        constexpr VkDeviceSize feedbackHeaderBytes = 16;
+        constexpr uint32_t emptyFeedback = 0xffffffffu;
+
+        // 和采样器的MIRRORED_REPEAT一致
+        uint32_t mirrorTexel(int64_t texel, uint32_t size) {
+            const int64_t period = 2 * static_cast<int64_t>(size);
+            int64_t t = texel % period;
+            if (t < 0) {
+                t += period;
+            }
+            return static_cast<uint32_t>(t < size ? t : period - 1 - t);
+        }
+
+        uint32_t levelPages(uint32_t size, uint32_t level) {
+            return (std::max(1u, size >> level) + VirtualTexture::pagePayload - 1) / VirtualTexture::pagePayload;
+        }
+    }
+
+    void VirtualTexture::initialize(std::shared_ptr<VulkanDevice> device, TextureStreamer *textureStreamer,
+                                    bool enabled) {
+        this->device = device;
+        this->textureStreamer = textureStreamer;
+        this->enabled = enabled;
+        if (!enabled) {
+            // 只保留能写descriptor的最小资源
+            physicalPagesPerSide = 1;
+            maxTextures = 1;
+            maxTableEntries = 1;
+        }
+        physicalPagesPerSide = std::min(physicalPagesPerSide, 256u);
+        cancelled = false;
+        worker = std::make_unique<ThreadPool>(1);
+        createResources();
+    }
+
+    void VirtualTexture::createResources() {
+        VkImageCreateInfo imageCreateInfo{};
+        imageCreateInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+        imageCreateInfo.imageType = VK_IMAGE_TYPE_2D;
+        imageCreateInfo.format = VK_FORMAT_R8G8B8A8_UNORM;
+        imageCreateInfo.mipLevels = 1;
+        imageCreateInfo.arrayLayers = 1;
+        imageCreateInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+        imageCreateInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+        imageCreateInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+        imageCreateInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+        imageCreateInfo.extent = {physicalPagesPerSide * pageSize, physicalPagesPerSide * pageSize, 1};
+        imageCreateInfo.usage = VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT;
+        device->CreateImageWithInfo(imageCreateInfo, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, atlasImage, atlasMemory);
+        // 页的上传和采样交替进行，atlas一直处于GENERAL
+        device->transitionImageLayout(atlasImage, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_GENERAL);
+
+        VkImageViewCreateInfo viewInfo{};
+        viewInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+        viewInfo.image = atlasImage;
+        viewInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
+        viewInfo.format = VK_FORMAT_R8G8B8A8_UNORM;
+        viewInfo.subresourceRange = {VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1};
+        device->CreateImageView(&viewInfo, &atlasView);
+
+        VkSamplerCreateInfo samplerInfo{};
+        samplerInfo.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
+        samplerInfo.magFilter = VK_FILTER_LINEAR;
+        samplerInfo.minFilter = VK_FILTER_LINEAR;
+        samplerInfo.mipmapMode = VK_SAMPLER_MIPMAP_MODE_NEAREST;
+        samplerInfo.addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+        samplerInfo.addressModeV = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+        samplerInfo.addressModeW = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+        samplerInfo.maxLod = 0.0f;
+        samplerInfo.maxAnisotropy = 1.0f;
+        samplerInfo.borderColor = VK_BORDER_COLOR_FLOAT_OPAQUE_WHITE;
+        device->CreateSampler(&samplerInfo, &atlasSampler);
+
+        device->CreateBuffer(VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+                             VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+                             stagingBuffer, static_cast<VkDeviceSize>(maxPageUploadsPerFrame) * pageBytes);
+        device->MapMemory(stagingBuffer);
+        device->CreateBuffer(VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+                             VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+                             infoBuffer, static_cast<VkDeviceSize>(maxTextures) * sizeof(GpuImageInfo));
+        device->MapMemory(infoBuffer);
+
+        std::vector<VkDescriptorSetLayoutBinding> bindings = {
+                CreateDescriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
+                                                 VK_SHADER_STAGE_FRAGMENT_BIT, 0),
+                CreateDescriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_FRAGMENT_BIT, 1),
+                CreateDescriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_FRAGMENT_BIT, 2),
+                CreateDescriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_FRAGMENT_BIT, 3),
+        };
+        VkDescriptorSetLayoutCreateInfo layoutInfo{};
+        layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+        layoutInfo.pBindings = bindings.data();
+        layoutInfo.bindingCount = static_cast<uint32_t>(bindings.size());
+        device->CreateDescriptorSetLayout(&layoutInfo, &descriptorSetLayout);
+
+        const uint32_t feedbackEntries = enabled
+                                         ? ((device->width() + feedbackScale - 1) / feedbackScale) *
+                                           ((device->height() + feedbackScale - 1) / feedbackScale) : 1;
+        for (uint32_t i = 0; i < VulkanDevice::MAX_FRAMES_IN_FLIGHT; ++i) {
+            device->CreateBuffer(VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+                                 VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+                                 pageTableBuffers[i], static_cast<VkDeviceSize>(maxTableEntries) * sizeof(uint32_t));
+            device->MapMemory(pageTableBuffers[i]);
+            device->CreateDescriptorSet(1, descriptorSetLayout, descriptorSets[i]);
+            feedbackCapacity[i] = 0;
+            createFeedbackBuffer(i, feedbackEntries);
+        }
+        physicalPages.assign(static_cast<size_t>(physicalPagesPerSide) * physicalPagesPerSide, PhysicalPage{});
+        freeSlots.clear();
+        for (uint32_t slot = static_cast<uint32_t>(physicalPages.size()); slot > 0; --slot) {
+            freeSlots.push_back(slot - 1);
+        }
+    }
+
+    void VirtualTexture::createFeedbackBuffer(uint32_t frame, uint32_t entries) {
+        if (feedbackCapacity[frame] > 0) {
+            device->unMapMemory(feedbackBuffers[frame]);
+            device->DestroyVulkanBuffer(feedbackBuffers[frame]);
+        }
+        feedbackCapacity[frame] = entries;
+        const VkDeviceSize size = feedbackHeaderBytes + static_cast<VkDeviceSize>(entries) * 2 * sizeof(uint32_t);
+        device->CreateBuffer(VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+                             VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+                             feedbackBuffers[frame], size);
+        device->MapMemory(feedbackBuffers[frame]);
+        // 宽高为0时shader不写反馈
+        memset(feedbackBuffers[frame].mapped, 0, feedbackHeaderBytes);
+        memset(static_cast<unsigned char *>(feedbackBuffers[frame].mapped) + feedbackHeaderBytes, 0xff,
+               size - feedbackHeaderBytes);
+
+        VkDescriptorImageInfo atlasInfo{atlasSampler, atlasView, VK_IMAGE_LAYOUT_GENERAL};
+        VkDescriptorBufferInfo infoBufferInfo{infoBuffer.buffer, 0, VK_WHOLE_SIZE};
+        VkDescriptorBufferInfo pageTableInfo{pageTableBuffers[frame].buffer, 0, VK_WHOLE_SIZE};
+        VkDescriptorBufferInfo feedbackInfo{feedbackBuffers[frame].buffer, 0, VK_WHOLE_SIZE};
+        std::array<VkWriteDescriptorSet, 4> writes{};
+        for (uint32_t binding = 0; binding < writes.size(); ++binding) {
+            writes[binding].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+            writes[binding].dstSet = descriptorSets[frame];
+            writes[binding].dstBinding = binding;
+            writes[binding].descriptorCount = 1;
+            writes[binding].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+        }
+        writes[0].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+        writes[0].pImageInfo = &atlasInfo;
+        writes[1].pBufferInfo = &infoBufferInfo;
+        writes[2].pBufferInfo = &pageTableInfo;
+        writes[3].pBufferInfo = &feedbackInfo;
+        device->UpdateDescriptorSets(static_cast<uint32_t>(writes.size()), writes.data());
+    }
+
+    void VirtualTexture::clean() {
+        cancelled = true;
+        worker.reset();
+        for (uint32_t i = 0; i < VulkanDevice::MAX_FRAMES_IN_FLIGHT; ++i) {
+            device->unMapMemory(pageTableBuffers[i]);
+            device->DestroyVulkanBuffer(pageTableBuffers[i]);
+            device->unMapMemory(feedbackBuffers[i]);
+            device->DestroyVulkanBuffer(feedbackBuffers[i]);
+            feedbackCapacity[i] = 0;
+        }
+        device->FreeDescriptorSets(static_cast<uint32_t>(descriptorSets.size()), descriptorSets.data());
+        device->DestroyDescriptorSetLayout(descriptorSetLayout);
+        device->unMapMemory(infoBuffer);
+        device->DestroyVulkanBuffer(infoBuffer);
+        device->unMapMemory(stagingBuffer);
+        device->DestroyVulkanBuffer(stagingBuffer);
+        device->DestroySampler(atlasSampler);
+        device->DestroyImageView(atlasView);
+        device->DestroyImage(atlasImage);
+        device->FreeMemory(atlasMemory);
+
+        images.clear();
+        imageIndices.clear();
+        pageTable.clear();
+        for (auto &dirty: dirtyEntries) {
+            dirty.clear();
+        }
+        residentPages.clear();
+        pinnedPageCount = 0;
+        quarantinedPages.clear();
+        loadingPages.clear();
+        pendingImages.clear();
+        loadedPages.clear();
+        decodedImages.clear();
+        decodedBytes = 0;
+    }
+
+    void VirtualTexture::track(size_t guid, std::shared_ptr<TextureStreamer::StreamedImage> image) {
+        if (!enabled || guid == invalidGuid || !image) {
+            return;
+        }
+        std::lock_guard<std::mutex> lock(mutex);
+        pendingImages.emplace_back(guid, std::move(image));
+    }
+
+    uint32_t VirtualTexture::getTextureIndex(size_t guid) const {
+        auto it = imageIndices.find(guid);
+        return it != imageIndices.end() ? it->second : invalidIndex;
+    }
+
+    VkDescriptorSet VirtualTexture::getDescriptorSet() const {
+        return descriptorSets[device->getFrameIndex()];
+    }
+
+    void VirtualTexture::update() {
+        if (!enabled) {
+            return;
+        }
+        ++frameIndex;
+        // 当前帧的反馈和页表buffer在这一帧的fence之后才能访问
+        device->waitForFences();
+        reservePages();
+        registerPendingImages();
+        readFeedback();
+        applyLoadedPages();
+        flushPageTable();
+    }
+
+    void VirtualTexture::registerPendingImages() {
+        std::vector<std::pair<size_t, std::shared_ptr<TextureStreamer::StreamedImage>>> pending;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            pending.swap(pendingImages);
+        }
+        std::vector<LoadedPage> pinnedPages;
+        for (auto &it: pending) {
+            const TextureStreamer::StreamedImage &source = *it.second;
+            if (imageIndices.count(it.first)) {
+                continue;
+            }
+            // 常驻页最多占atlas的一半，其余留给按需加载的页
+            if (images.size() >= maxTextures || freeSlots.empty() || source.tailLevels.empty() ||
+                (pinnedPageCount + 1) * 2 > physicalPages.size()) {
+                textureStreamer->track(it.first, it.second);
+                continue;
+            }
+            // 最粗的一级只有一页，常驻CPU的尾部mip可以直接生成
+            uint32_t pinnedLevel = source.tailFirstLevel;
+            while (pinnedLevel + 1 < source.mipLevels &&
+                   (levelPages(source.width, pinnedLevel) > 1 || levelPages(source.height, pinnedLevel) > 1)) {
+                ++pinnedLevel;
+            }
+            if (pinnedLevel >= maxLevels || pinnedLevel - source.tailFirstLevel >= source.tailLevels.size()) {
+                textureStreamer->track(it.first, it.second);
+                continue;
+            }
+            VirtualImage image;
+            image.guid = it.first;
+            image.image = it.second;
+            image.levelCount = pinnedLevel + 1;
+            image.tableOffset = static_cast<uint32_t>(pageTable.size());
+            uint32_t entries = 0;
+            for (uint32_t level = 0; level < image.levelCount; ++level) {
+                image.levelOffsets[level] = entries;
+                image.pagesX[level] = levelPages(source.width, level);
+                image.pagesY[level] = levelPages(source.height, level);
+                entries += image.pagesX[level] * image.pagesY[level];
+            }
+            if (static_cast<size_t>(image.tableOffset) + entries > maxTableEntries) {
+                textureStreamer->track(it.first, it.second);
+                continue;
+            }
+
+            const uint32_t imageIndex = static_cast<uint32_t>(images.size());
+            const uint64_t key = makeKey(imageIndex, pinnedLevel, 0, 0);
+            const uint32_t slot = freeSlots.back();
+            freeSlots.pop_back();
+            physicalPages[slot].key = key;
+            physicalPages[slot].pinned = true;
+            ++pinnedPageCount;
+            residentPages[key] = slot;
+            const uint32_t entry = makeEntry(slot, physicalPagesPerSide, pinnedLevel);
+            pageTable.resize(pageTable.size() + entries, entry);
+            for (uint32_t i = 0; i < entries; ++i) {
+                for (auto &dirty: dirtyEntries) {
+                    dirty.push_back(image.tableOffset + i);
+                }
+            }
+
+            GpuImageInfo info{};
+            info.width = source.width;
+            info.height = source.height;
+            info.levelCount = image.levelCount;
+            info.tableOffset = image.tableOffset;
+            std::copy(image.levelOffsets.begin(), image.levelOffsets.end(), info.levelOffsets);
+            memcpy(static_cast<GpuImageInfo *>(infoBuffer.mapped) + imageIndex, &info, sizeof(info));
+
+            LoadedPage page;
+            page.key = key;
+            page.success = true;
+            const uint32_t tailIndex = pinnedLevel - source.tailFirstLevel;
+            extractPage(source.tailLevels[tailIndex].data(), std::max(1u, source.width >> pinnedLevel),
+                        std::max(1u, source.height >> pinnedLevel), 0, 0, page.pixels);
+            pinnedPages.push_back(std::move(page));
+            imageIndices[image.guid] = imageIndex;
+            images.push_back(std::move(image));
+        }
+        if (pinnedPages.empty()) {
+            return;
+        }
+        // 材质在update之后才获取序号，返回前常驻页已经上传完
+        for (size_t first = 0; first < pinnedPages.size(); first += maxPageUploadsPerFrame) {
+            const size_t count = std::min<size_t>(maxPageUploadsPerFrame, pinnedPages.size() - first);
+            std::vector<std::pair<uint32_t, const unsigned char *>> uploads;
+            for (size_t i = first; i < first + count; ++i) {
+                uploads.emplace_back(residentPages[pinnedPages[i].key], pinnedPages[i].pixels.data());
+            }
+            uploadPages(uploads);
+        }
+        ++version;
+    }
+
+    void VirtualTexture::readFeedback() {
+        const uint32_t frame = static_cast<uint32_t>(device->getFrameIndex());
+        auto *header = static_cast<uint32_t *>(feedbackBuffers[frame].mapped);
+        auto *feedback = reinterpret_cast<uint32_t *>(static_cast<unsigned char *>(feedbackBuffers[frame].mapped) +
+                                                      feedbackHeaderBytes);
+        const uint32_t count = std::min(header[0] * header[1], feedbackCapacity[frame]);
+        std::vector<uint64_t> requests;
+        std::unordered_set<uint64_t> visited;
+        for (uint32_t i = 0; i < count; ++i) {
+            const uint32_t request = feedback[2 * i];
+            const uint32_t page = feedback[2 * i + 1];
+            if (request == emptyFeedback) {
+                continue;
+            }
+            feedback[2 * i] = emptyFeedback;
+            const uint32_t imageIndex = request >> 4;
+            uint32_t level = request & 0xf;
+            if (imageIndex >= images.size() || level >= images[imageIndex].levelCount) {
+                continue;
+            }
+            const VirtualImage &image = images[imageIndex];
+            uint32_t x = page & 0xffff, y = page >> 16;
+            if (x >= image.pagesX[level] || y >= image.pagesY[level]) {
+                continue;
+            }
+            // 同时保留所有祖先页，缺页时回退到它们
+            for (; level + 1 < image.levelCount; ++level, x >>= 1, y >>= 1) {
+                const uint64_t key = makeKey(imageIndex, level, x, y);
+                if (!visited.insert(key).second) {
+                    break;
+                }
+                auto resident = residentPages.find(key);
+                if (resident != residentPages.end()) {
+                    physicalPages[resident->second].lastUsedFrame = frameIndex;
+                } else if (!image.failed && !loadingPages.count(key)) {
+                    requests.push_back(key);
+                }
+            }
+        }
+
+        // 粗的页先加载，缺页时画面先从模糊变清晰
+        std::sort(requests.begin(), requests.end(), [](uint64_t a, uint64_t b) {
+            return keyLevel(a) > keyLevel(b);
+        });
+        for (uint64_t key: requests) {
+            if (loadingPages.size() >= maxInFlightPages) {
+                break;
+            }
+            requestPage(key);
+        }
+
+        // 反馈分辨率跟随窗口，扩容时这一帧的buffer已经不在使用中
+        const uint32_t width = (device->width() + feedbackScale - 1) / feedbackScale;
+        const uint32_t height = (device->height() + feedbackScale - 1) / feedbackScale;
+        if (width * height > feedbackCapacity[frame]) {
+            createFeedbackBuffer(frame, width * height);
+            header = static_cast<uint32_t *>(feedbackBuffers[frame].mapped);
+        }
+        // 每帧换一个像素写反馈，feedbackScale^2帧覆盖整个块
+        const uint32_t jitter = static_cast<uint32_t>((frameIndex * 37) % (feedbackScale * feedbackScale));
+        header[0] = width;
+        header[1] = height;
+        header[2] = jitter % feedbackScale;
+        header[3] = jitter / feedbackScale;
+    }
+
+    void VirtualTexture::requestPage(uint64_t key) {
+        loadingPages.insert(key);
+        std::shared_ptr<TextureStreamer::StreamedImage> image = images[keyImage(key)].image;
+        worker->submit([this, key, image]() { loadPage(key, image); });
+    }
+
+    void VirtualTexture::loadPage(uint64_t key, std::shared_ptr<TextureStreamer::StreamedImage> image) {
+        LoadedPage page;
+        page.key = key;
+        if (!cancelled) {
+            std::shared_ptr<const DecodedImage> decoded = decodeImage(keyImage(key), *image);
+            const uint32_t level = keyLevel(key);
+            if (decoded && level < decoded->size()) {
+                extractPage((*decoded)[level].data(), std::max(1u, image->width >> level),
+                            std::max(1u, image->height >> level), keyX(key), keyY(key), page.pixels);
+                page.success = true;
+            }
+        }
+        std::lock_guard<std::mutex> lock(mutex);
+        loadedPages.push_back(std::move(page));
+    }
+
+    std::shared_ptr<const VirtualTexture::DecodedImage>
+    VirtualTexture::decodeImage(uint32_t imageIndex, const TextureStreamer::StreamedImage &image) {
+        for (auto it = decodedImages.begin(); it != decodedImages.end(); ++it) {
+            if (it->first == imageIndex) {
+                decodedImages.splice(decodedImages.begin(), decodedImages, it);
+                return it->second;
+            }
+        }
+        VirtualFile file;
+        const unsigned char *data = image.data.data();
+        size_t size = image.data.size();
+        if (!image.filename.empty() && VirtualFileSystem::global().open(image.filename, file)) {
+            data = file.data();
+            size = file.size();
+        }
+        int width = 0, height = 0, component = 0;
+        unsigned char *pixels = size > 0 ? stbi_load_from_memory(data, static_cast<int>(size), &width, &height,
+                                                                 &component, 4) : nullptr;
+        std::shared_ptr<DecodedImage> decoded;
+        if (pixels && static_cast<uint32_t>(width) == image.width && static_cast<uint32_t>(height) == image.height) {
+            decoded = std::make_shared<DecodedImage>(generateMipChain(pixels, image.width, image.height, 4, 0));
+        } else {
+            std::cerr << "Could not load virtual texture pages of \"" << image.filename << "\"" << std::endl;
+        }
+        stbi_image_free(pixels);
+        if (!decoded) {
+            return nullptr;
+        }
+
+        size_t bytes = 0;
+        for (const auto &level: *decoded) {
+            bytes += level.size();
+        }
+        while (!decodedImages.empty() && decodedBytes + bytes > decodedCacheBudget) {
+            for (const auto &level: *decodedImages.back().second) {
+                decodedBytes -= level.size();
+            }
+            decodedImages.pop_back();
+        }
+        decodedBytes += bytes;
+        decodedImages.emplace_front(imageIndex, decoded);
+        return decoded;
+    }
+
+    void VirtualTexture::extractPage(const unsigned char *levelPixels, uint32_t levelWidth, uint32_t levelHeight,
+                                     uint32_t x, uint32_t y, std::vector<unsigned char> &pixels) {
+        pixels.resize(pageBytes);
+        const int64_t originX = static_cast<int64_t>(x) * pagePayload - pageBorder;
+        const int64_t originY = static_cast<int64_t>(y) * pagePayload - pageBorder;
+        for (uint32_t row = 0; row < pageSize; ++row) {
+            const uint32_t sourceY = mirrorTexel(originY + row, levelHeight);
+            const unsigned char *sourceRow = levelPixels + static_cast<size_t>(sourceY) * levelWidth * 4;
+            unsigned char *destination = pixels.data() + static_cast<size_t>(row) * pageSize * 4;
+            for (uint32_t column = 0; column < pageSize; ++column) {
+                const uint32_t sourceX = mirrorTexel(originX + column, levelWidth);
+                memcpy(destination + column * 4, sourceRow + sourceX * 4, 4);
+            }
+        }
+    }
+
+    void VirtualTexture::applyLoadedPages() {
+        std::vector<LoadedPage> pages;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            // 超出本帧上传数量的页留到下一帧
+            const size_t count = std::min<size_t>(loadedPages.size(), maxPageUploadsPerFrame);
+            pages.assign(std::make_move_iterator(loadedPages.begin()),
+                         std::make_move_iterator(loadedPages.begin() + count));
+            loadedPages.erase(loadedPages.begin(), loadedPages.begin() + count);
+        }
+        std::vector<std::pair<uint32_t, const unsigned char *>> uploads;
+        std::vector<uint64_t> mappedKeys;
+        for (LoadedPage &page: pages) {
+            loadingPages.erase(page.key);
+            if (!page.success) {
+                images[keyImage(page.key)].failed = true;
+                continue;
+            }
+            // 没有空闲的物理页时丢弃，仍然需要时会再次出现在反馈中
+            if (freeSlots.empty() || residentPages.count(page.key)) {
+                continue;
+            }
+            const uint32_t slot = freeSlots.back();
+            freeSlots.pop_back();
+            physicalPages[slot].key = page.key;
+            physicalPages[slot].lastUsedFrame = frameIndex;
+            physicalPages[slot].pinned = false;
+            uploads.emplace_back(slot, page.pixels.data());
+            mappedKeys.push_back(page.key);
+        }
+        if (uploads.empty()) {
+            return;
+        }
+        uploadPages(uploads);
+        for (size_t i = 0; i < mappedKeys.size(); ++i) {
+            mapPage(mappedKeys[i], uploads[i].first);
+        }
+    }
+
+    void VirtualTexture::uploadPages(const std::vector<std::pair<uint32_t, const unsigned char *>> &uploads) {
+        std::vector<VkBufferImageCopy> regions;
+        for (size_t i = 0; i < uploads.size(); ++i) {
+            memcpy(static_cast<unsigned char *>(stagingBuffer.mapped) + i * pageBytes, uploads[i].second, pageBytes);
+            const uint32_t slot = uploads[i].first;
+            VkBufferImageCopy region{};
+            region.bufferOffset = static_cast<VkDeviceSize>(i) * pageBytes;
+            region.imageSubresource = {VK_IMAGE_ASPECT_COLOR_BIT, 0, 0, 1};
+            region.imageOffset = {static_cast<int32_t>(slot % physicalPagesPerSide * pageSize),
+                                  static_cast<int32_t>(slot / physicalPagesPerSide * pageSize), 0};
+            region.imageExtent = {pageSize, pageSize, 1};
+            regions.push_back(region);
+        }
+
+        VkCommandBuffer commandBuffer = device->beginSingleTimeCommands();
+        // 写入的都是空闲页，正在执行的帧不会采样它们
+        VkImageMemoryBarrier barrier{};
+        barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+        barrier.oldLayout = VK_IMAGE_LAYOUT_GENERAL;
+        barrier.newLayout = VK_IMAGE_LAYOUT_GENERAL;
+        barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        barrier.image = atlasImage;
+        barrier.subresourceRange = {VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1};
+        barrier.srcAccessMask = VK_ACCESS_SHADER_READ_BIT;
+        barrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+        vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0,
+                             0, nullptr, 0, nullptr, 1, &barrier);
+        vkCmdCopyBufferToImage(commandBuffer, stagingBuffer.buffer, atlasImage, VK_IMAGE_LAYOUT_GENERAL,
+                               static_cast<uint32_t>(regions.size()), regions.data());
+        barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+        barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+        vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 0,
+                             0, nullptr, 0, nullptr, 1, &barrier);
+        device->endSingleTimeCommands(commandBuffer);
+    }
+
+    void VirtualTexture::reservePages() {
+        while (!quarantinedPages.empty() &&
+               quarantinedPages.front().frame + VulkanDevice::MAX_FRAMES_IN_FLIGHT + 1 <= frameIndex) {
+            freeSlots.push_back(quarantinedPages.front().slot);
+            quarantinedPages.pop_front();
+        }
+        // 预留下一批上传需要的物理页，最近几帧用过的页不换出
+        const size_t target = maxPageUploadsPerFrame;
+        if (freeSlots.size() + quarantinedPages.size() >= target) {
+            return;
+        }
+        std::vector<std::pair<uint64_t, uint64_t>> candidates;
+        for (const auto &it: residentPages) {
+            const PhysicalPage &page = physicalPages[it.second];
+            if (!page.pinned && page.lastUsedFrame + VulkanDevice::MAX_FRAMES_IN_FLIGHT + 1 < frameIndex) {
+                candidates.emplace_back(page.lastUsedFrame, it.first);
+            }
+        }
+        const size_t count = std::min(candidates.size(), target - freeSlots.size() - quarantinedPages.size());
+        std::partial_sort(candidates.begin(), candidates.begin() + count, candidates.end());
+        for (size_t i = 0; i < count; ++i) {
+            const uint64_t key = candidates[i].second;
+            const uint32_t slot = residentPages[key];
+            unmapPage(key);
+            quarantinedPages.push_back({frameIndex, slot});
+        }
+    }
+
+    void VirtualTexture::mapPage(uint64_t key, uint32_t slot) {
+        const VirtualImage &image = images[keyImage(key)];
+        const uint32_t level = keyLevel(key);
+        residentPages[key] = slot;
+        const uint32_t entry = makeEntry(slot, physicalPagesPerSide, level);
+        // 子树中所有回退到更粗页的条目改为指向这一页
+        for (uint32_t l = 0; l <= level; ++l) {
+            const uint32_t shift = level - l;
+            const uint32_t x0 = keyX(key) << shift, y0 = keyY(key) << shift;
+            const uint32_t x1 = std::min(x0 + (1u << shift), image.pagesX[l]);
+            const uint32_t y1 = std::min(y0 + (1u << shift), image.pagesY[l]);
+            for (uint32_t y = y0; y < y1; ++y) {
+                for (uint32_t x = x0; x < x1; ++x) {
+                    const uint32_t index = image.tableOffset + image.levelOffsets[l] + y * image.pagesX[l] + x;
+                    if (entryLevel(pageTable[index]) > level) {
+                        setEntry(index, entry);
+                    }
+                }
+            }
+        }
+    }
+
+    void VirtualTexture::unmapPage(uint64_t key) {
+        const VirtualImage &image = images[keyImage(key)];
+        const uint32_t level = keyLevel(key);
+        residentPages.erase(key);
+        // 指向这一页的条目改为父页当前的映射，最粗一级常驻所以父页总是存在
+        const uint32_t parent = pageTable[image.tableOffset + image.levelOffsets[level + 1] +
+                                          (keyY(key) >> 1) * image.pagesX[level + 1] + (keyX(key) >> 1)];
+        for (uint32_t l = 0; l <= level; ++l) {
+            const uint32_t shift = level - l;
+            const uint32_t x0 = keyX(key) << shift, y0 = keyY(key) << shift;
+            const uint32_t x1 = std::min(x0 + (1u << shift), image.pagesX[l]);
+            const uint32_t y1 = std::min(y0 + (1u << shift), image.pagesY[l]);
+            for (uint32_t y = y0; y < y1; ++y) {
+                for (uint32_t x = x0; x < x1; ++x) {
+                    const uint32_t index = image.tableOffset + image.levelOffsets[l] + y * image.pagesX[l] + x;
+                    if (entryLevel(pageTable[index]) == level) {
+                        setEntry(index, parent);
+                    }
+                }
+            }
+        }
+    }
+
+    void VirtualTexture::setEntry(uint32_t index, uint32_t entry) {
+        pageTable[index] = entry;
+        for (auto &dirty: dirtyEntries) {
+            dirty.push_back(index);
+        }
+    }
+
+    void VirtualTexture::flushPageTable() {
+        // 只写入这一帧的buffer还没有的修改
+        const uint32_t frame = static_cast<uint32_t>(device->getFrameIndex());
+        std::vector<uint32_t> &dirty = dirtyEntries[frame];
+        auto *mapped = static_cast<uint32_t *>(pageTableBuffers[frame].mapped);
+        if (dirty.size() >= pageTable.size()) {
+            memcpy(mapped, pageTable.data(), pageTable.size() * sizeof(uint32_t));
+        } else {
+            for (uint32_t index: dirty) {
+                mapped[index] = pageTable[index];
+            }
+        }
+        dirty.clear();
+    }
+}
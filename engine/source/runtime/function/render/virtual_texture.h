@@ -0,0 +1,205 @@
+#pragma once
+
+#include "render_resource.h"
+#include "texture_streamer.h"
+#include "core/base/thread_pool.h"
+#include <array>
+#include <atomic>
+#include <deque>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+namespace MW {
+    /*
+        Virtual texture for material base colors.
+        Source images are split into pages of pagePayload texels plus a border, resident pages live in a physical
+        atlas of fixed size, so the memory used does not grow with the scene. The G-buffer pass writes the pages it
+        samples into a low resolution feedback buffer, which is read back once the frame has finished to schedule
+        page loads on a worker thread. Every level of every texture has a page table in a storage buffer, entries of
+        missing pages point to the finest resident ancestor, and the single page of the coarsest level stays resident
+    */
+    class VirtualTexture {
+    public:
+        static constexpr uint32_t invalidIndex = ~0u;
+        // 和shader/include/virtual_texture.glsl一致
+        static constexpr uint32_t pageSize = 128;
+        static constexpr uint32_t pageBorder = 4;
+        static constexpr uint32_t pagePayload = pageSize - 2 * pageBorder;
+        static constexpr uint32_t maxLevels = 16;
+        static constexpr uint32_t feedbackScale = 8;
+
+        // enabled为false时只创建最小的资源，所有材质使用普通贴图
+        // 页表或atlas放不下的贴图交还给textureStreamer做整张贴图的mip流送
+        void initialize(std::shared_ptr<VulkanDevice> device, TextureStreamer *textureStreamer, bool enabled);
+
+        void clean();
+
+        bool isEnabled() const { return enabled; }
+
+        // 登记已加入RenderResource的贴图，在下一次update中分配页表和常驻页，可以在后台线程调用
+        void track(size_t guid, std::shared_ptr<TextureStreamer::StreamedImage> image);
+
+        // 贴图在虚拟贴图中的序号，还没有登记完成时返回invalidIndex，只在主线程调用
+        uint32_t getTextureIndex(size_t guid) const;
+
+        // 每登记完成一批贴图加一，材质需要重新获取序号
+        uint64_t getVersion() const { return version; }
+
+        // 每帧在录制命令前调用一次：读回反馈、上传完成的页、更新页表、调度新的页
+        void update();
+
+        VkDescriptorSetLayout getDescriptorSetLayout() const { return descriptorSetLayout; }
+
+        // 当前帧使用的页表和反馈buffer
+        VkDescriptorSet getDescriptorSet() const;
+
+        uint32_t getResidentPageCount() const { return static_cast<uint32_t>(residentPages.size()); }
+
+        // 物理页每边的数量，默认4096x4096的RGBA8，64MiB
+        uint32_t physicalPagesPerSide{32};
+        uint32_t maxTextures{4096};
+        uint32_t maxTableEntries{1u << 20};
+        // 每帧最多上传的页数
+        uint32_t maxPageUploadsPerFrame{16};
+        uint32_t maxInFlightPages{64};
+        // 解码后的源图片在CPU上缓存的上限
+        size_t decodedCacheBudget{256ull * 1024 * 1024};
+
+    private:
+        struct VirtualImage {
+            size_t guid{invalidGuid};
+            std::shared_ptr<TextureStreamer::StreamedImage> image;
+            uint32_t levelCount{0};
+            uint32_t tableOffset{0};
+            std::array<uint32_t, maxLevels> levelOffsets{};
+            std::array<uint32_t, maxLevels> pagesX{};
+            std::array<uint32_t, maxLevels> pagesY{};
+            bool failed{false};
+        };
+
+        // 和shader中的VirtualTextureInfo布局一致
+        struct GpuImageInfo {
+            uint32_t width;
+            uint32_t height;
+            uint32_t levelCount;
+            uint32_t tableOffset;
+            uint32_t levelOffsets[maxLevels];
+        };
+
+        struct PhysicalPage {
+            uint64_t key{0};
+            uint64_t lastUsedFrame{0};
+            bool pinned{false};
+        };
+
+        struct LoadedPage {
+            uint64_t key{0};
+            bool success{false};
+            std::vector<unsigned char> pixels;
+        };
+
+        struct QuarantinedPage {
+            uint64_t frame{0};
+            uint32_t slot{0};
+        };
+
+        using DecodedImage = std::vector<std::vector<unsigned char>>;
+
+        static uint64_t makeKey(uint32_t image, uint32_t level, uint32_t x, uint32_t y) {
+            return static_cast<uint64_t>(image) << 40 | static_cast<uint64_t>(level) << 32 |
+                   static_cast<uint64_t>(y) << 16 | x;
+        }
+
+        static uint32_t keyImage(uint64_t key) { return static_cast<uint32_t>(key >> 40); }
+
+        static uint32_t keyLevel(uint64_t key) { return static_cast<uint32_t>(key >> 32) & 0xff; }
+
+        static uint32_t keyX(uint64_t key) { return static_cast<uint32_t>(key) & 0xffff; }
+
+        static uint32_t keyY(uint64_t key) { return static_cast<uint32_t>(key >> 16) & 0xffff; }
+
+        static uint32_t makeEntry(uint32_t slot, uint32_t physicalPagesPerSide, uint32_t level) {
+            return (slot % physicalPagesPerSide) | (slot / physicalPagesPerSide) << 8 | level << 16;
+        }
+
+        static uint32_t entryLevel(uint32_t entry) { return (entry >> 16) & 0xff; }
+
+        // 取出一页和四周的边框，超出图片的部分按镜像重复
+        static void extractPage(const unsigned char *levelPixels, uint32_t levelWidth, uint32_t levelHeight,
+                                uint32_t x, uint32_t y, std::vector<unsigned char> &pixels);
+
+        void createResources();
+
+        void createFeedbackBuffer(uint32_t frame, uint32_t entries);
+
+        void registerPendingImages();
+
+        void readFeedback();
+
+        void requestPage(uint64_t key);
+
+        void applyLoadedPages();
+
+        // (物理页, 像素)，完成后才返回
+        void uploadPages(const std::vector<std::pair<uint32_t, const unsigned char *>> &uploads);
+
+        void reservePages();
+
+        void mapPage(uint64_t key, uint32_t slot);
+
+        void unmapPage(uint64_t key);
+
+        void setEntry(uint32_t index, uint32_t entry);
+
+        void flushPageTable();
+
+        void loadPage(uint64_t key, std::shared_ptr<TextureStreamer::StreamedImage> image);
+
+        std::shared_ptr<const DecodedImage> decodeImage(uint32_t imageIndex,
+                                                        const TextureStreamer::StreamedImage &image);
+
+        std::shared_ptr<VulkanDevice> device;
+        TextureStreamer *textureStreamer{nullptr};
+        bool enabled{false};
+
+        VkImage atlasImage{VK_NULL_HANDLE};
+        VkDeviceMemory atlasMemory{VK_NULL_HANDLE};
+        VkImageView atlasView{VK_NULL_HANDLE};
+        VkSampler atlasSampler{VK_NULL_HANDLE};
+        VulkanBuffer stagingBuffer{};
+        VulkanBuffer infoBuffer{};
+        std::array<VulkanBuffer, VulkanDevice::MAX_FRAMES_IN_FLIGHT> pageTableBuffers{};
+        std::array<VulkanBuffer, VulkanDevice::MAX_FRAMES_IN_FLIGHT> feedbackBuffers{};
+        std::array<uint32_t, VulkanDevice::MAX_FRAMES_IN_FLIGHT> feedbackCapacity{};
+        VkDescriptorSetLayout descriptorSetLayout{VK_NULL_HANDLE};
+        std::array<VkDescriptorSet, VulkanDevice::MAX_FRAMES_IN_FLIGHT> descriptorSets{};
+
+        std::vector<VirtualImage> images;
+        std::unordered_map<size_t, uint32_t> imageIndices;
+        // 页表在CPU上的副本，每个帧的buffer记录自己还没写入的条目
+        std::vector<uint32_t> pageTable;
+        std::array<std::vector<uint32_t>, VulkanDevice::MAX_FRAMES_IN_FLIGHT> dirtyEntries;
+        std::vector<PhysicalPage> physicalPages;
+        std::unordered_map<uint64_t, uint32_t> residentPages;
+        std::vector<uint32_t> freeSlots;
+        uint32_t pinnedPageCount{0};
+        // 被换出的页在引用过它的帧执行完之前不能覆盖
+        std::deque<QuarantinedPage> quarantinedPages;
+        std::unordered_set<uint64_t> loadingPages;
+        uint64_t frameIndex{0};
+        uint64_t version{0};
+
+        std::unique_ptr<ThreadPool> worker;
+        std::atomic<bool> cancelled{false};
+        std::mutex mutex;
+        std::vector<std::pair<size_t, std::shared_ptr<TextureStreamer::StreamedImage>>> pendingImages;
+        std::vector<LoadedPage> loadedPages;
+        // 只在worker线程访问
+        std::list<std::pair<uint32_t, std::shared_ptr<const DecodedImage>>> decodedImages;
+        size_t decodedBytes{0};
+    };
+}